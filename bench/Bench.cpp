@@ -0,0 +1,415 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace Ime {
+namespace Bench {
+
+std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+static void appendJsonString(std::string& out, const std::string& str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+std::string toJson(const std::vector<Result>& results) {
+    std::string out = "{\n  \"benchmarks\": [";
+    char number[64];
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        out += i ? ",\n    {\"name\": " : "\n    {\"name\": ";
+        appendJsonString(out, result.name);
+        snprintf(number, sizeof(number), ", \"iterations\": %zu", result.iterations);
+        out += number;
+        snprintf(number, sizeof(number), ", \"ns_per_op\": %.3f", result.nsPerOp);
+        out += number;
+        snprintf(number, sizeof(number), ", \"min_ns_per_op\": %.3f}", result.minNsPerOp);
+        out += number;
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+namespace {
+
+// Just enough JSON for the documents of toJson(), and a bit more leniency
+// for files edited by hand.
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& json) : json_(json) {}
+
+    bool readResults(std::vector<Result>& results) {
+        if (!consume('{'))
+            return false;
+        while (!consume('}')) {
+            std::string key;
+            if (!readString(key) || !consume(':'))
+                return false;
+            if (key == "benchmarks") {
+                if (!readArray(results))
+                    return false;
+            }
+            else if (!skipValue()) {
+                return false;
+            }
+            consume(',');
+        }
+        return true;
+    }
+
+private:
+    bool readArray(std::vector<Result>& results) {
+        if (!consume('['))
+            return false;
+        while (!consume(']')) {
+            Result result;
+            if (!readResult(result))
+                return false;
+            results.push_back(std::move(result));
+            consume(',');
+        }
+        return true;
+    }
+
+    bool readResult(Result& result) {
+        if (!consume('{'))
+            return false;
+        while (!consume('}')) {
+            std::string key;
+            if (!readString(key) || !consume(':'))
+                return false;
+            double number = 0;
+            if (key == "name") {
+                if (!readString(result.name))
+                    return false;
+            }
+            else if (key == "iterations" || key == "ns_per_op" || key == "min_ns_per_op") {
+                if (!readNumber(number))
+                    return false;
+                if (key == "iterations")
+                    result.iterations = size_t(number);
+                else if (key == "ns_per_op")
+                    result.nsPerOp = number;
+                else
+                    result.minNsPerOp = number;
+            }
+            else if (!skipValue()) {
+                return false;
+            }
+            consume(',');
+        }
+        return true;
+    }
+
+    bool readString(std::string& str) {
+        if (!consume('"'))
+            return false;
+        str.clear();
+        while (pos_ < json_.size() && json_[pos_] != '"') {
+            if (json_[pos_] == '\\' && pos_ + 1 < json_.size())
+                ++pos_;
+            str += json_[pos_++];
+        }
+        return consume('"');
+    }
+
+    bool readNumber(double& number) {
+        skipSpace();
+        const char* begin = json_.c_str() + pos_;
+        char* end = nullptr;
+        number = strtod(begin, &end);
+        if (end == begin)
+            return false;
+        pos_ += end - begin;
+        return true;
+    }
+
+    bool skipValue() {
+        skipSpace();
+        if (pos_ >= json_.size())
+            return false;
+        std::string str;
+        double number;
+        switch (json_[pos_]) {
+        case '"':
+            return readString(str);
+        case '{':
+        case '[': {
+            // nested values are skipped by counting brackets outside strings
+            int depth = 0;
+            do {
+                char c = json_[pos_];
+                if (c == '"') {
+                    if (!readString(str))
+                        return false;
+                    continue;
+                }
+                if (c == '{' || c == '[')
+                    ++depth;
+                else if (c == '}' || c == ']')
+                    --depth;
+                ++pos_;
+            } while (depth > 0 && pos_ < json_.size());
+            return depth == 0;
+        }
+        case 't':
+        case 'f':
+        case 'n':
+            while (pos_ < json_.size() && isalpha((unsigned char)json_[pos_]))
+                ++pos_;
+            return true;
+        default:
+            return readNumber(number);
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos_ < json_.size() && json_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void skipSpace() {
+        while (pos_ < json_.size() && isspace((unsigned char)json_[pos_]))
+            ++pos_;
+    }
+
+    const std::string& json_;
+    size_t pos_ = 0;
+};
+
+struct Options {
+    std::string filter;
+    double minTime = 0.05;  // seconds per repetition
+    int repetitions = 5;
+    std::string jsonFile;
+    std::string baselineFile;
+    double threshold = 10;  // percent
+    bool list = false;
+};
+
+const char usage[] =
+    "usage: libIME2_bench [options]\n"
+    "  --filter=TEXT      run only the benchmarks whose name contains TEXT\n"
+    "  --min-time=SEC     minimum time of each repetition (default 0.05)\n"
+    "  --repetitions=N    measures per benchmark; the median is reported (default 5)\n"
+    "  --json=FILE        write the results as JSON to FILE, or - for stdout\n"
+    "  --baseline=FILE    compare with the JSON results of an earlier run\n"
+    "  --threshold=PCT    slowdown reported as a regression (default 10)\n"
+    "  --list             list the benchmarks and exit\n"
+    "With --baseline, the exit code is 1 if a benchmark regressed.\n";
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            size_t length = strlen(name);
+            return arg.compare(0, length, name) == 0 ? arg.c_str() + length : nullptr;
+        };
+        if (auto v = value("--filter="))
+            options.filter = v;
+        else if (auto v = value("--min-time="))
+            options.minTime = atof(v);
+        else if (auto v = value("--repetitions="))
+            options.repetitions = std::max(1, atoi(v));
+        else if (auto v = value("--json="))
+            options.jsonFile = v;
+        else if (auto v = value("--baseline="))
+            options.baselineFile = v;
+        else if (auto v = value("--threshold="))
+            options.threshold = atof(v);
+        else if (arg == "--list")
+            options.list = true;
+        else
+            return false;
+    }
+    return true;
+}
+
+// Runs benchmark with more and more iterations until one run lasts
+// minTime, then repeats that run. Returns false if it was skipped.
+bool run(const Benchmark& benchmark, const Options& options, Result& result, std::string& skipReason) {
+    const double targetNs = options.minTime * 1e9;
+    size_t iterations = 1;
+    for (;;) {
+        State state(iterations);
+        benchmark.function(state);
+        if (!state.skipReason().empty()) {
+            skipReason = state.skipReason();
+            return false;
+        }
+        double elapsed = state.elapsedNs();
+        if (elapsed >= targetNs || iterations >= 1000000000)
+            break;
+        double factor = elapsed > 0 ? targetNs * 1.2 / elapsed : 100;
+        iterations = size_t(iterations * std::min(100.0, std::max(2.0, factor)));
+    }
+
+    std::vector<double> nsPerOp;
+    for (int i = 0; i < options.repetitions; ++i) {
+        State state(iterations);
+        benchmark.function(state);
+        nsPerOp.push_back(state.elapsedNs() / double(iterations));
+    }
+    std::sort(nsPerOp.begin(), nsPerOp.end());
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.nsPerOp = nsPerOp[nsPerOp.size() / 2];
+    result.minNsPerOp = nsPerOp.front();
+    return true;
+}
+
+bool readFile(const std::string& file, std::string& content) {
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream)
+        return false;
+    std::ostringstream buffer;
+    buffer << stream.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+} // namespace
+
+std::vector<Result> parseJson(const std::string& json) {
+    std::vector<Result> results;
+    JsonReader reader(json);
+    if (!reader.readResults(results))
+        results.clear();
+    return results;
+}
+
+} // namespace Bench
+} // namespace Ime
+
+using namespace Ime::Bench;
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fputs(usage, stderr);
+        return 2;
+    }
+
+    auto benchmarks = registry();
+    // by name, keeping the variants of a benchmark ("name/threads:8", etc)
+    // in the order they were registered
+    std::stable_sort(benchmarks.begin(), benchmarks.end(), [](const Benchmark& a, const Benchmark& b) {
+        return a.name.substr(0, a.name.find('/')) < b.name.substr(0, b.name.find('/'));
+    });
+    benchmarks.erase(std::remove_if(benchmarks.begin(), benchmarks.end(),
+        [&](const Benchmark& benchmark) { return benchmark.name.find(options.filter) == std::string::npos; }),
+        benchmarks.end());
+
+    if (options.list) {
+        for (const auto& benchmark : benchmarks)
+            printf("%s\n", benchmark.name.c_str());
+        return 0;
+    }
+
+    std::map<std::string, Result> baseline;
+    if (!options.baselineFile.empty()) {
+        std::string json;
+        if (!readFile(options.baselineFile, json)) {
+            fprintf(stderr, "cannot read %s\n", options.baselineFile.c_str());
+            return 2;
+        }
+        for (auto& result : parseJson(json))
+            baseline[result.name] = result;
+        if (baseline.empty()) {
+            fprintf(stderr, "no results in %s\n", options.baselineFile.c_str());
+            return 2;
+        }
+    }
+
+    // the table goes to stderr if stdout gets the JSON
+    FILE* out = options.jsonFile == "-" ? stderr : stdout;
+    fprintf(out, "%-44s %14s %12s", "benchmark", "iterations", "ns/op");
+    if (!baseline.empty())
+        fprintf(out, " %12s %9s", "baseline", "change");
+    fputc('\n', out);
+
+    std::vector<Result> results;
+    int regressions = 0;
+    for (const auto& benchmark : benchmarks) {
+        Result result;
+        std::string skipReason;
+        if (!run(benchmark, options, result, skipReason)) {
+            fprintf(out, "%-44s skipped: %s\n", benchmark.name.c_str(), skipReason.c_str());
+            continue;
+        }
+        fprintf(out, "%-44s %14zu %12.2f", result.name.c_str(), result.iterations, result.nsPerOp);
+        if (!baseline.empty()) {
+            auto it = baseline.find(result.name);
+            if (it != baseline.end() && it->second.nsPerOp > 0) {
+                double change = (result.nsPerOp / it->second.nsPerOp - 1) * 100;
+                bool regressed = change > options.threshold;
+                regressions += regressed;
+                fprintf(out, " %12.2f %+8.1f%%%s", it->second.nsPerOp, change, regressed ? "  REGRESSED" : "");
+            }
+            else {
+                fprintf(out, " %12s", "new");
+            }
+        }
+        fputc('\n', out);
+        fflush(out);
+        results.push_back(std::move(result));
+    }
+
+    if (!options.jsonFile.empty()) {
+        auto json = toJson(results);
+        if (options.jsonFile == "-") {
+            fputs(json.c_str(), stdout);
+        }
+        else {
+            std::ofstream stream(options.jsonFile, std::ios::binary);
+            stream << json;
+            if (!stream) {
+                fprintf(stderr, "cannot write %s\n", options.jsonFile.c_str());
+                return 2;
+            }
+        }
+    }
+
+    if (regressions) {
+        fprintf(out, "%d benchmark(s) regressed by more than %.1f%%\n", regressions, options.threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_BENCH_H
+#define IME_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// A small benchmark harness for libIME2_bench, with no dependency besides
+// the standard library. A benchmark is a function running its loop while
+// state.running() returns true:
+//
+//     IME_BENCHMARK(KeyEvent_Construct) {
+//         ... setup ...
+//         while (state.running())
+//             Ime::Bench::doNotOptimize(KeyEvent(...));
+//     }
+//
+// The runner picks an iteration count filling the minimum time, then
+// repeats the measure and reports the median time per iteration.
+
+namespace Ime {
+namespace Bench {
+
+class State {
+public:
+    explicit State(size_t iterations) : iterations_(iterations), remaining_(iterations) {}
+
+    // true while more iterations are wanted; the clock runs between the
+    // first call and the last one
+    bool running() {
+        if (remaining_ == iterations_)
+            start_ = Clock::now();
+        if (remaining_ == 0) {
+            elapsed_ += Clock::now() - start_;
+            return false;
+        }
+        --remaining_;
+        return true;
+    }
+
+    // Excludes some setup inside the loop from the measure. Keep it for
+    // work much slower than the clock itself.
+    void pauseTiming() {
+        elapsed_ += Clock::now() - start_;
+    }
+    void resumeTiming() {
+        start_ = Clock::now();
+    }
+
+    // Marks the benchmark as not runnable here (a missing CPU feature, etc).
+    // The loop is not run and nothing is reported.
+    void skip(std::string reason) {
+        skipReason_ = std::move(reason);
+        remaining_ = 0;
+        iterations_ = 0;
+    }
+
+    size_t iterations() const {
+        return iterations_;
+    }
+
+    double elapsedNs() const {
+        return std::chrono::duration<double, std::nano>(elapsed_).count();
+    }
+
+    const std::string& skipReason() const {
+        return skipReason_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    size_t iterations_;
+    size_t remaining_;
+    Clock::time_point start_;
+    Clock::duration elapsed_{};
+    std::string skipReason_;
+};
+
+using Function = std::function<void(State&)>;
+
+struct Benchmark {
+    std::string name;
+    Function function;
+};
+
+// all the benchmarks registered with IME_BENCHMARK(), in no particular order
+std::vector<Benchmark>& registry();
+
+struct Registrar {
+    Registrar(std::string name, Function function) {
+        registry().push_back({ std::move(name), std::move(function) });
+    }
+};
+
+// Keeps the compiler from optimizing away the computation of value.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#ifdef _MSC_VER
+    static const void* volatile sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r"(&value) : "memory");
+#endif
+}
+
+// The result of one benchmark, as written to and read from JSON.
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double nsPerOp = 0;     // median of the repetitions
+    double minNsPerOp = 0;  // fastest repetition
+};
+
+// Writes the results as a JSON document: {"benchmarks": [{...}, ...]}.
+std::string toJson(const std::vector<Result>& results);
+
+// Reads the results written by toJson(). Unknown members are ignored.
+std::vector<Result> parseJson(const std::string& json);
+
+} // namespace Bench
+} // namespace Ime
+
+#define IME_BENCHMARK(name) \
+    static void name(Ime::Bench::State& state); \
+    static Ime::Bench::Registrar name##Registrar(#name, name); \
+    static void name(Ime::Bench::State& state)
+
+#endif
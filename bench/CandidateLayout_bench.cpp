@@ -0,0 +1,154 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <string>
+#include <vector>
+#include "CandidateLayout.h"
+#include "CandidateSource.h"
+#include "TextMeasureCache.h"
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+const size_t itemCount = 10000;
+
+CandidateLayoutParams benchParams() {
+    CandidateLayoutParams params;
+    params.contentMargin = { 4, 4, 4, 4 };
+    params.textMargin = { 2, 6, 2, 6 };
+    params.itemsPerRow = 3;
+    params.pageSize = 9;
+    return params;
+}
+
+std::vector<Size> itemSizes(int extraWidth) {
+    std::vector<Size> sizes(itemCount);
+    for (size_t i = 0; i < itemCount; ++i)
+        sizes[i] = { int(16 + (i % 5) * 16 + extraWidth), 20 };
+    return sizes;
+}
+
+std::vector<std::wstring> itemTexts() {
+    std::vector<std::wstring> texts(itemCount);
+    for (size_t i = 0; i < itemCount; ++i)
+        texts[i] = std::wstring(1 + i % 5, wchar_t(0x4e00 + i % 0x5000));
+    return texts;
+}
+
+// a fixed width per character, as a monospace font would give
+class BenchMeasurer : public TextMeasurer {
+public:
+    Size measure(std::wstring_view text) override {
+        return { int(text.size()) * 16, 20 };
+    }
+};
+
+} // namespace
+
+// Every page of a 10k-item list laid out again, as when all the sizes
+// change (another font, another DPI).
+IME_BENCHMARK(CandidateLayout_10kItemsAllPages) {
+    CandidateLayout layout;
+    layout.setParams(benchParams());
+    std::vector<Size> sizes[2] = { itemSizes(0), itemSizes(1) };
+    size_t round = 0;
+    while (state.running()) {
+        layout.setItemSizes(sizes[round++ & 1]);
+        for (size_t page = 0; page < layout.pageCount(); ++page)
+            doNotOptimize(layout.page(page).size);
+    }
+}
+
+// The visible page of a 10k-item list after new sizes, which is all the
+// window lays out.
+IME_BENCHMARK(CandidateLayout_10kItemsVisiblePage) {
+    CandidateLayout layout;
+    layout.setParams(benchParams());
+    std::vector<Size> sizes[2] = { itemSizes(0), itemSizes(1) };
+    size_t round = 0;
+    while (state.running()) {
+        layout.setItemSizes(sizes[round++ & 1]);
+        doNotOptimize(layout.page(0).size);
+    }
+}
+
+// one item changed, one page laid out again
+IME_BENCHMARK(CandidateLayout_UpdateOneItem) {
+    CandidateLayout layout;
+    layout.setParams(benchParams());
+    layout.setItemSizes(itemSizes(0));
+    size_t item = 0;
+    while (state.running()) {
+        layout.setItemSize(item, { int(20 + item % 7), 20 });
+        doNotOptimize(layout.page(layout.pageOf(item)).size);
+        item = (item + 97) % itemCount;
+    }
+}
+
+IME_BENCHMARK(CandidateList_Assign10k) {
+    auto texts = itemTexts();
+    std::vector<wchar_t> selKeys(itemCount, L'1');
+    CandidateList list;
+    while (state.running()) {
+        list.assign(texts, selKeys);
+        doNotOptimize(list.count());
+    }
+}
+
+IME_BENCHMARK(CandidateList_GetPage) {
+    auto texts = itemTexts();
+    CandidateList list;
+    list.assign(texts, {});
+    CandidateArena page;
+    size_t first = 0;
+    while (state.running()) {
+        list.getRange(first, 9, page);
+        doNotOptimize(page.size());
+        first = (first + 9) % itemCount;
+    }
+}
+
+IME_BENCHMARK(TextMeasureCache_Hit) {
+    auto texts = itemTexts();
+    BenchMeasurer measurer;
+    TextMeasureCache cache;
+    FontKey font{ 1, 96 };
+    for (size_t i = 0; i < 64; ++i)
+        cache.measure(font, texts[i], measurer);
+    size_t i = 0;
+    while (state.running()) {
+        doNotOptimize(cache.measure(font, texts[i], measurer));
+        i = (i + 1) & 63;
+    }
+}
+
+IME_BENCHMARK(TextMeasureCache_Miss) {
+    auto texts = itemTexts();
+    BenchMeasurer measurer;
+    TextMeasureCache cache(64);
+    FontKey font{ 1, 96 };
+    size_t i = 0;
+    while (state.running()) {
+        doNotOptimize(cache.measure(font, texts[i], measurer));
+        i = (i + 1) % itemCount;
+    }
+}
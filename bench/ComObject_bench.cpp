@@ -0,0 +1,116 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ComObject.h"
+
+// AddRef() and Release() of one object by 1 to 64 threads at once, as TSF
+// does with the class factory from every thread hosting the text service.
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+class AtomicObject : public MultiThreadedComObject<ComInterface<IUnknown>> {
+};
+
+// how ImeModule counted its references before: a plain counter behind a
+// process-wide mutex
+class MutexObject : public ComObject<ComInterface<IUnknown>> {
+public:
+    STDMETHODIMP_(ULONG) AddRef() override {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        return BasicComObject::AddRef();
+    }
+
+    STDMETHODIMP_(ULONG) Release() override {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        return BasicComObject::Release();
+    }
+
+private:
+    static std::mutex mutex_;
+};
+
+std::mutex MutexObject::mutex_;
+
+// One iteration is one AddRef() and Release() pair on each thread. The
+// calling thread is one of them, and the clock runs until all are done.
+template <typename Object>
+void contend(Bench::State& state, int threadCount) {
+    auto object = new Object();
+    std::atomic<int> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i) {
+        threads.emplace_back([&, iterations = state.iterations()] {
+            ++ready;
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (size_t n = 0; n < iterations; ++n) {
+                object->AddRef();
+                object->Release();
+            }
+        });
+    }
+    while (ready.load() != threadCount - 1)
+        std::this_thread::yield();
+
+    go.store(true, std::memory_order_release);
+    while (state.running()) {
+        object->AddRef();
+        object->Release();
+    }
+    // running() stopped the clock; count the time the others take to finish
+    state.resumeTiming();
+    for (auto& thread : threads)
+        thread.join();
+    state.pauseTiming();
+    doNotOptimize(object->Release());
+}
+
+// a plain counter, only usable from one thread: the floor of the others
+IME_BENCHMARK(ComObject_SingleThreadedRefCount) {
+    auto object = new ComObject<ComInterface<IUnknown>>();
+    while (state.running()) {
+        object->AddRef();
+        object->Release();
+    }
+    doNotOptimize(object->Release());
+}
+
+struct ContentionBenchmarks {
+    ContentionBenchmarks() {
+        for (int threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+            auto suffix = "/threads:" + std::to_string(threads);
+            Bench::Registrar("ComObject_AtomicRefCount" + suffix,
+                [threads](Bench::State& state) { contend<AtomicObject>(state, threads); });
+            Bench::Registrar("ComObject_MutexRefCount" + suffix,
+                [threads](Bench::State& state) { contend<MutexObject>(state, threads); });
+        }
+    }
+} contentionBenchmarks;
+
+} // namespace
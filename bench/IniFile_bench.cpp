@@ -0,0 +1,125 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <string>
+#include "IniFile.h"
+#include "ThemeBinary.h"
+#include "ThemeData.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <filesystem>
+#include <fstream>
+#endif
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+// a theme.conf as written by hand, comments included
+const char themeConf[] =
+    "; a dark theme\r\n"
+    "[InputPanel]\r\n"
+    "Font = Microsoft JhengHei 12\r\n"
+    "NormalColor = #D0D0D0\r\n"
+    "HighlightCandidateColor = #FFFFFF\r\n"
+    "\r\n"
+    "[InputPanel/Background]\r\n"
+    "Image = panel.png\r\n"
+    "Top = 6\r\nRight = 6\r\nBottom = 6\r\nLeft = 6\r\n"
+    "\r\n"
+    "[InputPanel/Highlight]\r\n"
+    "Image = highlight.png\r\n"
+    "Top = 3\r\nRight = 3\r\nBottom = 3\r\nLeft = 3\r\n"
+    "\r\n"
+    "[InputPanel/TextMargin]\r\n"
+    "Top = 2\r\nRight = 6\r\nBottom = 2\r\nLeft = 6\r\n"
+    "\r\n"
+    "[InputPanel/ContentMargin]\r\n"
+    "Top = 4\r\nRight = 4\r\nBottom = 4\r\nLeft = 4\r\n";
+
+// the keys CandidateWindow::Theme reads
+void readTheme(const IniFile& conf) {
+    doNotOptimize(conf.getString(L"InputPanel/Background", L"Image", L"image.png"));
+    doNotOptimize(conf.getMargins(L"InputPanel/Background"));
+    doNotOptimize(conf.getString(L"InputPanel/Highlight", L"Image", L""));
+    doNotOptimize(conf.getMargins(L"InputPanel/Highlight"));
+    doNotOptimize(conf.getMargins(L"InputPanel/TextMargin"));
+    doNotOptimize(conf.getMargins(L"InputPanel/ContentMargin"));
+    doNotOptimize(conf.getFont(L"InputPanel", L"Font"));
+    doNotOptimize(conf.getColor(L"InputPanel", L"NormalColor", 0));
+    doNotOptimize(conf.getColor(L"InputPanel", L"HighlightCandidateColor", 0));
+}
+
+} // namespace
+
+IME_BENCHMARK(IniFile_ParseTheme) {
+    while (state.running()) {
+        IniFile conf;
+        conf.parseBytes(themeConf);
+        doNotOptimize(conf.size());
+    }
+}
+
+IME_BENCHMARK(IniFile_ReadThemeKeys) {
+    IniFile conf;
+    conf.parseBytes(themeConf);
+    while (state.running())
+        readTheme(conf);
+}
+
+// the theme.bin path which replaces both of the above
+IME_BENCHMARK(ThemeBinary_Read) {
+    auto binary = writeThemeBinary(builtinThemeData());
+    while (state.running()) {
+        ThemeData theme;
+        doNotOptimize(readThemeBinary(binary.data(), binary.size(), theme));
+    }
+}
+
+#ifdef _WIN32
+
+// What IniFile replaced: one profile API call per key, each opening and
+// scanning the file again.
+IME_BENCHMARK(IniFile_ProfileApiReadThemeKeys) {
+    auto file = std::filesystem::temp_directory_path() / L"libIME2_bench_theme.conf";
+    std::ofstream(file, std::ios::binary) << themeConf;
+    const wchar_t* margins[] = { L"Top", L"Right", L"Bottom", L"Left" };
+    const wchar_t* sections[] = { L"InputPanel/Background", L"InputPanel/Highlight",
+        L"InputPanel/TextMargin", L"InputPanel/ContentMargin" };
+    wchar_t value[256];
+    while (state.running()) {
+        GetPrivateProfileStringW(L"InputPanel/Background", L"Image", L"image.png", value, 256, file.c_str());
+        GetPrivateProfileStringW(L"InputPanel/Highlight", L"Image", L"", value, 256, file.c_str());
+        for (auto section : sections) {
+            for (auto key : margins)
+                doNotOptimize(GetPrivateProfileIntW(section, key, 0, file.c_str()));
+        }
+        GetPrivateProfileStringW(L"InputPanel", L"Font", L"", value, 256, file.c_str());
+        GetPrivateProfileStringW(L"InputPanel", L"NormalColor", L"", value, 256, file.c_str());
+        GetPrivateProfileStringW(L"InputPanel", L"HighlightCandidateColor", L"", value, 256, file.c_str());
+        doNotOptimize(value);
+    }
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+}
+
+#endif // _WIN32
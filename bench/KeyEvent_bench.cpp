@@ -0,0 +1,115 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <cstring>
+#include "KeyEvent.h"
+#include "KeyTranslation.h"
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+const unsigned keyDown = 0x0100;  // WM_KEYDOWN
+const intptr_t keyALParam = 0x001E0001;  // scan code of A, repeat count 1
+
+// A US layout: letters only, with Shift and Caps Lock.
+class UsLayout : public KeyboardLayout {
+public:
+    uintptr_t id() override {
+        return 0x0409;
+    }
+
+    KeyText translate(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        KeyText text;
+        if (keyCode < 'A' || keyCode > 'Z')
+            return text;
+        bool upper = !!(modifiers & KeyModifierShift) != !!(modifiers & KeyModifierCapsLock);
+        text.units[0] = wchar_t(upper ? keyCode : keyCode - 'A' + 'a');
+        text.length = 1;
+        return text;
+    }
+};
+
+// Key states in memory and the layout above behind a KeyTranslationCache,
+// as systemKeyStateProvider() does with the Win32 API.
+class BenchKeyStateProvider : public KeyStateProvider {
+public:
+    bool keyboardState(uint8_t* states) override {
+        memcpy(states, keys, sizeof(keys));
+        return true;
+    }
+
+    KeyText translateKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        return cache.translate(layout, keyCode, scanCode, modifiers);
+    }
+
+    uint8_t keys[256] = {};
+    UsLayout layout;
+    KeyTranslationCache cache;
+};
+
+} // namespace
+
+// what a key the engine decides by its code alone costs
+IME_BENCHMARK(KeyEvent_Construct) {
+    BenchKeyStateProvider provider;
+    while (state.running()) {
+        KeyEvent event(keyDown, 'A', keyALParam, provider);
+        doNotOptimize(event.keyCode());
+    }
+}
+
+IME_BENCHMARK(KeyEvent_ConstructWithModifiersAndText) {
+    BenchKeyStateProvider provider;
+    provider.keys[0x10] = 0x80;  // VK_SHIFT
+    while (state.running()) {
+        KeyEvent event(keyDown, 'A', keyALParam, provider);
+        doNotOptimize(event.modifiers());
+        doNotOptimize(event.charCode());
+    }
+}
+
+IME_BENCHMARK(KeyEvent_Resolved) {
+    BenchKeyStateProvider provider;
+    KeyEvent event(keyDown, 'A', keyALParam, provider);
+    while (state.running())
+        doNotOptimize(event.resolved());
+}
+
+IME_BENCHMARK(KeyEvent_ModifierState) {
+    uint8_t keys[256] = {};
+    keys[0x10] = 0x80;
+    keys[0x14] = 0x01;  // VK_CAPITAL toggled
+    while (state.running()) {
+        doNotOptimize(keys);
+        doNotOptimize(modifierState(keys));
+    }
+}
+
+IME_BENCHMARK(KeyTranslationCache_Hit) {
+    UsLayout layout;
+    KeyTranslationCache cache;
+    unsigned keyCode = 'A';
+    while (state.running()) {
+        doNotOptimize(cache.translate(layout, keyCode, 0x1E, KeyModifierShift));
+        keyCode = keyCode == 'Z' ? 'A' : keyCode + 1;
+    }
+}
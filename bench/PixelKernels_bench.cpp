@@ -0,0 +1,66 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <cstdint>
+#include <vector>
+#include "PixelKernels.h"
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+// a 400x60 candidate window, about what a page of 9 candidates covers
+const size_t pixelCount = 400 * 60;
+
+void premultiply(Bench::State& state, PixelKernelIsa isa) {
+    if (!isPixelKernelIsaSupported(isa)) {
+        state.skip("not supported by this CPU or build");
+        return;
+    }
+    auto kernel = premultiplyCoverageKernel(isa);
+    // antialiased text: mostly white with a ramp of coverage
+    std::vector<uint8_t> source(pixelCount * 4);
+    for (size_t i = 0; i < source.size(); ++i)
+        source[i] = (i / 4) % 7 ? 255 : uint8_t(i * 37);
+    std::vector<uint8_t> pixels(source.size());
+    while (state.running()) {
+        // the kernel works in place, so every run starts from the same pixels
+        state.pauseTiming();
+        pixels = source;
+        state.resumeTiming();
+        kernel(pixels.data(), pixelCount, 0x20, 0x40, 0x80);
+        doNotOptimize(pixels.data());
+    }
+}
+
+} // namespace
+
+IME_BENCHMARK(PixelKernels_PremultiplyScalar) {
+    premultiply(state, PixelKernelIsa::Scalar);
+}
+
+IME_BENCHMARK(PixelKernels_PremultiplySse2) {
+    premultiply(state, PixelKernelIsa::Sse2);
+}
+
+IME_BENCHMARK(PixelKernels_PremultiplyAvx2) {
+    premultiply(state, PixelKernelIsa::Avx2);
+}
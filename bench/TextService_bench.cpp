@@ -0,0 +1,278 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "Bench.h"
+#include <functional>
+#include <string>
+#include "FakeTsf.h"
+#include "ImeModule.h"
+#include "TextService.h"
+#include "EditSession.h"
+
+// The per-keystroke path of a text service, driven through the in-memory
+// TSF of FakeTsf.h: what TSF costs here is a few virtual calls, so the
+// numbers are those of libIME and the engine callbacks.
+
+using namespace Ime;
+using Bench::doNotOptimize;
+
+namespace {
+
+// {5A0C3E71-2B8D-4F96-A4E2-7C19D0B6F358}
+const GUID benchClsid = { 0x5a0c3e71, 0x2b8d, 0x4f96, { 0xa4, 0xe2, 0x7c, 0x19, 0xd0, 0xb6, 0xf3, 0x58 } };
+
+const UINT vkF5 = 0x74;
+
+// Composes the letters typed and commits them with Enter, like the
+// simplest table-based input method.
+class BenchTextService : public TextService {
+public:
+    explicit BenchTextService(ImeModule* module) : TextService(module) {}
+
+    bool filterKeyDown(KeyEvent& keyEvent) override {
+        if (keyEvent.keyCode() >= 'A' && keyEvent.keyCode() <= 'Z')
+            return true;
+        return isComposing() && keyEvent.keyCode() == VK_RETURN;
+    }
+
+    bool onKeyDown(KeyEvent& keyEvent, EditSession* session) override {
+        if (keyEvent.keyCode() == VK_RETURN) {
+            endComposition(session->context());
+            buffer.clear();
+            return true;
+        }
+        if (!isComposing())
+            startComposition(session->context());
+        buffer += keyEvent.charCode();
+        setCompositionString(session, buffer.c_str(), (int)buffer.size());
+        return true;
+    }
+
+    void onCompositionTerminated(bool forced) override {
+        buffer.clear();
+    }
+
+    std::wstring buffer;
+};
+
+class BenchImeModule : public ImeModule {
+public:
+    BenchImeModule() : ImeModule(NULL, benchClsid) {}
+
+    TextService* createTextService() override {
+        return new BenchTextService(this);
+    }
+};
+
+// an activated text service with a focused, empty context
+struct Session {
+    Session() {
+        BYTE states[256] = {};
+        ::SetKeyboardState(states);
+        threadMgr->activate(service);
+        context = threadMgr->focusNewContext();
+    }
+
+    ~Session() {
+        threadMgr->deactivate();
+    }
+
+    ComPtr<BenchImeModule> module = ComPtr<BenchImeModule>::make();
+    ComPtr<BenchTextService> service = ComPtr<BenchTextService>::make(module);
+    ComPtr<FakeThreadMgr> threadMgr = ComPtr<FakeThreadMgr>::make();
+    ComPtr<FakeContext> context;
+};
+
+// The recursive chain QueryInterface() used before the interface table:
+// one full IID comparison per interface, in declaration order.
+template <typename Object, typename Owner>
+void* recursiveQuery(Object*, REFIID, TypeList<>) {
+    return nullptr;
+}
+
+template <typename Object, typename Owner, typename T, typename... Rest>
+void* recursiveQuery(Object* object, REFIID riid, TypeList<T, Rest...>) {
+    return riid == __uuidof(T) ? static_cast<T*>(static_cast<Owner*>(object)) :
+        recursiveQuery<Object, Owner>(object, riid, TypeList<Rest...>{});
+}
+
+template <typename Object>
+void* recursiveQuery(Object*, REFIID) {
+    return nullptr;
+}
+
+template <typename Object, typename Interface, typename... Rest>
+void* recursiveQuery(Object* object, REFIID riid) {
+    auto result = recursiveQuery<Object, Interface>(object, riid, typename Interface::InterfaceList{});
+    return result ? result : recursiveQuery<Object, Rest...>(object, riid);
+}
+
+// TextService with the QueryInterface() it had before
+class RecursiveQueryTextService : public BenchTextService {
+public:
+    explicit RecursiveQueryTextService(ImeModule* module) : BenchTextService(module) {}
+
+    STDMETHODIMP QueryInterface(REFIID riid, void** ppvObj) override {
+        if (ppvObj == nullptr)
+            return E_POINTER;
+        if (riid == IID_IUnknown) {
+            *ppvObj = static_cast<ComInterface<ITfTextInputProcessorEx, ITfTextInputProcessor>*>(this);
+        }
+        else {
+            *ppvObj = recursiveQuery<TextService,
+                ComInterface<ITfTextInputProcessorEx, ITfTextInputProcessor>,
+                ComInterface<ITfDisplayAttributeProvider>,
+                ComInterface<ITfThreadMgrEventSink>,
+                ComInterface<ITfTextEditSink>,
+                ComInterface<ITfKeyEventSink>,
+                ComInterface<ITfCompositionSink>,
+                ComInterface<ITfCompartmentEventSink>,
+                ComInterface<ITfLangBarEventSink>,
+                ComInterface<ITfActiveLanguageProfileNotifySink>>(this, riid);
+        }
+        if (*ppvObj) {
+            AddRef();
+            return S_OK;
+        }
+        return E_NOINTERFACE;
+    }
+};
+
+// Queries riid through IUnknown, as TSF does, and releases the result.
+template <typename Service>
+void queryInterface(Bench::State& state, REFIID riid) {
+    auto module = ComPtr<BenchImeModule>::make();
+    auto service = ComPtr<Service>::make(module);
+    IUnknown* unknown = static_cast<ITfKeyEventSink*>(service);
+    // copies the compiler cannot see through
+    IID iid = riid;
+    void* result = nullptr;
+    while (state.running()) {
+        doNotOptimize(unknown);
+        doNotOptimize(iid);
+        if (unknown->QueryInterface(iid, &result) == S_OK)
+            unknown->Release();
+        doNotOptimize(result);
+    }
+}
+
+HRESULT runEditSession(FakeContext* context, TfClientId clientId,
+    std::function<void(EditSession*, TfEditCookie)> callback) {
+    auto session = ComPtr<EditSession>::make(context, std::move(callback));
+    HRESULT hr = E_FAIL;
+    context->RequestEditSession(clientId, session, TF_ES_SYNC | TF_ES_READWRITE, &hr);
+    return hr;
+}
+
+} // namespace
+
+// a key the text service does not want: tested, then passed on
+IME_BENCHMARK(TextService_KeyIgnored) {
+    Session session;
+    while (state.running()) {
+        doNotOptimize(session.threadMgr->keyDown(vkF5));
+        doNotOptimize(session.threadMgr->keyUp(vkF5));
+    }
+}
+
+// Eight letters composed then committed with Enter: each key is tested,
+// handled in an edit session, and updates the composition string.
+IME_BENCHMARK(TextService_ComposeAndCommit8Keys) {
+    Session session;
+    size_t round = 0;
+    while (state.running()) {
+        for (UINT key = 'A'; key < 'A' + 8; ++key)
+            session.threadMgr->typeKey(key);
+        session.threadMgr->typeKey(VK_RETURN);
+        // keep the document short, as an edit box cleared now and then
+        if (++round % 64 == 0) {
+            state.pauseTiming();
+            session.context->setText(std::wstring());
+            state.resumeTiming();
+        }
+    }
+}
+
+// RequestEditSession() with nothing to do: the overhead of each round trip
+IME_BENCHMARK(TextService_EditSessionRoundTrip) {
+    Session session;
+    auto clientId = session.service->clientId();
+    while (state.running()) {
+        doNotOptimize(runEditSession(session.context, clientId,
+            [](EditSession*, TfEditCookie cookie) { doNotOptimize(cookie); }));
+    }
+}
+
+// setCompositionString() of an ongoing composition, in one edit session
+IME_BENCHMARK(TextService_CompositionUpdate) {
+    Session session;
+    auto clientId = session.service->clientId();
+    auto service = session.service;
+    runEditSession(session.context, clientId, [&](EditSession* editSession, TfEditCookie) {
+        service->startComposition(editSession->context());
+    });
+    const std::wstring strings[2] = { L"ni3", L"hao3" };
+    runEditSession(session.context, clientId, [&](EditSession* editSession, TfEditCookie) {
+        size_t i = 0;
+        while (state.running()) {
+            const auto& str = strings[i++ & 1];
+            service->setCompositionString(editSession, str.c_str(), (int)str.size());
+        }
+    });
+}
+
+// isKeyboardOpened(), asked on most keys
+IME_BENCHMARK(TextService_ThreadCompartmentRead) {
+    Session session;
+    while (state.running())
+        doNotOptimize(session.service->isKeyboardOpened());
+}
+
+// isKeyboardDisabled() of the focused context
+IME_BENCHMARK(TextService_ContextCompartmentRead) {
+    Session session;
+    while (state.running())
+        doNotOptimize(session.service->isKeyboardDisabled());
+}
+
+// QueryInterface() of TextService, which lists ten interfaces, for the
+// first and the last of them and one it does not have
+IME_BENCHMARK(ComObject_QueryInterfaceFirst) {
+    queryInterface<BenchTextService>(state, IID_ITfTextInputProcessorEx);
+}
+
+IME_BENCHMARK(ComObject_QueryInterfaceLast) {
+    queryInterface<BenchTextService>(state, IID_ITfActiveLanguageProfileNotifySink);
+}
+
+IME_BENCHMARK(ComObject_QueryInterfaceMiss) {
+    queryInterface<BenchTextService>(state, IID_ITfContext);
+}
+
+IME_BENCHMARK(ComObject_RecursiveQueryInterfaceFirst) {
+    queryInterface<RecursiveQueryTextService>(state, IID_ITfTextInputProcessorEx);
+}
+
+IME_BENCHMARK(ComObject_RecursiveQueryInterfaceLast) {
+    queryInterface<RecursiveQueryTextService>(state, IID_ITfActiveLanguageProfileNotifySink);
+}
+
+IME_BENCHMARK(ComObject_RecursiveQueryInterfaceMiss) {
+    queryInterface<RecursiveQueryTextService>(state, IID_ITfContext);
+}
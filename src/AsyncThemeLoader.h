@@ -0,0 +1,197 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef IME_ASYNC_THEME_LOADER_H
+#define IME_ASYNC_THEME_LOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Ime {
+
+// Builds themes on a worker thread, so that reading and decoding the files
+// does not stall the thread handling the keys. Requests are served in
+// order by a single worker, which is started by the first one and then
+// waits for more until stop(), so that no caller ever waits for a thread
+// to start or to end.
+template <typename Theme>
+class AsyncThemeLoader {
+public:
+    using Result = std::shared_ptr<const Theme>;
+    using Loader = std::function<Result(const std::filesystem::path& dir)>;
+    // called on the worker thread; theme is null if the loader threw
+    using Callback = std::function<void(Result theme)>;
+    // called on the worker thread before and after its loop, for instance
+    // to initialize COM there
+    using ThreadHook = std::function<void()>;
+
+    explicit AsyncThemeLoader(Loader loader, ThreadHook enterThread = {}, ThreadHook leaveThread = {}) :
+        loader_(std::move(loader)),
+        enterThread_(std::move(enterThread)),
+        leaveThread_(std::move(leaveThread)) {
+    }
+
+    // waits for the requests already queued
+    ~AsyncThemeLoader() {
+        stop();
+    }
+
+    AsyncThemeLoader(const AsyncThemeLoader&) = delete;
+    AsyncThemeLoader& operator=(const AsyncThemeLoader&) = delete;
+
+    // The future holds the theme, or the exception thrown by the loader.
+    // done, if any, is called before the future becomes ready.
+    std::shared_future<Result> load(const std::filesystem::path& dir, Callback done = {}) {
+        Request request{ dir, std::move(done) };
+        auto future = request.promise.get_future().share();
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(request));
+        if (running_) {
+            wake_.notify_one();
+        }
+        else {
+            // a worker ended by stop() has left its loop and is about to return
+            if (worker_.joinable())
+                worker_.join();
+            running_ = true;
+            worker_ = std::thread(&AsyncThemeLoader::run, this);
+        }
+        return future;
+    }
+
+    // blocks until every queued request is done
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    }
+
+    // Serves the requests already queued, then ends the worker thread, for
+    // instance before the code it runs is unloaded. A later load() starts
+    // a new worker.
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        wake_.notify_all();
+        std::thread worker = std::move(worker_);
+        lock.unlock();
+        if (worker.joinable())
+            worker.join();
+        lock.lock();
+        stopping_ = false;
+    }
+
+private:
+    struct Request {
+        std::filesystem::path dir;
+        Callback done;
+        std::promise<Result> promise;
+    };
+
+    void run() {
+        if (enterThread_)
+            enterThread_();
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+            // only left once nothing is queued, so no request is stranded
+            if (queue_.empty())
+                break;
+            auto request = std::move(queue_.front());
+            queue_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            Result theme;
+            std::exception_ptr error;
+            try {
+                theme = loader_(request.dir);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            if (request.done)
+                request.done(theme);
+            if (error)
+                request.promise.set_exception(error);
+            else
+                request.promise.set_value(std::move(theme));
+
+            lock.lock();
+            busy_ = false;
+            if (queue_.empty())
+                idle_.notify_all();
+        }
+        running_ = false;
+        lock.unlock();
+        if (leaveThread_)
+            leaveThread_();
+    }
+
+    Loader loader_;
+    ThreadHook enterThread_, leaveThread_;
+    std::mutex mutex_;
+    // signaled when a request is queued or the worker has to stop
+    std::condition_variable wake_;
+    // signaled when the queue is drained
+    std::condition_variable idle_;
+    std::deque<Request> queue_;
+    // the worker is in its loop
+    bool running_ = false;
+    // the worker is serving a request
+    bool busy_ = false;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+// The theme in use, replaced as a whole when a new one is ready. Readers
+// on other threads see either the old or the new theme, never a mix, and
+// keep theirs alive as long as they hold it.
+template <typename Theme>
+class ThemeSlot {
+public:
+    explicit ThemeSlot(std::shared_ptr<const Theme> theme = {}) : theme_(std::move(theme)) {}
+
+    std::shared_ptr<const Theme> get() const {
+        return std::atomic_load(&theme_);
+    }
+
+    void set(std::shared_ptr<const Theme> theme) {
+        std::atomic_store(&theme_, std::move(theme));
+    }
+
+    // returns the theme and leaves theme in its place
+    std::shared_ptr<const Theme> exchange(std::shared_ptr<const Theme> theme) {
+        return std::atomic_exchange(&theme_, std::move(theme));
+    }
+
+private:
+    std::shared_ptr<const Theme> theme_;
+};
+
+} // namespace Ime
+
+#endif
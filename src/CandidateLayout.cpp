@@ -0,0 +1,205 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "CandidateLayout.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Ime {
+
+void CandidateLayout::setParams(const CandidateLayoutParams& params) {
+    if (params == params_)
+        return;
+    params_ = params;
+    invalidateAll();
+}
+
+void CandidateLayout::setCompositionSize(Size size) {
+    if (size != compositionSize_) {
+        compositionSize_ = size;
+        invalidateAll();
+    }
+}
+
+void CandidateLayout::resize(size_t count) {
+    size_t oldCount = sizes_.size();
+    if (count == oldCount)
+        return;
+    sizes_.resize(count);
+    if (params_.pageSize <= 0) {
+        // everything is on the only page
+        invalidateAll();
+        return;
+    }
+    size_t pages = pageCount();
+    pages_.resize(pages);
+    valid_.resize(pages, false);
+    // only the page where the old and the new item lists diverge changes
+    size_t firstChanged = pageOf((std::min)(oldCount, count));
+    for (size_t page = firstChanged; page < pages; ++page)
+        invalidatePage(page);
+}
+
+void CandidateLayout::setItemSize(size_t item, Size size) {
+    assert(item < sizes_.size());
+    if (sizes_[item] != size) {
+        sizes_[item] = size;
+        invalidatePage(pageOf(item));
+    }
+}
+
+void CandidateLayout::setItemSizes(const std::vector<Size>& sizes) {
+    resize(sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i)
+        setItemSize(i, sizes[i]);
+}
+
+void CandidateLayout::clear() {
+    sizes_.clear();
+    compositionSize_ = {};
+    invalidateAll();
+}
+
+size_t CandidateLayout::pageSize() const {
+    if (params_.pageSize > 0)
+        return size_t(params_.pageSize);
+    return (std::max)(sizes_.size(), size_t(1));
+}
+
+size_t CandidateLayout::pageCount() const {
+    if (sizes_.empty())
+        return 1;
+    return (sizes_.size() + pageSize() - 1) / pageSize();
+}
+
+const CandidateLayout::Page& CandidateLayout::page(size_t page) const {
+    assert(page < pageCount());
+    if (pages_.size() != pageCount()) {
+        pages_.resize(pageCount());
+        valid_.assign(pageCount(), false);
+    }
+    if (!valid_[page])
+        layoutPage(page);
+    return pages_[page];
+}
+
+const CandidateCell& CandidateLayout::cell(size_t item) const {
+    const auto& p = page(pageOf(item));
+    return p.cells[item - p.first];
+}
+
+Rect CandidateLayout::compositionRect() const {
+    if (compositionSize_.cx <= 0 || compositionSize_.cy <= 0)
+        return {};
+    return Rect::fromPointSize({ params_.contentMargin.left + params_.textMargin.left,
+        params_.contentMargin.top + params_.textMargin.top }, compositionSize_);
+}
+
+int CandidateLayout::hitTest(size_t pageIndex, Point point) const {
+    const auto& p = page(pageIndex);
+    for (size_t i = 0; i < p.cells.size(); ++i) {
+        if (p.cells[i].rect.contains(point))
+            return int(p.first + i);
+    }
+    return -1;
+}
+
+std::vector<Rect> CandidateLayout::selectionDamage(int oldSel, int newSel) const {
+    std::vector<Rect> damage;
+    auto inRange = [&](int sel) { return sel >= 0 && size_t(sel) < sizes_.size(); };
+    if (inRange(oldSel) && inRange(newSel) && pageOf(oldSel) != pageOf(newSel))
+        return damage;
+    for (int sel : { oldSel, newSel }) {
+        if (inRange(sel)) {
+            const Rect& rect = cell(sel).rect;
+            if (std::find(damage.begin(), damage.end(), rect) == damage.end())
+                damage.push_back(rect);
+        }
+    }
+    return damage;
+}
+
+void CandidateLayout::invalidateAll() {
+    pages_.resize(pageCount());
+    valid_.assign(pageCount(), false);
+}
+
+void CandidateLayout::invalidatePage(size_t page) {
+    if (page < valid_.size())
+        valid_[page] = false;
+}
+
+void CandidateLayout::layoutPage(size_t pageIndex) const {
+    ++layoutPasses_;
+    auto& p = pages_[pageIndex];
+    const auto& cm = params_.contentMargin;
+    const auto& tm = params_.textMargin;
+
+    p.first = pageStart(pageIndex);
+    size_t last = (std::min)(p.first + pageSize(), sizes_.size());
+    size_t n = last > p.first ? last - p.first : 0;
+    size_t perRow = params_.itemsPerRow > 0 ? size_t(params_.itemsPerRow) : (std::max)(n, size_t(1));
+    size_t columns = (std::min)(perRow, n);
+    size_t rows = n ? (n + perRow - 1) / perRow : 0;
+
+    columnWidths_.assign(columns, 0);
+    rowHeights_.assign(rows, 0);
+    for (size_t i = 0; i < n; ++i) {
+        const Size& size = sizes_[p.first + i];
+        auto& width = columnWidths_[i % perRow];
+        auto& height = rowHeights_[i / perRow];
+        width = (std::max)(width, size.cx + tm.xspace());
+        height = (std::max)(height, size.cy + tm.yspace());
+    }
+
+    Size content;
+    Point origin{ cm.left, cm.top };
+    if (compositionSize_.cx > 0 && compositionSize_.cy > 0) {
+        content.cx = compositionSize_.cx + tm.xspace();
+        content.cy = compositionSize_.cy + tm.yspace();
+        origin.y += content.cy;
+    }
+
+    p.cells.resize(n);
+    int y = origin.y;
+    for (size_t row = 0; row < rows; ++row) {
+        int x = origin.x;
+        for (size_t column = 0; column < columns; ++column) {
+            size_t i = row * perRow + column;
+            if (i >= n)
+                break;
+            auto& cell = p.cells[i];
+            cell.rect = { x, y, x + columnWidths_[column], y + rowHeights_[row] };
+            cell.textRect = Rect::fromPointSize({ x + tm.left, y + tm.top }, sizes_[p.first + i]);
+            x += columnWidths_[column];
+        }
+        y += rowHeights_[row];
+    }
+
+    int gridWidth = 0;
+    for (int width : columnWidths_)
+        gridWidth += width;
+    content.cx = (std::max)(content.cx, gridWidth);
+    content.cy += y - origin.y;
+    p.size = { content.cx + cm.xspace(), content.cy + cm.yspace() };
+    valid_[pageIndex] = true;
+}
+
+} // namespace Ime
@@ -0,0 +1,139 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_CANDIDATE_LAYOUT_H
+#define IME_CANDIDATE_LAYOUT_H
+
+#include <vector>
+#include <cstddef>
+#include "Geometry.h"
+
+namespace Ime {
+
+struct CandidateCell {
+    Rect rect;      // the whole grid cell, including the text margin
+    Rect textRect;  // where the text and the highlight are drawn
+};
+
+// The page size of CandidateWindow unless set, the number of candidates it
+// used to list: a whole source on one page would be fetched and measured.
+constexpr int defaultCandidatePageSize = 10;
+
+struct CandidateLayoutParams {
+    Margins contentMargin;
+    Margins textMargin;
+    int itemsPerRow = 0;  // 0 puts all items of a page on one row
+    int pageSize = 0;     // 0 puts all items on one page
+
+    bool operator == (const CandidateLayoutParams& other) const {
+        return contentMargin == other.contentMargin && textMargin == other.textMargin &&
+            itemsPerRow == other.itemsPerRow && pageSize == other.pageSize;
+    }
+    bool operator != (const CandidateLayoutParams& other) const {
+        return !(*this == other);
+    }
+};
+
+// Turns measured candidate sizes into cell rectangles and pages, in device
+// pixels. Each page shows the composition string (if any) above a grid of
+// itemsPerRow columns; columns are as wide as their widest cell and rows as
+// tall as their tallest one.
+// Pages are laid out lazily and only pages whose items changed are laid out
+// again, so updating a few items of a long list costs O(changed pages).
+class CandidateLayout {
+public:
+    struct Page {
+        size_t first = 0;                  // index of the first item
+        Size size;                         // including the content margin
+        std::vector<CandidateCell> cells;  // cells[i] belongs to item first + i
+    };
+
+    // invalidates every page if the parameters changed
+    void setParams(const CandidateLayoutParams& params);
+    const CandidateLayoutParams& params() const {
+        return params_;
+    }
+
+    // an empty size means there is no composition string
+    void setCompositionSize(Size size);
+
+    // New items start with an empty size.
+    void resize(size_t count);
+    void setItemSize(size_t item, Size size);
+    // Replaces all item sizes, invalidating only the pages which changed.
+    void setItemSizes(const std::vector<Size>& sizes);
+    void clear();
+
+    size_t count() const {
+        return sizes_.size();
+    }
+
+    Size itemSize(size_t item) const {
+        return sizes_[item];
+    }
+
+    // the number of items per page, at least 1
+    size_t pageSize() const;
+    // at least 1, even without items
+    size_t pageCount() const;
+    size_t pageOf(size_t item) const {
+        return item / pageSize();
+    }
+    size_t pageStart(size_t page) const {
+        return page * pageSize();
+    }
+
+    const Page& page(size_t page) const;
+    const CandidateCell& cell(size_t item) const;
+
+    // empty if there is no composition string
+    Rect compositionRect() const;
+
+    // index of the item whose cell on the page contains point, or -1
+    int hitTest(size_t page, Point point) const;
+
+    // The areas to repaint when the highlight moves from oldSel to newSel on
+    // the same page. Indices out of range are ignored. If the two items are
+    // on different pages the whole window changes and nothing is returned.
+    std::vector<Rect> selectionDamage(int oldSel, int newSel) const;
+
+    // the number of page layouts done so far, for tests and benchmarks
+    size_t layoutPasses() const {
+        return layoutPasses_;
+    }
+
+private:
+    void invalidateAll();
+    void invalidatePage(size_t page);
+    void layoutPage(size_t page) const;
+
+    CandidateLayoutParams params_;
+    Size compositionSize_;
+    std::vector<Size> sizes_;
+    mutable std::vector<Page> pages_;
+    mutable std::vector<bool> valid_;
+    mutable size_t layoutPasses_ = 0;
+    // scratch space for layoutPage()
+    mutable std::vector<int> columnWidths_;
+    mutable std::vector<int> rowHeights_;
+};
+
+} // namespace Ime
+
+#endif
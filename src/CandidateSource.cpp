@@ -0,0 +1,107 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "CandidateSource.h"
+
+#include <algorithm>
+
+namespace Ime {
+
+void CandidateArena::reserve(size_t count, size_t textLength) {
+    text_.reserve(textLength);
+    ends_.reserve(count);
+    selKeys_.reserve(count);
+}
+
+void CandidateArena::push_back(std::wstring_view text, wchar_t selKey) {
+    text_.append(text.data(), text.size());
+    ends_.push_back(text_.size());
+    selKeys_.push_back(selKey);
+}
+
+void CandidateArena::clear() {
+    text_.clear();
+    ends_.clear();
+    selKeys_.clear();
+}
+
+void CandidateSource::getRange(size_t first, size_t n, CandidateArena& out) const {
+    size_t total = count();
+    size_t last = first < total ? first + (std::min)(n, total - first) : first;
+    out.clear();
+    for (size_t i = first; i < last; ++i) {
+        auto candidate = at(i);
+        out.push_back(candidate.text, candidate.selKey);
+    }
+}
+
+Candidate CandidateList::at(size_t index) const {
+    if (index >= arena_.size())
+        return {};
+    return { std::wstring(arena_.text(index)), arena_.selKey(index) };
+}
+
+void CandidateList::getRange(size_t first, size_t n, CandidateArena& out) const {
+    size_t total = count();
+    size_t last = first < total ? first + (std::min)(n, total - first) : first;
+    out.clear();
+    if (first >= last)
+        return;
+    // the texts of the range are contiguous in our own arena
+    size_t length = arena_.text(last - 1).data() + arena_.text(last - 1).size() - arena_.text(first).data();
+    out.reserve(last - first, length);
+    for (size_t i = first; i < last; ++i)
+        out.push_back(arena_.text(i), arena_.selKey(i));
+}
+
+template<typename String>
+void CandidateList::assignImpl(Span<String> items, Span<wchar_t> selKeys) {
+    size_t length = 0;
+    for (const auto& item : items)
+        length += item.size();
+    arena_.clear();
+    arena_.reserve(items.size(), length);
+    for (size_t i = 0; i < items.size(); ++i)
+        arena_.push_back(items[i], i < selKeys.size() ? selKeys[i] : L'\0');
+}
+
+void CandidateList::assign(Span<std::wstring> items, Span<wchar_t> selKeys) {
+    assignImpl(items, selKeys);
+}
+
+void CandidateList::assign(Span<std::wstring_view> items, Span<wchar_t> selKeys) {
+    assignImpl(items, selKeys);
+}
+
+void CandidateList::add(std::wstring_view item, wchar_t selKey) {
+    arena_.push_back(item, selKey);
+}
+
+bool CandidatePage::load(const CandidateSource& source, size_t first, size_t n) {
+    if (isLoaded(source, first, n))
+        return false;
+    source.getRange(first, n, items_);
+    source_ = &source;
+    first_ = first;
+    requested_ = n;
+    valid_ = true;
+    return true;
+}
+
+} // namespace Ime
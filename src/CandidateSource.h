@@ -0,0 +1,180 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_CANDIDATE_SOURCE_H
+#define IME_CANDIDATE_SOURCE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <initializer_list>
+#include <cstddef>
+#include "Span.h"
+
+namespace Ime {
+
+struct Candidate {
+    std::wstring text;
+    wchar_t selKey = 0;  // 0 if the candidate has no selection key
+};
+
+// Candidates stored back to back in a single buffer. Filling it takes a
+// constant number of allocations however many candidates there are, and
+// none once the buffers are large enough, since clear() keeps them.
+class CandidateArena {
+public:
+    size_t size() const {
+        return selKeys_.size();
+    }
+
+    bool empty() const {
+        return selKeys_.empty();
+    }
+
+    // valid until the arena is modified
+    std::wstring_view text(size_t index) const {
+        size_t begin = index ? ends_[index - 1] : 0;
+        return { text_.data() + begin, ends_[index] - begin };
+    }
+
+    wchar_t selKey(size_t index) const {
+        return selKeys_[index];
+    }
+
+    // the total length of all texts
+    size_t textLength() const {
+        return text_.size();
+    }
+
+    void reserve(size_t count, size_t textLength);
+    void push_back(std::wstring_view text, wchar_t selKey);
+    void clear();
+
+private:
+    std::wstring text_;
+    std::vector<size_t> ends_;  // text i ends at ends_[i]
+    std::vector<wchar_t> selKeys_;
+};
+
+// Where CandidateWindow gets its candidates from. Engines producing huge
+// candidate lists implement it to generate candidates on demand; the window
+// only fetches the page it shows and the TSF UI element asks for the rest
+// one by one.
+class CandidateSource {
+public:
+    virtual ~CandidateSource() {}
+
+    virtual size_t count() const = 0;
+
+    // index must be less than count()
+    virtual Candidate at(size_t index) const = 0;
+
+    // Replaces the content of out with the candidates [first, first + n),
+    // clipped to count(). Override it if fetching a batch is cheaper.
+    virtual void getRange(size_t first, size_t n, CandidateArena& out) const;
+};
+
+// A plain list of candidates, used by CandidateWindow::setItems() and add().
+class CandidateList: public CandidateSource {
+public:
+    size_t count() const override {
+        return arena_.size();
+    }
+
+    // an empty candidate if index is out of range
+    Candidate at(size_t index) const override;
+    void getRange(size_t first, size_t n, CandidateArena& out) const override;
+
+    std::wstring_view text(size_t index) const {
+        return arena_.text(index);
+    }
+
+    wchar_t selKey(size_t index) const {
+        return arena_.selKey(index);
+    }
+
+    // selKeys may be shorter than items; the missing keys are 0
+    void assign(Span<std::wstring> items, Span<wchar_t> selKeys);
+    void assign(Span<std::wstring_view> items, Span<wchar_t> selKeys);
+    // braced lists of literals, which would match both of the above
+    void assign(std::initializer_list<std::wstring_view> items, Span<wchar_t> selKeys) {
+        assign(Span<std::wstring_view>(items.begin(), items.size()), selKeys);
+    }
+    void add(std::wstring_view item, wchar_t selKey);
+    void clear() {
+        arena_.clear();
+    }
+
+private:
+    template<typename String>
+    void assignImpl(Span<String> items, Span<wchar_t> selKeys);
+
+    CandidateArena arena_;
+};
+
+// The candidates of the visible page, fetched from a source only when the
+// page changes.
+class CandidatePage {
+public:
+    // Fetches [first, first + n) unless it is already loaded from source.
+    // Returns true if the source was asked.
+    bool load(const CandidateSource& source, size_t first, size_t n);
+
+    bool isLoaded(const CandidateSource& source, size_t first, size_t n) const {
+        return valid_ && source_ == &source && first_ == first && requested_ == n;
+    }
+
+    // forgets the page, e.g. after the content of the source changed
+    void invalidate() {
+        valid_ = false;
+    }
+
+    size_t first() const {
+        return first_;
+    }
+
+    // the number of candidates loaded, less than requested at the end of the list
+    size_t size() const {
+        return items_.size();
+    }
+
+    bool contains(size_t index) const {
+        return valid_ && index >= first_ && index - first_ < items_.size();
+    }
+
+    // index is relative to the whole list, not to the page
+    std::wstring_view text(size_t index) const {
+        return items_.text(index - first_);
+    }
+
+    wchar_t selKey(size_t index) const {
+        return items_.selKey(index - first_);
+    }
+
+private:
+    const CandidateSource* source_ = nullptr;
+    size_t first_ = 0;
+    size_t requested_ = 0;
+    bool valid_ = false;
+    CandidateArena items_;
+};
+
+} // namespace Ime
+
+#endif
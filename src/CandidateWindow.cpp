@@ -21,6 +21,9 @@
 #include "DrawUtils.h"
 #include "TextService.h"
 #include "EditSession.h"
+#include "ThemeBinary.h"
+#include "ThemeCompiler.h"
+#include "ThemeRegistry.h"
 
 #include <algorithm>
 #include <cassert>
@@ -36,6 +39,9 @@ using namespace std::literals;
 
 namespace Ime {
 
+// posted by the theme loader once the theme of loadTheme() is ready
+static const UINT WM_THEME_LOADED = WM_USER + 1;
+
 CandidateWindow::CandidateWindow(TextService* service, EditSession* session,
     const CandidateWindow::Theme* theme) :
     ImeWindow(service),
@@ -47,7 +53,8 @@ CandidateWindow::CandidateWindow(TextService* service, EditSession* session,
     hasResult_(false),
     useCursor_(true),
     selKeyWidth_(0),
-    theme_(theme) {
+    theme_(theme),
+    surfacePool_(gdiSurfaceAllocator()) {
 
     if(service->isImmersive()) { // windows 8 app mode
         margin_ = 10;
@@ -64,6 +71,18 @@ CandidateWindow::CandidateWindow(TextService* service, EditSession* session,
     create(parent, WS_POPUP|WS_CLIPCHILDREN, WS_EX_TOOLWINDOW|WS_EX_TOPMOST|WS_EX_LAYERED);
 }
 
+CandidateWindow::CandidateWindow(TextService* service, EditSession* session,
+    std::shared_ptr<const CandidateWindow::Theme> theme) :
+    CandidateWindow(service, session, theme.get()) {
+    sharedTheme_ = std::move(theme);
+}
+
+CandidateWindow::CandidateWindow(TextService* service, EditSession* session,
+    const std::filesystem::path& themeDir) :
+    CandidateWindow(service, session, Theme::builtin()) {
+    loadTheme(themeDir);
+}
+
 CandidateWindow::~CandidateWindow(void) {
 }
 
@@ -109,15 +128,16 @@ STDMETHODIMP CandidateWindow::GetUpdatedFlags(DWORD *pdwFlags) {
 }
 
 STDMETHODIMP CandidateWindow::GetDocumentMgr(ITfDocumentMgr **ppdim) {
-    if (!textService_)
+    auto service = textService_.lock();
+    if (!service)
         return E_FAIL;
-    return textService_->currentContext()->GetDocumentMgr(ppdim);
+    return service->currentContext()->GetDocumentMgr(ppdim);
 }
 
 STDMETHODIMP CandidateWindow::GetCount(UINT *puCount) {
     if (!puCount)
         return E_INVALIDARG;
-    *puCount = std::min<UINT>(10, items_.size());
+    *puCount = static_cast<UINT>(source().count());
     return S_OK;
 }
 
@@ -132,22 +152,28 @@ STDMETHODIMP CandidateWindow::GetSelection(UINT *puIndex) {
 STDMETHODIMP CandidateWindow::GetString(UINT uIndex, BSTR *pbstr) {
     if (!pbstr)
         return E_INVALIDARG;
-    if (uIndex >= items_.size())
+    if (uIndex >= source().count())
         return E_INVALIDARG;
-    *pbstr = SysAllocString(items_[uIndex].c_str());
+    // fetched on demand so that huge lists are never materialized at once
+    if (!source_) {
+        auto text = list_.text(uIndex);
+        *pbstr = SysAllocStringLen(text.data(), static_cast<UINT>(text.size()));
+    }
+    else
+        *pbstr = SysAllocString(source().at(uIndex).text.c_str());
     return S_OK;
 }
 
 STDMETHODIMP CandidateWindow::GetPageIndex(UINT *puIndex, UINT uSize, UINT *puPageCnt) {
-    /// XXX Always return the same single page index.
     if (!puPageCnt)
         return E_INVALIDARG;
-    *puPageCnt = 1;
+    *puPageCnt = static_cast<UINT>(layout_.pageCount());
     if (puIndex) {
         if (uSize < *puPageCnt) {
             return E_INVALIDARG;
         }
-        puIndex[0] = 0;
+        for (UINT page = 0; page < *puPageCnt; ++page)
+            puIndex[page] = static_cast<UINT>(layout_.pageStart(page));
     }
     return S_OK;
 }
@@ -162,7 +188,7 @@ STDMETHODIMP CandidateWindow::SetPageIndex(UINT *puIndex, UINT uPageCnt) {
 STDMETHODIMP CandidateWindow::GetCurrentPage(UINT *puPage) {
     if (!puPage)
         return E_INVALIDARG;
-    *puPage = 0;
+    *puPage = static_cast<UINT>(currentPage());
     return S_OK;
 }
 
@@ -182,22 +208,49 @@ LRESULT CandidateWindow::wndProc(UINT msg, WPARAM wp , LPARAM lp) {
             break;
         case WM_MOUSEACTIVATE:
             return MA_NOACTIVATE;
+        case WM_THEME_LOADED:
+            // the GDI objects of the theme are created by the thread using them
+            if (auto data = loadedTheme_ ? loadedTheme_->exchange(nullptr) : nullptr)
+                setTheme(std::make_shared<const Theme>(*data));
+            break;
         default:
             return Window::wndProc(msg, wp, lp);
     }
     return 0;
 }
 
+static Margins scaledMargins(const CandidateWindow::Theme::Margin& margin, const DPIScaler& ds) {
+    return { ds.y(margin.top), ds.x(margin.right), ds.y(margin.bottom), ds.x(margin.left) };
+}
+
 void CandidateWindow::refresh() {
+    if (layoutDirty_ || !page_.isLoaded(source(), layout_.pageStart(currentPage()), layout_.pageSize()))
+        updateLayout();
+
     RECT clientRect;
     GetClientRect(hwnd_, &clientRect);
     SIZE size = rectSize(clientRect);
-
-    GdiDC dcDesktop(GetDC(HWND_DESKTOP), HWND_DESKTOP);
-    GdiDC dc(CreateCompatibleDC(dcDesktop));
-    GdiObject bmp(CreateCompatibleBitmap(dcDesktop, size.cx, size.cy));
-    GdiDCSelector bmpSelector(dc, bmp);
-    paint(dc, clientRect);
+    Ime::Size surfaceSize{ (int) size.cx, (int) size.cy };
+
+    // background_ keeps the theme background alone so that refreshSelection()
+    // can restore single cells; frame_ keeps the last complete frame.
+    for (auto surface : { &background_, &frame_ }) {
+        auto& lease = *surface;
+        if (!lease || lease.size().cx < surfaceSize.cx || lease.size().cy < surfaceSize.cy) {
+            lease = surfacePool_.acquire(surfaceSize);
+            if (surface == &background_)
+                backgroundSize_ = {};
+        }
+    }
+    // the composed background only changes with the window size
+    if (size.cx != backgroundSize_.cx || size.cy != backgroundSize_.cy) {
+        background_->clear(clientRect);
+        theme_->background.paint(background_->dc(), clientRect, sliceCache_);
+        backgroundSize_ = size;
+    }
+    BitBlt(frame_->dc(), 0, 0, size.cx, size.cy, background_->dc(), 0, 0, SRCCOPY);
+    paint(frame_->dc(), clientRect);
+    frameSize_ = size;
 
     POINT ptSrc = {};
     RECT windowRect;
@@ -205,75 +258,176 @@ void CandidateWindow::refresh() {
     POINT ptDst = { windowRect.left, windowRect.top };
 
     BLENDFUNCTION blend = bmpBlendFunction();
-    ::UpdateLayeredWindow(hwnd_, dcDesktop, &ptDst, &size, dc, &ptSrc, 0, &blend, ULW_ALPHA);
+    ::UpdateLayeredWindow(hwnd_, NULL, &ptDst, &size, frame_->dc(), &ptSrc, 0, &blend, ULW_ALPHA);
+}
+
+void CandidateWindow::refreshSelection(int oldSel) {
+    RECT clientRect;
+    GetClientRect(hwnd_, &clientRect);
+    SIZE size = rectSize(clientRect);
+    if (oldSel >= 0 && size_t(oldSel) < layout_.count() && layout_.pageOf(oldSel) != currentPage()) {
+        // moved to another page, which may have a different size
+        recalculateSize();
+        refresh();
+        return;
+    }
+    if (layoutDirty_ || !frame_ || !background_ ||
+        size.cx != frameSize_.cx || size.cy != frameSize_.cy) {
+        refresh();
+        return;
+    }
+
+    auto damage = layout_.selectionDamage(oldSel, currentSel_);
+    if (damage.empty())
+        return;
+
+    HDC dc = frame_->dc();
+    DPIScaler ds(dc);
+    GdiObject font(ds.createFont(theme_->font));
+    Rect dirty;
+    for (const auto& rect : damage) {
+        BitBlt(dc, rect.left, rect.top, rect.width(), rect.height(),
+            background_->dc(), rect.left, rect.top, SRCCOPY);
+        dirty = dirty.united(rect);
+    }
+    {
+        GdiTextBlender normalTextBlender(dc, surfacePool_, size, theme_->normalColor, 255);
+        for (int sel : { oldSel, currentSel_ }) {
+            if (sel >= 0 && size_t(sel) < layout_.count())
+                paintCandidate(dc, size, font, sel, normalTextBlender);
+        }
+    }
+
+    POINT ptSrc = {};
+    RECT dirtyRect = toRECT(dirty);
+    BLENDFUNCTION blend = bmpBlendFunction();
+    UPDATELAYEREDWINDOWINFO info = {};
+    info.cbSize = sizeof(info);
+    info.psize = &size;
+    info.hdcSrc = dc;
+    info.pptSrc = &ptSrc;
+    info.pblend = &blend;
+    info.dwFlags = ULW_ALPHA;
+    info.prcDirty = &dirtyRect;
+    if (!::UpdateLayeredWindowIndirect(hwnd_, &info))
+        refresh();
 }
 
 void CandidateWindow::paint(HDC dc, const RECT& clientRect) {
     DPIScaler ds(dc);
     SIZE clientSize = rectSize(clientRect);
-
-    theme_->background.paint(dc, clientRect);
-    
-    POINT pt{ theme_->contentMargin.left, theme_->contentMargin.top };
     GdiObject font(ds.createFont(theme_->font));
 
     if (!composition_.empty()) {
-        GdiTextBlender textBlender(dc, clientSize, theme_->normalColor, 255);
-        SIZE size = textBlender(composition_, { pt.x + ds.x(theme_->textMargin.left),
-            pt.y + ds.y(theme_->textMargin.top) }, font);
-        pt.y += size.cy + ds.y(theme_->textMargin.yspace());
+        GdiTextBlender textBlender(dc, surfacePool_, clientSize, theme_->normalColor, 255);
+        const auto& rect = layout_.compositionRect();
+        textBlender(composition_, { rect.left, rect.top }, font, toSIZE(rect.size()));
     }
-    
-    GdiTextBlender normalTextBlender(dc, clientSize, theme_->normalColor, 255);
-    for (size_t i = 0; i < items_.size(); ++i) {
-        auto str = candidateString(i);
-        SIZE size;
-        if (useCursor_ && i == currentSel_) {
-            POINT ptText{ pt.x + ds.x(theme_->textMargin.left),
-                pt.y + ds.y(theme_->textMargin.top) };
-            {
-                GdiTextBlender highlightTextBlender(dc, clientSize,
-                    theme_->highlightCandidateColor, 255);
-                size = highlightTextBlender(str, ptText, font);
-            }
-            theme_->highlight.paint(dc, pointSizeRect(ptText, size));
-        } else
-            size = normalTextBlender(str, { pt.x + ds.x(theme_->textMargin.left),
-                pt.y + ds.y(theme_->textMargin.top) }, font);
-        pt.x += size.cx + ds.x(theme_->textMargin.xspace());
+
+    GdiTextBlender normalTextBlender(dc, surfacePool_, clientSize, theme_->normalColor, 255);
+    const auto& page = layout_.page(currentPage());
+    for (size_t i = page.first; i < page.first + page.cells.size(); ++i) {
+        paintCandidate(dc, clientSize, font, i, normalTextBlender);
     }
 }
 
-wstring CandidateWindow::candidateString(size_t i) {
-    return (selKeys_[i] ? selKeys_[i] + L"."s : L"") + items_[i];
+void CandidateWindow::paintCandidate(HDC dc, SIZE clientSize, HFONT font, size_t i,
+    GdiTextBlender& normalTextBlender) {
+    auto str = candidateString(i);
+    const auto& textRect = layout_.cell(i).textRect;
+    POINT ptText{ textRect.left, textRect.top };
+    SIZE size = toSIZE(textRect.size());
+    if (useCursor_ && i == currentSel_) {
+        // the highlight goes under the text, which an opaque image would hide
+        theme_->highlight.paint(dc, pointSizeRect(ptText, size), sliceCache_);
+        GdiTextBlender highlightTextBlender(dc, surfacePool_, clientSize,
+            theme_->highlightCandidateColor, 255);
+        highlightTextBlender(str, ptText, font, size);
+    } else
+        normalTextBlender(str, ptText, font, size);
+}
+
+wstring_view CandidateWindow::candidateString(size_t i) {
+    // reuses the capacity of label_ instead of building a new string
+    label_.clear();
+    if (wchar_t selKey = page_.selKey(i)) {
+        label_ += selKey;
+        label_ += L'.';
+    }
+    label_ += page_.text(i);
+    return label_;
 }
 
-void CandidateWindow::recalculateSize() {
+void CandidateWindow::itemsChanged() {
+    sourceChanged();
+    recalculateSize();
+    refresh();
+}
+
+void CandidateWindow::updateLayout() {
     GdiDC dc(::GetWindowDC(hwnd_), hwnd_);
     DPIScaler ds(dc);
-    SIZE totalSize{ 0, 0 };
     GdiObject font(ds.createFont(theme_->font));
-    GdiDCSelector fontSelector(dc, font);
-    if (!composition_.empty()) {
-        SIZE size;
-        ::GetTextExtentPoint32W(dc, composition_.c_str(), composition_.size(), &size);
-        totalSize.cx = size.cx + ds.x(theme_->textMargin.xspace());
-        totalSize.cy = size.cy + ds.y(theme_->textMargin.yspace());
-    }
+    auto key = fontKey(theme_->font, ds.y.value);
+    GdiTextMeasurer measurer(dc, font);
+
+    Ime::Size compositionSize;
+    if (!composition_.empty())
+        compositionSize = measureCache_.measure(key, composition_, measurer);
+
+    CandidateLayoutParams params;
+    params.contentMargin = scaledMargins(theme_->contentMargin, ds);
+    params.textMargin = scaledMargins(theme_->textMargin, ds);
+    params.itemsPerRow = candPerRow_;
+    params.pageSize = pageSize_;
+    // only the pages whose items changed are laid out again
+    layout_.setParams(params);
+    layout_.setCompositionSize(compositionSize);
+    layout_.resize(source().count());
+    if (size_t(currentSel_) >= layout_.count())
+        currentSel_ = 0;
+
+    // Other pages keep the sizes measured when they were last shown, and
+    // are measured again before they are shown next.
+    page_.load(source(), layout_.pageStart(currentPage()), layout_.pageSize());
+    for (size_t i = page_.first(); i < page_.first() + page_.size(); ++i)
+        layout_.setItemSize(i, measureCache_.measure(key, candidateString(i), measurer));
+    layoutDirty_ = false;
+}
+
+void CandidateWindow::setTheme(std::shared_ptr<const Theme> theme) {
+    if (!theme || theme.get() == theme_)
+        return;
+    sharedTheme_ = std::move(theme);
+    theme_ = sharedTheme_.get();
+    // the font, the margins and the background may all differ
+    layoutDirty_ = true;
+    backgroundSize_ = {};
+    recalculateSize();
+    if (isVisible())
+        refresh();
+}
 
-    SIZE candidateSize{ 0, 0 };
-    for (size_t i = 0; i < items_.size(); ++i) {
-        auto str = candidateString(i);
-        SIZE size;
-        ::GetTextExtentPoint32W(dc, str.c_str(), str.size(), &size);
-        candidateSize.cx += size.cx + ds.x(theme_->textMargin.xspace());
-        candidateSize.cy = (max) (candidateSize.cy, size.cy + ds.y(theme_->textMargin.yspace()));
-    }
-    totalSize.cx = (max) (totalSize.cx, candidateSize.cx);
-    totalSize.cy = (max) (totalSize.cy, candidateSize.cy);
+void CandidateWindow::loadTheme(const std::filesystem::path& dir) {
+    if (!loadedTheme_)
+        loadedTheme_ = std::make_shared<ThemeSlot<ThemeData>>();
+    // The window may be gone when the theme is ready, so the worker only
+    // touches the slot it shares with the window, and the message to a
+    // destroyed window is dropped.
+    HWND hwnd = hwnd_;
+    Theme::loadAsync(dir, [slot = loadedTheme_, hwnd](std::shared_ptr<const ThemeData> theme) {
+        if (!theme)
+            return;
+        slot->set(std::move(theme));
+        ::PostMessageW(hwnd, WM_THEME_LOADED, 0, 0);
+    });
+}
 
-    totalSize.cx += ds.x(theme_->contentMargin.xspace());
-    totalSize.cy += ds.y(theme_->contentMargin.yspace());
+void CandidateWindow::recalculateSize() {
+    updateLayout();
+    auto totalSize = layout_.page(currentPage()).size;
+    // free the pooled surfaces the window has outgrown
+    surfacePool_.trim(totalSize);
     resize(totalSize.cx, totalSize.cy);
 }
 
@@ -284,6 +438,13 @@ void CandidateWindow::setCandPerRow(int n) {
     }
 }
 
+void CandidateWindow::setPageSize(int n) {
+    if(n != pageSize_) {
+        pageSize_ = n;
+        recalculateSize();
+    }
+}
+
 bool CandidateWindow::filterKeyEvent(KeyEvent& keyEvent) {
     // select item with arrow keys
     int oldSel = currentSel_;
@@ -293,7 +454,7 @@ bool CandidateWindow::filterKeyEvent(KeyEvent& keyEvent) {
             currentSel_ -= candPerRow_;
         break;
     case VK_DOWN:
-        if(currentSel_ + candPerRow_ < items_.size())
+        if(currentSel_ + candPerRow_ < source().count())
             currentSel_ += candPerRow_;
         break;
     case VK_LEFT:
@@ -301,7 +462,7 @@ bool CandidateWindow::filterKeyEvent(KeyEvent& keyEvent) {
             --currentSel_;
         break;
     case VK_RIGHT:
-        if(currentSel_ + 1 < items_.size())
+        if(currentSel_ + 1 < source().count())
             ++currentSel_;
         break;
     case VK_RETURN:
@@ -312,143 +473,238 @@ bool CandidateWindow::filterKeyEvent(KeyEvent& keyEvent) {
     }
     // if currently selected item is changed, redraw
     if(currentSel_ != oldSel) {
-        refresh();
+        refreshSelection(oldSel);
         return true;
     }
     return false;
 }
 
 void CandidateWindow::setCurrentSel(int sel) {
-    if(sel >= items_.size())
+    if(sel >= source().count())
         sel = 0;
     if (currentSel_ != sel) {
+        int oldSel = currentSel_;
         currentSel_ = sel;
-        refresh();
+        refreshSelection(oldSel);
     }
 }
 
 void CandidateWindow::clear() {
-    items_.clear();
-    selKeys_.clear();
+    list_.clear();
+    source_.reset();
+    sourceChanged();
     currentSel_ = 0;
     hasResult_ = false;
 }
 
+void CandidateWindow::setSource(std::shared_ptr<const CandidateSource> source) {
+    source_ = std::move(source);
+    sourceChanged();
+    currentSel_ = 0;
+}
+
 void CandidateWindow::setUseCursor(bool use) {
     useCursor_ = use;
     // caller will refresh
 }
 
-static wstring readIni(const filesystem::path& file, const wstring& section,
-    const wstring& key, const wstring& fallback) {
-    wchar_t buffer[MAX_PATH];
-    ::GetPrivateProfileStringW(section.c_str(), key.c_str(), fallback.c_str(),
-        &*buffer, sizeof(buffer) / sizeof(buffer[0]), file.c_str());
-    return &*buffer;
-}
-
-static int readIni(const filesystem::path& file, const wstring& section,
-    const wstring& key, int fallback) {
-    return (int) ::GetPrivateProfileIntW(section.c_str(), key.c_str(),
-        fallback, file.c_str());
-}
-
-static LOGFONT readIniFont(const filesystem::path& file, const wstring& section,
-    const wstring& prefix) {
-    auto defaultFont = (HFONT) GetStockObject(DEFAULT_GUI_FONT);
+// the default GUI font, with the face and the size (in points) overridden if given
+static LOGFONT themeFont(const wstring& face, int size) {
     LOGFONT lf;
-    GetObjectW(defaultFont, sizeof(lf), &lf);
-    auto name = readIni(file, section, prefix, lf.lfFaceName);
-    auto i = name.find_last_of(L' ');
-    if (i != wstring::npos) {
-        wchar_t* p;
-        auto suffix = name.substr(i + 1);
-        long size = wcstol(suffix.c_str(), &p, 10);
-        if (!errno && !*p && size > 0) {
-            name = name.substr(0, i);
-            lf.lfHeight = size;
-        }
+    GetObjectW(GetStockObject(DEFAULT_GUI_FONT), sizeof(lf), &lf);
+    if (!face.empty()) {
+        auto name = face.substr(0, LF_FACESIZE - 1);
+        wcscpy(lf.lfFaceName, name.c_str());
     }
-    constexpr unsigned max_name_size =
-        sizeof(lf.lfFaceName) / sizeof(lf.lfFaceName[0]) - 1;
-    if (name.size() > max_name_size)
-        name.resize(max_name_size);
-    wcscpy(lf.lfFaceName, name.c_str());
+    if (size > 0)
+        lf.lfHeight = size;
     return lf;
 }
 
-static int readIniColor(const filesystem::path& file, const wstring& section,
-    const wstring& key, int fallback) {
-    auto str = readIni(file, section, key, wstring());
-    if (!str.empty() && str[0] == L'#') str = str.substr(1);
-    if (str.size() != 6) return fallback;
-    for (auto c : str)
-        if (!(L'0' <= c && c <= L'9' || L'a' <= c && c <= L'f' ||
-            L'A' <= c && c <= L'F'))
-            return fallback;
-    int v = wcstol(str.c_str(), NULL, 16);
-    return RGB((v & 0xFF0000) >> 16, (v & 0xFF00) >> 8, v & 0xFF);
+static void applyMargins(CandidateWindow::Theme::Margin& margin, const Margins& margins) {
+    margin.top = margins.top;
+    margin.right = margins.right;
+    margin.bottom = margins.bottom;
+    margin.left = margins.left;
 }
 
-void CandidateWindow::Theme::Margin::read(const std::filesystem::path& conf, const wstring& section) {
-    top = readIni(conf, section, L"Top", 0);
-    right = readIni(conf, section, L"Right", 0);
-    bottom = readIni(conf, section, L"Bottom", 0);
-    left = readIni(conf, section, L"Left", 0);
+void CandidateWindow::Theme::Margin::read(const IniFile& conf, const wstring& section) {
+    applyMargins(*this, conf.getMargins(section));
 }
 
-void CandidateWindow::Theme::StretchedImage::read(const std::filesystem::path& conf,
-    const std::wstring& section, const std::filesystem::path& dir) {
-    auto file = dir / readIni(conf, section, L"Image", L"image.png");
+void CandidateWindow::Theme::StretchedImage::read(const IniFile& conf,
+    const std::wstring& section, const std::filesystem::path& dir, const std::wstring& defaultImage) {
+    auto name = conf.getString(section, L"Image", defaultImage);
+    if (name.empty())
+        return;
+    auto file = dir / wstring(name);
     image = make_unique<GdiWicBitmap>(file.c_str());
     margin.read(conf, section + L"/Margin");
 }
 
+static Margins toMargins(const CandidateWindow::Theme::Margin& margin) {
+    return { margin.top, margin.right, margin.bottom, margin.left };
+}
+
 void CandidateWindow::Theme::StretchedImage::paint(HDC dc, const RECT& rect) const {
     if (!image) return;
+    DPIScaler ds(dc);
+    Ime::Size imageSize{ (int) image->width(), (int) image->height() };
+    paint(dc, rect, NineSlice(imageSize, toMargins(margin),
+        Rect::fromPointSize({}, toRect(rect).size()), ds.x.value, ds.y.value));
+}
 
-    struct Strechable {
-        int value;
-        bool stretched;
-
-        int operator()(int total, DPIScaler::Value dsv) const {
-            return (stretched ? total : 0) + dsv(value);
+void CandidateWindow::Theme::StretchedImage::paint(HDC dc, const RECT& rect,
+    NineSliceCache& slices) const {
+    if (!image) return;
+    DPIScaler ds(dc);
+    Ime::Size imageSize{ (int) image->width(), (int) image->height() };
+    paint(dc, rect, slices.get(imageSize, toMargins(margin), toRect(rect).size(),
+        ds.x.value, ds.y.value));
+}
+
+void CandidateWindow::Theme::StretchedImage::paint(HDC dc, const RECT& rect,
+    const NineSlice& slice) const {
+    // the patches are relative to the top left corner of rect
+    for (const auto& patch : slice)
+        image->paint(dc, toRECT(patch.dest.translated(rect.left, rect.top)), toRECT(patch.src));
+}
+
+namespace {
+
+// A read-only view of a whole file.
+class MappedFile {
+public:
+    MappedFile(const filesystem::path& path) {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            if (HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL)) {
+                data_ = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data_)
+                    size_ = (size_t) size.QuadPart;
+                CloseHandle(mapping);
+            }
         }
-    };
-    struct Dim { Strechable start, size; };
-    vector<Dim> xDims{
-        {{ 0, false }, { margin.left, false }},
-        {{ margin.left, false }, { -margin.left - margin.right, true }},
-        {{ -margin.right, true }, { margin.right, false }},
-    };
-    vector<Dim> yDims{
-        {{ 0, false }, { margin.top, false } },
-        {{ margin.top, false}, { -margin.top - margin.bottom, true }},
-        {{ -margin.bottom, true}, { margin.bottom, false }},
-    };
+        CloseHandle(file);
+    }
 
-    DPIScaler ds(dc);
-    DPIScaler::Value nods;
-    SIZE size = rectSize(rect);
-    for (auto&& x : xDims) for (auto&& y : yDims) {
-        image->paint(dc, pointSizeRect(
-            { rect.left + x.start(size.cx, ds.x),rect.top + y.start(size.cy, ds.y) },
-            { x.size(size.cx, ds.x), y.size(size.cy, ds.y) }),
-            pointSizeRect(
-                { x.start(image->width(), nods), y.start(image->height(), nods) },
-                { x.size(image->width(), nods), y.size(image->height(), nods) }));
+    ~MappedFile() {
+        if (data_)
+            UnmapViewOfFile(data_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace
+
+void CandidateWindow::Theme::assign(const ThemeData& data) {
+    for (auto [image, imageData] : { std::pair{ &background, &data.background },
+        std::pair{ &highlight, &data.highlight } }) {
+        applyMargins(image->margin, imageData->margin);
+        if (!imageData->isEmpty())
+            image->image = make_unique<GdiWicBitmap>(imageData->pixels.data(),
+                (UINT) imageData->size.cx, (UINT) imageData->size.cy);
     }
+    applyMargins(textMargin, data.textMargin);
+    applyMargins(contentMargin, data.contentMargin);
+
+    font = themeFont(data.fontFace, data.fontSize);
+    normalColor = data.normalColor;
+    highlightCandidateColor = data.highlightCandidateColor;
 }
 
-CandidateWindow::Theme::Theme(const filesystem::path& dir) {
+// Reads dir/theme.bin (see ThemeBinary.h) unless theme.conf is newer.
+static bool readBinaryTheme(const filesystem::path& dir, ThemeData& data) {
+    auto bin = dir / themeBinaryFileName;
     auto conf = dir / "theme.conf";
-    background.read(conf, L"InputPanel/Background", dir);
-    textMargin.read(conf, L"InputPanel/TextMargin");
-    contentMargin.read(conf, L"InputPanel/ContentMargin");
-    font = readIniFont(conf, L"InputPanel", L"Font");
-    normalColor = readIniColor(conf, L"InputPanel", L"NormalColor", 0x000000);
-    highlightCandidateColor = readIniColor(conf, L"InputPanel",
-        L"HighlightCandidateColor", 0x000000);
+    std::error_code ec;
+    auto binTime = filesystem::last_write_time(bin, ec);
+    if (ec)
+        return false;
+    // a stale binary theme is ignored until it is compiled again
+    auto confTime = filesystem::last_write_time(conf, ec);
+    if (!ec && confTime > binTime)
+        return false;
+
+    MappedFile file(bin);
+    return file.data() && readThemeBinary(file.data(), file.size(), data);
+}
+
+static bool decodeThemeImage(const filesystem::path& file, ThemeImageData& image) {
+    UINT width, height;
+    if (!decodeImageFile(file.c_str(), width, height, image.pixels))
+        return false;
+    image.size = { (int) width, (int) height };
+    return true;
+}
+
+static ThemeData readThemeData(const filesystem::path& dir) {
+    ThemeData data;
+    if (readBinaryTheme(dir, data))
+        return data;
+    // a missing theme.conf reads as an empty one, as with the profile API
+    if (!compileTheme(dir, decodeThemeImage, data) &&
+        !decodeThemeImage(dir / L"image.png", data.background))
+        data.background = {};
+    return data;
+}
+
+CandidateWindow::Theme::Theme(const filesystem::path& dir) :
+    Theme(*sharedData(dir)) {
+}
+
+CandidateWindow::Theme::Theme(const ThemeData& data) {
+    assign(data);
+}
+
+std::shared_ptr<const CandidateWindow::Theme> CandidateWindow::Theme::builtin() {
+    static const ThemeData data = builtinThemeData();
+    return std::make_shared<const Theme>(data);
+}
+
+std::shared_ptr<const ThemeData> CandidateWindow::Theme::sharedData(const filesystem::path& dir) {
+    static ThemeRegistry<ThemeData> registry([](const filesystem::path& dir) {
+        return std::make_shared<const ThemeData>(readThemeData(dir));
+    });
+    return registry.get(dir);
+}
+
+// Never destroyed: its destructor would join the worker while the module
+// is unloaded, under the loader lock, where the exit of the worker waits
+// for that lock. ImeModule::canUnloadNow() calls stopLoader() instead.
+static AsyncThemeLoader<ThemeData>& themeLoader() {
+    // The images of a theme without theme.bin are decoded with WIC, which
+    // needs COM on the worker thread too.
+    static thread_local bool comInitialized = false;
+    static auto loader = new AsyncThemeLoader<ThemeData>(&CandidateWindow::Theme::sharedData, [] {
+        comInitialized = SUCCEEDED(::CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+    }, [] {
+        if (comInitialized)
+            ::CoUninitialize();
+    });
+    return *loader;
+}
+
+std::shared_future<std::shared_ptr<const ThemeData>> CandidateWindow::Theme::loadAsync(
+    const filesystem::path& dir, std::function<void(std::shared_ptr<const ThemeData>)> done) {
+    return themeLoader().load(dir, std::move(done));
+}
+
+void CandidateWindow::Theme::stopLoader() {
+    themeLoader().stop();
 }
 
 } // namespace Ime
@@ -28,6 +28,13 @@
 #include <filesystem>
 #include "ComObject.h"
 #include "DrawUtils.h"
+#include "CandidateLayout.h"
+#include "CandidateSource.h"
+#include "NineSlice.h"
+#include "IniFile.h"
+#include "ThemeData.h"
+#include "AsyncThemeLoader.h"
+#include <future>
 #pragma comment(lib, "Msimg32.lib")
 #pragma comment(lib, "windowscodecs.lib")
 
@@ -45,7 +52,7 @@ public:
         struct Margin {
             int top = 0, right = 0, bottom = 0, left = 0;
 
-            void read(const std::filesystem::path& conf, const std::wstring& section);
+            void read(const IniFile& conf, const std::wstring& section);
             auto xspace() const { return left + right; }
             auto yspace() const { return top + bottom; }
         };
@@ -54,10 +61,15 @@ public:
             std::unique_ptr<GdiWicBitmap> image;
             Margin margin;
 
-            void read(const std::filesystem::path& conf, const std::wstring& section,
-                const std::filesystem::path& dir);
+            // no image is loaded if the section has none and defaultImage is empty
+            void read(const IniFile& conf, const std::wstring& section,
+                const std::filesystem::path& dir, const std::wstring& defaultImage = L"image.png");
             void paint(HDC dc, const RECT& rect) const;
+            // same as above, reusing the slices computed for the same size and DPI
+            void paint(HDC dc, const RECT& rect, NineSliceCache& slices) const;
         private:
+            void paint(HDC dc, const RECT& rect, const NineSlice& slice) const;
+
             std::string imageData;
         };
 
@@ -66,10 +78,42 @@ public:
         LOGFONT font;
         COLORREF normalColor, highlightCandidateColor;
 
+        // Loads dir/theme.bin (see ThemeBinary.h) unless theme.conf is newer,
+        // and reads theme.conf and the images otherwise, through sharedData().
         Theme(const std::filesystem::path& dir);
+        explicit Theme(const ThemeData& data);
+
+        // the theme shown while the real one is loading (see builtinThemeData()),
+        // a new one for each caller
+        static std::shared_ptr<const Theme> builtin();
+
+        // The decoded theme in dir, read once per process and shared by all
+        // candidate windows until a file in dir changes (see ThemeRegistry.h).
+        // A Theme owns memory DCs, which cannot be used by several threads at
+        // once, so only this is shared: each window builds its own Theme.
+        static std::shared_ptr<const ThemeData> sharedData(const std::filesystem::path& dir);
+
+        // Same as sharedData(), on a worker thread. done, if any, is called on
+        // that thread; the future throws what reading the theme threw.
+        static std::shared_future<std::shared_ptr<const ThemeData>> loadAsync(
+            const std::filesystem::path& dir,
+            std::function<void(std::shared_ptr<const ThemeData>)> done = {});
+
+        // Waits for the loads of loadAsync() and for the end of its worker
+        // thread, which otherwise lives as long as the module. Called by
+        // ImeModule::canUnloadNow() before the module is unloaded.
+        static void stopLoader();
+
+    private:
+        void assign(const ThemeData& data);
     };
 
     CandidateWindow(TextService* service, EditSession* session, const Theme* theme);
+    // keeps the theme alive as long as the window; the theme must not be
+    // painted by another thread meanwhile
+    CandidateWindow(TextService* service, EditSession* session, std::shared_ptr<const Theme> theme);
+    // paints with Theme::builtin() until the theme in dir is loaded (see loadTheme())
+    CandidateWindow(TextService* service, EditSession* session, const std::filesystem::path& themeDir);
 
     // ITfUIElement
     STDMETHODIMP GetDescription(BSTR *pbstrDescription);
@@ -89,20 +133,73 @@ public:
 
     void refresh() override;
 
+    const Theme& theme() const {
+        return *theme_;
+    }
+    // replaces the theme and repaints with it
+    void setTheme(std::shared_ptr<const Theme> theme);
+    // Loads the theme in dir on a worker thread and switches to it on this
+    // thread once it is ready. The current theme is kept meanwhile, and if
+    // the loading fails.
+    void loadTheme(const std::filesystem::path& dir);
+
+    // the items given to setItems() and add(), not those of a custom source
+    const CandidateList& candidateList() const {
+        return list_;
+    }
+
+    // Copies of the same items, for code written before candidateList().
+    // Built again by each call, and valid until the next one.
+    [[deprecated("use candidateList(), which copies nothing")]]
     const std::vector<std::wstring>& items() const {
-        return items_;
+        legacyItems_.clear();
+        for (size_t i = 0; i < list_.count(); ++i)
+            legacyItems_.emplace_back(list_.text(i));
+        return legacyItems_;
     }
 
-    void setItems(const std::vector<std::wstring>& items, const std::vector<wchar_t>& sekKeys) {
-        items_ = items;
-        selKeys_ = selKeys_;
-        recalculateSize();
-        refresh();
+    // The items are copied into a single buffer reused across calls, so
+    // temporaries and views can be passed without extra copies.
+    void setItems(Span<std::wstring> items, Span<wchar_t> selKeys) {
+        source_.reset();
+        list_.assign(items, selKeys);
+        itemsChanged();
     }
 
-    void add(std::wstring item, wchar_t selKey) {
-        items_.push_back(item);
-        selKeys_.push_back(selKey);
+    void setItems(Span<std::wstring_view> items, Span<wchar_t> selKeys) {
+        source_.reset();
+        list_.assign(items, selKeys);
+        itemsChanged();
+    }
+
+    // for callers handing over their vector, as with the setItems() of old
+    void setItems(std::vector<std::wstring>&& items, Span<wchar_t> selKeys) {
+        setItems(Span<std::wstring>(items), selKeys);
+    }
+
+    // setItems({ L"a", L"b" }, ...), which would match all of the above
+    void setItems(std::initializer_list<std::wstring_view> items, Span<wchar_t> selKeys) {
+        setItems(Span<std::wstring_view>(items.begin(), items.size()), selKeys);
+    }
+
+    void add(std::wstring_view item, wchar_t selKey) {
+        list_.add(item, selKey);
+        sourceChanged();
+    }
+
+    // Shows the candidates of source instead of those given to setItems()
+    // and add(). Only the visible page is fetched. Pass nullptr to go back
+    // to the built-in list. The caller will refresh.
+    void setSource(std::shared_ptr<const CandidateSource> source);
+
+    const CandidateSource& source() const {
+        return source_ ? *source_ : list_;
+    }
+
+    // call it after the content of the source changed
+    void sourceChanged() {
+        page_.invalidate();
+        layoutDirty_ = true;
     }
 
     void clear();
@@ -112,6 +209,17 @@ public:
     }
     void setCandPerRow(int n);
 
+    // the number of candidates per page, defaultCandidatePageSize unless
+    // set; 0 shows all of them on one page
+    int pageSize() const {
+        return pageSize_;
+    }
+    void setPageSize(int n);
+
+    size_t currentPage() const {
+        return layout_.pageOf(currentSel_);
+    }
+
     virtual void recalculateSize();
 
     bool filterKeyEvent(KeyEvent& keyEvent);
@@ -121,8 +229,11 @@ public:
     }
     void setCurrentSel(int sel);
 
+    // 0 if there is no candidate
     wchar_t currentSelKey() const {
-        return selKeys_.at(currentSel_);
+        if (currentSel_ < 0 || size_t(currentSel_) >= source().count())
+            return 0;
+        return source().at(currentSel_).selKey;
     }
 
     bool hasResult() const {
@@ -135,10 +246,31 @@ public:
 
     void setUseCursor(bool use);
 
+    const GdiSurfacePool& surfacePool() const {
+        return surfacePool_;
+    }
+
+    const TextMeasureCache& measureCache() const {
+        return measureCache_;
+    }
+
+    const CandidateLayout& layout() const {
+        return layout_;
+    }
+
 protected:
     LRESULT wndProc(UINT msg, WPARAM wp , LPARAM lp);
+    // draws the composition string and the candidates over the background
     void paint(HDC dc, const RECT& clientRect);
-    std::wstring candidateString(size_t i);
+    void paintCandidate(HDC dc, SIZE clientSize, HFONT font, size_t i,
+        GdiTextBlender& normalTextBlender);
+    // repaints only the cells of oldSel and currentSel_ in the last frame
+    void refreshSelection(int oldSel);
+    // measures and lays out the page of the current selection
+    void updateLayout();
+    // i must be on the loaded page; valid until the next call
+    std::wstring_view candidateString(size_t i);
+    void itemsChanged();
 
 protected: // COM object should not be deleted directly. calling Release() instead.
     ~CandidateWindow(void);
@@ -150,16 +282,40 @@ private:
     int textWidth_;
     int itemHeight_;
     int candPerRow_;
+    int pageSize_ = defaultCandidatePageSize;
     int colSpacing_;
     int rowSpacing_;
-    std::vector<wchar_t> selKeys_;
-    std::vector<std::wstring> items_;
+    CandidateList list_;
+    // returned by items()
+    mutable std::vector<std::wstring> legacyItems_;
+    std::shared_ptr<const CandidateSource> source_;
+    // the candidates of the visible page
+    CandidatePage page_;
+    // scratch buffer of candidateString()
+    std::wstring label_;
     int currentSel_;
     bool hasResult_;
     bool useCursor_;
 
     const Theme* theme_;
+    // owns theme_ if given as a shared_ptr
+    std::shared_ptr<const Theme> sharedTheme_;
+    // handed over by the theme loader, taken by the window thread
+    std::shared_ptr<ThemeSlot<ThemeData>> loadedTheme_;
     std::wstring composition_;
+    // back buffer and GdiTextBlender scratch surfaces, reused across refresh() calls
+    GdiSurfacePool surfacePool_;
+    // text extents shared by recalculateSize() and paint()
+    TextMeasureCache measureCache_;
+    CandidateLayout layout_;
+    bool layoutDirty_ = true;
+    GdiSurfacePool::Lease background_;
+    GdiSurfacePool::Lease frame_;
+    SIZE frameSize_ = {};
+    // the size background_ was painted for; empty if it must be painted again
+    SIZE backgroundSize_ = {};
+    // nine-slice patches of the theme images for the last few sizes
+    NineSliceCache sliceCache_;
 };
 
 }
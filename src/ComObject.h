@@ -20,87 +20,220 @@
 #pragma once
 
 #include <Unknwn.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "ComPtr.h"
 
 namespace Ime {
 
+template <typename... T>
+struct TypeList {};
+
+// Base and the interfaces it derives from, which QueryInterface() returns
+// it as. For example ComInterface<ITfTextInputProcessorEx, ITfTextInputProcessor>.
 template <typename Base, typename... Interfaces>
 class ComInterface: public Base {
-protected:
-    void* queryInterface(REFIID riid) {
-        return queryInterfaceHelper<Base, Interfaces...>(riid);
-    }
+public:
+    using InterfaceList = TypeList<Base, Interfaces...>;
+};
 
-private:
-    template <typename T>
-    void* queryInterfaceHelper(REFIID riid) {
-        return riid == __uuidof(T) ? static_cast<T*>(this) : nullptr;
-    }
+// Reference counting policies of BasicComObject.
 
-    template <typename T, typename U, typename... Args>
-    void* queryInterfaceHelper(REFIID riid) {
-        return riid == __uuidof(T) ? static_cast<T*>(this) : queryInterfaceHelper<U, Args...>(riid);
-    }
+// A plain counter, for objects only used by the thread which created them.
+// This is the case of most TSF objects, as TSF calls a text service on the
+// thread which activated it.
+struct SingleThreaded {
+    class RefCount {
+    public:
+        explicit RefCount(ULONG count) : count_{ count } {}
+
+        ULONG increment() {
+            return ++count_;
+        }
+
+        ULONG decrement() {
+            return --count_;
+        }
+
+        ULONG value() const {
+            return count_;
+        }
+
+    private:
+        ULONG count_;
+    };
 };
 
+// An atomic counter, for objects shared by several threads, such as the
+// class factory every thread hosting the text service gets.
+struct MultiThreaded {
+    class RefCount {
+    public:
+        explicit RefCount(ULONG count) : count_{ count } {}
 
-template <typename FirstInterface, typename... ComInterfaces>
-class ComObject : public FirstInterface, public ComInterfaces... {
+        // Taking a reference needs no ordering: the caller already holds one.
+        ULONG increment() {
+            return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        // Releasing publishes the writes of this thread to the one which
+        // deletes the object, and the deleting thread acquires them.
+        ULONG decrement() {
+            return count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        }
+
+        ULONG value() const {
+            return count_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<ULONG> count_;
+    };
+};
+
+template <typename ThreadingModel, typename FirstInterface, typename... ComInterfaces>
+class BasicComObject : public FirstInterface, public ComInterfaces... {
 public:
-    ComObject() : refCount_{ 1 } {}
+    BasicComObject() : refCount_{ 1 } {}
+
+    virtual ~BasicComObject() {
+        if (weakRefBlock_) {
+            weakRefBlock_->expire();
+            weakRefBlock_->release();
+        }
+    }
 
-    virtual ~ComObject() {}
+    // The block shared with the weak references to this object (see
+    // ComWeakPtr), created by the first one.
+    WeakRefBlock* weakRefBlock() {
+        static_assert(std::is_same<ThreadingModel, SingleThreaded>::value,
+            "weak references can only be locked by the thread of the object");
+        if (!weakRefBlock_) {
+            weakRefBlock_ = new WeakRefBlock();
+        }
+        return weakRefBlock_;
+    }
 
     int refCount() const {
-        return refCount_;
+        return int(refCount_.value());
     }
 
     STDMETHODIMP QueryInterface(REFIID riid, void** ppvObj) {
         if (ppvObj == nullptr) {
             return E_POINTER;
         }
-        if (riid == IID_IUnknown) {
-            // An explicit type casting here is required to ensure querying IUnknown
-            // always returns the same pointer. (This is required by COM).
-            *ppvObj = static_cast<FirstInterface*>(this);
-        }
-        else {
-            *ppvObj = queryInterfaceHelper<FirstInterface, ComInterfaces...>(riid);
-        }
-        if (*ppvObj) {
-            AddRef();
-            return S_OK;
+        const auto& table = interfaceTable(this);
+        auto entry = std::lower_bound(table.begin(), table.end(), riid.Data1,
+            [](const InterfaceEntry& entry, uint32_t data1) { return entry.data1 < data1; });
+        // distinct IIDs rarely share data1, but may
+        for (; entry != table.end() && entry->data1 == riid.Data1; ++entry) {
+            if (entry->iid == riid) {
+                *ppvObj = reinterpret_cast<char*>(this) + entry->offset;
+                AddRef();
+                return S_OK;
+            }
         }
+        *ppvObj = nullptr;
         return E_NOINTERFACE;
     }
 
     STDMETHODIMP_(ULONG) AddRef() {
-        return ++refCount_;
+        return refCount_.increment();
     }
 
     STDMETHODIMP_(ULONG) Release() {
-        assert(refCount_ > 0);
-        const ULONG newCount = --refCount_;
-        if (0 == refCount_) {
+        assert(refCount_.value() > 0);
+        // the count is not read again: another thread may own it by now
+        const ULONG newCount = refCount_.decrement();
+        if (0 == newCount) {
+            // before the destructors, which could lock one otherwise
+            if (weakRefBlock_) {
+                weakRefBlock_->expire();
+            }
             delete this;
         }
         return newCount;
     }
 private:
+    // An interface and where it is in the object.
+    struct InterfaceEntry {
+        uint32_t data1;     // the first word of iid, the sort key
+        ptrdiff_t offset;   // from this to the interface
+        IID iid;
+    };
+
+    template <typename List>
+    struct ListSize;
+
+    template <typename... T>
+    struct ListSize<TypeList<T...>> {
+        static constexpr size_t value = sizeof...(T);
+    };
+
+    // IUnknown, then the interfaces of each ComInterface
+    static constexpr size_t interfaceCount = 1 +
+        (ListSize<typename FirstInterface::InterfaceList>::value + ... +
+            ListSize<typename ComInterfaces::InterfaceList>::value);
+
+    using InterfaceTable = std::array<InterfaceEntry, interfaceCount>;
+
+    // The entries of all the objects of this class, sorted by data1 and
+    // built by the first query: the offsets are the same in every object.
+    static const InterfaceTable& interfaceTable(BasicComObject* object) {
+        static const InterfaceTable table = makeInterfaceTable(object);
+        return table;
+    }
+
+    static InterfaceTable makeInterfaceTable(BasicComObject* object) {
+        InterfaceTable table;
+        size_t n = 0;
+        // Querying IUnknown must always return the same pointer (this is
+        // required by COM), so it comes first and wins over any other base.
+        table[n++] = interfaceEntry<IUnknown>(static_cast<FirstInterface*>(object), object);
+        addInterfaceEntries(table, n, static_cast<FirstInterface*>(object), object,
+            typename FirstInterface::InterfaceList{});
+        (addInterfaceEntries(table, n, static_cast<ComInterfaces*>(object), object,
+            typename ComInterfaces::InterfaceList{}), ...);
+        // stable, so that the first of the interfaces sharing an IID wins,
+        // as in the declaration order
+        std::stable_sort(table.begin(), table.end(), [](const InterfaceEntry& a, const InterfaceEntry& b) {
+            return a.data1 < b.data1;
+        });
+        return table;
+    }
 
-    template <typename T>
-    void* queryInterfaceHelper(REFIID riid) {
-        return T::queryInterface(riid);
+    template <typename Owner, typename... T>
+    static void addInterfaceEntries(InterfaceTable& table, size_t& n, Owner* owner,
+        BasicComObject* object, TypeList<T...>) {
+        ((table[n++] = interfaceEntry<T>(owner, object)), ...);
     }
 
-    template <typename T, typename U, typename... Args>
-    void* queryInterfaceHelper(REFIID riid) {
-        auto result = T::queryInterface(riid);
-        return result ? result : queryInterfaceHelper<U, Args...>(riid);
+    template <typename T, typename Owner>
+    static InterfaceEntry interfaceEntry(Owner* owner, BasicComObject* object) {
+        auto offset = reinterpret_cast<char*>(static_cast<T*>(owner)) - reinterpret_cast<char*>(object);
+        return { __uuidof(T).Data1, offset, __uuidof(T) };
     }
 
 private:
-    int refCount_;
+    typename ThreadingModel::RefCount refCount_;
+    WeakRefBlock* weakRefBlock_ = nullptr;
+};
+
+// A COM object used by one thread, which most are. A class rather than an
+// alias, so that derived classes can still name their base ComObject, as in
+// ComObject::AddRef().
+template <typename FirstInterface, typename... ComInterfaces>
+class ComObject : public BasicComObject<SingleThreaded, FirstInterface, ComInterfaces...> {
+};
+
+// A COM object whose references may be taken and released by any thread.
+template <typename FirstInterface, typename... ComInterfaces>
+class MultiThreadedComObject : public BasicComObject<MultiThreaded, FirstInterface, ComInterfaces...> {
 };
 
 } // namespace Ime
@@ -20,6 +20,9 @@
 #ifndef IME_COM_PTR_H
 #define IME_COM_PTR_H
 
+#include <cstddef>
+#include <memory>
+#include <type_traits>
 #include <utility>
 
 // ATL-indepdent smart pointers for COM objects
@@ -70,6 +73,36 @@ public:
         return ptr;
     }
 
+    T* get() const {
+        return p_;
+    }
+
+    // For out parameters, which return a reference the caller owns:
+    // releases the pointer held and returns where to store the new one.
+    T** put() {
+        if (p_) {
+            p_->Release();
+            p_ = nullptr;
+        }
+        return &p_;
+    }
+
+    // Takes over the reference of p, without AddRef().
+    void attach(T* p) {
+        T* old = p_;
+        p_ = p;
+        if (old) {
+            old->Release();
+        }
+    }
+
+    // Gives up the reference held, which the caller now owns.
+    T* detach() {
+        T* p = p_;
+        p_ = nullptr;
+        return p;
+    }
+
     // QueryInterface
     template <typename U>
     ComPtr<U> query() const {
@@ -118,8 +151,15 @@ public:
     }
 
     ComPtr& operator = (ComPtr&& other) noexcept {
-        p_ = other.p_;
-        other.p_ = nullptr;
+        if (this != std::addressof(other)) {
+            T* old = p_;
+            p_ = other.p_;
+            other.p_ = nullptr;
+            // after the assignment, in case releasing old releases other too
+            if (old) {
+                old->Release();
+            }
+        }
         return *this;
     }
 
@@ -143,6 +183,149 @@ protected:
     T* p_;
 };
 
+// A borrowed pointer to a COM interface/object, for parameters and locals
+// which do not outlive the caller's reference: no AddRef() nor Release().
+// Converts from raw pointers and from ComPtr of T or of a derived class.
+template <class T>
+class ComRef {
+public:
+    ComRef(void): p_(nullptr) {
+    }
+
+    ComRef(std::nullptr_t): p_(nullptr) {
+    }
+
+    ComRef(T* p): p_(p) {
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+    ComRef(const ComPtr<U>& p): p_(p.get()) {
+    }
+
+    T* get() const {
+        return p_;
+    }
+
+    // QueryInterface; the result is owned, unlike this
+    template <typename U>
+    ComPtr<U> query() const {
+        return ComPtr<U>::queryFrom(p_);
+    }
+
+    T& operator * () const {
+        return *p_;
+    }
+
+    T* operator-> () const {
+        return p_;
+    }
+
+    operator T* () const {
+        return p_;
+    }
+
+    bool operator !() const {
+        return !p_;
+    }
+
+    bool operator == (T* p) const {
+        return p == p_;
+    }
+
+    bool operator != (T* p) const {
+        return p != p_;
+    }
+
+private:
+    T* p_;
+};
+
+// Shared by a COM object and the weak references to it, which outlive it:
+// tells them whether the object is still alive. Freed with the last of them.
+class WeakRefBlock {
+public:
+    WeakRefBlock(void): refCount_(1), alive_(true) {
+    }
+
+    WeakRefBlock(const WeakRefBlock&) = delete;
+    WeakRefBlock& operator = (const WeakRefBlock&) = delete;
+
+    void addRef() {
+        ++refCount_;
+    }
+
+    void release() {
+        if (--refCount_ == 0) {
+            delete this;
+        }
+    }
+
+    bool alive() const {
+        return alive_;
+    }
+
+    // called by the object before it goes away
+    void expire() {
+        alive_ = false;
+    }
+
+private:
+    unsigned long refCount_;
+    bool alive_;
+};
+
+// A weak reference to a COM object, which does not keep it alive: lock()
+// returns a ComPtr to it, or nullptr once it is gone. For back references,
+// which would otherwise make cycles. T needs weakRefBlock(), which
+// ComObject provides.
+template <class T>
+class ComWeakPtr {
+public:
+    ComWeakPtr(void): p_(nullptr), block_(nullptr) {
+    }
+
+    ComWeakPtr(T* p): p_(p), block_(p ? p->weakRefBlock() : nullptr) {
+        if (block_) {
+            block_->addRef();
+        }
+    }
+
+    ComWeakPtr(const ComWeakPtr& other): p_(other.p_), block_(other.block_) {
+        if (block_) {
+            block_->addRef();
+        }
+    }
+
+    ComWeakPtr(ComWeakPtr&& other) noexcept : p_(other.p_), block_(other.block_) {
+        other.p_ = nullptr;
+        other.block_ = nullptr;
+    }
+
+    ~ComWeakPtr(void) {
+        if (block_) {
+            block_->release();
+        }
+    }
+
+    ComWeakPtr& operator = (ComWeakPtr other) noexcept {
+        std::swap(p_, other.p_);
+        std::swap(block_, other.block_);
+        return *this;
+    }
+
+    ComPtr<T> lock() const {
+        return expired() ? ComPtr<T>() : ComPtr<T>(p_);
+    }
+
+    bool expired() const {
+        return !block_ || !block_->alive();
+    }
+
+private:
+    T* p_;
+    WeakRefBlock* block_;
+};
+
 }
 
 #endif
@@ -0,0 +1,75 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "DirtyRegion.h"
+
+namespace Ime {
+
+DirtyRegion::DirtyRegion(const Rect& bounds, size_t maxBoxes) :
+    bounds_(bounds),
+    maxBoxes_(maxBoxes > 0 ? maxBoxes : 1) {
+    boxes_.reserve(maxBoxes_);
+}
+
+Rect DirtyRegion::add(const Rect& rect) {
+    Rect box = rect.intersected(bounds_);
+    if (box.isEmpty())
+        return box;
+
+    for (;;) {
+        // absorb every box overlapping the new one
+        auto it = boxes_.begin();
+        while (it != boxes_.end()) {
+            if (it->intersects(box)) {
+                box = box.united(*it);
+                boxes_.erase(it);
+                // the grown box may overlap boxes we have already passed
+                it = boxes_.begin();
+            }
+            else
+                ++it;
+        }
+        if (boxes_.size() < maxBoxes_)
+            break;
+
+        // no room left: merge with the box whose union is the smallest
+        auto best = boxes_.begin();
+        long long bestArea = best->united(box).area();
+        for (it = best + 1; it != boxes_.end(); ++it) {
+            long long area = it->united(box).area();
+            if (area < bestArea) {
+                best = it;
+                bestArea = area;
+            }
+        }
+        box = box.united(*best);
+        boxes_.erase(best);
+    }
+    boxes_.push_back(box);
+    return box;
+}
+
+Rect DirtyRegion::boundingRect() const {
+    Rect result;
+    for (const auto& box : boxes_)
+        result = result.united(box);
+    return result;
+}
+
+} // namespace Ime
@@ -0,0 +1,67 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_DIRTY_REGION_H
+#define IME_DIRTY_REGION_H
+
+#include <vector>
+#include "Geometry.h"
+
+namespace Ime {
+
+// A small set of non-overlapping boxes covering everything added so far.
+// Overlapping boxes are merged into their bounding box, and once maxBoxes is
+// reached a new box is merged with the existing one that grows the least.
+class DirtyRegion {
+public:
+    explicit DirtyRegion(const Rect& bounds, size_t maxBoxes = 4);
+
+    // Adds rect (clipped to the bounds) and returns the box that now covers it,
+    // or an empty rect if nothing was added. Every box present before the call
+    // is either inside the returned box or does not intersect it.
+    Rect add(const Rect& rect);
+
+    const std::vector<Rect>& boxes() const {
+        return boxes_;
+    }
+
+    const Rect& bounds() const {
+        return bounds_;
+    }
+
+    bool isEmpty() const {
+        return boxes_.empty();
+    }
+
+    // The bounding box of all boxes.
+    Rect boundingRect() const;
+
+    void clear() {
+        boxes_.clear();
+    }
+
+private:
+    Rect bounds_;
+    size_t maxBoxes_;
+    std::vector<Rect> boxes_;
+};
+
+} // namespace Ime
+
+#endif
@@ -18,6 +18,8 @@
 //
 
 #include "DrawUtils.h"
+#include "PixelKernels.h"
+#include <mutex>
 
 using namespace std;
 
@@ -87,77 +89,145 @@ inline BOOL alphaBlend2(HDC dcDest, POINT destPoint, SIZE destSize,
         dcSource, srcPoint.x, srcPoint.y, srcSize.cx, srcSize.cy, bf);
 }
 
-GdiTextBlender::GdiTextBlender(HDC dcTarget, SIZE size, COLORREF color, BYTE alpha) :
-    dcTarget(dcTarget), size(size), color(color), alpha(alpha),
-    bmp(create32bppBitmap(size, bits)),
-    dc(CreateCompatibleDC(dcTarget)), bmpSelector(dc, bmp)
-{
-    RECT rect = { 0, 0, size.cx, size.cy };
-    FillRect(dc, &rect, WHITE_BRUSH);
+Ime::FontKey fontKey(const LOGFONT& lf, int dpi) {
+    // everything but the face name, whose unused tail may contain garbage
+    auto id = Ime::hashBytes(&lf, offsetof(LOGFONT, lfFaceName));
+    id = Ime::hashBytes(lf.lfFaceName, wcsnlen(lf.lfFaceName, LF_FACESIZE) * sizeof(wchar_t), id);
+    return { id, dpi };
 }
 
-SIZE GdiTextBlender::operator()(const std::wstring& str, POINT point, HFONT font) {
+Ime::Size GdiTextMeasurer::measure(std::wstring_view text) {
     GdiDCSelector selector(dc, font);
-    TextOutW(dc, point.x, point.y, str.c_str(), str.size());
+    SIZE size{};
+    ::GetTextExtentPoint32W(dc, text.data(), (int) text.size(), &size);
+    return { (int) size.cx, (int) size.cy };
+}
+
+GdiSurface::GdiSurface(SIZE size) :
+    size_(size),
+    bmp_(create32bppBitmap(size, bits_)),
+    dc_(CreateCompatibleDC(NULL)), bmpSelector_(dc_, bmp_) {
+}
+
+void GdiSurface::clear(const RECT& rect) {
+    RECT r;
+    RECT bounds{ 0, 0, size_.cx, size_.cy };
+    if (!bits_ || !IntersectRect(&r, &rect, &bounds))
+        return;
+    GdiFlush();
+    for (int y = r.top; y < r.bottom; ++y)
+        memset(row(y) + r.left * 4, 0, size_t(r.right - r.left) * 4);
+}
+
+GdiSurfacePool::Allocator gdiSurfaceAllocator() {
+    return [](Ime::Size size) {
+        return std::make_unique<GdiSurface>(SIZE{ size.cx, size.cy });
+    };
+}
+
+GdiTextBlender::GdiTextBlender(HDC dcTarget, GdiSurfacePool& pool, SIZE size,
+    COLORREF color, BYTE alpha) :
+    surface(pool.acquire({ (int) size.cx, (int) size.cy })),
+    dcTarget(dcTarget), dc(surface->dc()), color(color), alpha(alpha),
+    dirty({ 0, 0, (int) size.cx, (int) size.cy }) {
+}
+
+SIZE GdiTextBlender::operator()(std::wstring_view str, POINT point, HFONT font) {
     SIZE size;
-    ::GetTextExtentPoint32W(dc, str.c_str(), str.size(), &size);
+    {
+        GdiDCSelector selector(dc, font);
+        ::GetTextExtentPoint32W(dc, str.data(), (int) str.size(), &size);
+    }
+    return (*this)(str, point, font, size);
+}
+
+SIZE GdiTextBlender::operator()(std::wstring_view str, POINT point, HFONT font, SIZE size) {
+    GdiDCSelector selector(dc, font);
+
+    // Fill the box covering the text with white, but keep the text
+    // already drawn in the other boxes which may be merged into it.
+    for (const auto& box : dirty.boxes())
+        ExcludeClipRect(dc, box.left, box.top, box.right, box.bottom);
+    RECT rect = toRECT(dirty.add(toRect(pointSizeRect(point, size))));
+    FillRect(dc, &rect, (HBRUSH) GetStockObject(WHITE_BRUSH));
+    SelectClipRgn(dc, NULL);
+
+    TextOutW(dc, point.x, point.y, str.data(), (int) str.size());
     return size;
 }
 
 GdiTextBlender::~GdiTextBlender() {
     GdiFlush();
-    int count = size.cx * size.cy;
     BYTE r = GetRValue(color), g = GetGValue(color), b = GetBValue(color);
-    auto p = bits;
-    for (int c = 0; c != count; ++c) {
-        BYTE alpha = 255 - p[0];
-        p[0] = b * alpha / 255;
-        p[1] = g * alpha / 255;
-        p[2] = r * alpha / 255;
-        p[3] = alpha;
-        p += 4;
+    for (const auto& box : dirty.boxes()) {
+        // the rows of a box are not contiguous in the DIB, so convert them one by one.
+        for (int y = box.top; y < box.bottom; ++y) {
+            Ime::premultiplyCoverage(surface->row(y) + box.left * 4, box.width(), r, g, b);
+        }
+        POINT point{ box.left, box.top };
+        SIZE boxSize{ box.width(), box.height() };
+        alphaBlend2(dcTarget, point, boxSize, dc, point, boxSize, bmpBlendFunction());
     }
-    alphaBlend2(dcTarget, POINT{ 0, 0 }, size,
-        dc, POINT{ 0, 0 }, size, bmpBlendFunction());
 }
 
+// Shared by every thread decoding images. A failed creation, as on a thread
+// without COM, is not kept: the next call tries again.
 static Ime::ComPtr<IWICImagingFactory> wicImagingFactory() {
-    static auto result = [] {
-        Ime::ComPtr<IWICImagingFactory> ptr;
-        IWICImagingFactory** pptr = &ptr;
+    static std::mutex mutex;
+    static Ime::ComPtr<IWICImagingFactory> factory;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!factory) {
         CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER,
-            IID_IWICImagingFactory, (LPVOID*) pptr);
-        return ptr;
-    }();
-    return result;
+            IID_IWICImagingFactory, (LPVOID*) factory.put());
+    }
+    return factory;
 }
 
 inline UINT dibWidthBytes(UINT bits) { return ((bits + 31) >> 5) << 2; }
 
-GdiWicBitmap::GdiWicBitmap(const wchar_t* file) {
+bool decodeImageFile(const wchar_t* file, UINT& width, UINT& height, std::vector<BYTE>& pixels) {
+    Ime::ComPtr<IWICImagingFactory> factory = wicImagingFactory();
     Ime::ComPtr<IWICBitmapDecoder> decoder;
     Ime::ComPtr<IWICBitmapFrameDecode> frameDecode;
     Ime::ComPtr<IWICFormatConverter> convertedFrame;
-    if (!wicImagingFactory() ||
-        !SUCCEEDED(wicImagingFactory()->CreateDecoderFromFilename(
+    if (!factory ||
+        !SUCCEEDED(factory->CreateDecoderFromFilename(
             file, NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder)) ||
         !SUCCEEDED(decoder->GetFrame(0, &frameDecode)) ||
-        !SUCCEEDED(frameDecode->GetSize(&width_, &height_)) ||
-        !SUCCEEDED(wicImagingFactory()->CreateFormatConverter(&convertedFrame)) ||
+        !SUCCEEDED(frameDecode->GetSize(&width, &height)) ||
+        !SUCCEEDED(factory->CreateFormatConverter(&convertedFrame)) ||
         !SUCCEEDED(convertedFrame->Initialize(frameDecode, GUID_WICPixelFormat32bppPBGRA,
             WICBitmapDitherTypeNone, NULL, 0, WICBitmapPaletteTypeCustom))) {
-        return;
+        return false;
     }
-    BYTE* bits;
+    auto stride = dibWidthBytes(width * 32);
+    auto bufferSize = stride * height;
+    pixels.resize(bufferSize);
+    return SUCCEEDED(convertedFrame->CopyPixels(nullptr, stride, bufferSize, pixels.data()));
+}
+
+GdiWicBitmap::GdiWicBitmap(const wchar_t* file) {
+    std::vector<BYTE> pixels;
+    UINT width, height;
+    if (decodeImageFile(file, width, height, pixels))
+        create(pixels.data(), width, height);
+}
+
+GdiWicBitmap::GdiWicBitmap(const BYTE* pixels, UINT width, UINT height) {
+    create(pixels, width, height);
+}
+
+void GdiWicBitmap::create(const BYTE* pixels, UINT width, UINT height) {
+    width_ = width;
+    height_ = height;
+    BYTE* bits = nullptr;
     bmp.emplace(create32bppBitmap(SIZE{ (long) width_, (long) height_ }, bits));
+    if (!bits)
+        return;
+    memcpy(bits, pixels, size_t(dibWidthBytes(width_ * 32)) * height_);
     GdiDC dcDesktop(GetDC(HWND_DESKTOP), HWND_DESKTOP);
     dcBmp.emplace(CreateCompatibleDC(dcDesktop));
     bmpSelector.emplace(*dcBmp, *bmp);
-    auto stride = dibWidthBytes((UINT) (width_ * 32));
-    auto bufferSize = stride * height_;
-    if (!SUCCEEDED(convertedFrame->CopyPixels(nullptr, stride, bufferSize, bits))) {
-        dcBmp.reset();
-    }
 }
 
 void GdiWicBitmap::paint(HDC dc, const RECT& destRect, const RECT& srcRect) {
@@ -24,8 +24,14 @@
 #include <wincodec.h>
 #include <wincodecsdk.h>
 #include <string>
+#include <string_view>
 #include "ComPtr.h"
+#include "Geometry.h"
+#include "DirtyRegion.h"
+#include "SurfacePool.h"
+#include "TextMeasureCache.h"
 #include <optional>
+#include <vector>
 
 void FillSolidRect( HDC dc, LPRECT rc, COLORREF color );
 void FillSolidRect( HDC dc, int l, int t, int w, int h, COLORREF color );
@@ -92,30 +98,86 @@ inline RECT pointSizeRect(const POINT& p, const SIZE& s) {
     return { p.x, p.y, p.x + s.cx, p.y + s.cy };
 }
 
+inline Ime::Rect toRect(const RECT& r) {
+    return { (int) r.left, (int) r.top, (int) r.right, (int) r.bottom };
+}
+inline RECT toRECT(const Ime::Rect& r) { return { r.left, r.top, r.right, r.bottom }; }
+inline SIZE toSIZE(const Ime::Size& s) { return { s.cx, s.cy }; }
+
+// Identity of a font created from lf at the given DPI, for TextMeasureCache.
+Ime::FontKey fontKey(const LOGFONT& lf, int dpi);
+
+// Measures text with GetTextExtentPoint32W. The font is only selected into
+// the DC while measuring.
+struct GdiTextMeasurer : Ime::TextMeasurer {
+    GdiTextMeasurer(HDC dc, HFONT font) : dc(dc), font(font) {}
+    Ime::Size measure(std::wstring_view text) override;
+private:
+    HDC dc;
+    HFONT font;
+};
+
+// A 32bpp DIB section with a memory DC it stays selected into.
+struct GdiSurface : NoCopy {
+    GdiSurface(SIZE size);
+
+    HDC dc() { return dc_; }
+    SIZE size() const { return size_; }
+
+    // pixels of row y, counted from the top (the DIB is bottom-up)
+    BYTE* row(int y) const { return bits_ + size_t(size_.cy - 1 - y) * size_.cx * 4; }
+
+    // makes the pixels in rect fully transparent
+    void clear(const RECT& rect);
+
+private:
+    SIZE size_;
+    BYTE* bits_ = NULL;
+    GdiObject<HBITMAP> bmp_;
+    GdiDC dc_;
+    GdiDCSelector bmpSelector_;
+};
+
+using GdiSurfacePool = Ime::SurfacePool<GdiSurface>;
+
+GdiSurfacePool::Allocator gdiSurfaceAllocator();
+
+// Draws text of one color into a scratch surface and alpha blends it onto
+// dcTarget on destruction. Only the boxes covered by the drawn text are
+// filled, converted and blended.
 struct GdiTextBlender {
-    GdiTextBlender(HDC dcTarget, SIZE size, COLORREF color, BYTE alpha);
-    SIZE operator()(const std::wstring& str, POINT point, HFONT font);
+    GdiTextBlender(HDC dcTarget, GdiSurfacePool& pool, SIZE size, COLORREF color, BYTE alpha);
+    SIZE operator()(std::wstring_view str, POINT point, HFONT font);
+    // same as above, with the text extent already known (see TextMeasureCache)
+    SIZE operator()(std::wstring_view str, POINT point, HFONT font, SIZE size);
     ~GdiTextBlender();
 
 private:
+    GdiSurfacePool::Lease surface;
     HDC dcTarget;
-    SIZE size;
+    HDC dc;
     COLORREF color;
     BYTE alpha;
-    BYTE* bits = NULL;
-    GdiObject<HBITMAP> bmp;
-    GdiDC dc;
-    GdiDCSelector bmpSelector;
+    Ime::DirtyRegion dirty;
 };
 
+// Decodes an image file with WIC into premultiplied BGRA pixels, rows from
+// top to bottom. Needs COM on the calling thread; it touches no GDI object,
+// so it may run on any thread.
+bool decodeImageFile(const wchar_t* file, UINT& width, UINT& height, std::vector<BYTE>& pixels);
+
 struct GdiWicBitmap {
     GdiWicBitmap(const wchar_t* file);
+    // from premultiplied BGRA pixels, rows in the order WIC decodes them
+    GdiWicBitmap(const BYTE* pixels, UINT width, UINT height);
     explicit operator bool() const { return !!dcBmp; }
     void paint(HDC dc, const RECT& destRect, const RECT& srcRect);
 
     auto width() const { return width_; }
     auto height() const { return height_; }
 private:
+    void create(const BYTE* pixels, UINT width, UINT height);
+
     std::optional<GdiObject<HBITMAP>> bmp;
     std::optional<GdiDC> dcBmp;
     std::optional<GdiDCSelector> bmpSelector;
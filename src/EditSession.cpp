@@ -23,8 +23,8 @@
 
 namespace Ime {
 
-EditSession::EditSession(ComPtr<ITfContext> context, std::function<void(EditSession*, TfEditCookie)>&& callback):
-    context_{std::move(context)},
+EditSession::EditSession(ComRef<ITfContext> context, std::function<void(EditSession*, TfEditCookie)>&& callback):
+    context_{context.get()},
     editCookie_{0},
     callback_{std::move(callback)} {
 }
@@ -31,9 +31,11 @@ class TextService;
 
 class EditSession: public ComObject<ComInterface<ITfEditSession>> {
 public:
-    EditSession(ComPtr<ITfContext> context, std::function<void(EditSession*, TfEditCookie)>&& callback);
+    // context is kept: a session requested with TF_ES_ASYNC can run after
+    // the caller released its own reference
+    EditSession(ComRef<ITfContext> context, std::function<void(EditSession*, TfEditCookie)>&& callback);
 
-    const ComPtr<ITfContext>& context() const {
+    ComRef<ITfContext> context() const {
         return context_;
     }
 
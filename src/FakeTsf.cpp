@@ -0,0 +1,1283 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#include "FakeTsf.h"
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+
+namespace Ime {
+
+bool GuidLess::operator()(const GUID& a, const GUID& b) const {
+    return memcmp(&a, &b, sizeof(GUID)) < 0;
+}
+
+// Where an anchor at position ends up once [start, end) is replaced by
+// length characters. Anchors inside the replaced text, or at the point
+// of an insertion, go to its end if they have forward gravity and to its
+// start otherwise.
+static LONG moveAnchor(LONG position, LONG start, LONG end, LONG length, bool forward) {
+    if (position < start)
+        return position;
+    if (position > end)
+        return position + length - (end - start);
+    if (start != end) {
+        if (position == start)
+            return start;
+        if (position == end)
+            return start + length;
+    }
+    return forward ? start + length : start;
+}
+
+static bool sameValue(const VARIANT& a, const VARIANT& b) {
+    if (a.vt != b.vt)
+        return false;
+    switch (a.vt) {
+    case VT_EMPTY:
+        return true;
+    case VT_I4:
+        return a.lVal == b.lVal;
+    case VT_BSTR:
+        return SysStringLen(a.bstrVal) == SysStringLen(b.bstrVal)
+            && memcmp(a.bstrVal, b.bstrVal, SysStringLen(a.bstrVal) * sizeof(OLECHAR)) == 0;
+    case VT_UNKNOWN:
+        return a.punkVal == b.punkVal;
+    }
+    return false;
+}
+
+// FakeSinkList
+
+HRESULT FakeSinkList::advise(REFIID riid, IUnknown* punk, DWORD* pdwCookie) {
+    static DWORD nextCookie = 0;
+    if (!punk || !pdwCookie)
+        return E_INVALIDARG;
+    *pdwCookie = TF_INVALID_COOKIE;
+    if (std::find(accepted_.begin(), accepted_.end(), riid) == accepted_.end())
+        return CONNECT_E_CANNOTCONNECT;
+    ComPtr<IUnknown> sink;
+    if (punk->QueryInterface(riid, (void**)&sink) != S_OK)
+        return CONNECT_E_CANNOTCONNECT;
+    if (++nextCookie == TF_INVALID_COOKIE)
+        ++nextCookie;
+    entries_.push_back(Entry{ riid, nextCookie, std::move(sink) });
+    *pdwCookie = nextCookie;
+    return S_OK;
+}
+
+HRESULT FakeSinkList::unadvise(DWORD cookie) {
+    auto it = std::find_if(entries_.begin(), entries_.end(),
+        [=](const Entry& entry) { return entry.cookie == cookie; });
+    if (it == entries_.end())
+        return CONNECT_E_NOCONNECTION;
+    entries_.erase(it);
+    return S_OK;
+}
+
+size_t FakeSinkList::count(REFIID riid) const {
+    return std::count_if(entries_.begin(), entries_.end(),
+        [&](const Entry& entry) { return entry.iid == riid; });
+}
+
+// FakeCompartment
+
+FakeCompartment::FakeCompartment(const GUID& guid) :
+    guid_(guid),
+    sinks_{ IID_ITfCompartmentEventSink } {
+    ::VariantInit(&value_);
+}
+
+FakeCompartment::~FakeCompartment() {
+    ::VariantClear(&value_);
+}
+
+DWORD FakeCompartment::intValue() const {
+    return value_.vt == VT_I4 ? (DWORD)value_.lVal : 0;
+}
+
+STDMETHODIMP FakeCompartment::SetValue(TfClientId tid, const VARIANT* pvarValue) {
+    if (!pvarValue)
+        return E_INVALIDARG;
+    if (sameValue(value_, *pvarValue))
+        return S_OK;
+    HRESULT hr = ::VariantCopy(&value_, pvarValue);
+    if (hr != S_OK)
+        return hr;
+    sinks_.forEach<ITfCompartmentEventSink>([&](ITfCompartmentEventSink* sink) {
+        sink->OnChange(guid_);
+    });
+    return S_OK;
+}
+
+STDMETHODIMP FakeCompartment::GetValue(VARIANT* pvarValue) {
+    if (!pvarValue)
+        return E_INVALIDARG;
+    ::VariantInit(pvarValue);
+    if (value_.vt == VT_EMPTY)
+        return S_FALSE;
+    return ::VariantCopy(pvarValue, &value_);
+}
+
+STDMETHODIMP FakeCompartment::AdviseSink(REFIID riid, IUnknown* punk, DWORD* pdwCookie) {
+    return sinks_.advise(riid, punk, pdwCookie);
+}
+
+STDMETHODIMP FakeCompartment::UnadviseSink(DWORD dwCookie) {
+    return sinks_.unadvise(dwCookie);
+}
+
+// FakeCompartmentMgr
+
+ComPtr<FakeCompartment> FakeCompartmentMgr::compartment(const GUID& guid) {
+    auto& compartment = compartments_[guid];
+    if (!compartment)
+        compartment = ComPtr<FakeCompartment>::make(guid);
+    return compartment;
+}
+
+STDMETHODIMP FakeCompartmentMgr::GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) {
+    if (!ppcomp)
+        return E_INVALIDARG;
+    auto result = compartment(rguid);
+    result->AddRef();
+    *ppcomp = result;
+    return S_OK;
+}
+
+STDMETHODIMP FakeCompartmentMgr::ClearCompartment(TfClientId tid, REFGUID rguid) {
+    compartments_.erase(rguid);
+    return S_OK;
+}
+
+// FakeRange
+
+FakeRange::FakeRange(FakeContext* context, LONG start, LONG end) :
+    context_(context),
+    start_(start),
+    end_(end) {
+    context_->ranges_.push_back(this);
+}
+
+FakeRange::~FakeRange() {
+    auto& ranges = context_->ranges_;
+    ranges.erase(std::find(ranges.begin(), ranges.end(), this));
+}
+
+FakeRange* FakeRange::sameContext(ITfRange* range) const {
+    auto other = dynamic_cast<FakeRange*>(range);
+    return (other && other->context_ == context_) ? other : nullptr;
+}
+
+HRESULT FakeRange::compare(TfEditCookie ec, LONG anchor, ITfRange* with, TfAnchor aPos, LONG* result) const {
+    if (!result)
+        return E_INVALIDARG;
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    auto other = sameContext(with);
+    if (!other)
+        return E_INVALIDARG;
+    LONG otherAnchor = (aPos == TF_ANCHOR_START) ? other->start_ : other->end_;
+    *result = (anchor < otherAnchor) ? -1 : (anchor > otherAnchor) ? 1 : 0;
+    return S_OK;
+}
+
+HRESULT FakeRange::shift(TfEditCookie ec, LONG& anchor, LONG cchReq, LONG* pcch) {
+    if (!pcch)
+        return E_INVALIDARG;
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    LONG moved = std::clamp<LONG>(anchor + cchReq, 0, (LONG)context_->text_.size());
+    *pcch = moved - anchor;
+    anchor = moved;
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::GetText(TfEditCookie ec, DWORD dwFlags, WCHAR* pchText, ULONG cchMax, ULONG* pcch) {
+    if (!pcch || (cchMax && !pchText))
+        return E_INVALIDARG;
+    *pcch = 0;
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    ULONG length = std::min<ULONG>(cchMax, ULONG(end_ - start_));
+    std::copy_n(context_->text_.data() + start_, length, pchText);
+    *pcch = length;
+    if (dwFlags & TF_TF_MOVESTART)
+        start_ += (LONG)length;
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::SetText(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch) {
+    if (!context_->hasLock(ec, true))
+        return TF_E_NOLOCK;
+    if (cch < 0)
+        cch = pchText ? (LONG)wcslen(pchText) : 0;
+    if (cch && !pchText)
+        return E_INVALIDARG;
+    // the anchors of this range end up around the new text
+    context_->replace(start_, end_, pchText, cch);
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::ShiftStart(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) {
+    HRESULT hr = shift(ec, start_, cchReq, pcch);
+    end_ = std::max(start_, end_);
+    return hr;
+}
+
+STDMETHODIMP FakeRange::ShiftEnd(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) {
+    HRESULT hr = shift(ec, end_, cchReq, pcch);
+    start_ = std::min(start_, end_);
+    return hr;
+}
+
+STDMETHODIMP FakeRange::ShiftStartToRange(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) {
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    auto other = sameContext(pRange);
+    if (!other)
+        return E_INVALIDARG;
+    start_ = (aPos == TF_ANCHOR_START) ? other->start_ : other->end_;
+    end_ = std::max(start_, end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::ShiftEndToRange(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) {
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    auto other = sameContext(pRange);
+    if (!other)
+        return E_INVALIDARG;
+    end_ = (aPos == TF_ANCHOR_START) ? other->start_ : other->end_;
+    start_ = std::min(start_, end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::IsEmpty(TfEditCookie ec, BOOL* pfEmpty) {
+    if (!pfEmpty)
+        return E_INVALIDARG;
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    *pfEmpty = (start_ == end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::Collapse(TfEditCookie ec, TfAnchor aPos) {
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    if (aPos == TF_ANCHOR_START)
+        end_ = start_;
+    else
+        start_ = end_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::IsEqualStart(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) {
+    if (!pfEqual)
+        return E_INVALIDARG;
+    LONG result;
+    HRESULT hr = compare(ec, start_, pWith, aPos, &result);
+    *pfEqual = (hr == S_OK && result == 0);
+    return hr;
+}
+
+STDMETHODIMP FakeRange::IsEqualEnd(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) {
+    if (!pfEqual)
+        return E_INVALIDARG;
+    LONG result;
+    HRESULT hr = compare(ec, end_, pWith, aPos, &result);
+    *pfEqual = (hr == S_OK && result == 0);
+    return hr;
+}
+
+STDMETHODIMP FakeRange::CompareStart(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) {
+    return compare(ec, start_, pWith, aPos, plResult);
+}
+
+STDMETHODIMP FakeRange::CompareEnd(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) {
+    return compare(ec, end_, pWith, aPos, plResult);
+}
+
+STDMETHODIMP FakeRange::Clone(ITfRange** ppClone) {
+    if (!ppClone)
+        return E_INVALIDARG;
+    *ppClone = new FakeRange(context_, start_, end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::GetContext(ITfContext** ppContext) {
+    if (!ppContext)
+        return E_INVALIDARG;
+    context_->AddRef();
+    *ppContext = context_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::GetExtent(LONG* pacpAnchor, LONG* pcch) {
+    if (!pacpAnchor || !pcch)
+        return E_INVALIDARG;
+    *pacpAnchor = start_;
+    *pcch = end_ - start_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeRange::SetExtent(LONG acpAnchor, LONG cch) {
+    if (acpAnchor < 0 || cch < 0 || acpAnchor + cch > (LONG)context_->text_.size())
+        return E_INVALIDARG;
+    start_ = acpAnchor;
+    end_ = acpAnchor + cch;
+    return S_OK;
+}
+
+// FakeComposition
+
+FakeComposition::FakeComposition(FakeContext* context, LONG start, LONG end, ITfCompositionSink* sink) :
+    context_(context),
+    range_(ComPtr<FakeRange>::make(context, start, end)),
+    sink_(sink) {
+}
+
+FakeComposition::~FakeComposition() {
+    if (context_ && context_->composition_ == this)
+        context_->composition_ = nullptr;
+}
+
+std::wstring FakeComposition::text() const {
+    return range_->context_->text().substr(range_->start(), range_->end() - range_->start());
+}
+
+void FakeComposition::detach() {
+    sink_ = nullptr;
+    context_ = nullptr;
+}
+
+STDMETHODIMP FakeComposition::GetRange(ITfRange** ppRange) {
+    return range_->Clone(ppRange);
+}
+
+STDMETHODIMP FakeComposition::ShiftStart(TfEditCookie ecWrite, ITfRange* pNewStart) {
+    if (isEnded())
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ecWrite, true))
+        return TF_E_NOLOCK;
+    auto start = range_->sameContext(pNewStart);
+    if (!start)
+        return E_INVALIDARG;
+    range_->start_ = start->start_;
+    range_->end_ = std::max(range_->start_, range_->end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeComposition::ShiftEnd(TfEditCookie ecWrite, ITfRange* pNewEnd) {
+    if (isEnded())
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ecWrite, true))
+        return TF_E_NOLOCK;
+    auto end = range_->sameContext(pNewEnd);
+    if (!end)
+        return E_INVALIDARG;
+    range_->end_ = end->end_;
+    range_->start_ = std::min(range_->start_, range_->end_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeComposition::EndComposition(TfEditCookie ecWrite) {
+    if (isEnded())
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ecWrite, true))
+        return TF_E_NOLOCK;
+    if (context_->composition_ == this)
+        context_->composition_ = nullptr;
+    detach();
+    return S_OK;
+}
+
+// FakeProperty
+
+FakeProperty::FakeProperty(FakeContext* context, const GUID& guid) :
+    context_(context),
+    guid_(guid) {
+}
+
+FakeProperty::~FakeProperty() {
+    for (auto& span : spans_)
+        ::VariantClear(&span.value);
+}
+
+const VARIANT* FakeProperty::valueAt(LONG position) const {
+    for (const auto& span : spans_) {
+        if (span.start <= position && position < span.end)
+            return &span.value;
+    }
+    return nullptr;
+}
+
+void FakeProperty::erase(LONG start, LONG end) {
+    std::vector<Span> kept;
+    for (auto& span : spans_) {
+        if (span.end <= start || span.start >= end) {
+            kept.push_back(span);
+            continue;
+        }
+        // keep the parts out of [start, end), each with its own copy of the value
+        for (auto part : { std::make_pair(span.start, start), std::make_pair(end, span.end) }) {
+            if (part.first < part.second) {
+                Span piece{ part.first, part.second, {} };
+                ::VariantInit(&piece.value);
+                ::VariantCopy(&piece.value, &span.value);
+                kept.push_back(piece);
+            }
+        }
+        ::VariantClear(&span.value);
+    }
+    spans_.swap(kept);
+}
+
+STDMETHODIMP FakeProperty::GetType(GUID* pguid) {
+    if (!pguid)
+        return E_INVALIDARG;
+    *pguid = guid_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeProperty::GetValue(TfEditCookie ec, ITfRange* pRange, VARIANT* pvarValue) {
+    if (!pvarValue)
+        return E_INVALIDARG;
+    ::VariantInit(pvarValue);
+    if (!context_)
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ec))
+        return TF_E_NOLOCK;
+    auto range = dynamic_cast<FakeRange*>(pRange);
+    if (!range)
+        return E_INVALIDARG;
+    if (auto value = valueAt(range->start()))
+        return ::VariantCopy(pvarValue, value);
+    return S_OK;
+}
+
+STDMETHODIMP FakeProperty::GetContext(ITfContext** ppContext) {
+    if (!ppContext)
+        return E_INVALIDARG;
+    *ppContext = context_;
+    if (!context_)
+        return E_UNEXPECTED;
+    context_->AddRef();
+    return S_OK;
+}
+
+STDMETHODIMP FakeProperty::SetValue(TfEditCookie ec, ITfRange* pRange, const VARIANT* pvarValue) {
+    if (!pvarValue)
+        return E_INVALIDARG;
+    if (!context_)
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ec, true))
+        return TF_E_NOLOCK;
+    auto range = dynamic_cast<FakeRange*>(pRange);
+    if (!range)
+        return E_INVALIDARG;
+    erase(range->start(), range->end());
+    if (range->start() < range->end()) {
+        Span span{ range->start(), range->end(), {} };
+        ::VariantInit(&span.value);
+        ::VariantCopy(&span.value, pvarValue);
+        spans_.push_back(span);
+    }
+    return S_OK;
+}
+
+STDMETHODIMP FakeProperty::Clear(TfEditCookie ec, ITfRange* pRange) {
+    if (!context_)
+        return E_UNEXPECTED;
+    if (!context_->hasLock(ec, true))
+        return TF_E_NOLOCK;
+    if (!pRange) {
+        erase(0, (LONG)context_->text().size());
+        return S_OK;
+    }
+    auto range = dynamic_cast<FakeRange*>(pRange);
+    if (!range)
+        return E_INVALIDARG;
+    erase(range->start(), range->end());
+    return S_OK;
+}
+
+// FakeContext
+
+FakeContext::FakeContext(FakeDocumentMgr* documentMgr) :
+    documentMgr_(documentMgr),
+    compartments_(ComPtr<FakeCompartmentMgr>::make()) {
+}
+
+FakeContext::~FakeContext() {
+    for (auto& property : properties_)
+        property.second->context_ = nullptr;
+}
+
+void FakeContext::setText(std::wstring text) {
+    replace(0, (LONG)text_.size(), text.data(), (LONG)text.size());
+    selectionStart_ = selectionEnd_ = (LONG)text_.size();
+}
+
+FakeProperty* FakeContext::property(const GUID& guid) const {
+    auto it = properties_.find(guid);
+    return it != properties_.end() ? (FakeProperty*)it->second : nullptr;
+}
+
+void FakeContext::replace(LONG start, LONG end, const WCHAR* text, LONG length) {
+    text_.replace(start, end - start, length ? text : L"", length);
+    for (auto range : ranges_) {
+        range->start_ = moveAnchor(range->start_, start, end, length, false);
+        range->end_ = moveAnchor(range->end_, start, end, length, true);
+    }
+    selectionStart_ = moveAnchor(selectionStart_, start, end, length, false);
+    selectionEnd_ = moveAnchor(selectionEnd_, start, end, length, true);
+    // values stay on the text they were set for
+    for (auto& property : properties_) {
+        auto& spans = property.second->spans_;
+        for (auto& span : spans) {
+            span.start = moveAnchor(span.start, start, end, length, false);
+            span.end = moveAnchor(span.end, start, end, length, false);
+            if (span.start == span.end)
+                ::VariantClear(&span.value);
+        }
+        spans.erase(std::remove_if(spans.begin(), spans.end(),
+            [](const FakeProperty::Span& span) { return span.start == span.end; }), spans.end());
+    }
+}
+
+void FakeContext::terminateComposition() {
+    if (!composition_)
+        return;
+    ComPtr<FakeContext> self(this);
+    ComPtr<FakeComposition> composition(composition_);
+    ComPtr<ITfCompositionSink> sink = composition->sink_;
+    composition_ = nullptr;
+    bool nested = (editCookie_ != TF_INVALID_EDIT_COOKIE);
+    if (!nested) {
+        editCookie_ = ++lastCookie_;
+        writable_ = true;
+    }
+    if (sink)
+        sink->OnCompositionTerminated(editCookie_, composition);
+    if (!nested) {
+        editCookie_ = TF_INVALID_EDIT_COOKIE;
+        writable_ = false;
+    }
+    composition->detach();
+}
+
+HRESULT FakeContext::runSession(TfClientId tid, ITfEditSession* session, DWORD flags) {
+    ComPtr<FakeContext> self(this);
+    if (++lastCookie_ == TF_INVALID_EDIT_COOKIE)
+        ++lastCookie_;
+    editCookie_ = lastCookie_;
+    writable_ = (flags & TF_ES_READWRITE) == TF_ES_READWRITE;
+    sessionClient_ = tid;
+    ++sessionCount_;
+    HRESULT hr = session->DoEditSession(editCookie_);
+    editCookie_ = TF_INVALID_EDIT_COOKIE;
+    writable_ = false;
+    sessionClient_ = TF_CLIENTID_NULL;
+    return hr;
+}
+
+STDMETHODIMP FakeContext::RequestEditSession(TfClientId tid, ITfEditSession* pes, DWORD dwFlags, HRESULT* phrSession) {
+    if (!pes || !phrSession)
+        return E_INVALIDARG;
+    if (editCookie_ != TF_INVALID_EDIT_COOKIE) {
+        bool write = (dwFlags & TF_ES_READWRITE) == TF_ES_READWRITE;
+        if ((dwFlags & TF_ES_SYNC) && tid == sessionClient_ && (writable_ || !write)) {
+            // within the lock the text service already holds
+            ++sessionCount_;
+            *phrSession = pes->DoEditSession(editCookie_);
+            return S_OK;
+        }
+        // the document is locked: queue it, like TSF does, unless it must run now
+        if (dwFlags & TF_ES_SYNC) {
+            *phrSession = TF_E_SYNCHRONOUS;
+            return S_OK;
+        }
+        pendingSessions_.push_back(PendingSession{ tid, pes, dwFlags });
+        *phrSession = TF_S_ASYNC;
+        return S_OK;
+    }
+    *phrSession = runSession(tid, pes, dwFlags);
+    while (!pendingSessions_.empty()) {
+        auto pending = std::move(pendingSessions_.front());
+        pendingSessions_.erase(pendingSessions_.begin());
+        runSession(pending.tid, pending.session, pending.flags);
+    }
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::InWriteSession(TfClientId tid, BOOL* pfWriteSession) {
+    if (!pfWriteSession)
+        return E_INVALIDARG;
+    *pfWriteSession = (editCookie_ != TF_INVALID_EDIT_COOKIE && writable_);
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetSelection(TfEditCookie ec, ULONG ulIndex, ULONG ulCount, TF_SELECTION* pSelection, ULONG* pcFetched) {
+    if (!pcFetched || (ulCount && !pSelection))
+        return E_INVALIDARG;
+    *pcFetched = 0;
+    if (!hasLock(ec))
+        return TF_E_NOLOCK;
+    // there is only one selection
+    if (ulIndex != TF_DEFAULT_SELECTION && ulIndex != 0)
+        return E_INVALIDARG;
+    if (ulCount == 0)
+        return S_OK;
+    pSelection[0].range = new FakeRange(this, selectionStart_, selectionEnd_);
+    pSelection[0].style.ase = TF_AE_END;
+    pSelection[0].style.fInterimChar = FALSE;
+    *pcFetched = 1;
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::SetSelection(TfEditCookie ec, ULONG ulCount, const TF_SELECTION* pSelection) {
+    if (!hasLock(ec, true))
+        return TF_E_NOLOCK;
+    if (ulCount == 0 || !pSelection)
+        return E_INVALIDARG;
+    auto range = dynamic_cast<FakeRange*>(pSelection[0].range);
+    if (!range || range->context_ != this)
+        return E_INVALIDARG;
+    selectionStart_ = range->start_;
+    selectionEnd_ = range->end_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetStart(TfEditCookie ec, ITfRange** ppStart) {
+    if (!ppStart)
+        return E_INVALIDARG;
+    *ppStart = nullptr;
+    if (!hasLock(ec))
+        return TF_E_NOLOCK;
+    *ppStart = new FakeRange(this, 0, 0);
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetEnd(TfEditCookie ec, ITfRange** ppEnd) {
+    if (!ppEnd)
+        return E_INVALIDARG;
+    *ppEnd = nullptr;
+    if (!hasLock(ec))
+        return TF_E_NOLOCK;
+    *ppEnd = new FakeRange(this, (LONG)text_.size(), (LONG)text_.size());
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetActiveView(ITfContextView** ppView) {
+    // nothing is shown on a screen
+    if (ppView)
+        *ppView = nullptr;
+    return E_NOTIMPL;
+}
+
+STDMETHODIMP FakeContext::GetProperty(REFGUID guidProp, ITfProperty** ppProp) {
+    if (!ppProp)
+        return E_INVALIDARG;
+    auto& property = properties_[guidProp];
+    if (!property)
+        property = ComPtr<FakeProperty>::make(this, guidProp);
+    property->AddRef();
+    *ppProp = property;
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetDocumentMgr(ITfDocumentMgr** ppDm) {
+    if (!ppDm)
+        return E_INVALIDARG;
+    *ppDm = documentMgr_;
+    if (!documentMgr_)
+        return S_FALSE;
+    documentMgr_->AddRef();
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::StartComposition(TfEditCookie ecWrite, ITfRange* pCompositionRange,
+    ITfCompositionSink* pSink, ITfComposition** ppComposition) {
+    if (!ppComposition)
+        return E_INVALIDARG;
+    *ppComposition = nullptr;
+    if (!hasLock(ecWrite, true))
+        return TF_E_NOLOCK;
+    auto range = dynamic_cast<FakeRange*>(pCompositionRange);
+    if (!range || range->context_ != this)
+        return E_INVALIDARG;
+    // one composition at a time
+    if (composition_)
+        return S_FALSE;
+    composition_ = new FakeComposition(this, range->start_, range->end_, pSink);
+    *ppComposition = composition_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::InsertTextAtSelection(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch, ITfRange** ppRange) {
+    if (ppRange)
+        *ppRange = nullptr;
+    if (dwFlags & TF_IAS_QUERYONLY) {
+        if (!ppRange)
+            return E_INVALIDARG;
+        if (!hasLock(ec))
+            return TF_E_NOLOCK;
+        *ppRange = new FakeRange(this, selectionStart_, selectionEnd_);
+        return S_OK;
+    }
+    if (!hasLock(ec, true))
+        return TF_E_NOLOCK;
+    if (cch < 0)
+        cch = pchText ? (LONG)wcslen(pchText) : 0;
+    if (cch && !pchText)
+        return E_INVALIDARG;
+    LONG start = selectionStart_;
+    replace(selectionStart_, selectionEnd_, pchText, cch);
+    selectionStart_ = selectionEnd_ = start + cch;
+    if (ppRange && !(dwFlags & TF_IAS_NOQUERY))
+        *ppRange = new FakeRange(this, start, start + cch);
+    return S_OK;
+}
+
+STDMETHODIMP FakeContext::GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) {
+    return compartments_->GetCompartment(rguid, ppcomp);
+}
+
+STDMETHODIMP FakeContext::ClearCompartment(TfClientId tid, REFGUID rguid) {
+    return compartments_->ClearCompartment(tid, rguid);
+}
+
+// FakeDocumentMgr
+
+FakeDocumentMgr::~FakeDocumentMgr() {
+    for (auto& context : contexts_) {
+        if (context->documentMgr_ == this)
+            context->documentMgr_ = nullptr;
+    }
+}
+
+ComPtr<FakeContext> FakeDocumentMgr::top() const {
+    return contexts_.empty() ? nullptr : contexts_.back();
+}
+
+STDMETHODIMP FakeDocumentMgr::CreateContext(TfClientId tidOwner, DWORD dwFlags, IUnknown* punk,
+    ITfContext** ppic, TfEditCookie* pecTextStore) {
+    if (!ppic || !pecTextStore)
+        return E_INVALIDARG;
+    *ppic = new FakeContext(this);
+    *pecTextStore = TF_INVALID_EDIT_COOKIE;
+    return S_OK;
+}
+
+STDMETHODIMP FakeDocumentMgr::Push(ITfContext* pic) {
+    auto context = dynamic_cast<FakeContext*>(pic);
+    if (!context)
+        return E_INVALIDARG;
+    // TSF allows a base context and one on top of it
+    if (contexts_.size() >= 2)
+        return E_FAIL;
+    context->documentMgr_ = this;
+    contexts_.emplace_back(context);
+    return S_OK;
+}
+
+STDMETHODIMP FakeDocumentMgr::Pop(DWORD dwFlags) {
+    if (contexts_.empty())
+        return E_FAIL;
+    if (dwFlags & 1) // TF_POPF_ALL
+        contexts_.clear();
+    else
+        contexts_.pop_back();
+    return S_OK;
+}
+
+STDMETHODIMP FakeDocumentMgr::GetTop(ITfContext** ppic) {
+    if (!ppic)
+        return E_INVALIDARG;
+    *ppic = contexts_.empty() ? nullptr : (FakeContext*)contexts_.back();
+    if (*ppic)
+        (*ppic)->AddRef();
+    return S_OK;
+}
+
+STDMETHODIMP FakeDocumentMgr::GetBase(ITfContext** ppic) {
+    if (!ppic)
+        return E_INVALIDARG;
+    *ppic = contexts_.empty() ? nullptr : (FakeContext*)contexts_.front();
+    if (*ppic)
+        (*ppic)->AddRef();
+    return S_OK;
+}
+
+// FakeThreadMgr
+
+// Presses or releases keyCode in states, like the system does before the
+// key message is sent: the generic modifier keys follow the left and right
+// ones, and lock keys toggle when pressed.
+static void updateKeyState(BYTE* states, UINT keyCode, bool down) {
+    auto set = [&](UINT key) {
+        if (down)
+            states[key] |= 0x80;
+        else
+            states[key] &= ~0x80;
+    };
+    set(keyCode);
+    switch (keyCode) {
+    case VK_SHIFT: set(VK_LSHIFT); break;
+    case VK_CONTROL: set(VK_LCONTROL); break;
+    case VK_MENU: set(VK_LMENU); break;
+    case VK_LSHIFT: case VK_RSHIFT: set(VK_SHIFT); break;
+    case VK_LCONTROL: case VK_RCONTROL: set(VK_CONTROL); break;
+    case VK_LMENU: case VK_RMENU: set(VK_MENU); break;
+    case VK_CAPITAL: case VK_NUMLOCK: case VK_SCROLL:
+        if (down)
+            states[keyCode] ^= 1;
+        break;
+    }
+}
+
+// whether the modifiers of a preserved key, among any, left and right,
+// match the keys held down
+static bool modifierMatches(UINT modifiers, UINT any, UINT left, UINT right, int vkLeft, int vkRight) {
+    bool leftDown = (GetKeyState(vkLeft) & 0x8000) != 0;
+    bool rightDown = (GetKeyState(vkRight) & 0x8000) != 0;
+    if (!(modifiers & (any | left | right)))
+        return !leftDown && !rightDown;
+    if (modifiers & any)
+        return leftDown || rightDown;
+    return (!(modifiers & left) || leftDown) && (!(modifiers & right) || rightDown);
+}
+
+static bool samePreservedKey(const TF_PRESERVEDKEY& a, const TF_PRESERVEDKEY& b) {
+    return a.uVKey == b.uVKey && a.uModifiers == b.uModifiers;
+}
+
+FakeThreadMgr::FakeThreadMgr() :
+    sinks_{ IID_ITfThreadMgrEventSink, IID_ITfActiveLanguageProfileNotifySink },
+    compartments_(ComPtr<FakeCompartmentMgr>::make()) {
+}
+
+FakeThreadMgr::~FakeThreadMgr() {
+}
+
+ComPtr<FakeCompartmentMgr> FakeThreadMgr::globalCompartments() {
+    static ComPtr<FakeCompartmentMgr> compartments = ComPtr<FakeCompartmentMgr>::make();
+    return compartments;
+}
+
+HRESULT FakeThreadMgr::activate(ITfTextInputProcessor* textService, DWORD flags) {
+    TfClientId tid;
+    ActivateEx(&tid, flags);
+    textService_ = textService;
+    if (auto textServiceEx = textService_.query<ITfTextInputProcessorEx>())
+        return textServiceEx->ActivateEx(this, tid, flags);
+    return textService_->Activate(this, tid);
+}
+
+HRESULT FakeThreadMgr::deactivate() {
+    HRESULT hr = S_OK;
+    if (textService_) {
+        hr = textService_->Deactivate();
+        textService_ = nullptr;
+    }
+    Deactivate();
+    return hr;
+}
+
+ComPtr<FakeContext> FakeThreadMgr::focusNewContext(std::wstring text) {
+    ComPtr<ITfDocumentMgr> document;
+    CreateDocumentMgr(&document);
+    auto context = ComPtr<FakeContext>::make();
+    context->setText(std::move(text));
+    document->Push(context);
+    sinks_.forEach<ITfThreadMgrEventSink>([&](ITfThreadMgrEventSink* sink) {
+        sink->OnPushContext(context);
+    });
+    SetFocus(document);
+    return context;
+}
+
+ComPtr<ITfContext> FakeThreadMgr::focusedContext() const {
+    if (auto context = focus_ ? focus_->top() : nullptr)
+        return ComPtr<ITfContext>(context);
+    return nullptr;
+}
+
+bool FakeThreadMgr::keyDown(UINT keyCode, LPARAM lParam) {
+    BYTE states[256];
+    ::GetKeyboardState(states);
+    updateKeyState(states, keyCode, true);
+    ::SetKeyboardState(states);
+    BOOL eaten = FALSE;
+    TestKeyDown(keyCode, lParam, &eaten);
+    if (eaten)
+        KeyDown(keyCode, lParam, &eaten);
+    return eaten != FALSE;
+}
+
+bool FakeThreadMgr::keyUp(UINT keyCode, LPARAM lParam) {
+    BYTE states[256];
+    ::GetKeyboardState(states);
+    updateKeyState(states, keyCode, false);
+    ::SetKeyboardState(states);
+    BOOL eaten = FALSE;
+    TestKeyUp(keyCode, lParam, &eaten);
+    if (eaten)
+        KeyUp(keyCode, lParam, &eaten);
+    return eaten != FALSE;
+}
+
+bool FakeThreadMgr::typeKey(UINT keyCode) {
+    bool eaten = keyDown(keyCode);
+    keyUp(keyCode);
+    return eaten;
+}
+
+const FakeThreadMgr::PreservedKey* FakeThreadMgr::findPreservedKey(WPARAM keyCode, bool keyUp) const {
+    for (const auto& preservedKey : preservedKeys_) {
+        UINT modifiers = preservedKey.key.uModifiers;
+        if (preservedKey.key.uVKey != keyCode || ((modifiers & TF_MOD_ON_KEYUP) != 0) != keyUp)
+            continue;
+        if ((modifiers & TF_MOD_IGNORE_ALL_MODIFIER)
+            || (modifierMatches(modifiers, TF_MOD_ALT, TF_MOD_LALT, TF_MOD_RALT, VK_LMENU, VK_RMENU)
+                && modifierMatches(modifiers, TF_MOD_CONTROL, TF_MOD_LCONTROL, TF_MOD_RCONTROL, VK_LCONTROL, VK_RCONTROL)
+                && modifierMatches(modifiers, TF_MOD_SHIFT, TF_MOD_LSHIFT, TF_MOD_RSHIFT, VK_LSHIFT, VK_RSHIFT))) {
+            return &preservedKey;
+        }
+    }
+    return nullptr;
+}
+
+HRESULT FakeThreadMgr::sendKey(KeyHandler handler, WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
+    if (!pfEaten)
+        return E_INVALIDARG;
+    *pfEaten = FALSE;
+    if (!keyEventSink_)
+        return S_OK;
+    // the sink may unadvise itself meanwhile
+    ComPtr<ITfKeyEventSink> sink = keyEventSink_;
+    auto context = focusedContext();
+    if (auto key = findPreservedKey(wParam, handler == &ITfKeyEventSink::OnKeyUp
+        || handler == &ITfKeyEventSink::OnTestKeyUp)) {
+        // TSF only tests whether a preserved key is wanted and sends it as
+        // OnPreservedKey() instead of the key itself
+        if (handler == &ITfKeyEventSink::OnTestKeyDown || handler == &ITfKeyEventSink::OnTestKeyUp) {
+            *pfEaten = TRUE;
+            return S_OK;
+        }
+        GUID guid = key->guid;
+        return sink->OnPreservedKey(context, guid, pfEaten);
+    }
+    return (sink->*handler)(context, wParam, lParam, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::Activate(TfClientId* ptid) {
+    static TfClientId nextClientId = 0;
+    if (!ptid)
+        return E_INVALIDARG;
+    if (clientId_ == TF_CLIENTID_NULL)
+        clientId_ = ++nextClientId;
+    *ptid = clientId_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::Deactivate() {
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::CreateDocumentMgr(ITfDocumentMgr** ppdim) {
+    if (!ppdim)
+        return E_INVALIDARG;
+    *ppdim = new FakeDocumentMgr();
+    sinks_.forEach<ITfThreadMgrEventSink>([&](ITfThreadMgrEventSink* sink) {
+        sink->OnInitDocumentMgr(*ppdim);
+    });
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::GetFocus(ITfDocumentMgr** ppdimFocus) {
+    if (!ppdimFocus)
+        return E_INVALIDARG;
+    *ppdimFocus = focus_;
+    if (!focus_)
+        return S_FALSE;
+    focus_->AddRef();
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::SetFocus(ITfDocumentMgr* pdimFocus) {
+    auto document = dynamic_cast<FakeDocumentMgr*>(pdimFocus);
+    if (pdimFocus && !document)
+        return E_INVALIDARG;
+    ComPtr<FakeDocumentMgr> previous = std::move(focus_);
+    focus_ = document;
+    if (focus_ != previous) {
+        sinks_.forEach<ITfThreadMgrEventSink>([&](ITfThreadMgrEventSink* sink) {
+            sink->OnSetFocus(focus_, previous);
+        });
+    }
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::IsThreadFocus(BOOL* pfThreadFocus) {
+    if (!pfThreadFocus)
+        return E_INVALIDARG;
+    *pfThreadFocus = TRUE;
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::GetGlobalCompartment(ITfCompartmentMgr** ppCompMgr) {
+    if (!ppCompMgr)
+        return E_INVALIDARG;
+    auto compartments = globalCompartments();
+    compartments->AddRef();
+    *ppCompMgr = compartments;
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::ActivateEx(TfClientId* ptid, DWORD dwFlags) {
+    activeFlags_ = dwFlags;
+    return Activate(ptid);
+}
+
+STDMETHODIMP FakeThreadMgr::GetActiveFlags(DWORD* lpdwFlags) {
+    if (!lpdwFlags)
+        return E_INVALIDARG;
+    *lpdwFlags = activeFlags_;
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::AdviseKeyEventSink(TfClientId tid, ITfKeyEventSink* pSink, BOOL fForeground) {
+    if (!pSink)
+        return E_INVALIDARG;
+    if (keyEventSink_)
+        return CONNECT_E_ADVISELIMIT;
+    keyEventSink_ = pSink;
+    keyEventSinkClient_ = tid;
+    if (fForeground)
+        pSink->OnSetFocus(TRUE);
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::UnadviseKeyEventSink(TfClientId tid) {
+    if (!keyEventSink_ || tid != keyEventSinkClient_)
+        return CONNECT_E_NOCONNECTION;
+    keyEventSink_ = nullptr;
+    keyEventSinkClient_ = TF_CLIENTID_NULL;
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::GetForeground(CLSID* pclsid) {
+    // the CLSIDs of the text services are not known here
+    return E_NOTIMPL;
+}
+
+STDMETHODIMP FakeThreadMgr::TestKeyDown(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
+    return sendKey(&ITfKeyEventSink::OnTestKeyDown, wParam, lParam, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::TestKeyUp(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
+    return sendKey(&ITfKeyEventSink::OnTestKeyUp, wParam, lParam, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::KeyDown(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
+    return sendKey(&ITfKeyEventSink::OnKeyDown, wParam, lParam, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::KeyUp(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
+    return sendKey(&ITfKeyEventSink::OnKeyUp, wParam, lParam, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::GetPreservedKey(ITfContext* pic, const TF_PRESERVEDKEY* pprekey, GUID* pguid) {
+    if (!pprekey || !pguid)
+        return E_INVALIDARG;
+    for (const auto& preservedKey : preservedKeys_) {
+        if (samePreservedKey(preservedKey.key, *pprekey)) {
+            *pguid = preservedKey.guid;
+            return S_OK;
+        }
+    }
+    *pguid = GUID_NULL;
+    return S_FALSE;
+}
+
+STDMETHODIMP FakeThreadMgr::IsPreservedKey(REFGUID rguid, const TF_PRESERVEDKEY* pprekey, BOOL* pfRegistered) {
+    if (!pprekey || !pfRegistered)
+        return E_INVALIDARG;
+    *pfRegistered = std::any_of(preservedKeys_.begin(), preservedKeys_.end(),
+        [&](const PreservedKey& preservedKey) {
+            return preservedKey.guid == rguid && samePreservedKey(preservedKey.key, *pprekey);
+        });
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::PreserveKey(TfClientId tid, REFGUID rguid, const TF_PRESERVEDKEY* prekey,
+    const WCHAR* pchDesc, ULONG cchDesc) {
+    if (!prekey)
+        return E_INVALIDARG;
+    for (const auto& preservedKey : preservedKeys_) {
+        if (samePreservedKey(preservedKey.key, *prekey))
+            return TF_E_ALREADY_EXISTS;
+    }
+    preservedKeys_.push_back(PreservedKey{ rguid, *prekey,
+        pchDesc ? std::wstring(pchDesc, cchDesc) : std::wstring() });
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::UnpreserveKey(REFGUID rguid, const TF_PRESERVEDKEY* pprekey) {
+    if (!pprekey)
+        return E_INVALIDARG;
+    auto it = std::find_if(preservedKeys_.begin(), preservedKeys_.end(),
+        [&](const PreservedKey& preservedKey) {
+            return preservedKey.guid == rguid && samePreservedKey(preservedKey.key, *pprekey);
+        });
+    if (it == preservedKeys_.end())
+        return CONNECT_E_NOCONNECTION;
+    preservedKeys_.erase(it);
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::SetPreservedKeyDescription(REFGUID rguid, const WCHAR* pchDesc, ULONG cchDesc) {
+    for (auto& preservedKey : preservedKeys_) {
+        if (preservedKey.guid == rguid) {
+            preservedKey.description = pchDesc ? std::wstring(pchDesc, cchDesc) : std::wstring();
+            return S_OK;
+        }
+    }
+    return E_INVALIDARG;
+}
+
+STDMETHODIMP FakeThreadMgr::GetPreservedKeyDescription(REFGUID rguid, BSTR* pbstrDesc) {
+    if (!pbstrDesc)
+        return E_INVALIDARG;
+    *pbstrDesc = nullptr;
+    for (const auto& preservedKey : preservedKeys_) {
+        if (preservedKey.guid == rguid) {
+            *pbstrDesc = ::SysAllocStringLen(preservedKey.description.data(), (UINT)preservedKey.description.size());
+            return *pbstrDesc ? S_OK : E_OUTOFMEMORY;
+        }
+    }
+    return E_INVALIDARG;
+}
+
+STDMETHODIMP FakeThreadMgr::SimulatePreservedKey(ITfContext* pic, REFGUID rguid, BOOL* pfEaten) {
+    if (!pfEaten)
+        return E_INVALIDARG;
+    *pfEaten = FALSE;
+    if (!keyEventSink_)
+        return S_OK;
+    ComPtr<ITfKeyEventSink> sink = keyEventSink_;
+    return sink->OnPreservedKey(pic, rguid, pfEaten);
+}
+
+STDMETHODIMP FakeThreadMgr::AdviseSink(REFIID riid, IUnknown* punk, DWORD* pdwCookie) {
+    return sinks_.advise(riid, punk, pdwCookie);
+}
+
+STDMETHODIMP FakeThreadMgr::UnadviseSink(DWORD dwCookie) {
+    return sinks_.unadvise(dwCookie);
+}
+
+STDMETHODIMP FakeThreadMgr::GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) {
+    return compartments_->GetCompartment(rguid, ppcomp);
+}
+
+STDMETHODIMP FakeThreadMgr::ClearCompartment(TfClientId tid, REFGUID rguid) {
+    return compartments_->ClearCompartment(tid, rguid);
+}
+
+STDMETHODIMP FakeThreadMgr::AddItem(ITfLangBarItem* punk) {
+    if (!punk || std::find(langBarItems_.begin(), langBarItems_.end(), punk) != langBarItems_.end())
+        return E_INVALIDARG;
+    langBarItems_.emplace_back(punk);
+    return S_OK;
+}
+
+STDMETHODIMP FakeThreadMgr::RemoveItem(ITfLangBarItem* punk) {
+    auto it = std::find(langBarItems_.begin(), langBarItems_.end(), punk);
+    if (it == langBarItems_.end())
+        return E_INVALIDARG;
+    langBarItems_.erase(it);
+    return S_OK;
+}
+
+// FakeKeystrokeTarget
+
+ComPtr<FakeContext> FakeKeystrokeTarget::context(uint32_t contextId) {
+    auto& context = contexts_[contextId];
+    if (!context)
+        context = threadMgr_->focusNewContext();
+    return context;
+}
+
+void FakeKeystrokeTarget::prepare(const KeyEvent& event, uint32_t contextId) {
+    auto target = context(contextId);
+    ComPtr<ITfDocumentMgr> document;
+    if (target->GetDocumentMgr(&document) == S_OK && document != threadMgr_->focus())
+        threadMgr_->SetFocus(document);
+
+    // the modifiers as the system would have them
+    static const struct {
+        UINT keyCode;
+        uint16_t modifier;
+    } modifierKeys[] = {
+        { VK_SHIFT, ModifierShift }, { VK_LSHIFT, ModifierLeftShift }, { VK_RSHIFT, ModifierRightShift },
+        { VK_CONTROL, ModifierCtrl }, { VK_LCONTROL, ModifierLeftCtrl }, { VK_RCONTROL, ModifierRightCtrl },
+        { VK_MENU, ModifierAlt }, { VK_LMENU, ModifierLeftAlt }, { VK_RMENU, ModifierRightAlt },
+        { VK_LWIN, ModifierLeftWin }, { VK_RWIN, ModifierRightWin },
+    };
+    static const struct {
+        UINT keyCode;
+        uint16_t modifier;
+    } lockKeys[] = {
+        { VK_CAPITAL, ModifierCapsLock }, { VK_NUMLOCK, ModifierNumLock }, { VK_SCROLL, ModifierScrollLock },
+    };
+    BYTE states[256];
+    ::GetKeyboardState(states);
+    uint16_t modifiers = event.modifiers();
+    for (const auto& key : modifierKeys)
+        states[key.keyCode] = (modifiers & key.modifier) ? 0x80 : 0;
+    for (const auto& key : lockKeys)
+        states[key.keyCode] = (modifiers & key.modifier) ? 1 : 0;
+    ::SetKeyboardState(states);
+}
+
+bool FakeKeystrokeTarget::testKey(KeyEvent& event, uint32_t contextId) {
+    prepare(event, contextId);
+    BOOL eaten = FALSE;
+    if (event.type() == WM_KEYDOWN)
+        threadMgr_->TestKeyDown(event.keyCode(), event.lParam(), &eaten);
+    else
+        threadMgr_->TestKeyUp(event.keyCode(), event.lParam(), &eaten);
+    return eaten != FALSE;
+}
+
+bool FakeKeystrokeTarget::handleKey(KeyEvent& event, uint32_t contextId) {
+    prepare(event, contextId);
+    BOOL eaten = FALSE;
+    if (event.type() == WM_KEYDOWN)
+        threadMgr_->KeyDown(event.keyCode(), event.lParam(), &eaten);
+    else
+        threadMgr_->KeyUp(event.keyCode(), event.lParam(), &eaten);
+    return eaten != FALSE;
+}
+
+} // namespace Ime
@@ -0,0 +1,584 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef IME_FAKE_TSF_H
+#define IME_FAKE_TSF_H
+
+// In-memory stand-ins for the TSF manager of a thread, its documents and
+// their text, to drive a TextService without Windows (see compat/msctf.h).
+// They are strict where a text service could go wrong on Windows: text is
+// only read or changed with the cookie of a running edit session, and a
+// synchronous session requested meanwhile only runs if it is of the same
+// text service and needs no more than the lock it holds. Single-threaded,
+// like TSF itself.
+
+#include <msctf.h>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+#include "ComObject.h"
+#include "ComPtr.h"
+#include "KeystrokeReplay.h"
+
+namespace Ime {
+
+class FakeContext;
+class FakeDocumentMgr;
+
+struct GuidLess {
+    bool operator()(const GUID& a, const GUID& b) const;
+};
+
+// The AddRef() and Release() calls made on all the fakes so far. TSF
+// objects are shared by threads, so on Windows each is an interlocked
+// operation a text service should not waste on every key.
+inline size_t fakeRefCountCalls = 0;
+
+// The QueryInterface() calls made on all the fakes so far. On Windows the
+// thread manager may be a proxy, making each a round trip.
+inline size_t fakeQueryInterfaceCalls = 0;
+
+// A ComObject adding its calls to fakeRefCountCalls and fakeQueryInterfaceCalls.
+template <typename FirstInterface, typename... ComInterfaces>
+class FakeComObject : public ComObject<FirstInterface, ComInterfaces...> {
+public:
+    STDMETHODIMP QueryInterface(REFIID riid, void** ppvObj) override {
+        ++fakeQueryInterfaceCalls;
+        return ComObject<FirstInterface, ComInterfaces...>::QueryInterface(riid, ppvObj);
+    }
+
+    STDMETHODIMP_(ULONG) AddRef() override {
+        ++fakeRefCountCalls;
+        return ComObject<FirstInterface, ComInterfaces...>::AddRef();
+    }
+
+    STDMETHODIMP_(ULONG) Release() override {
+        ++fakeRefCountCalls;
+        return ComObject<FirstInterface, ComInterfaces...>::Release();
+    }
+};
+
+// The sinks advised to an ITfSource.
+class FakeSinkList {
+public:
+    // only sinks of the given interfaces are accepted
+    explicit FakeSinkList(std::initializer_list<IID> accepted) : accepted_(accepted) {}
+
+    HRESULT advise(REFIID riid, IUnknown* punk, DWORD* pdwCookie);
+    HRESULT unadvise(DWORD cookie);
+
+    // calls f(Sink*) for every sink of that interface; sinks may unadvise meanwhile
+    template <typename Sink, typename F>
+    void forEach(F f) const {
+        std::vector<ComPtr<IUnknown>> sinks;
+        for (const auto& entry : entries_) {
+            if (entry.iid == __uuidof(Sink))
+                sinks.push_back(entry.sink);
+        }
+        for (auto& sink : sinks)
+            f(static_cast<Sink*>(static_cast<IUnknown*>(sink)));
+    }
+
+    size_t count(REFIID riid) const;
+
+private:
+    struct Entry {
+        IID iid;
+        DWORD cookie;
+        // the pointer to the interface iid, not to IUnknown
+        ComPtr<IUnknown> sink;
+    };
+
+    std::vector<IID> accepted_;
+    std::vector<Entry> entries_;
+};
+
+// A value in a compartment, and the ITfCompartmentEventSinks told when it changes.
+class FakeCompartment :
+    public FakeComObject<ComInterface<ITfCompartment>, ComInterface<ITfSource>> {
+public:
+    explicit FakeCompartment(const GUID& guid);
+
+    // the value as a VT_I4, like TextService::compartmentValue(); 0 if there is none
+    DWORD intValue() const;
+
+    size_t sinkCount() const {
+        return sinks_.count(IID_ITfCompartmentEventSink);
+    }
+
+    // ITfCompartment
+    STDMETHODIMP SetValue(TfClientId tid, const VARIANT* pvarValue) override;
+    STDMETHODIMP GetValue(VARIANT* pvarValue) override;
+
+    // ITfSource
+    STDMETHODIMP AdviseSink(REFIID riid, IUnknown* punk, DWORD* pdwCookie) override;
+    STDMETHODIMP UnadviseSink(DWORD dwCookie) override;
+
+protected:
+    ~FakeCompartment() override;
+
+private:
+    GUID guid_;
+    VARIANT value_;
+    FakeSinkList sinks_;
+};
+
+// The compartments of a thread manager, of a context, or global ones.
+// Compartments are created when first asked for.
+class FakeCompartmentMgr : public FakeComObject<ComInterface<ITfCompartmentMgr>> {
+public:
+    ComPtr<FakeCompartment> compartment(const GUID& guid);
+
+    // ITfCompartmentMgr
+    STDMETHODIMP GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) override;
+    STDMETHODIMP ClearCompartment(TfClientId tid, REFGUID rguid) override;
+
+private:
+    std::map<GUID, ComPtr<FakeCompartment>, GuidLess> compartments_;
+};
+
+// A span of the text of a FakeContext. Its anchors follow the edits of
+// the text like those of TSF: the start one stays before text inserted
+// at it, the end one moves after it.
+class FakeRange : public FakeComObject<ComInterface<ITfRangeACP, ITfRange>> {
+public:
+    FakeRange(FakeContext* context, LONG start, LONG end);
+
+    LONG start() const {
+        return start_;
+    }
+
+    LONG end() const {
+        return end_;
+    }
+
+    // ITfRange
+    STDMETHODIMP GetText(TfEditCookie ec, DWORD dwFlags, WCHAR* pchText, ULONG cchMax, ULONG* pcch) override;
+    STDMETHODIMP SetText(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch) override;
+    STDMETHODIMP ShiftStart(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) override;
+    STDMETHODIMP ShiftEnd(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) override;
+    STDMETHODIMP ShiftStartToRange(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) override;
+    STDMETHODIMP ShiftEndToRange(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) override;
+    STDMETHODIMP IsEmpty(TfEditCookie ec, BOOL* pfEmpty) override;
+    STDMETHODIMP Collapse(TfEditCookie ec, TfAnchor aPos) override;
+    STDMETHODIMP IsEqualStart(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) override;
+    STDMETHODIMP IsEqualEnd(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) override;
+    STDMETHODIMP CompareStart(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) override;
+    STDMETHODIMP CompareEnd(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) override;
+    STDMETHODIMP Clone(ITfRange** ppClone) override;
+    STDMETHODIMP GetContext(ITfContext** ppContext) override;
+
+    // ITfRangeACP
+    STDMETHODIMP GetExtent(LONG* pacpAnchor, LONG* pcch) override;
+    STDMETHODIMP SetExtent(LONG acpAnchor, LONG cch) override;
+
+protected:
+    ~FakeRange() override;
+
+private:
+    friend class FakeContext;
+    friend class FakeComposition;
+
+    // the range of the same context, or nullptr
+    FakeRange* sameContext(ITfRange* range) const;
+    HRESULT compare(TfEditCookie ec, LONG anchor, ITfRange* with, TfAnchor aPos, LONG* result) const;
+    HRESULT shift(TfEditCookie ec, LONG& anchor, LONG cchReq, LONG* pcch);
+
+    ComPtr<FakeContext> context_;
+    LONG start_;
+    LONG end_;
+};
+
+// A composition started by ITfContextComposition::StartComposition().
+class FakeComposition : public FakeComObject<ComInterface<ITfComposition>> {
+public:
+    FakeComposition(FakeContext* context, LONG start, LONG end, ITfCompositionSink* sink);
+
+    LONG start() const {
+        return range_->start();
+    }
+
+    LONG end() const {
+        return range_->end();
+    }
+
+    std::wstring text() const;
+
+    bool isEnded() const {
+        return context_ == nullptr;
+    }
+
+    // ITfComposition
+    STDMETHODIMP GetRange(ITfRange** ppRange) override;
+    STDMETHODIMP ShiftStart(TfEditCookie ecWrite, ITfRange* pNewStart) override;
+    STDMETHODIMP ShiftEnd(TfEditCookie ecWrite, ITfRange* pNewEnd) override;
+    STDMETHODIMP EndComposition(TfEditCookie ecWrite) override;
+
+protected:
+    ~FakeComposition() override;
+
+private:
+    friend class FakeContext;
+
+    // called by the context once the composition ended
+    void detach();
+
+    ComPtr<FakeContext> context_;
+    ComPtr<FakeRange> range_;
+    ComPtr<ITfCompositionSink> sink_;
+};
+
+// Values of a property of the text, such as GUID_PROP_ATTRIBUTE, over spans.
+class FakeProperty : public FakeComObject<ComInterface<ITfProperty, ITfReadOnlyProperty>> {
+public:
+    FakeProperty(FakeContext* context, const GUID& guid);
+
+    // the value at the character at position, or nullptr
+    const VARIANT* valueAt(LONG position) const;
+
+    // the number of spans with a value
+    size_t spanCount() const {
+        return spans_.size();
+    }
+
+    // ITfReadOnlyProperty
+    STDMETHODIMP GetType(GUID* pguid) override;
+    STDMETHODIMP GetValue(TfEditCookie ec, ITfRange* pRange, VARIANT* pvarValue) override;
+    STDMETHODIMP GetContext(ITfContext** ppContext) override;
+
+    // ITfProperty
+    STDMETHODIMP SetValue(TfEditCookie ec, ITfRange* pRange, const VARIANT* pvarValue) override;
+    STDMETHODIMP Clear(TfEditCookie ec, ITfRange* pRange) override;
+
+protected:
+    ~FakeProperty() override;
+
+private:
+    friend class FakeContext;
+
+    struct Span {
+        LONG start;
+        LONG end;
+        VARIANT value;
+    };
+
+    // removes the values over [start, end)
+    void erase(LONG start, LONG end);
+
+    // the context owns the property; cleared when it goes away
+    FakeContext* context_;
+    GUID guid_;
+    std::vector<Span> spans_;
+};
+
+// The text of a document, with one selection and at most one composition.
+class FakeContext :
+    public FakeComObject<
+        ComInterface<ITfContext>,
+        ComInterface<ITfContextComposition>,
+        ComInterface<ITfInsertAtSelection>,
+        ComInterface<ITfCompartmentMgr>
+    > {
+public:
+    explicit FakeContext(FakeDocumentMgr* documentMgr = nullptr);
+
+    const std::wstring& text() const {
+        return text_;
+    }
+
+    // replaces the text, outside edit sessions, like the user of the
+    // application would; the selection is collapsed at its end
+    void setText(std::wstring text);
+
+    LONG selectionStart() const {
+        return selectionStart_;
+    }
+
+    LONG selectionEnd() const {
+        return selectionEnd_;
+    }
+
+    // the running composition, or nullptr
+    FakeComposition* composition() const {
+        return composition_;
+    }
+
+    // the property, or nullptr if nobody asked for it
+    FakeProperty* property(const GUID& guid) const;
+
+    const ComPtr<FakeCompartmentMgr>& compartments() const {
+        return compartments_;
+    }
+
+    // the number of edit sessions run so far
+    size_t sessionCount() const {
+        return sessionCount_;
+    }
+
+    // Ends the composition as if the application did, such as when the
+    // document loses the focus: its sink is told with
+    // OnCompositionTerminated() in a write session.
+    void terminateComposition();
+
+    // whether ec is the cookie of the running session, with write access if asked
+    bool hasLock(TfEditCookie ec, bool write = false) const {
+        return ec != TF_INVALID_EDIT_COOKIE && ec == editCookie_ && (!write || writable_);
+    }
+
+    // ITfContext
+    STDMETHODIMP RequestEditSession(TfClientId tid, ITfEditSession* pes, DWORD dwFlags, HRESULT* phrSession) override;
+    STDMETHODIMP InWriteSession(TfClientId tid, BOOL* pfWriteSession) override;
+    STDMETHODIMP GetSelection(TfEditCookie ec, ULONG ulIndex, ULONG ulCount, TF_SELECTION* pSelection, ULONG* pcFetched) override;
+    STDMETHODIMP SetSelection(TfEditCookie ec, ULONG ulCount, const TF_SELECTION* pSelection) override;
+    STDMETHODIMP GetStart(TfEditCookie ec, ITfRange** ppStart) override;
+    STDMETHODIMP GetEnd(TfEditCookie ec, ITfRange** ppEnd) override;
+    STDMETHODIMP GetActiveView(ITfContextView** ppView) override;
+    STDMETHODIMP GetProperty(REFGUID guidProp, ITfProperty** ppProp) override;
+    STDMETHODIMP GetDocumentMgr(ITfDocumentMgr** ppDm) override;
+
+    // ITfContextComposition
+    STDMETHODIMP StartComposition(TfEditCookie ecWrite, ITfRange* pCompositionRange,
+        ITfCompositionSink* pSink, ITfComposition** ppComposition) override;
+
+    // ITfInsertAtSelection
+    STDMETHODIMP InsertTextAtSelection(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch, ITfRange** ppRange) override;
+
+    // ITfCompartmentMgr
+    STDMETHODIMP GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) override;
+    STDMETHODIMP ClearCompartment(TfClientId tid, REFGUID rguid) override;
+
+protected:
+    ~FakeContext() override;
+
+private:
+    friend class FakeRange;
+    friend class FakeComposition;
+    friend class FakeDocumentMgr;
+
+    struct PendingSession {
+        TfClientId tid;
+        ComPtr<ITfEditSession> session;
+        DWORD flags;
+    };
+
+    HRESULT runSession(TfClientId tid, ITfEditSession* session, DWORD flags);
+    // replaces [start, end) with text and moves all the anchors after it
+    void replace(LONG start, LONG end, const WCHAR* text, LONG length);
+
+    std::wstring text_;
+    LONG selectionStart_ = 0;
+    LONG selectionEnd_ = 0;
+    FakeDocumentMgr* documentMgr_;
+    // the ranges alive, whose anchors move with the edits
+    std::vector<FakeRange*> ranges_;
+    // owned by the text service; forgotten once it ended
+    FakeComposition* composition_ = nullptr;
+    std::map<GUID, ComPtr<FakeProperty>, GuidLess> properties_;
+    ComPtr<FakeCompartmentMgr> compartments_;
+    TfEditCookie editCookie_ = TF_INVALID_EDIT_COOKIE;
+    TfEditCookie lastCookie_ = TF_INVALID_EDIT_COOKIE;
+    bool writable_ = false;
+    // the text service of the running session
+    TfClientId sessionClient_ = TF_CLIENTID_NULL;
+    std::vector<PendingSession> pendingSessions_;
+    size_t sessionCount_ = 0;
+};
+
+// A document: a stack of at most two contexts.
+class FakeDocumentMgr : public FakeComObject<ComInterface<ITfDocumentMgr>> {
+public:
+    // the top context, or nullptr
+    ComPtr<FakeContext> top() const;
+
+    // ITfDocumentMgr
+    STDMETHODIMP CreateContext(TfClientId tidOwner, DWORD dwFlags, IUnknown* punk,
+        ITfContext** ppic, TfEditCookie* pecTextStore) override;
+    STDMETHODIMP Push(ITfContext* pic) override;
+    STDMETHODIMP Pop(DWORD dwFlags) override;
+    STDMETHODIMP GetTop(ITfContext** ppic) override;
+    STDMETHODIMP GetBase(ITfContext** ppic) override;
+
+protected:
+    ~FakeDocumentMgr() override;
+
+private:
+    std::vector<ComPtr<FakeContext>> contexts_;
+};
+
+// The TSF manager of a thread: documents, the focus, the keystrokes given
+// to the key event sink, preserved keys, compartments and the language
+// bar items. The global compartments are shared by all of them.
+class FakeThreadMgr :
+    public FakeComObject<
+        ComInterface<ITfThreadMgrEx, ITfThreadMgr>,
+        ComInterface<ITfKeystrokeMgr>,
+        ComInterface<ITfSource>,
+        ComInterface<ITfCompartmentMgr>,
+        ComInterface<ITfLangBarItemMgr>
+    > {
+public:
+    FakeThreadMgr();
+
+    // Activates textService like TSF does when the user picks it, with the
+    // flags of ITfThreadMgrEx::ActivateEx().
+    HRESULT activate(ITfTextInputProcessor* textService, DWORD flags = 0);
+    HRESULT deactivate();
+
+    TfClientId clientId() const {
+        return clientId_;
+    }
+
+    // Creates a document with one context holding text and gives it the
+    // focus. Returns the context.
+    ComPtr<FakeContext> focusNewContext(std::wstring text = std::wstring());
+
+    // the focused document, or nullptr
+    const ComPtr<FakeDocumentMgr>& focus() const {
+        return focus_;
+    }
+
+    // The key events of a message loop: the key is tested and, if the sink
+    // wants it, handled. The keyboard state of the thread is updated before
+    // (see SetKeyboardState()). Return whether the key was eaten.
+    bool keyDown(UINT keyCode, LPARAM lParam = 1);
+    bool keyUp(UINT keyCode, LPARAM lParam = 0xC0000001);
+    // keyDown() then keyUp(); returns whether the key down was eaten
+    bool typeKey(UINT keyCode);
+
+    const ComPtr<ITfKeyEventSink>& keyEventSink() const {
+        return keyEventSink_;
+    }
+
+    size_t preservedKeyCount() const {
+        return preservedKeys_.size();
+    }
+
+    const std::vector<ComPtr<ITfLangBarItem>>& langBarItems() const {
+        return langBarItems_;
+    }
+
+    size_t sinkCount(REFIID riid) const {
+        return sinks_.count(riid);
+    }
+
+    const ComPtr<FakeCompartmentMgr>& compartments() const {
+        return compartments_;
+    }
+
+    // the compartments of GetGlobalCompartment(), shared by the process
+    static ComPtr<FakeCompartmentMgr> globalCompartments();
+
+    // ITfThreadMgr
+    STDMETHODIMP Activate(TfClientId* ptid) override;
+    STDMETHODIMP Deactivate() override;
+    STDMETHODIMP CreateDocumentMgr(ITfDocumentMgr** ppdim) override;
+    STDMETHODIMP GetFocus(ITfDocumentMgr** ppdimFocus) override;
+    STDMETHODIMP SetFocus(ITfDocumentMgr* pdimFocus) override;
+    STDMETHODIMP IsThreadFocus(BOOL* pfThreadFocus) override;
+    STDMETHODIMP GetGlobalCompartment(ITfCompartmentMgr** ppCompMgr) override;
+
+    // ITfThreadMgrEx
+    STDMETHODIMP ActivateEx(TfClientId* ptid, DWORD dwFlags) override;
+    STDMETHODIMP GetActiveFlags(DWORD* lpdwFlags) override;
+
+    // ITfKeystrokeMgr
+    STDMETHODIMP AdviseKeyEventSink(TfClientId tid, ITfKeyEventSink* pSink, BOOL fForeground) override;
+    STDMETHODIMP UnadviseKeyEventSink(TfClientId tid) override;
+    STDMETHODIMP GetForeground(CLSID* pclsid) override;
+    STDMETHODIMP TestKeyDown(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) override;
+    STDMETHODIMP TestKeyUp(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) override;
+    STDMETHODIMP KeyDown(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) override;
+    STDMETHODIMP KeyUp(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) override;
+    STDMETHODIMP GetPreservedKey(ITfContext* pic, const TF_PRESERVEDKEY* pprekey, GUID* pguid) override;
+    STDMETHODIMP IsPreservedKey(REFGUID rguid, const TF_PRESERVEDKEY* pprekey, BOOL* pfRegistered) override;
+    STDMETHODIMP PreserveKey(TfClientId tid, REFGUID rguid, const TF_PRESERVEDKEY* prekey,
+        const WCHAR* pchDesc, ULONG cchDesc) override;
+    STDMETHODIMP UnpreserveKey(REFGUID rguid, const TF_PRESERVEDKEY* pprekey) override;
+    STDMETHODIMP SetPreservedKeyDescription(REFGUID rguid, const WCHAR* pchDesc, ULONG cchDesc) override;
+    STDMETHODIMP GetPreservedKeyDescription(REFGUID rguid, BSTR* pbstrDesc) override;
+    STDMETHODIMP SimulatePreservedKey(ITfContext* pic, REFGUID rguid, BOOL* pfEaten) override;
+
+    // ITfSource
+    STDMETHODIMP AdviseSink(REFIID riid, IUnknown* punk, DWORD* pdwCookie) override;
+    STDMETHODIMP UnadviseSink(DWORD dwCookie) override;
+
+    // ITfCompartmentMgr
+    STDMETHODIMP GetCompartment(REFGUID rguid, ITfCompartment** ppcomp) override;
+    STDMETHODIMP ClearCompartment(TfClientId tid, REFGUID rguid) override;
+
+    // ITfLangBarItemMgr
+    STDMETHODIMP AddItem(ITfLangBarItem* punk) override;
+    STDMETHODIMP RemoveItem(ITfLangBarItem* punk) override;
+
+protected:
+    ~FakeThreadMgr() override;
+
+private:
+    struct PreservedKey {
+        GUID guid;
+        TF_PRESERVEDKEY key;
+        std::wstring description;
+    };
+
+    // the preserved key matching the key and the keyboard state, or nullptr
+    const PreservedKey* findPreservedKey(WPARAM keyCode, bool keyUp) const;
+    // the top context of the focused document, or nullptr
+    ComPtr<ITfContext> focusedContext() const;
+    using KeyHandler = HRESULT (STDMETHODCALLTYPE ITfKeyEventSink::*)(ITfContext*, WPARAM, LPARAM, BOOL*);
+    HRESULT sendKey(KeyHandler handler, WPARAM wParam, LPARAM lParam, BOOL* pfEaten);
+
+    TfClientId clientId_ = TF_CLIENTID_NULL;
+    DWORD activeFlags_ = 0;
+    ComPtr<ITfTextInputProcessor> textService_;
+    ComPtr<FakeDocumentMgr> focus_;
+    ComPtr<ITfKeyEventSink> keyEventSink_;
+    TfClientId keyEventSinkClient_ = TF_CLIENTID_NULL;
+    std::vector<PreservedKey> preservedKeys_;
+    FakeSinkList sinks_;
+    ComPtr<FakeCompartmentMgr> compartments_;
+    std::vector<ComPtr<ITfLangBarItem>> langBarItems_;
+};
+
+// Replays keystrokes through the key event sink of a thread manager, the
+// way TSF calls a text service (see KeystrokeReplay.h). Each context id
+// gets its own document, focused when a key is sent to it, and the
+// keyboard state is set from the modifiers of the event.
+class FakeKeystrokeTarget : public KeystrokeTarget {
+public:
+    explicit FakeKeystrokeTarget(FakeThreadMgr* threadMgr) : threadMgr_(threadMgr) {}
+
+    bool testKey(KeyEvent& event, uint32_t contextId) override;
+    bool handleKey(KeyEvent& event, uint32_t contextId) override;
+
+    // the context of contextId, created if needed
+    ComPtr<FakeContext> context(uint32_t contextId);
+
+private:
+    void prepare(const KeyEvent& event, uint32_t contextId);
+
+    ComPtr<FakeThreadMgr> threadMgr_;
+    std::map<uint32_t, ComPtr<FakeContext>> contexts_;
+};
+
+} // namespace Ime
+
+#endif
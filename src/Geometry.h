@@ -0,0 +1,125 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_GEOMETRY_H
+#define IME_GEOMETRY_H
+
+#include <algorithm>
+
+// Win32-free counterparts of POINT, SIZE and RECT for the portable code.
+
+namespace Ime {
+
+struct Point {
+    int x = 0, y = 0;
+
+    bool operator == (const Point& other) const {
+        return x == other.x && y == other.y;
+    }
+    bool operator != (const Point& other) const {
+        return !(*this == other);
+    }
+};
+
+struct Size {
+    int cx = 0, cy = 0;
+
+    bool operator == (const Size& other) const {
+        return cx == other.cx && cy == other.cy;
+    }
+    bool operator != (const Size& other) const {
+        return !(*this == other);
+    }
+};
+
+// Same convention as RECT: right and bottom are exclusive.
+struct Rect {
+    int left = 0, top = 0, right = 0, bottom = 0;
+
+    static Rect fromPointSize(Point p, Size s) {
+        return { p.x, p.y, p.x + s.cx, p.y + s.cy };
+    }
+
+    int width() const { return right - left; }
+    int height() const { return bottom - top; }
+    Size size() const { return { width(), height() }; }
+    Point topLeft() const { return { left, top }; }
+    bool isEmpty() const { return right <= left || bottom <= top; }
+    long long area() const { return isEmpty() ? 0 : (long long) width() * height(); }
+
+    bool intersects(const Rect& other) const {
+        return left < other.right && other.left < right &&
+            top < other.bottom && other.top < bottom;
+    }
+
+    bool contains(const Rect& other) const {
+        return left <= other.left && other.right <= right &&
+            top <= other.top && other.bottom <= bottom;
+    }
+
+    bool contains(Point p) const {
+        return left <= p.x && p.x < right && top <= p.y && p.y < bottom;
+    }
+
+    Rect intersected(const Rect& other) const {
+        Rect r{ (std::max)(left, other.left), (std::max)(top, other.top),
+            (std::min)(right, other.right), (std::min)(bottom, other.bottom) };
+        return r.isEmpty() ? Rect{} : r;
+    }
+
+    // The bounding box of both; empty rects are ignored.
+    Rect united(const Rect& other) const {
+        if (isEmpty()) return other;
+        if (other.isEmpty()) return *this;
+        return { (std::min)(left, other.left), (std::min)(top, other.top),
+            (std::max)(right, other.right), (std::max)(bottom, other.bottom) };
+    }
+
+    Rect translated(int dx, int dy) const {
+        return { left + dx, top + dy, right + dx, bottom + dy };
+    }
+
+    bool operator == (const Rect& other) const {
+        return left == other.left && top == other.top &&
+            right == other.right && bottom == other.bottom;
+    }
+    bool operator != (const Rect& other) const {
+        return !(*this == other);
+    }
+};
+
+// Space around a box, like CandidateWindow::Theme::Margin.
+struct Margins {
+    int top = 0, right = 0, bottom = 0, left = 0;
+
+    int xspace() const { return left + right; }
+    int yspace() const { return top + bottom; }
+
+    bool operator == (const Margins& other) const {
+        return top == other.top && right == other.right &&
+            bottom == other.bottom && left == other.left;
+    }
+    bool operator != (const Margins& other) const {
+        return !(*this == other);
+    }
+};
+
+} // namespace Ime
+
+#endif
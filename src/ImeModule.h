@@ -28,7 +28,6 @@
 #include <list>
 #include "ComPtr.h"
 #include "ComObject.h"
-#include <mutex>
 
 namespace Ime {
 
@@ -46,7 +45,9 @@ struct LangProfileInfo {
 };
 
 
-class ImeModule: public ComObject<
+// Shared by all the threads hosting the text service, hence the atomic
+// reference count.
+class ImeModule: public MultiThreadedComObject<
     ComInterface<IClassFactory>,
     ComInterface<ITfFnConfigure>
 > {
@@ -93,12 +94,6 @@ public:
     }
     */
 
-    // COM-related stuff
-
-    // IUnknown
-    STDMETHODIMP_(ULONG) AddRef(void) override;
-    STDMETHODIMP_(ULONG) Release(void) override;
-
 protected:
     // IClassFactory
     STDMETHODIMP CreateInstance(IUnknown *pUnkOuter, REFIID riid, void **ppvObj);
@@ -114,8 +109,6 @@ protected: // COM object should not be deleted directly. calling Release() inste
     virtual ~ImeModule(void);
 
 private:
-    // refCountMutex needs to be static because it may be accessed after Release() calls the destructor.
-    static std::mutex refCountMutex_;
     HINSTANCE hInstance_;
     CLSID textServiceClsid_;
 
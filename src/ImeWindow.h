@@ -35,7 +35,8 @@ public:
     virtual ~ImeWindow(void);
     void move(int x, int y);
     bool isImmersive() {
-        return textService_->isImmersive();
+        auto service = textService_.lock();
+        return service && service->isImmersive();
     }
 
     void setFont(HFONT f);
@@ -47,7 +48,8 @@ protected:
     void onMouseMove(WPARAM wp, LPARAM lp);
 
 protected:
-    TextService* textService_;
+    // the window may outlive the text service which created it
+    ComWeakPtr<TextService> textService_;
     POINTS oldPos;
     HFONT font_;
     int margin_;
@@ -0,0 +1,239 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "IniFile.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <fstream>
+#include <iterator>
+
+namespace Ime {
+
+namespace {
+
+bool isSpace(wchar_t c) {
+    return c == L' ' || c == L'\t' || c == L'\r' || c == L'\v' || c == L'\f';
+}
+
+bool isDigit(wchar_t c) {
+    return L'0' <= c && c <= L'9';
+}
+
+int hexDigit(wchar_t c) {
+    if (isDigit(c))
+        return c - L'0';
+    if (L'a' <= c && c <= L'f')
+        return c - L'a' + 10;
+    if (L'A' <= c && c <= L'F')
+        return c - L'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+bool IniFile::load(const std::filesystem::path& file) {
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream)
+        return false;
+    std::string bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    parseBytes(bytes);
+    return true;
+}
+
+void IniFile::parseBytes(std::string_view bytes) {
+    parse(decode(bytes));
+}
+
+std::wstring IniFile::decode(std::string_view bytes) {
+    std::wstring text;
+    if (bytes.size() >= 2 && uint8_t(bytes[0]) == 0xFF && uint8_t(bytes[1]) == 0xFE) {
+        text.reserve(bytes.size() / 2);
+        for (size_t i = 2; i + 1 < bytes.size(); i += 2)
+            text.push_back(wchar_t(uint8_t(bytes[i]) | uint8_t(bytes[i + 1]) << 8));
+        return text;
+    }
+    text.reserve(bytes.size());
+    size_t i = bytes.substr(0, 3) == "\xEF\xBB\xBF" ? 3 : 0;
+    while (i < bytes.size()) {
+        uint8_t lead = uint8_t(bytes[i]);
+        int extra = lead < 0x80 ? 0 : lead >= 0xF8 ? -1 : lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+        bool valid = extra >= 0 && i + extra < bytes.size();
+        for (int k = 1; valid && k <= extra; ++k)
+            valid = (uint8_t(bytes[i + k]) & 0xC0) == 0x80;
+        if (!valid) {
+            text.push_back(L'\uFFFD');
+            ++i;
+            continue;
+        }
+        uint32_t cp = extra ? lead & (0x3F >> extra) : lead;
+        for (int k = 1; k <= extra; ++k)
+            cp = cp << 6 | (uint8_t(bytes[i + k]) & 0x3F);
+        if (cp > 0x10FFFF)
+            cp = 0xFFFD;
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+            cp -= 0x10000;
+            text.push_back(wchar_t(0xD800 + (cp >> 10)));
+            text.push_back(wchar_t(0xDC00 + (cp & 0x3FF)));
+        } else
+            text.push_back(wchar_t(cp));
+        i += extra + 1;
+    }
+    return text;
+}
+
+void IniFile::parse(std::wstring text) {
+    text_ = std::move(text);
+    entries_.clear();
+    errors_.clear();
+
+    auto trimmed = [this](size_t begin, size_t end) {
+        while (begin < end && isSpace(text_[begin]))
+            ++begin;
+        while (end > begin && isSpace(text_[end - 1]))
+            --end;
+        return Range{ begin, end - begin };
+    };
+
+    Range section;
+    size_t lineNumber = 0;
+    for (size_t pos = 0; pos < text_.size();) {
+        ++lineNumber;
+        size_t end = text_.find(L'\n', pos);
+        if (end == std::wstring::npos)
+            end = text_.size();
+        Range line = trimmed(pos, end);
+        pos = end + 1;
+        if (!line.size || text_[line.begin] == L';' || text_[line.begin] == L'#')
+            continue;
+
+        if (text_[line.begin] == L'[') {
+            size_t close = text_.find(L']', line.begin);
+            if (close == std::wstring::npos || close >= line.begin + line.size) {
+                errors_.push_back({ lineNumber, "unterminated section header" });
+                close = line.begin + line.size;
+            }
+            section = trimmed(line.begin + 1, close);
+            continue;
+        }
+
+        size_t eq = text_.find(L'=', line.begin);
+        if (eq == std::wstring::npos || eq >= line.begin + line.size) {
+            errors_.push_back({ lineNumber, "line is neither a section nor a key" });
+            continue;
+        }
+        Range key = trimmed(line.begin, eq);
+        if (!key.size) {
+            errors_.push_back({ lineNumber, "empty key" });
+            continue;
+        }
+        entries_.push_back({ section, key, trimmed(eq + 1, line.begin + line.size) });
+    }
+
+    // a flat index sorted by section and key; the stable sort keeps
+    // duplicates in file order, so the first one is found first
+    std::stable_sort(entries_.begin(), entries_.end(), [this](const Entry& a, const Entry& b) {
+        int result = compare(view(a.section), view(b.section));
+        return result ? result < 0 : compare(view(a.key), view(b.key)) < 0;
+    });
+}
+
+int IniFile::compare(std::wstring_view a, std::wstring_view b) {
+    size_t n = (std::min)(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        auto ca = std::towlower(a[i]), cb = std::towlower(b[i]);
+        if (ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    return a.size() == b.size() ? 0 : a.size() < b.size() ? -1 : 1;
+}
+
+int IniFile::compare(const Entry& entry, std::wstring_view section, std::wstring_view key) const {
+    int result = compare(view(entry.section), section);
+    return result ? result : compare(view(entry.key), key);
+}
+
+std::optional<std::wstring_view> IniFile::get(std::wstring_view section, std::wstring_view key) const {
+    auto it = std::partition_point(entries_.begin(), entries_.end(),
+        [&](const Entry& entry) { return compare(entry, section, key) < 0; });
+    if (it == entries_.end() || compare(*it, section, key) != 0)
+        return std::nullopt;
+    return view(it->value);
+}
+
+int IniFile::getInt(std::wstring_view section, std::wstring_view key, int fallback) const {
+    auto value = getString(section, key);
+    size_t i = 0;
+    bool negative = !value.empty() && value[0] == L'-';
+    if (negative)
+        ++i;
+    if (i >= value.size() || !isDigit(value[i]))
+        return fallback;
+    long long result = 0;
+    for (; i < value.size() && isDigit(value[i]); ++i)
+        result = (std::min)(result * 10 + (value[i] - L'0'), 0x7FFFFFFFLL);
+    return int(negative ? -result : result);
+}
+
+uint32_t IniFile::getColor(std::wstring_view section, std::wstring_view key, uint32_t fallback) const {
+    auto value = getString(section, key);
+    if (!value.empty() && value[0] == L'#')
+        value.remove_prefix(1);
+    if (value.size() != 6)
+        return fallback;
+    uint32_t rgb = 0;
+    for (auto c : value) {
+        int digit = hexDigit(c);
+        if (digit < 0)
+            return fallback;
+        rgb = rgb << 4 | uint32_t(digit);
+    }
+    // 0xRRGGBB to COLORREF
+    return (rgb >> 16 & 0xFF) | (rgb & 0xFF00) | (rgb & 0xFF) << 16;
+}
+
+IniFont IniFile::getFont(std::wstring_view section, std::wstring_view key) const {
+    IniFont font;
+    auto value = getString(section, key);
+    auto space = value.find_last_of(L' ');
+    if (space != std::wstring_view::npos) {
+        auto suffix = value.substr(space + 1);
+        bool digits = !suffix.empty() && suffix.size() < 6;
+        for (auto c : suffix)
+            digits = digits && isDigit(c);
+        int size = 0;
+        for (size_t i = 0; digits && i < suffix.size(); ++i)
+            size = size * 10 + (suffix[i] - L'0');
+        if (size > 0) {
+            font.size = size;
+            value = value.substr(0, space);
+            while (!value.empty() && isSpace(value.back()))
+                value.remove_suffix(1);
+        }
+    }
+    font.face = value;
+    return font;
+}
+
+Margins IniFile::getMargins(std::wstring_view section) const {
+    return { getInt(section, L"Top", 0), getInt(section, L"Right", 0),
+        getInt(section, L"Bottom", 0), getInt(section, L"Left", 0) };
+}
+
+} // namespace Ime
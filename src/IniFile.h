@@ -0,0 +1,118 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_INI_FILE_H
+#define IME_INI_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Geometry.h"
+
+namespace Ime {
+
+// A font written as "Face Name 12": the last word is the size in points.
+struct IniFont {
+    std::wstring face;  // empty if the key is missing
+    int size = 0;       // 0 if not given
+};
+
+// An INI file read in one go, replacing one profile API call (which opens
+// and scans the file again) per key. Like the profile API, sections and
+// keys are case-insensitive, the first occurrence of a key wins, and lines
+// starting with ';' or '#' are comments.
+// Values are views into the decoded text kept by the object, valid until
+// it is modified or destroyed.
+class IniFile {
+public:
+    struct Error {
+        size_t line;  // 1-based
+        std::string message;
+    };
+
+    IniFile() = default;
+
+    // Reads a UTF-16 (with a BOM) or UTF-8 file. Returns false if it
+    // cannot be read; malformed lines are reported by errors() instead.
+    bool load(const std::filesystem::path& file);
+
+    // Parses encoded bytes as load() does.
+    void parseBytes(std::string_view bytes);
+    void parse(std::wstring text);
+
+    std::optional<std::wstring_view> get(std::wstring_view section, std::wstring_view key) const;
+
+    std::wstring_view getString(std::wstring_view section, std::wstring_view key,
+        std::wstring_view fallback = {}) const {
+        return get(section, key).value_or(fallback);
+    }
+
+    // Like GetPrivateProfileInt: the leading digits of the value, with an
+    // optional minus sign, or fallback if there are none.
+    int getInt(std::wstring_view section, std::wstring_view key, int fallback) const;
+
+    // "#RRGGBB" or "RRGGBB" as a COLORREF (0x00BBGGRR), or fallback.
+    uint32_t getColor(std::wstring_view section, std::wstring_view key, uint32_t fallback) const;
+
+    IniFont getFont(std::wstring_view section, std::wstring_view key) const;
+
+    // the Top, Right, Bottom and Left keys of section, 0 if missing
+    Margins getMargins(std::wstring_view section) const;
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    const std::vector<Error>& errors() const {
+        return errors_;
+    }
+
+    // UTF-16 with a BOM, or UTF-8 with or without one
+    static std::wstring decode(std::string_view bytes);
+
+private:
+    // offsets into text_ rather than views, so that copies stay valid
+    struct Range {
+        size_t begin = 0, size = 0;
+    };
+
+    struct Entry {
+        Range section, key, value;
+    };
+
+    std::wstring_view view(Range range) const {
+        return std::wstring_view(text_).substr(range.begin, range.size);
+    }
+
+    // case-insensitive, like the profile API
+    static int compare(std::wstring_view a, std::wstring_view b);
+    int compare(const Entry& entry, std::wstring_view section, std::wstring_view key) const;
+
+    std::wstring text_;
+    std::vector<Entry> entries_;  // sorted by section and key
+    std::vector<Error> errors_;
+};
+
+} // namespace Ime
+
+#endif
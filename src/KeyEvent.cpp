@@ -19,31 +19,174 @@
 
 #include "KeyEvent.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace Ime {
 
-KeyEvent::KeyEvent(UINT type, WPARAM wp, LPARAM lp):
-    type_(type),
-    keyCode_(wp),
-    lParam_(lp) {
+// virtual key codes, for the portable build
+static const unsigned vkShift = 0x10;
+static const unsigned vkControl = 0x11;
+static const unsigned vkMenu = 0x12;
+static const unsigned vkCapital = 0x14;
+static const unsigned vkLeftWin = 0x5B;
+static const unsigned vkRightWin = 0x5C;
+static const unsigned vkNumLock = 0x90;
+static const unsigned vkScroll = 0x91;
+static const unsigned vkLeftShift = 0xA0;
+static const unsigned vkRightShift = 0xA1;
+static const unsigned vkLeftControl = 0xA2;
+static const unsigned vkRightControl = 0xA3;
+static const unsigned vkLeftMenu = 0xA4;
+static const unsigned vkRightMenu = 0xA5;
+
+// the modifier of a key held down, or 0
+static uint16_t downModifier(unsigned keyCode) {
+    switch(keyCode) {
+    case vkShift: return ModifierShift;
+    case vkLeftShift: return ModifierLeftShift;
+    case vkRightShift: return ModifierRightShift;
+    case vkControl: return ModifierCtrl;
+    case vkLeftControl: return ModifierLeftCtrl;
+    case vkRightControl: return ModifierRightCtrl;
+    case vkMenu: return ModifierAlt;
+    case vkLeftMenu: return ModifierLeftAlt;
+    case vkRightMenu: return ModifierRightAlt;
+    case vkLeftWin: return ModifierLeftWin;
+    case vkRightWin: return ModifierRightWin;
+    }
+    return 0;
+}
+
+// the modifier of a lock key toggled on, or 0
+static uint16_t toggleModifier(unsigned keyCode) {
+    switch(keyCode) {
+    case vkCapital: return ModifierCapsLock;
+    case vkNumLock: return ModifierNumLock;
+    case vkScroll: return ModifierScrollLock;
+    }
+    return 0;
+}
+
+uint16_t modifierState(const uint8_t* keyStates) {
+    uint16_t modifiers = 0;
+    for(unsigned key : { vkShift, vkLeftShift, vkRightShift, vkControl, vkLeftControl, vkRightControl,
+        vkMenu, vkLeftMenu, vkRightMenu, vkLeftWin, vkRightWin }) {
+        if(keyStates[key] & 0x80)
+            modifiers |= downModifier(key);
+    }
+    for(unsigned key : { vkCapital, vkNumLock, vkScroll }) {
+        if(keyStates[key] & 1)
+            modifiers |= toggleModifier(key);
+    }
+    return modifiers;
+}
+
+// the modifiers which change the text typed (see keyModifiers())
+static unsigned translationModifiers(uint16_t modifiers) {
+    unsigned result = 0;
+    if(modifiers & ModifierShift)
+        result |= KeyModifierShift;
+    if(modifiers & ModifierCapsLock)
+        result |= KeyModifierCapsLock;
+    if(modifiers & ModifierRightAlt)
+        result |= KeyModifierAltGr;
+    return result;
+}
 
-    if(!::GetKeyboardState(keyStates_)) // get state of all keys
-        ::memset(keyStates_, 0, sizeof(keyStates_));
+KeyEvent::KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, KeyStateProvider& provider):
+    provider_(&provider),
+    type_((uint16_t) type),
+    keyCode_((uint16_t) wp),
+    lParam_((uint32_t) lp) {
+    uint8_t states[256];
+    if(fullKeyStates(states))
+        modifiers_ = modifierState(states);
+}
 
-    // try to convert the key event to an ASCII character
-    // ToAscii API tries to convert Ctrl + printable characters to
-    // ASCII 0x00 - 0x31 non-printable escape characters, which we don't want
-    // So here is a hack: pretend that Ctrl key is not pressed
-    WORD result[2] = {0, 0};
-    BYTE ctrlState = keyStates_[VK_CONTROL];
-    keyStates_[VK_CONTROL] = 0;
-    if(::ToAscii(keyCode_, scanCode(), keyStates_, result, 0) == 1)
-        charCode_ = (UINT)result[0];
-    else
-        charCode_ = 0;
-    keyStates_[VK_CONTROL] = ctrlState;
+KeyEvent::KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, const uint8_t* keyStates,
+    KeyStateProvider& provider):
+    provider_(&provider),
+    type_((uint16_t) type),
+    keyCode_((uint16_t) wp),
+    lParam_((uint32_t) lp),
+    modifiers_(modifierState(keyStates)) {
+}
+
+KeyEvent::KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, uint16_t modifiers, const KeyText& text):
+    provider_(nullptr),
+    type_((uint16_t) type),
+    keyCode_((uint16_t) wp),
+    lParam_((uint32_t) lp),
+    modifiers_(modifiers),
+    flags_(HasText | (text.deadKey ? DeadKey : 0)),
+    textLength_(text.length) {
+    std::copy(text.units, text.units + text.length, text_);
 }
 
 KeyEvent::~KeyEvent(void) {
 }
 
+void KeyEvent::loadText() const {
+    if(!(flags_ & HasText)) {
+        // translationModifiers() ignores Ctrl alone, which would otherwise
+        // turn Ctrl + printable characters into control characters
+        if(provider_) {
+            auto text = provider_->translateKey(keyCode_, scanCode(), translationModifiers(modifiers_));
+            textLength_ = text.length;
+            std::copy(text.units, text.units + text.length, text_);
+            if(text.deadKey)
+                flags_ |= DeadKey;
+        }
+        flags_ |= HasText;
+    }
+}
+
+KeyText KeyEvent::keyText() const {
+    loadText();
+    KeyText text;
+    std::copy(text_, text_ + textLength_, text.units);
+    text.length = textLength_;
+    text.deadKey = (flags_ & DeadKey) != 0;
+    return text;
+}
+
+bool KeyEvent::isKeyDown(unsigned code) const {
+    if(auto modifier = downModifier(code))
+        return (modifiers() & modifier) != 0;
+    return provider_ && (provider_->keyState(code) & 0x80) != 0;
+}
+
+bool KeyEvent::isKeyToggled(unsigned code) const {
+    if(auto modifier = toggleModifier(code))
+        return (modifiers() & modifier) != 0;
+    return provider_ && (provider_->keyState(code) & 1) != 0;
+}
+
+bool KeyEvent::fullKeyStates(uint8_t* states) const {
+    if(provider_ && provider_->keyboardState(states))
+        return true;
+    ::memset(states, 0, 256);
+    return false;
+}
+
+KeyEvent KeyEvent::resolved() const {
+    return KeyEvent(type_, keyCode_, lParam_, modifiers(), keyText());
+}
+
+KeyEvent& KeyEventCache::test(unsigned type, uintptr_t wp, intptr_t lp) {
+    event_.emplace(type, wp, lp, provider_);
+    tested_ = true;
+    return *event_;
+}
+
+KeyEvent& KeyEventCache::handle(unsigned type, uintptr_t wp, intptr_t lp) {
+    // the same key pressed again is a new keystroke, so an event is only
+    // reused once, right after its test
+    if(!tested_ || !event_->isSameMessage(type, wp, lp))
+        event_.emplace(type, wp, lp, provider_);
+    tested_ = false;
+    return *event_;
+}
+
 } // namespace Ime
@@ -19,34 +19,122 @@
 
 #pragma once
 
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "KeyTranslation.h"
+
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 namespace Ime {
 
+// Where key events get the state of the keyboard from: the Win32 API in a
+// text service (see systemKeyStateProvider()), a fake in the tests.
+class KeyStateProvider {
+public:
+    virtual ~KeyStateProvider() = default;
+
+    // fills the 256 key states like GetKeyboardState(); false if they are unavailable
+    virtual bool keyboardState(uint8_t* states) = 0;
+
+    // the state of one key, in the format of keyboardState()
+    virtual uint8_t keyState(unsigned keyCode) {
+        uint8_t states[256];
+        return keyCode < 256 && keyboardState(states) ? states[keyCode] : 0;
+    }
+
+    // the text typed by keyCode with the modifiers (see keyModifiers()),
+    // in the active keyboard layout
+    virtual KeyText translateKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) = 0;
+
+    // the keyboard layout of the calling thread may be another one now
+    virtual void keyboardLayoutChanged() {
+    }
+};
+
+// GetKeyboardState() and ToUnicodeEx() of the calling thread, with the
+// translations of its keyboard layout cached (see KeyTranslationCache).
+// Part of libIME2_static; elsewhere the keyboard is that of compat/windows.h.
+KeyStateProvider& systemKeyStateProvider();
+
+// Modifier keys held down and lock keys toggled, as a bitmask.
+enum ModifierState : uint16_t {
+    ModifierShift = 1 << 0,
+    ModifierLeftShift = 1 << 1,
+    ModifierRightShift = 1 << 2,
+    ModifierCtrl = 1 << 3,
+    ModifierLeftCtrl = 1 << 4,
+    ModifierRightCtrl = 1 << 5,
+    ModifierAlt = 1 << 6,
+    ModifierLeftAlt = 1 << 7,
+    ModifierRightAlt = 1 << 8,
+    ModifierLeftWin = 1 << 9,
+    ModifierRightWin = 1 << 10,
+    ModifierCapsLock = 1 << 11,
+    ModifierNumLock = 1 << 12,
+    ModifierScrollLock = 1 << 13,
+};
+
+// the modifiers in 256 key states like those of GetKeyboardState()
+uint16_t modifierState(const uint8_t* keyStates);
+
+// A WM_KEYDOWN or WM_KEYUP message, small enough to be copied, queued and
+// recorded freely (at most 32 bytes with a 16-bit wchar_t). The modifiers
+// are taken when it is built, so that they are those of the keystroke even
+// if it is looked at later; the text typed is only fetched from the
+// provider when first asked for, as most keys are decided by their key code
+// alone. The states of other keys are not kept; isKeyDown(),
+// isKeyToggled() and fullKeyStates() ask the provider for them again.
 class KeyEvent {
 public:
     KeyEvent() = delete;
     KeyEvent(const KeyEvent& other) = default;
-    KeyEvent(UINT type, WPARAM wp, LPARAM lp);
+    KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, KeyStateProvider& provider);
+    // with the modifiers taken from keyStates instead of the provider
+    KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, const uint8_t* keyStates, KeyStateProvider& provider);
+    // complete, with no provider: see resolved()
+    KeyEvent(unsigned type, uintptr_t wp, intptr_t lp, uint16_t modifiers, const KeyText& text);
+#ifdef _WIN32
+    KeyEvent(UINT type, WPARAM wp, LPARAM lp):
+        KeyEvent(type, wp, lp, systemKeyStateProvider()) {
+    }
+#endif
     ~KeyEvent(void);
 
-    UINT type() const {
+    unsigned type() const {
         return type_;
     }
 
-    UINT keyCode() const {
+    unsigned keyCode() const {
         return keyCode_;
     }
 
-    UINT charCode() const {
-        return charCode_;
+    // the code point typed by the key if it types exactly one, or 0
+    unsigned charCode() const {
+        return keyText().codePoint();
+    }
+
+    // all the UTF-16 text typed by the key
+    std::wstring_view text() const {
+        loadText();
+        return { text_, textLength_ };
     }
 
+    bool isDeadKey() const {
+        loadText();
+        return (flags_ & DeadKey) != 0;
+    }
+
+    KeyText keyText() const;
+
     bool isChar() const {
-        return (charCode_ != 0);
+        return (charCode() != 0);
     }
 
-    LPARAM lParam() const {
+    // the low 32 bits of lParam, which are all a key message uses
+    intptr_t lParam() const {
         return lParam_;
     }
 
@@ -57,7 +145,7 @@ public:
 
     unsigned char scanCode() const {
         // bits 16-23
-        return (unsigned char)(lParam_ & 0xff0000);
+        return (unsigned char)((lParam_ >> 16) & 0xff);
     }
 
     bool isExtended() const {
@@ -65,26 +153,80 @@ public:
         return (lParam_ & (1<<24)) != 0;
     }
 
-    bool isKeyDown(UINT code) const {
-        return (keyStates_[code] & (1 << 7)) != 0;
+    // a combination of ModifierState flags
+    uint16_t modifiers() const {
+        return modifiers_;
     }
 
-    bool isKeyToggled(UINT code) const {
-        return (keyStates_[code] & 1) != 0;
+    bool hasModifiers(uint16_t mask) const {
+        return (modifiers() & mask) == mask;
     }
 
-    const BYTE* keyStates() const {
-        return keyStates_;
+    // Answered from modifiers() for the modifier and lock keys; other keys
+    // are asked from the provider (false if there is none).
+    bool isKeyDown(unsigned code) const;
+    bool isKeyToggled(unsigned code) const;
+
+    // The states of all the keys, for the rare cases which need them.
+    // They are asked from the provider, so they are those of the moment of
+    // the call. Returns false, with states zeroed, if there is no provider.
+    bool fullKeyStates(uint8_t* states) const;
+
+    // A copy with the modifiers and the text fetched and no provider, so
+    // that it can outlive the provider and be replayed on another thread.
+    KeyEvent resolved() const;
+
+    // whether this is the same message as (type, wp, lp)
+    bool isSameMessage(unsigned type, uintptr_t wp, intptr_t lp) const {
+        return type_ == type && keyCode_ == wp && lParam_ == uint32_t(lp);
+    }
+
+private:
+    enum Flags : uint8_t {
+        HasText = 1,
+        DeadKey = 2,
+    };
+
+    void loadText() const;
+
+    KeyStateProvider* provider_;
+    uint16_t type_;
+    uint16_t keyCode_;
+    uint32_t lParam_;
+    uint16_t modifiers_ = 0;
+    mutable uint8_t flags_ = 0;
+    mutable uint8_t textLength_ = 0;
+    mutable wchar_t text_[KeyText::capacity] = {};
+};
+
+static_assert(sizeof(wchar_t) != 2 || sizeof(KeyEvent) <= 32, "KeyEvent should stay small");
+
+// Builds the KeyEvent objects of a text service. TSF usually asks whether
+// a key is wanted (OnTestKeyDown) and then sends the same key again
+// (OnKeyDown); the second call gets the event of the first one, so the key
+// states and the character are fetched at most once per keystroke.
+class KeyEventCache {
+public:
+    explicit KeyEventCache(KeyStateProvider& provider) : provider_(provider) {}
+
+    // a new event, for OnTestKeyDown() and OnTestKeyUp()
+    KeyEvent& test(unsigned type, uintptr_t wp, intptr_t lp);
+
+    // for OnKeyDown() and OnKeyUp(): the event of the last test if it was
+    // the same message, or a new one
+    KeyEvent& handle(unsigned type, uintptr_t wp, intptr_t lp);
+
+    KeyStateProvider& provider() const {
+        return provider_;
     }
 
 private:
-    UINT type_;
-    UINT keyCode_;
-    UINT charCode_;
-    LPARAM lParam_;
-    BYTE keyStates_[256];
+    KeyStateProvider& provider_;
+    std::optional<KeyEvent> event_;
+    bool tested_ = false;
 };
 
+#ifdef _WIN32
 // Try to use KeyEvent::isKeyDown() and KeyEvent::isKeyToggled() whenever possible.
 // If a KeyEvent object is not available, then build a KeyState object as an alternative
 // to get key states
@@ -109,5 +251,6 @@ public:
 private:
     short state_;
 };
+#endif
 
 }
@@ -0,0 +1,93 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#include "KeyTranslation.h"
+
+namespace Ime {
+
+// virtual key codes, for the portable build
+static const unsigned vkShift = 0x10;
+static const unsigned vkCapital = 0x14;
+static const unsigned vkRightMenu = 0xA5;
+
+unsigned keyModifiers(const uint8_t* keyStates) {
+    auto isDown = [keyStates](unsigned key) { return (keyStates[key] & 0x80) != 0; };
+    unsigned modifiers = 0;
+    if (isDown(vkShift))
+        modifiers |= KeyModifierShift;
+    if (keyStates[vkCapital] & 1)
+        modifiers |= KeyModifierCapsLock;
+    if (isDown(vkRightMenu))
+        modifiers |= KeyModifierAltGr;
+    return modifiers;
+}
+
+unsigned KeyText::codePoint() const {
+    if (length == 1 && (units[0] < 0xD800 || units[0] > 0xDFFF))
+        return units[0];
+    if (length == 2 && units[0] >= 0xD800 && units[0] <= 0xDBFF &&
+        units[1] >= 0xDC00 && units[1] <= 0xDFFF)
+        return 0x10000 + ((unsigned(units[0]) - 0xD800) << 10) + (unsigned(units[1]) - 0xDC00);
+    return 0;
+}
+
+KeyText KeyTranslationCache::translate(KeyboardLayout& layout, unsigned keyCode,
+    unsigned scanCode, unsigned modifiers) {
+    auto layoutId = layout.id();
+    if (layoutId != layoutId_) {
+        invalidate();
+        layoutId_ = layoutId;
+    }
+    if (deadKeyPending_) {
+        ++misses_;
+        auto text = layout.translateAfterDeadKey(keyCode, scanCode, modifiers);
+        // a modifier key types nothing, and the dead key still waits
+        if (text.length > 0)
+            deadKeyPending_ = false;
+        return text;
+    }
+    if (keyCode > 0xff || modifiers >= keyModifierCount || scanCode > 0xffff) {
+        ++misses_;
+        auto text = layout.translate(keyCode, scanCode, modifiers);
+        deadKeyPending_ = text.deadKey;
+        return text;
+    }
+    if (entries_.empty())
+        entries_.resize(256 * keyModifierCount);
+    auto& entry = entries_[keyCode * keyModifierCount + modifiers];
+    // A key code has the same scan code on nearly every keyboard, so one
+    // is kept per entry and a different one replaces it.
+    if (!entry.valid || entry.scanCode != scanCode) {
+        ++misses_;
+        entry.text = layout.translate(keyCode, scanCode, modifiers);
+        entry.scanCode = uint16_t(scanCode);
+        entry.valid = true;
+    }
+    deadKeyPending_ = entry.text.deadKey;
+    return entry.text;
+}
+
+void KeyTranslationCache::invalidate() {
+    for (auto& entry : entries_)
+        entry.valid = false;
+    deadKeyPending_ = false;
+}
+
+} // namespace Ime
@@ -0,0 +1,115 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef IME_KEY_TRANSLATION_H
+#define IME_KEY_TRANSLATION_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Ime {
+
+// The modifiers which change the character typed by a key.
+enum KeyModifier : unsigned {
+    KeyModifierShift = 1,
+    KeyModifierCapsLock = 2,
+    // the right Alt key, which layouts with a third level use as AltGr
+    // (Windows reports Ctrl with it); Ctrl + left Alt is a shortcut
+    KeyModifierAltGr = 4,
+};
+
+// 1 << 3 combinations of the modifiers above
+constexpr unsigned keyModifierCount = 8;
+
+// The modifiers held in 256 key states like those of GetKeyboardState().
+// Ctrl alone is ignored, so that Ctrl + C still reads as "c" instead of a
+// control character.
+unsigned keyModifiers(const uint8_t* keyStates);
+
+// The UTF-16 text typed by a key: usually one unit, two for characters
+// outside the BMP, and sometimes a few more for ligatures, which are cut to
+// the capacity.
+struct KeyText {
+    static constexpr size_t capacity = 4;
+
+    wchar_t units[capacity] = {};
+    uint8_t length = 0;
+    // the key only changes how the next one is typed (an accent, etc)
+    bool deadKey = false;
+
+    std::wstring_view text() const {
+        return { units, length };
+    }
+
+    // the code point of text() if it is exactly one, or 0
+    unsigned codePoint() const;
+};
+
+// A keyboard layout of the system (an HKL on Windows).
+class KeyboardLayout {
+public:
+    virtual ~KeyboardLayout() = default;
+
+    // identifies the layout in use; translations are dropped when it changes
+    virtual uintptr_t id() = 0;
+
+    virtual KeyText translate(unsigned keyCode, unsigned scanCode, unsigned modifiers) = 0;
+
+    // A key typed after a dead key, which may combine with it (an accented
+    // letter, etc). It depends on more than the key, so it is not cached.
+    virtual KeyText translateAfterDeadKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) {
+        return translate(keyCode, scanCode, modifiers);
+    }
+};
+
+// Remembers the translations of a layout by (key code, scan code,
+// modifiers), filled on first use and emptied when another layout becomes
+// active. After a dead key, the keys are translated by the layout until one
+// types some text. One per thread, as the active layout is.
+class KeyTranslationCache {
+public:
+    KeyText translate(KeyboardLayout& layout, unsigned keyCode, unsigned scanCode, unsigned modifiers);
+
+    // forgets everything, for example when the layout was edited
+    void invalidate();
+
+    // how many translations were asked from a layout
+    size_t misses() const {
+        return misses_;
+    }
+
+private:
+    struct Entry {
+        KeyText text;
+        uint16_t scanCode = 0;
+        bool valid = false;
+    };
+
+    // indexed by key code * keyModifierCount + modifiers, allocated on first use
+    std::vector<Entry> entries_;
+    uintptr_t layoutId_ = 0;
+    size_t misses_ = 0;
+    bool deadKeyPending_ = false;
+};
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,192 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#include "KeystrokeLog.h"
+
+#include <algorithm>
+
+namespace Ime {
+
+namespace {
+
+constexpr uint8_t magic[4] = { 'I', 'M', 'K', 'L' };
+constexpr size_t headerSize = 16;
+constexpr size_t recordSize = 32;
+
+enum RecordFlags : uint8_t {
+    FlagTest = 1,
+    FlagEaten = 2,
+    FlagDeadKey = 4,
+};
+
+class Writer {
+public:
+    void u8(uint8_t v) {
+        data[size++] = v;
+    }
+
+    void u16(uint16_t v) {
+        u8(uint8_t(v));
+        u8(uint8_t(v >> 8));
+    }
+
+    void u32(uint32_t v) {
+        u16(uint16_t(v));
+        u16(uint16_t(v >> 16));
+    }
+
+    void u64(uint64_t v) {
+        u32(uint32_t(v));
+        u32(uint32_t(v >> 32));
+    }
+
+    uint8_t data[recordSize] = {};
+    size_t size = 0;
+};
+
+class Reader {
+public:
+    explicit Reader(const uint8_t* data) : data_(data) {}
+
+    uint8_t u8() {
+        return data_[offset_++];
+    }
+
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return uint16_t(lo | u8() << 8);
+    }
+
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | uint32_t(u16()) << 16;
+    }
+
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | uint64_t(u32()) << 32;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t offset_ = 0;
+};
+
+bool fail(std::string* error, const char* message) {
+    if (error)
+        *error = message;
+    return false;
+}
+
+} // namespace
+
+bool KeystrokeRecord::operator == (const KeystrokeRecord& other) const {
+    return time == other.time && contextId == other.contextId && type == other.type &&
+        keyCode == other.keyCode && lParam == other.lParam && modifiers == other.modifiers &&
+        test == other.test && eaten == other.eaten && text.deadKey == other.text.deadKey &&
+        text.text() == other.text.text();
+}
+
+KeystrokeRecorder::KeystrokeRecorder(std::ostream& out) :
+    out_(out), start_(std::chrono::steady_clock::now()) {
+    Writer header;
+    for (uint8_t c : magic)
+        header.u8(c);
+    header.u32(keystrokeLogVersion);
+    header.u32(recordSize);
+    header.u32(0);
+    out_.write((const char*) header.data, headerSize);
+}
+
+uint32_t KeystrokeRecorder::contextId(const void* context) {
+    auto it = contexts_.emplace(context, uint32_t(contexts_.size() + 1)).first;
+    return it->second;
+}
+
+void KeystrokeRecorder::record(const KeyEvent& event, const void* context, bool test, bool eaten) {
+    KeystrokeRecord r;
+    r.time = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_).count());
+    r.contextId = contextId(context);
+    r.type = uint16_t(event.type());
+    r.keyCode = uint16_t(event.keyCode());
+    r.lParam = uint32_t(event.lParam());
+    r.modifiers = event.modifiers();
+    r.test = test;
+    r.eaten = eaten;
+    r.text = event.keyText();
+    record(r);
+}
+
+void KeystrokeRecorder::record(const KeystrokeRecord& record) {
+    Writer w;
+    w.u64(record.time);
+    w.u32(record.contextId);
+    w.u16(record.type);
+    w.u16(record.keyCode);
+    w.u32(record.lParam);
+    w.u16(record.modifiers);
+    w.u8(uint8_t((record.test ? FlagTest : 0) | (record.eaten ? FlagEaten : 0) |
+        (record.text.deadKey ? FlagDeadKey : 0)));
+    w.u8(record.text.length);
+    for (size_t i = 0; i < KeyText::capacity; ++i)
+        w.u16(i < record.text.length ? uint16_t(record.text.units[i]) : 0);
+    out_.write((const char*) w.data, recordSize);
+    ++count_;
+}
+
+bool readKeystrokeLog(const uint8_t* data, size_t size, std::vector<KeystrokeRecord>& records,
+    std::string* error) {
+    if (size < headerSize || !std::equal(magic, magic + 4, data))
+        return fail(error, "not a keystroke log");
+    Reader header(data + 4);
+    if (header.u32() != keystrokeLogVersion || header.u32() != recordSize)
+        return fail(error, "unsupported keystroke log version");
+
+    for (size_t offset = headerSize; offset < size; offset += recordSize) {
+        if (size - offset < recordSize)
+            return fail(error, "truncated keystroke log");
+        Reader r(data + offset);
+        KeystrokeRecord record;
+        record.time = r.u64();
+        record.contextId = r.u32();
+        record.type = r.u16();
+        record.keyCode = r.u16();
+        record.lParam = r.u32();
+        record.modifiers = r.u16();
+        uint8_t flags = r.u8();
+        uint8_t length = r.u8();
+        if (length > KeyText::capacity)
+            return fail(error, "corrupted keystroke log");
+        record.test = (flags & FlagTest) != 0;
+        record.eaten = (flags & FlagEaten) != 0;
+        record.text.deadKey = (flags & FlagDeadKey) != 0;
+        record.text.length = length;
+        for (size_t i = 0; i < KeyText::capacity; ++i) {
+            auto unit = r.u16();
+            if (i < length)
+                record.text.units[i] = wchar_t(unit);
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+} // namespace Ime
@@ -0,0 +1,105 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef IME_KEYSTROKE_LOG_H
+#define IME_KEYSTROKE_LOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "KeyEvent.h"
+
+// A compact binary log of the keys a text service handled, to replay them
+// against an engine later (see KeystrokeReplay.h).
+//
+// All integers are little-endian:
+//
+//   header   "IMKL", u32 version, u32 record size (32), u32 reserved
+//   records  until the end of the file, each:
+//            u64 microseconds since the recording started, u32 context id,
+//            u16 message, u16 key code, u32 lParam, u16 modifiers
+//            (ModifierState), u8 flags (1: test, 2: eaten, 4: dead key),
+//            u8 text length, 4 x u16 UTF-16 text
+
+namespace Ime {
+
+constexpr uint32_t keystrokeLogVersion = 1;
+
+// One call of OnTestKeyDown, OnKeyDown, OnTestKeyUp or OnKeyUp.
+struct KeystrokeRecord {
+    uint64_t time = 0;
+    // the ITfContext, numbered in the order they appeared
+    uint32_t contextId = 0;
+    uint16_t type = 0;
+    uint16_t keyCode = 0;
+    uint32_t lParam = 0;
+    uint16_t modifiers = 0;
+    // OnTestKeyDown or OnTestKeyUp, which only ask whether the key is wanted
+    bool test = false;
+    bool eaten = false;
+    KeyText text;
+
+    // the key, with everything the engine saw
+    KeyEvent event() const {
+        return KeyEvent(type, keyCode, lParam, modifiers, text);
+    }
+
+    bool operator == (const KeystrokeRecord& other) const;
+};
+
+// Writes records to out as they come. Not thread-safe: use one per text
+// service.
+class KeystrokeRecorder {
+public:
+    explicit KeystrokeRecorder(std::ostream& out);
+
+    // fetches what is still missing from event, so call it after the
+    // engine has seen it
+    void record(const KeyEvent& event, const void* context, bool test, bool eaten);
+
+    void record(const KeystrokeRecord& record);
+
+    // the id of context in the records
+    uint32_t contextId(const void* context);
+
+    size_t count() const {
+        return count_;
+    }
+
+private:
+    std::ostream& out_;
+    std::chrono::steady_clock::time_point start_;
+    std::unordered_map<const void*, uint32_t> contexts_;
+    size_t count_ = 0;
+};
+
+// Returns false and describes the problem in error if data is not a
+// keystroke log of the current version. The records read before a
+// problem are kept.
+bool readKeystrokeLog(const uint8_t* data, size_t size, std::vector<KeystrokeRecord>& records,
+    std::string* error = nullptr);
+
+} // namespace Ime
+
+#endif
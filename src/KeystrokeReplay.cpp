@@ -0,0 +1,77 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#include "KeystrokeReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace Ime {
+
+std::string ReplayReport::summary() const {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+        "%zu keys, %zu mismatches, %.0f keys/s, latency p50 %.2f us, p90 %.2f us, p99 %.2f us, max %.2f us",
+        keys, mismatches, keysPerSecond, p50, p90, p99, max);
+    return buffer;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    double rank = std::clamp(p, 0.0, 100.0) / 100 * (sorted.size() - 1);
+    size_t lower = size_t(rank);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - lower);
+}
+
+ReplayReport replayKeystrokes(const std::vector<KeystrokeRecord>& records,
+    KeystrokeTarget& target, int rounds) {
+    using Clock = std::chrono::steady_clock;
+    ReplayReport report;
+    std::vector<double> latencies;
+    latencies.reserve(records.size() * std::max(rounds, 0));
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& record : records) {
+            auto event = record.event();
+            auto start = Clock::now();
+            bool eaten = record.test ? target.testKey(event, record.contextId) :
+                target.handleKey(event, record.contextId);
+            auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            latencies.push_back(elapsed);
+            if (eaten != record.eaten)
+                ++report.mismatches;
+        }
+    }
+    report.keys = latencies.size();
+    for (double latency : latencies)
+        report.seconds += latency / 1e6;
+    if (report.seconds > 0)
+        report.keysPerSecond = report.keys / report.seconds;
+    std::sort(latencies.begin(), latencies.end());
+    report.p50 = percentile(latencies, 50);
+    report.p90 = percentile(latencies, 90);
+    report.p99 = percentile(latencies, 99);
+    report.max = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+} // namespace Ime
@@ -0,0 +1,71 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#ifndef IME_KEYSTROKE_REPLAY_H
+#define IME_KEYSTROKE_REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "KeyEvent.h"
+#include "KeystrokeLog.h"
+
+namespace Ime {
+
+// The key handling of an engine, as TSF drives it.
+class KeystrokeTarget {
+public:
+    virtual ~KeystrokeTarget() = default;
+
+    // OnTestKeyDown or OnTestKeyUp: whether the engine wants the key
+    virtual bool testKey(KeyEvent& event, uint32_t contextId) = 0;
+
+    // OnKeyDown or OnKeyUp: handles the key; returns whether it was eaten
+    virtual bool handleKey(KeyEvent& event, uint32_t contextId) = 0;
+};
+
+struct ReplayReport {
+    size_t keys = 0;
+    // keys eaten differently than when they were recorded
+    size_t mismatches = 0;
+    // time spent in the target
+    double seconds = 0;
+    double keysPerSecond = 0;
+    // latency of a single key, in microseconds
+    double p50 = 0, p90 = 0, p99 = 0, max = 0;
+
+    // one line for logs, like "1000 keys, 0 mismatches, 52000 keys/s, ..."
+    std::string summary() const;
+};
+
+// The p-th percentile (0 - 100) of sorted values, interpolated linearly
+// between the closest ranks; 0 if there are none.
+double percentile(const std::vector<double>& sorted, double p);
+
+// Feeds the records to target in order, as fast as it takes them, rounds
+// times, timing each call. The recorded timestamps are ignored, so that
+// the result only depends on the engine.
+ReplayReport replayKeystrokes(const std::vector<KeystrokeRecord>& records,
+    KeystrokeTarget& target, int rounds = 1);
+
+} // namespace Ime
+
+#endif
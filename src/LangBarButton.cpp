@@ -29,16 +29,17 @@ namespace Ime {
 
 std::atomic<DWORD> LangBarButton::nextCookie = 0;
 
-LangBarButton::LangBarButton(ComPtr<TextService> service, const GUID& guid, UINT commandId, const wchar_t* text, DWORD style):
-    textService_(std::move(service)),
+LangBarButton::LangBarButton(ComRef<TextService> service, const GUID& guid, UINT commandId, const wchar_t* text, DWORD style):
+    textService_(service),
+    module_(service ? service->imeModule() : nullptr),
     commandId_(commandId),
     menu_(NULL),
     icon_(NULL),
     status_(0) {
 
-    assert(textService_ && textService_->imeModule());
+    assert(service && module_);
 
-    info_.clsidService = textService_->imeModule()->textServiceClsid();
+    info_.clsidService = module_->textServiceClsid();
     info_.guidItem = guid;
     info_.dwStyle = style;
     info_.ulSort = 0;
@@ -74,7 +75,7 @@ void LangBarButton::setText(const wchar_t* text) {
 
 void LangBarButton::setText(UINT stringId) {
     const wchar_t* str;
-    int len = ::LoadStringW(textService_->imeModule()->hInstance(), stringId, (LPTSTR)&str, 0);
+    int len = ::LoadStringW(module_->hInstance(), stringId, (LPTSTR)&str, 0);
     if(str) {
         if (len > (TF_LBI_DESC_MAXLEN - 1)) {
             len = TF_LBI_DESC_MAXLEN - 1;
@@ -98,7 +99,7 @@ void LangBarButton::setTooltip(std::wstring tooltip) {
 void LangBarButton::setTooltip(UINT tooltipId) {
     const wchar_t* str;
     //  If this parameter is 0, then lpBuffer receives a read-only pointer to the resource itself.
-    auto len = ::LoadStringW(textService_->imeModule()->hInstance(), tooltipId, (LPTSTR)&str, 0);
+    auto len = ::LoadStringW(module_->hInstance(), tooltipId, (LPTSTR)&str, 0);
     if(str) {
         tooltip_ = std::wstring(str, len);
         update(TF_LBI_TOOLTIP);
@@ -118,7 +119,7 @@ void LangBarButton::setIcon(HICON icon) {
 }
 
 void LangBarButton::setIcon(UINT iconId) {
-    HICON icon = ::LoadIconW(textService_->imeModule()->hInstance(), (LPCTSTR)iconId);
+    HICON icon = ::LoadIconW(module_->hInstance(), MAKEINTRESOURCEW(iconId));
     setIcon(icon);
 }
 
@@ -212,7 +213,9 @@ STDMETHODIMP LangBarButton::GetTooltipString(BSTR *pbstrToolTip) {
 // ITfLangBarItemButton
 STDMETHODIMP LangBarButton::OnClick(TfLBIClick click, POINT pt, const RECT *prcArea) {
     auto type = click == TF_LBI_CLK_RIGHT ? TextService::COMMAND_RIGHT_CLICK : TextService::COMMAND_LEFT_CLICK;
-    textService_->onCommand(commandId_, type);
+    if (auto service = textService_.lock()) {
+        service->onCommand(commandId_, type);
+    }
     return S_OK;
 }
 
@@ -225,7 +228,9 @@ STDMETHODIMP LangBarButton::InitMenu(ITfMenu *pMenu) {
 }
 
 STDMETHODIMP LangBarButton::OnMenuSelect(UINT wID) {
-    textService_->onCommand(wID, TextService::COMMAND_MENU);
+    if (auto service = textService_.lock()) {
+        service->onCommand(wID, TextService::COMMAND_MENU);
+    }
     return S_OK;
 }
 
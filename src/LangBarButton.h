@@ -31,6 +31,7 @@
 
 namespace Ime {
 
+class ImeModule;
 class TextService;
 
 class LangBarButton:
@@ -39,8 +40,10 @@ class LangBarButton:
         ComInterface<ITfSource>
     > {
 public:
+    // The button only keeps a weak reference to service, which keeps the
+    // button while it is added to it.
     LangBarButton(
-        ComPtr<TextService> service,
+        ComRef<TextService> service,
         const GUID& guid,
         UINT commandId = 0,
         const wchar_t* text = NULL,
@@ -96,8 +99,9 @@ public:
 
     void update(DWORD flags = TF_LBI_BTNALL);
 
-    TextService* textService() const {
-        return textService_;
+    // nullptr once the text service is gone
+    ComPtr<TextService> textService() const {
+        return textService_.lock();
     };
 
 protected: // COM object should not be deleted directly. calling Release() instead.
@@ -107,7 +111,9 @@ private:
     void buildITfMenu(ITfMenu* menu, HMENU templ);
 
 private:
-    ComPtr<TextService> textService_;
+    ComWeakPtr<TextService> textService_;
+    // for the resources
+    ComPtr<ImeModule> module_;
     TF_LANGBARITEMINFO info_;
     UINT commandId_;
     std::wstring tooltip_;
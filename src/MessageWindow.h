@@ -38,8 +38,9 @@ public:
     }
     void setText(std::wstring text);
 
-    TextService* textService() {
-        return textService_;
+    // nullptr once the text service is gone
+    ComPtr<TextService> textService() {
+        return textService_.lock();
     }
 
     virtual void recalculateSize();
@@ -0,0 +1,90 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "NineSlice.h"
+
+#include <algorithm>
+
+namespace Ime {
+
+int scaleForDpi(int value, int dpi) {
+    long long product = (long long) value * dpi;
+    long long magnitude = (product < 0 ? -product : product) + 48;
+    int result = int(magnitude / 96);
+    return product < 0 ? -result : result;
+}
+
+namespace {
+
+struct Span1D {
+    int start, length;
+};
+
+// Splits [0, total) into the near border, the stretched middle and the far
+// border. The middle is derived from the two scaled borders rather than
+// scaled on its own, so rounding never makes the spans overlap.
+void sliceAxis(int total, int near, int far, int dpi, Span1D (&out)[3]) {
+    int nearLength = scaleForDpi(near, dpi);
+    int farLength = scaleForDpi(far, dpi);
+    out[0] = { 0, nearLength };
+    out[1] = { nearLength, total - nearLength - farLength };
+    out[2] = { total - farLength, farLength };
+}
+
+} // namespace
+
+NineSlice::NineSlice(Size imageSize, const Margins& margins, const Rect& dest, int dpiX, int dpiY) {
+    Span1D srcX[3], srcY[3], destX[3], destY[3];
+    sliceAxis(imageSize.cx, margins.left, margins.right, 96, srcX);
+    sliceAxis(imageSize.cy, margins.top, margins.bottom, 96, srcY);
+    sliceAxis(dest.width(), margins.left, margins.right, dpiX, destX);
+    sliceAxis(dest.height(), margins.top, margins.bottom, dpiY, destY);
+
+    for (int x = 0; x < 3; ++x) for (int y = 0; y < 3; ++y) {
+        NineSlicePatch patch;
+        patch.src = Rect::fromPointSize({ srcX[x].start, srcY[y].start },
+            { srcX[x].length, srcY[y].length });
+        patch.dest = Rect::fromPointSize({ dest.left + destX[x].start, dest.top + destY[y].start },
+            { destX[x].length, destY[y].length });
+        if (!patch.src.isEmpty() && !patch.dest.isEmpty())
+            patches_[count_++] = patch;
+    }
+}
+
+const NineSlice& NineSliceCache::get(Size imageSize, const Margins& margins, Size destSize,
+    int dpiX, int dpiY) {
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry) {
+        return entry.imageSize == imageSize && entry.margins == margins && entry.destSize == destSize &&
+            entry.dpiX == dpiX && entry.dpiY == dpiY;
+    });
+    if (it != entries_.end()) {
+        ++hits_;
+        std::rotate(entries_.begin(), it, it + 1);
+        return entries_.front().slice;
+    }
+    ++misses_;
+    if (entries_.size() >= capacity_ && !entries_.empty())
+        entries_.pop_back();
+    entries_.insert(entries_.begin(),
+        Entry{ imageSize, margins, destSize, dpiX, dpiY,
+            NineSlice(imageSize, margins, Rect::fromPointSize({}, destSize), dpiX, dpiY) });
+    return entries_.front().slice;
+}
+
+} // namespace Ime
@@ -0,0 +1,109 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_NINE_SLICE_H
+#define IME_NINE_SLICE_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "Geometry.h"
+
+namespace Ime {
+
+// value * dpi / 96 rounded to the nearest integer, half away from zero,
+// like MulDiv(value, dpi, 96).
+int scaleForDpi(int value, int dpi);
+
+struct NineSlicePatch {
+    Rect src;   // in image pixels
+    Rect dest;  // in device pixels
+};
+
+// The patches which stretch an image over dest while keeping its borders:
+// the corners are copied (scaled for the DPI only), the edges are stretched
+// along their length and the center in both directions.
+// margins are the border widths in image pixels. Empty patches are left out.
+class NineSlice {
+public:
+    NineSlice() = default;
+    NineSlice(Size imageSize, const Margins& margins, const Rect& dest, int dpiX = 96, int dpiY = 96);
+
+    size_t size() const {
+        return count_;
+    }
+
+    const NineSlicePatch* begin() const {
+        return patches_.data();
+    }
+
+    const NineSlicePatch* end() const {
+        return patches_.data() + count_;
+    }
+
+    const NineSlicePatch& operator[](size_t i) const {
+        return patches_[i];
+    }
+
+private:
+    std::array<NineSlicePatch, 9> patches_;
+    size_t count_ = 0;
+};
+
+// Remembers the NineSlice of the last few images, target sizes and DPIs, so
+// that repainting the same window does not compute them again.
+class NineSliceCache {
+public:
+    explicit NineSliceCache(size_t capacity = 4) : capacity_(capacity) {}
+
+    // The patches for a target of destSize at the origin; translate them by
+    // the top left corner of the actual target.
+    const NineSlice& get(Size imageSize, const Margins& margins, Size destSize,
+        int dpiX = 96, int dpiY = 96);
+
+    void clear() {
+        entries_.clear();
+    }
+
+    size_t hits() const {
+        return hits_;
+    }
+
+    size_t misses() const {
+        return misses_;
+    }
+
+private:
+    struct Entry {
+        Size imageSize;
+        Margins margins;
+        Size destSize;
+        int dpiX, dpiY;
+        NineSlice slice;
+    };
+
+    size_t capacity_;
+    std::vector<Entry> entries_;  // most recently used first
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace Ime
+
+#endif
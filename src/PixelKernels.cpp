@@ -0,0 +1,169 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "PixelKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IME_PIXEL_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define IME_TARGET_SSE2
+#define IME_TARGET_AVX2
+#else
+#define IME_TARGET_SSE2 __attribute__((target("sse2")))
+#define IME_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace Ime {
+
+// x / 255 rounded down, exact for 0 <= x <= 255 * 255.
+// The SIMD kernels use the same formula on 16-bit lanes.
+static inline unsigned div255(unsigned x) {
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+void premultiplyCoverageScalar(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b) {
+    auto p = bgra;
+    for (size_t i = 0; i != pixelCount; ++i) {
+        unsigned alpha = 255u - p[0];
+        p[0] = (uint8_t) div255(b * alpha);
+        p[1] = (uint8_t) div255(g * alpha);
+        p[2] = (uint8_t) div255(r * alpha);
+        p[3] = (uint8_t) alpha;
+        p += 4;
+    }
+}
+
+#ifdef IME_PIXEL_KERNELS_X86
+
+// Each pixel is widened to four 16-bit lanes holding its alpha, multiplied by
+// { b, g, r, 255 } and divided by 255, so the alpha lane comes out unchanged.
+
+IME_TARGET_SSE2
+static void premultiplyCoverageSse2(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    const __m128i color = _mm_setr_epi16(b, g, r, 255, b, g, r, 255);
+    size_t i = 0;
+    for (; i + 4 <= pixelCount; i += 4) {
+        auto p = reinterpret_cast<__m128i*>(bgra + i * 4);
+        __m128i alpha = _mm_andnot_si128(_mm_loadu_si128(p), lowByte);
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(alpha, zero), color);
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(alpha, zero), color);
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    premultiplyCoverageScalar(bgra + i * 4, pixelCount - i, r, g, b);
+}
+
+IME_TARGET_AVX2
+static void premultiplyCoverageAvx2(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i lowByte = _mm256_set1_epi32(0xFF);
+    const __m256i color = _mm256_setr_epi16(b, g, r, 255, b, g, r, 255,
+        b, g, r, 255, b, g, r, 255);
+    size_t i = 0;
+    for (; i + 8 <= pixelCount; i += 8) {
+        auto p = reinterpret_cast<__m256i*>(bgra + i * 4);
+        __m256i alpha = _mm256_andnot_si256(_mm256_loadu_si256(p), lowByte);
+        alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 8));
+        alpha = _mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 16));
+
+        // unpack and pack both work within 128-bit lanes, so the pixel order is kept.
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(alpha, zero), color);
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(alpha, zero), color);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one), _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one), _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    premultiplyCoverageSse2(bgra + i * 4, pixelCount - i, r, g, b);
+}
+
+static PixelKernelIsa detectPixelKernelIsa() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse2 = __builtin_cpu_supports("sse2");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2)
+        return PixelKernelIsa::Avx2;
+    if (sse2)
+        return PixelKernelIsa::Sse2;
+    return PixelKernelIsa::Scalar;
+}
+
+#else // IME_PIXEL_KERNELS_X86
+
+static PixelKernelIsa detectPixelKernelIsa() {
+    return PixelKernelIsa::Scalar;
+}
+
+#endif // IME_PIXEL_KERNELS_X86
+
+PixelKernelIsa bestPixelKernelIsa() {
+    static const PixelKernelIsa isa = detectPixelKernelIsa();
+    return isa;
+}
+
+bool isPixelKernelIsaSupported(PixelKernelIsa isa) {
+    return isa <= bestPixelKernelIsa();
+}
+
+PremultiplyCoverageFunc premultiplyCoverageKernel(PixelKernelIsa isa) {
+    if (!isPixelKernelIsaSupported(isa))
+        isa = bestPixelKernelIsa();
+    switch (isa) {
+#ifdef IME_PIXEL_KERNELS_X86
+    case PixelKernelIsa::Avx2:
+        return premultiplyCoverageAvx2;
+    case PixelKernelIsa::Sse2:
+        return premultiplyCoverageSse2;
+#endif
+    default:
+        return premultiplyCoverageScalar;
+    }
+}
+
+void premultiplyCoverage(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b) {
+    static const PremultiplyCoverageFunc kernel = premultiplyCoverageKernel(bestPixelKernelIsa());
+    kernel(bgra, pixelCount, r, g, b);
+}
+
+} // namespace Ime
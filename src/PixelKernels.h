@@ -0,0 +1,59 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_PIXEL_KERNELS_H
+#define IME_PIXEL_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Win32-free pixel loops used by the GDI drawing code.
+// All buffers are 32bpp BGRA, as in a top-down or bottom-up DIB section.
+
+namespace Ime {
+
+enum class PixelKernelIsa {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// Converts text drawn in black on a white background into premultiplied
+// BGRA pixels of the given color. The coverage is read from the blue channel:
+// alpha = 255 - blue, and each color channel becomes channel * alpha / 255.
+using PremultiplyCoverageFunc = void (*)(uint8_t* bgra, size_t pixelCount,
+    uint8_t r, uint8_t g, uint8_t b);
+
+void premultiplyCoverageScalar(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b);
+
+// The best instruction set supported by the current CPU (detected once).
+PixelKernelIsa bestPixelKernelIsa();
+
+bool isPixelKernelIsaSupported(PixelKernelIsa isa);
+
+// Returns the kernel for the given instruction set, or the best supported
+// one if the CPU or the build does not support it.
+PremultiplyCoverageFunc premultiplyCoverageKernel(PixelKernelIsa isa);
+
+// Runs the fastest kernel available.
+void premultiplyCoverage(uint8_t* bgra, size_t pixelCount, uint8_t r, uint8_t g, uint8_t b);
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,60 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_SPAN_H
+#define IME_SPAN_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace Ime {
+
+// A read-only view of contiguous elements, standing in for the C++20
+// std::span<const T>. It does not own the elements, so it is only meant
+// for function parameters.
+template<typename T>
+class Span {
+public:
+    Span() = default;
+
+    Span(const T* data, size_t size) : data_(data), size_(size) {}
+
+    Span(const std::vector<T>& v) : data_(v.data()), size_(v.size()) {}
+
+    template<size_t N>
+    Span(const T (&array)[N]) : data_(array), size_(N) {}
+
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+    const T& operator[](size_t i) const { return data_[i]; }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,216 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_SURFACE_POOL_H
+#define IME_SURFACE_POOL_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cassert>
+#include "Geometry.h"
+
+namespace Ime {
+
+// Keeps drawing surfaces (DIB sections, etc) alive across frames so that
+// repainting a window does not allocate new ones each time.
+// Sizes are rounded up to multiples of granularity, and any idle surface
+// at least as large as the request is reused, so a surface only has to be
+// reallocated when the window grows past its bucket.
+// Surface is an opaque type; the allocator creates it and its destructor
+// frees it.
+template <typename Surface>
+class SurfacePool {
+public:
+    using Allocator = std::function<std::unique_ptr<Surface>(Size)>;
+
+    // A surface borrowed from the pool, given back on destruction.
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(const Lease&) = delete;
+        Lease(Lease&& other) noexcept :
+            pool_{ other.pool_ }, size_{ other.size_ }, surface_{ std::move(other.surface_) } {
+            other.pool_ = nullptr;
+        }
+
+        ~Lease() {
+            reset();
+        }
+
+        Lease& operator = (const Lease&) = delete;
+        Lease& operator = (Lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                pool_ = other.pool_;
+                size_ = other.size_;
+                surface_ = std::move(other.surface_);
+                other.pool_ = nullptr;
+            }
+            return *this;
+        }
+
+        // the allocated size, which may be larger than requested.
+        Size size() const {
+            return size_;
+        }
+
+        Surface* get() const {
+            return surface_.get();
+        }
+
+        Surface* operator-> () const {
+            return surface_.get();
+        }
+
+        Surface& operator * () const {
+            return *surface_;
+        }
+
+        explicit operator bool() const {
+            return surface_ != nullptr;
+        }
+
+        void reset() {
+            if (pool_ && surface_) {
+                pool_->giveBack(size_, std::move(surface_));
+            }
+            pool_ = nullptr;
+            surface_.reset();
+        }
+
+    private:
+        friend class SurfacePool;
+        Lease(SurfacePool* pool, Size size, std::unique_ptr<Surface> surface) :
+            pool_{ pool }, size_{ size }, surface_{ std::move(surface) } {
+        }
+
+        SurfacePool* pool_ = nullptr;
+        Size size_;
+        std::unique_ptr<Surface> surface_;
+    };
+
+    explicit SurfacePool(Allocator allocator, int granularity = 64, size_t maxIdle = 4) :
+        allocator_{ std::move(allocator) },
+        granularity_{ granularity > 0 ? granularity : 1 },
+        maxIdle_{ maxIdle } {
+    }
+
+    SurfacePool(const SurfacePool&) = delete;
+    SurfacePool& operator = (const SurfacePool&) = delete;
+
+    ~SurfacePool() {
+        // all leases must be returned before the pool goes away.
+        assert(outstanding_ == 0);
+    }
+
+    Lease acquire(Size size) {
+        // reuse the smallest idle surface which is large enough.
+        auto best = idle_.end();
+        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (it->size.cx >= size.cx && it->size.cy >= size.cy &&
+                (best == idle_.end() || area(it->size) < area(best->size))) {
+                best = it;
+            }
+        }
+        ++outstanding_;
+        if (best != idle_.end()) {
+            ++hits_;
+            Lease lease{ this, best->size, std::move(best->surface) };
+            idle_.erase(best);
+            return lease;
+        }
+        ++misses_;
+        Size bucket{ roundUp(size.cx), roundUp(size.cy) };
+        return Lease{ this, bucket, allocator_(bucket) };
+    }
+
+    // Frees the idle surfaces too small to hold size, for example after
+    // the window has grown.
+    void trim(Size size) {
+        idle_.erase(std::remove_if(idle_.begin(), idle_.end(), [&](const Entry& entry) {
+            return entry.size.cx < size.cx || entry.size.cy < size.cy;
+        }), idle_.end());
+    }
+
+    void clear() {
+        idle_.clear();
+    }
+
+    size_t hits() const {
+        return hits_;
+    }
+
+    size_t misses() const {
+        return misses_;
+    }
+
+    size_t idleCount() const {
+        return idle_.size();
+    }
+
+    size_t outstandingCount() const {
+        return outstanding_;
+    }
+
+    void resetCounters() {
+        hits_ = misses_ = 0;
+    }
+
+private:
+    struct Entry {
+        Size size;
+        std::unique_ptr<Surface> surface;
+    };
+
+    static long long area(Size size) {
+        return (long long) size.cx * size.cy;
+    }
+
+    int roundUp(int value) const {
+        if (value <= 0)
+            return granularity_;
+        return (value + granularity_ - 1) / granularity_ * granularity_;
+    }
+
+    void giveBack(Size size, std::unique_ptr<Surface> surface) {
+        assert(outstanding_ > 0);
+        --outstanding_;
+        idle_.push_back(Entry{ size, std::move(surface) });
+        if (idle_.size() > maxIdle_) {
+            // drop the smallest one
+            auto smallest = std::min_element(idle_.begin(), idle_.end(),
+                [](const Entry& a, const Entry& b) { return area(a.size) < area(b.size); });
+            idle_.erase(smallest);
+        }
+    }
+
+    Allocator allocator_;
+    int granularity_;
+    size_t maxIdle_;
+    std::vector<Entry> idle_;
+    size_t outstanding_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,115 @@
+//
+//    Copyright (C) 2013 - 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "KeyEvent.h"
+#include <Windows.h>
+
+#include <algorithm>
+
+namespace Ime {
+
+namespace {
+
+// the keyboard layout of the calling thread, asked again after
+// SystemKeyStateProvider::keyboardLayoutChanged()
+thread_local HKL threadLayout = NULL;
+
+// the keyboard layout of the calling thread
+class SystemKeyboardLayout: public KeyboardLayout {
+public:
+    uintptr_t id() override {
+        if(!threadLayout)
+            threadLayout = ::GetKeyboardLayout(0);
+        return (uintptr_t)threadLayout;
+    }
+
+    KeyText translate(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        BYTE states[256] = {};
+        if(modifiers & KeyModifierShift)
+            states[VK_SHIFT] = states[VK_LSHIFT] = 0x80;
+        if(modifiers & KeyModifierCapsLock)
+            states[VK_CAPITAL] = 0x01;
+        if(modifiers & KeyModifierAltGr)
+            states[VK_CONTROL] = states[VK_LCONTROL] = states[VK_MENU] = states[VK_RMENU] = 0x80;
+        return toUnicode(keyCode, scanCode, states);
+    }
+
+    KeyText translateAfterDeadKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        // The system keeps the dead key typed by the application, and
+        // combines it with the key in the real state of the keyboard.
+        BYTE states[256];
+        if(!::GetKeyboardState(states))
+            return translate(keyCode, scanCode, modifiers);
+        if(!(modifiers & KeyModifierAltGr))
+            states[VK_CONTROL] = states[VK_LCONTROL] = states[VK_RCONTROL] = 0;
+        return toUnicode(keyCode, scanCode, states);
+    }
+
+private:
+    KeyText toUnicode(unsigned keyCode, unsigned scanCode, const BYTE* states) {
+        // flag 4 keeps the dead key state of the keyboard as it is, since
+        // the key was not really typed here (Windows 10 1607 and later)
+        WCHAR buffer[16];
+        int result = ::ToUnicodeEx(keyCode, scanCode, states, buffer, 16, 4,
+            (HKL)id());
+        KeyText text;
+        if(result < 0)
+            text.deadKey = true;
+        else {
+            text.length = (uint8_t)(std::min)((size_t)result, KeyText::capacity);
+            for(size_t i = 0; i < text.length; ++i)
+                text.units[i] = buffer[i];
+        }
+        return text;
+    }
+};
+
+class SystemKeyStateProvider: public KeyStateProvider {
+public:
+    bool keyboardState(uint8_t* states) override {
+        return !!::GetKeyboardState(states);
+    }
+
+    uint8_t keyState(unsigned keyCode) override {
+        // the same bits as GetKeyboardState(), without copying all 256
+        SHORT state = ::GetKeyState((int)keyCode);
+        return (uint8_t)(((state & 0x8000) ? 0x80 : 0) | (state & 1));
+    }
+
+    KeyText translateKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        // the keyboard layout is per thread, and so is its cache
+        thread_local KeyTranslationCache cache;
+        SystemKeyboardLayout layout;
+        return cache.translate(layout, keyCode, scanCode, modifiers);
+    }
+
+    void keyboardLayoutChanged() override {
+        threadLayout = NULL;
+    }
+};
+
+} // namespace
+
+KeyStateProvider& systemKeyStateProvider() {
+    // its state is per thread, so one object serves every thread
+    static SystemKeyStateProvider provider;
+    return provider;
+}
+
+} // namespace Ime
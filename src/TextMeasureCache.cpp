@@ -0,0 +1,80 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "TextMeasureCache.h"
+
+namespace Ime {
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    auto p = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t TextMeasureCache::KeyHash::operator()(const KeyView& key) const {
+    size_t hash = std::hash<std::wstring_view>{}(key.text);
+    hash ^= size_t(key.font.id * 0x9E3779B97F4A7C15ull) + size_t(key.font.dpi) + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+TextMeasureCache::TextMeasureCache(size_t capacity) :
+    capacity_(capacity > 0 ? capacity : 1) {
+    index_.reserve(capacity_);
+}
+
+Size TextMeasureCache::measure(FontKey font, std::wstring_view text, TextMeasurer& measurer) {
+    auto it = index_.find(KeyView{ font, text });
+    if (it != index_.end()) {
+        ++hits_;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->size;
+    }
+
+    ++misses_;
+    Size size = measurer.measure(text);
+    if (entries_.size() >= capacity_) {
+        const auto& last = entries_.back();
+        index_.erase(KeyView{ last.font, last.text });
+        entries_.pop_back();
+    }
+    entries_.push_front(Entry{ font, std::wstring(text), size });
+    index_.emplace(KeyView{ font, entries_.front().text }, entries_.begin());
+    return size;
+}
+
+const Size* TextMeasureCache::peek(FontKey font, std::wstring_view text) const {
+    auto it = index_.find(KeyView{ font, text });
+    return it != index_.end() ? &it->second->size : nullptr;
+}
+
+void TextMeasureCache::clear() {
+    index_.clear();
+    entries_.clear();
+}
+
+double TextMeasureCache::hitRate() const {
+    size_t lookups = hits_ + misses_;
+    return lookups ? double(hits_) / lookups : 0.0;
+}
+
+} // namespace Ime
@@ -0,0 +1,128 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_TEXT_MEASURE_CACHE_H
+#define IME_TEXT_MEASURE_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "Geometry.h"
+
+namespace Ime {
+
+// Identifies a font as rendered: a hash of its description plus the DPI.
+struct FontKey {
+    uint64_t id = 0;
+    int dpi = 96;
+
+    bool operator == (const FontKey& other) const {
+        return id == other.id && dpi == other.dpi;
+    }
+    bool operator != (const FontKey& other) const {
+        return !(*this == other);
+    }
+};
+
+// FNV-1a, used to build FontKey::id from a font description.
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Measures the extent of a string in some font. Implemented with GDI on
+// Windows and faked in the tests.
+class TextMeasurer {
+public:
+    virtual ~TextMeasurer() {}
+    virtual Size measure(std::wstring_view text) = 0;
+};
+
+// A least recently used cache of text extents keyed by (font, DPI, string).
+// Candidate lists repeat the same strings over and over, so most layout and
+// paint passes never need to call into the measurer.
+class TextMeasureCache {
+public:
+    explicit TextMeasureCache(size_t capacity = 1024);
+
+    // Returns the extent of text, asking measurer only on a cache miss.
+    Size measure(FontKey font, std::wstring_view text, TextMeasurer& measurer);
+
+    // Looks up text without touching the statistics or the LRU order.
+    const Size* peek(FontKey font, std::wstring_view text) const;
+
+    void clear();
+
+    size_t size() const {
+        return entries_.size();
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    size_t hits() const {
+        return hits_;
+    }
+
+    size_t misses() const {
+        return misses_;
+    }
+
+    // hits / lookups, or 0 if nothing was looked up yet.
+    double hitRate() const;
+
+    void resetCounters() {
+        hits_ = misses_ = 0;
+    }
+
+private:
+    struct Entry {
+        FontKey font;
+        std::wstring text;
+        Size size;
+    };
+
+    // Points into the text of an Entry, or into the caller's string during
+    // lookups, so that finding an entry does not copy the string.
+    struct KeyView {
+        FontKey font;
+        std::wstring_view text;
+
+        bool operator == (const KeyView& other) const {
+            return font == other.font && text == other.text;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const KeyView& key) const;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    size_t capacity_;
+    EntryList entries_; // most recently used first
+    std::unordered_map<KeyView, EntryList::iterator, KeyHash> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace Ime
+
+#endif
@@ -19,7 +19,6 @@
 
 #include "TextService.h"
 #include "EditSession.h"
-#include "CandidateWindow.h"
 #include "LangBarButton.h"
 #include "DisplayAttributeInfoEnum.h"
 #include "ImeModule.h"
@@ -27,6 +26,7 @@
 #include <assert.h>
 #include <string>
 #include <algorithm>
+#include <memory>
 
 using namespace std;
 
@@ -39,6 +39,7 @@ TextService::TextService(ImeModule* module):
     clientId_(TF_CLIENTID_NULL),
     activateFlags_(0),
     isKeyboardOpened_(false),
+    keyEvents_(systemKeyStateProvider()),
     langBarSinkCookie_(TF_INVALID_COOKIE) {
 
 }
@@ -65,10 +66,8 @@ DWORD TextService::langBarStatus() const {
 void TextService::addButton(LangBarButton* button) {
     if(button) {
         langBarButtons_.emplace_back(button);
-        if(isActivated()) {
-            if(auto langBarItemMgr = threadMgr_.query<ITfLangBarItemMgr>()) {
-                langBarItemMgr->AddItem(button);
-            }
+        if(auto& langBarItemMgr = threadMgrInterfaces_.langBarItemMgr) {
+            langBarItemMgr->AddItem(button);
         }
     }
 }
@@ -77,10 +76,8 @@ void TextService::removeButton(LangBarButton* button) {
     if(button) {
         auto it = find(langBarButtons_.begin(), langBarButtons_.end(), button);
         if(it != langBarButtons_.end()) {
-            if(isActivated()) {
-                if(auto langBarItemMgr = threadMgr_.query<ITfLangBarItemMgr>()) {
-                    langBarItemMgr->RemoveItem(button);
-                }
+            if(auto& langBarItemMgr = threadMgrInterfaces_.langBarItemMgr) {
+                langBarItemMgr->RemoveItem(button);
             }
             langBarButtons_.erase(it);
         }
@@ -94,10 +91,9 @@ void TextService::addPreservedKey(UINT keyCode, UINT modifiers, const GUID& guid
     preservedKey.uVKey = keyCode;
     preservedKey.uModifiers = modifiers;
     preservedKeys_.push_back(preservedKey);
-    if(threadMgr_) { // our text service is activated
-        if (auto keystrokeMgr = threadMgr_.query<ITfKeystrokeMgr>()) {
-            keystrokeMgr->PreserveKey(clientId_, guid, &preservedKey, NULL, 0);
-        }
+    // only set while our text service is activated
+    if (auto& keystrokeMgr = threadMgrInterfaces_.keystrokeMgr) {
+        keystrokeMgr->PreserveKey(clientId_, guid, &preservedKey, NULL, 0);
     }
 }
 
@@ -108,7 +104,7 @@ void TextService::removePreservedKey(const GUID& guid) {
         }
     );
     if (it != preservedKeys_.end()) {
-        if (auto keystrokeMgr = threadMgr_.query<ITfKeystrokeMgr>()) {
+        if (auto& keystrokeMgr = threadMgrInterfaces_.keystrokeMgr) {
             auto& preservedKey = *it;
             keystrokeMgr->UnpreserveKey(preservedKey.guid, &preservedKey);
         }
@@ -124,9 +120,22 @@ bool TextService::isComposing() const {
 }
 
 // is keyboard disabled for the context (NULL means current context)
-bool TextService::isKeyboardDisabled(ITfContext* context) const {
-    return (contextCompartmentValue(GUID_COMPARTMENT_KEYBOARD_DISABLED, context)
-        || contextCompartmentValue(GUID_COMPARTMENT_EMPTYCONTEXT, context));
+bool TextService::isKeyboardDisabled(ComRef<ITfContext> context) const {
+    ComPtr<ITfContext> curContext;
+    if(!context) {
+        curContext = currentContext();
+        context = curContext;
+    }
+    if(context) {
+        if(auto compartmentMgr = contextCompartmentMgr(context)) {
+            ComPtr<ITfCompartment> compartment;
+            for(const GUID& key : { GUID_COMPARTMENT_KEYBOARD_DISABLED, GUID_COMPARTMENT_EMPTYCONTEXT }) {
+                if(compartmentMgr->GetCompartment(key, compartment.put()) == S_OK && compartmentValue(compartment))
+                    return true;
+            }
+        }
+    }
+    return false;
 }
 
 // is keyboard opened for the whole thread
@@ -150,7 +159,7 @@ bool TextService::isInsertionAllowed(EditSession* session) const {
         TF_SELECTION selection;
         if(session->context()->GetSelection(cookie, TF_DEFAULT_SELECTION, 1, &selection, &selectionNum) == S_OK) {
             ComPtr<ITfRange> compositionRange;
-            if(composition_->GetRange(&compositionRange) == S_OK) {
+            if(composition_->GetRange(compositionRange.put()) == S_OK) {
                 bool allowed = false;
                 // check if current selection is covered by composition range
                 LONG compareResult1;
@@ -167,23 +176,22 @@ bool TextService::isInsertionAllowed(EditSession* session) const {
     return false;
 }
 
-void TextService::startComposition(ITfContext* context) {
+void TextService::startComposition(ComRef<ITfContext> context) {
     assert(context);
     HRESULT sessionResult;
     auto editSession = ComPtr<EditSession>::make(
         context,
         [=](EditSession* session, TfEditCookie cookie) {
-            if (auto contextComposition = ComPtr<ITfContextComposition>::queryFrom(context)) {
+            if (auto contextComposition = context.query<ITfContextComposition>()) {
                 // get current insertion point in the current context
                 ComPtr<ITfRange> range;
-                if (auto insertAtSelection = ComPtr<ITfInsertAtSelection>::queryFrom(context)) {
+                if (auto insertAtSelection = context.query<ITfInsertAtSelection>()) {
                     // get current selection range & insertion position (query only, did not insert any text)
-                    insertAtSelection->InsertTextAtSelection(cookie, TF_IAS_QUERYONLY, NULL, 0, &range);
+                    insertAtSelection->InsertTextAtSelection(cookie, TF_IAS_QUERYONLY, NULL, 0, range.put());
                 }
 
                 if (range) {
-                    composition_ = nullptr;
-                    if (contextComposition->StartComposition(cookie, range, (ITfCompositionSink*)this, &composition_) == S_OK) {
+                    if (contextComposition->StartComposition(cookie, range, (ITfCompositionSink*)this, composition_.put()) == S_OK) {
                         // according to the official TSF samples, we need to reset the current
                         // selection here. (maybe the range is altered by StartComposition()?
                         TF_SELECTION selection;
@@ -199,7 +207,7 @@ void TextService::startComposition(ITfContext* context) {
     context->RequestEditSession(clientId_, editSession, TF_ES_SYNC|TF_ES_READWRITE, &sessionResult);
 }
 
-void TextService::endComposition(ITfContext* context) {
+void TextService::endComposition(ComRef<ITfContext> context) {
     assert(context);
     HRESULT sessionResult;
     auto editSession = ComPtr<EditSession>::make(
@@ -208,10 +216,10 @@ void TextService::endComposition(ITfContext* context) {
             if (composition_) {
                 // move current insertion point to end of the composition string
                 ComPtr<ITfRange> compositionRange;
-                if (composition_->GetRange(&compositionRange) == S_OK) {
+                if (composition_->GetRange(compositionRange.put()) == S_OK) {
                     // clear display attribute for the composition range
                     ComPtr<ITfProperty> dispAttrProp;
-                    if (context->GetProperty(GUID_PROP_ATTRIBUTE, &dispAttrProp) == S_OK) {
+                    if (context->GetProperty(GUID_PROP_ATTRIBUTE, dispAttrProp.put()) == S_OK) {
                         dispAttrProp->Clear(cookie, compositionRange);
                     }
 
@@ -239,7 +247,7 @@ std::wstring TextService::compositionString(EditSession* session) const {
     std::wstring result;
     if (composition_) {
         ComPtr<ITfRange> compositionRange;
-        if (composition_->GetRange(&compositionRange) == S_OK) {
+        if (composition_->GetRange(compositionRange.put()) == S_OK) {
             auto rangeAcp = compositionRange.query<ITfRangeACP>();
             if (rangeAcp) {
                 LONG anchor, bufLen;
@@ -258,7 +266,7 @@ std::wstring TextService::compositionString(EditSession* session) const {
 }
 
 void TextService::setCompositionString(EditSession* session, const wchar_t* str, int len) const {
-    ITfContext* context = session->context();
+    auto context = session->context();
     if(context) {
         TfEditCookie editCookie = session->editCookie();
         TF_SELECTION selection;
@@ -266,7 +274,7 @@ void TextService::setCompositionString(EditSession* session, const wchar_t* str,
         // get current selection/insertion point
         if(context->GetSelection(editCookie, TF_DEFAULT_SELECTION, 1, &selection, &selectionNum) == S_OK) {
             ComPtr<ITfRange> compositionRange;
-            if(composition_->GetRange(&compositionRange) == S_OK) {
+            if(composition_->GetRange(compositionRange.put()) == S_OK) {
                 bool selPosInComposition = true;
                 // if current insertion point is not covered by composition, we cannot insert text here.
                 if(selPosInComposition) {
@@ -280,7 +288,7 @@ void TextService::setCompositionString(EditSession* session, const wchar_t* str,
 
                 // set display attribute to the composition range
                 ComPtr<ITfProperty> dispAttrProp;
-                if(context->GetProperty(GUID_PROP_ATTRIBUTE, &dispAttrProp) == S_OK) {
+                if(context->GetProperty(GUID_PROP_ATTRIBUTE, dispAttrProp.put()) == S_OK) {
                     VARIANT val;
                     val.vt = VT_I4;
                     val.lVal = module_->inputAttrib()->atom();
@@ -301,7 +309,7 @@ void TextService::setCompositionCursor(EditSession* session, int pos) const {
     if(session->context()->GetSelection(session->editCookie(), TF_DEFAULT_SELECTION, 1, &selection, &selectionNum) == S_OK) {
         // get composition range
         ComPtr<ITfRange> compositionRange;
-        if(composition_->GetRange(&compositionRange) == S_OK) {
+        if(composition_->GetRange(compositionRange.put()) == S_OK) {
             // make the start of selectionRange the same as that of compositionRange
             selection.range->ShiftStartToRange(session->editCookie(), compositionRange, TF_ANCHOR_START);
             selection.range->Collapse(session->editCookie(), TF_ANCHOR_START);
@@ -323,12 +331,12 @@ ComPtr<ITfCompartment> TextService::globalCompartment(const GUID& key) const {
     if (threadMgr == nullptr) {
         // if we don't have a thread manager (this is possible when we try to access
         // a global compartment while the text service is not activated)
-        ::CoCreateInstance(CLSID_TF_ThreadMgr, NULL, CLSCTX_INPROC_SERVER, IID_ITfThreadMgr, (void**)&threadMgr);
+        ::CoCreateInstance(CLSID_TF_ThreadMgr, NULL, CLSCTX_INPROC_SERVER, IID_ITfThreadMgr, (void**)threadMgr.put());
     }
     if(threadMgr) {
         ComPtr<ITfCompartmentMgr> compartmentMgr;
-        if(threadMgr_->GetGlobalCompartment(&compartmentMgr) == S_OK) {
-            compartmentMgr->GetCompartment(key, &compartment);
+        if(threadMgr->GetGlobalCompartment(compartmentMgr.put()) == S_OK) {
+            compartmentMgr->GetCompartment(key, compartment.put());
         }
     }
     return compartment;
@@ -336,27 +344,27 @@ ComPtr<ITfCompartment> TextService::globalCompartment(const GUID& key) const {
 
 ComPtr<ITfCompartment> TextService::threadCompartment(const GUID& key) const {
     if(threadMgr_) {
-        auto compartmentMgr = threadMgr_.query<ITfCompartmentMgr>();
+        auto& compartmentMgr = threadMgrInterfaces_.compartmentMgr;
         if(compartmentMgr) {
             ComPtr<ITfCompartment> compartment;
-            compartmentMgr->GetCompartment(key, &compartment);
+            compartmentMgr->GetCompartment(key, compartment.put());
             return compartment;
         }
     }
     return nullptr;
 }
 
-ComPtr<ITfCompartment> TextService::contextCompartment(const GUID& key, ITfContext* context) const {
+ComPtr<ITfCompartment> TextService::contextCompartment(const GUID& key, ComRef<ITfContext> context) const {
     ComPtr<ITfContext> curContext;
     if(!context) {
         curContext = currentContext();
         context = curContext;
     }
     if(context) {
-        auto compartmentMgr = ComPtr<ITfCompartmentMgr>::queryFrom(context);
+        auto compartmentMgr = contextCompartmentMgr(context);
         if(compartmentMgr) {
             ComPtr<ITfCompartment> compartment;
-            compartmentMgr->GetCompartment(key, &compartment);
+            compartmentMgr->GetCompartment(key, compartment.put());
             return compartment;
         }
     }
@@ -376,14 +384,14 @@ void TextService::setGlobalCompartmentValue(const GUID& key, DWORD value) const
     };
 }
 
-DWORD TextService::contextCompartmentValue(const GUID& key, ITfContext* context) const {
-    if (auto compartment = contextCompartment(key)) {
+DWORD TextService::contextCompartmentValue(const GUID& key, ComRef<ITfContext> context) const {
+    if (auto compartment = contextCompartment(key, context)) {
         return compartmentValue(compartment);
     }
     return 0;
 }
 
-void TextService::setContextCompartmentValue(const GUID& key, DWORD value, ITfContext* context) const {
+void TextService::setContextCompartmentValue(const GUID& key, DWORD value, ComRef<ITfContext> context) const {
     if (auto compartment = contextCompartment(key, context)) {
         setCompartmentValue(compartment, value);
     }
@@ -402,7 +410,7 @@ void TextService::setThreadCompartmentValue(const GUID& key, DWORD value) const
     }
 }
 
-DWORD TextService::compartmentValue(ITfCompartment* compartment) const {
+DWORD TextService::compartmentValue(ComRef<ITfCompartment> compartment) const {
     VARIANT var;
     if (compartment->GetValue(&var) == S_OK && var.vt == VT_I4) {
         return (DWORD)var.lVal;
@@ -410,7 +418,7 @@ DWORD TextService::compartmentValue(ITfCompartment* compartment) const {
     return 0;
 }
 
-void TextService::setCompartmentValue(ITfCompartment* compartment, DWORD value) const {
+void TextService::setCompartmentValue(ComRef<ITfCompartment> compartment, DWORD value) const {
     VARIANT var;
     ::VariantInit(&var);
     var.vt = VT_I4;
@@ -499,6 +507,14 @@ void TextService::onLangProfileActivated(REFGUID guidProfile) {
 void TextService::onLangProfileDeactivated(REFGUID guidProfile) {
 }
 
+ComRef<ITfCompartmentMgr> TextService::contextCompartmentMgr(ComRef<ITfContext> context) const {
+    if(compartmentContext_ != context) {
+        contextCompartmentMgr_ = context.query<ITfCompartmentMgr>();
+        compartmentContext_ = context;
+    }
+    return contextCompartmentMgr_;
+}
+
 void TextService::initKeyboardState() {
     // get current keyboard state
     isKeyboardOpened_ = threadCompartmentValue(GUID_COMPARTMENT_KEYBOARD_OPENCLOSE) != 0;
@@ -512,14 +528,14 @@ void TextService::initKeyboardState() {
 
 void TextService::installEventListeners() {
     // ITfThreadMgrEventSink, ITfActiveLanguageProfileNotifySink, and ITfTextEditSink
-    if (auto source = threadMgr_.query<ITfSource>()) {
+    if (auto& source = threadMgrInterfaces_.source) {
         threadMgrEventSink_ = SinkAdvice{ source, IID_ITfThreadMgrEventSink, static_cast<ITfThreadMgrEventSink*>(this) };
         activateLanguageProfileNotifySink_ = SinkAdvice{ source, IID_ITfActiveLanguageProfileNotifySink, static_cast<ITfActiveLanguageProfileNotifySink*>(this) };
         textEditSink_ = SinkAdvice{ source, IID_ITfTextEditSink, static_cast<ITfTextEditSink*>(this) };
     }
 
     // ITfKeyEventSink
-    if (auto keystrokeMgr = threadMgr_.query<ITfKeystrokeMgr>()) {
+    if (auto& keystrokeMgr = threadMgrInterfaces_.keystrokeMgr) {
         keystrokeMgr->AdviseKeyEventSink(clientId_, (ITfKeyEventSink*)this, TRUE);
 
         // register preserved keys
@@ -541,7 +557,7 @@ void TextService::uninstallEventListeners() {
     textEditSink_.unadvise();
 
     // ITfKeyEventSink
-    if (auto keystrokeMgr = threadMgr_.query<ITfKeystrokeMgr>()) {
+    if (auto& keystrokeMgr = threadMgrInterfaces_.keystrokeMgr) {
         keystrokeMgr->UnadviseKeyEventSink(clientId_);
         // unregister preserved keys
         for (const auto& preservedKey : preservedKeys_) {
@@ -555,13 +571,13 @@ void TextService::uninstallEventListeners() {
 
 void TextService::activateLanguageButtons() {
     ::CoCreateInstance(CLSID_TF_LangBarMgr, NULL, CLSCTX_INPROC_SERVER,
-        IID_ITfLangBarMgr, (void**)&langBarMgr_);
+        IID_ITfLangBarMgr, (void**)langBarMgr_.put());
     if (langBarMgr_) {
         langBarMgr_->AdviseEventSink(this, NULL, 0, &langBarSinkCookie_);
     }
     // Note: language bar has no effects in Win 8 immersive mode
     if (!langBarButtons_.empty()) {
-        if (auto langBarItemMgr = threadMgr_.query<ITfLangBarItemMgr>()) {
+        if (auto& langBarItemMgr = threadMgrInterfaces_.langBarItemMgr) {
             for (auto& button : langBarButtons_) {
                 langBarItemMgr->AddItem(button);
             }
@@ -571,7 +587,7 @@ void TextService::activateLanguageButtons() {
 
 void TextService::deactivateLanguageButtons() {
     if (!langBarButtons_.empty()) {
-        if (auto langBarItemMgr = threadMgr_.query<ITfLangBarItemMgr>()) {
+        if (auto& langBarItemMgr = threadMgrInterfaces_.langBarItemMgr) {
             for (auto& button : langBarButtons_) {
                 langBarItemMgr->RemoveItem(button);
             }
@@ -591,6 +607,10 @@ STDMETHODIMP TextService::Activate(ITfThreadMgr *pThreadMgr, TfClientId tfClient
     // store tsf manager & client id
     threadMgr_ = pThreadMgr;
     clientId_ = tfClientId;
+    threadMgrInterfaces_.keystrokeMgr = threadMgr_.query<ITfKeystrokeMgr>();
+    threadMgrInterfaces_.langBarItemMgr = threadMgr_.query<ITfLangBarItemMgr>();
+    threadMgrInterfaces_.source = threadMgr_.query<ITfSource>();
+    threadMgrInterfaces_.compartmentMgr = threadMgr_.query<ITfCompartmentMgr>();
 
     activateFlags_ = 0;
     if(auto threadMgrEx = threadMgr_.query<ITfThreadMgrEx>()) {
@@ -618,6 +638,9 @@ STDMETHODIMP TextService::Deactivate() {
     deactivateLanguageButtons();
     uninstallEventListeners();
 
+    threadMgrInterfaces_ = ThreadMgrInterfaces{};
+    compartmentContext_ = nullptr;
+    contextCompartmentMgr_ = nullptr;
     threadMgr_ = nullptr;
     clientId_ = TF_CLIENTID_NULL;
     activateFlags_ = 0;
@@ -657,6 +680,10 @@ STDMETHODIMP TextService::OnPushContext(ITfContext *pContext) {
 }
 
 STDMETHODIMP TextService::OnPopContext(ITfContext *pContext) {
+    if(compartmentContext_ == pContext) {
+        compartmentContext_ = nullptr;
+        contextCompartmentMgr_ = nullptr;
+    }
     return S_OK;
 }
 
@@ -680,7 +707,7 @@ STDMETHODIMP TextService::OnEndEdit(ITfContext *pContext, TfEditCookie ecReadOnl
             ULONG selectionNum;
             if(pContext->GetSelection(ecReadOnly, TF_DEFAULT_SELECTION, 1, &selection, &selectionNum) == S_OK) {
                 ComPtr<ITfRange> compRange;
-                if(composition_->GetRange(&compRange) == S_OK) {
+                if(composition_->GetRange(compRange.put()) == S_OK) {
                     // check if two ranges overlaps
                     // check if current selection is covered by composition range
                     LONG compareResult1;
@@ -719,8 +746,10 @@ STDMETHODIMP TextService::OnTestKeyDown(ITfContext *pContext, WPARAM wParam, LPA
         *pfEaten = FALSE;
     }
     else {
-        KeyEvent keyEvent(WM_KEYDOWN, wParam, lParam);
+        KeyEvent& keyEvent = keyEvents_.test(WM_KEYDOWN, wParam, lParam);
         *pfEaten = (BOOL)filterKeyDown(keyEvent);
+        if(keystrokeRecorder_)
+            keystrokeRecorder_->record(keyEvent, pContext, true, *pfEaten);
     }
     return S_OK;
 }
@@ -732,7 +761,7 @@ STDMETHODIMP TextService::OnKeyDown(ITfContext *pContext, WPARAM wParam, LPARAM
         *pfEaten = FALSE;
     }
     else {
-        KeyEvent keyEvent(WM_KEYDOWN, wParam, lParam);
+        KeyEvent& keyEvent = keyEvents_.handle(WM_KEYDOWN, wParam, lParam);
         *pfEaten = (BOOL)filterKeyDown(keyEvent);
         if(*pfEaten) { // we want to eat the key
             HRESULT sessionResult;
@@ -751,6 +780,8 @@ STDMETHODIMP TextService::OnKeyDown(ITfContext *pContext, WPARAM wParam, LPARAM
             // called before RequestEditSession() returns.
             pContext->RequestEditSession(clientId_, session, TF_ES_SYNC|TF_ES_READWRITE, &sessionResult);
         }
+        if(keystrokeRecorder_)
+            keystrokeRecorder_->record(keyEvent, pContext, false, *pfEaten);
     }
     return S_OK;
 }
@@ -760,8 +791,10 @@ STDMETHODIMP TextService::OnTestKeyUp(ITfContext *pContext, WPARAM wParam, LPARA
         *pfEaten = FALSE;
     }
     else {
-        KeyEvent keyEvent(WM_KEYDOWN, wParam, lParam);
+        KeyEvent& keyEvent = keyEvents_.test(WM_KEYUP, wParam, lParam);
         *pfEaten = (BOOL)filterKeyUp(keyEvent);
+        if(keystrokeRecorder_)
+            keystrokeRecorder_->record(keyEvent, pContext, true, *pfEaten);
     }
     return S_OK;
 }
@@ -773,7 +806,7 @@ STDMETHODIMP TextService::OnKeyUp(ITfContext *pContext, WPARAM wParam, LPARAM lP
         *pfEaten = FALSE;
     }
     else {
-        KeyEvent keyEvent(WM_KEYUP, wParam, lParam);
+        KeyEvent& keyEvent = keyEvents_.handle(WM_KEYUP, wParam, lParam);
         *pfEaten = (BOOL)filterKeyUp(keyEvent);
         if(*pfEaten) {
             HRESULT sessionResult;
@@ -785,6 +818,8 @@ STDMETHODIMP TextService::OnKeyUp(ITfContext *pContext, WPARAM wParam, LPARAM lP
             );
             pContext->RequestEditSession(clientId_, session, TF_ES_SYNC|TF_ES_READWRITE, &sessionResult);
         }
+        if(keystrokeRecorder_)
+            keystrokeRecorder_->record(keyEvent, pContext, false, *pfEaten);
     }
     return S_OK;
 }
@@ -854,6 +889,8 @@ STDMETHODIMP TextService::GetItemFloatingRect(DWORD dwThreadId, REFGUID rguid, R
 
 // ITfActiveLanguageProfileNotifySink
 STDMETHODIMP TextService::OnActivated(REFCLSID clsid, REFGUID guidProfile, BOOL fActivated) {
+    // any profile, ours or not, may come with another keyboard layout
+    keyEvents_.provider().keyboardLayoutChanged();
     // we only support one text service, so clsid must be the same as that of our text service.
     // otherwise it's not the notification for our text service, just ignore the event.
     if(clsid == module_->textServiceClsid()) {
@@ -870,8 +907,8 @@ STDMETHODIMP TextService::OnActivated(REFCLSID clsid, REFGUID guidProfile, BOOL
 ComPtr<ITfContext> TextService::currentContext() const {
     ComPtr<ITfContext> context;
     ComPtr<ITfDocumentMgr>  docMgr;
-    if(threadMgr_->GetFocus(&docMgr) == S_OK) {
-        docMgr->GetTop(&context);
+    if(threadMgr_->GetFocus(docMgr.put()) == S_OK) {
+        docMgr->GetTop(context.put());
     }
     return context;
 }
@@ -880,10 +917,10 @@ bool TextService::compositionRect(EditSession* session, RECT* rect) const {
     bool ret = false;
     if(isComposing()) {
         ComPtr<ITfContextView> view;
-        if(session->context()->GetActiveView(&view) == S_OK) {
+        if(session->context()->GetActiveView(view.put()) == S_OK) {
             BOOL clipped;
             ComPtr<ITfRange> range;
-            if(composition_->GetRange(&range) == S_OK) {
+            if(composition_->GetRange(range.put()) == S_OK) {
                 if(view->GetTextExt(session->editCookie(), range, rect, &clipped) == S_OK)
                     ret = true;
             }
@@ -896,7 +933,7 @@ bool TextService::selectionRect(EditSession* session, RECT* rect) const {
     bool ret = false;
     if(isComposing()) {
         ComPtr<ITfContextView> view;
-        if(session->context()->GetActiveView(&view) == S_OK) {
+        if(session->context()->GetActiveView(view.put()) == S_OK) {
             BOOL clipped;
             TF_SELECTION selection;
             ULONG selectionNum;
@@ -913,7 +950,7 @@ bool TextService::selectionRect(EditSession* session, RECT* rect) const {
 HWND TextService::compositionWindow(EditSession* session) const {
     HWND hwnd = NULL;
     ComPtr<ITfContextView> view;
-    if(session->context()->GetActiveView(&view) == S_OK) {
+    if(session->context()->GetActiveView(view.put()) == S_OK) {
         // get current composition window
         view->GetWnd(&hwnd);
     }
@@ -24,6 +24,7 @@
 #include <msctf.h>
 #include "EditSession.h"
 #include "KeyEvent.h"
+#include "KeystrokeLog.h"
 #include "ComPtr.h"
 #include "DisplayAttributeInfo.h"
 #include "DisplayAttributeProvider.h"
@@ -126,15 +127,21 @@ public:
     bool isComposing() const;
 
     // is keyboard disabled for the context (nullptr means current context)
-    bool isKeyboardDisabled(ITfContext* context = nullptr) const;
+    bool isKeyboardDisabled(ComRef<ITfContext> context = nullptr) const;
     
     // is keyboard opened for the whole thread
     bool isKeyboardOpened() const;
     void setKeyboardOpen(bool open);
 
+    // Logs every key given to the engine, with its result, until set to
+    // nullptr (see KeystrokeReplay.h). The caller owns the recorder.
+    void setKeystrokeRecorder(KeystrokeRecorder* recorder) {
+        keystrokeRecorder_ = recorder;
+    }
+
     bool isInsertionAllowed(EditSession* session) const;
-    void startComposition(ITfContext* context);
-    void endComposition(ITfContext* context);
+    void startComposition(ComRef<ITfContext> context);
+    void endComposition(ComRef<ITfContext> context);
     bool compositionRect(EditSession* session, RECT* rect) const;
     bool selectionRect(EditSession* session, RECT* rect) const;
     HWND compositionWindow(EditSession* session) const;
@@ -146,7 +153,7 @@ public:
     // compartment handling
     ComPtr<ITfCompartment> globalCompartment(const GUID& key) const;
     ComPtr<ITfCompartment> threadCompartment(const GUID& key) const;
-    ComPtr<ITfCompartment> contextCompartment(const GUID& key, ITfContext* context = nullptr) const;
+    ComPtr<ITfCompartment> contextCompartment(const GUID& key, ComRef<ITfContext> context = nullptr) const;
 
     DWORD globalCompartmentValue(const GUID& key) const;
     void setGlobalCompartmentValue(const GUID& key, DWORD value) const;
@@ -154,11 +161,11 @@ public:
     DWORD threadCompartmentValue(const GUID& key) const;
     void setThreadCompartmentValue(const GUID& key, DWORD value) const;
 
-    DWORD contextCompartmentValue(const GUID& key, ITfContext* context = nullptr) const;
-    void setContextCompartmentValue(const GUID& key, DWORD value, ITfContext* context = nullptr) const;
+    DWORD contextCompartmentValue(const GUID& key, ComRef<ITfContext> context = nullptr) const;
+    void setContextCompartmentValue(const GUID& key, DWORD value, ComRef<ITfContext> context = nullptr) const;
 
-    DWORD compartmentValue(ITfCompartment* compartment) const;
-    void setCompartmentValue(ITfCompartment* compartment, DWORD value) const;
+    DWORD compartmentValue(ComRef<ITfCompartment> compartment) const;
+    void setCompartmentValue(ComRef<ITfCompartment> compartment, DWORD value) const;
 
     // virtual functions that IME implementors may need to override
     virtual void onActivate();
@@ -262,16 +269,38 @@ protected:
     void activateLanguageButtons();
     void deactivateLanguageButtons();
 
+    // the compartment manager of context, queried again only when it is
+    // another context than the last one
+    ComRef<ITfCompartmentMgr> contextCompartmentMgr(ComRef<ITfContext> context) const;
+
 protected: // COM object should not be deleted directly. calling Release() instead.
     virtual ~TextService(void);
 
 private:
+    // The interfaces of threadMgr_ the helpers use, queried once by
+    // Activate() and released by Deactivate().
+    struct ThreadMgrInterfaces {
+        ComPtr<ITfKeystrokeMgr> keystrokeMgr;
+        ComPtr<ITfLangBarItemMgr> langBarItemMgr;
+        ComPtr<ITfSource> source;
+        ComPtr<ITfCompartmentMgr> compartmentMgr;
+    };
+
     ComPtr<ImeModule> module_;
     ComPtr<ITfDisplayAttributeProvider> displayAttributeProvider_;
     ComPtr<ITfThreadMgr> threadMgr_;
+    ThreadMgrInterfaces threadMgrInterfaces_;
+    // the context whose compartments were last read, usually the one
+    // keys are sent to, and its compartment manager; released when the
+    // context is popped
+    mutable ComPtr<ITfContext> compartmentContext_;
+    mutable ComPtr<ITfCompartmentMgr> contextCompartmentMgr_;
     TfClientId clientId_;
     DWORD activateFlags_;
     bool isKeyboardOpened_;
+    // shares the key states between OnTestKeyDown() and OnKeyDown(), etc
+    KeyEventCache keyEvents_;
+    KeystrokeRecorder* keystrokeRecorder_ = nullptr;
 
     // event sink cookies
     SinkAdvice threadMgrEventSink_;
@@ -0,0 +1,266 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "ThemeBinary.h"
+#include "TextMeasureCache.h"  // hashBytes()
+
+#include <algorithm>
+#include <utility>
+
+namespace Ime {
+
+namespace {
+
+constexpr uint8_t magic[4] = { 'I', 'M', 'T', 'H' };
+constexpr size_t headerSize = 24;
+constexpr size_t pixelAlignment = 16;
+
+class Writer {
+public:
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            data.push_back(uint8_t(v >> (i * 8)));
+    }
+
+    void i32(int32_t v) {
+        u32(uint32_t(v));
+    }
+
+    void u64(uint64_t v) {
+        u32(uint32_t(v));
+        u32(uint32_t(v >> 32));
+    }
+
+    void margins(const Margins& m) {
+        i32(m.top);
+        i32(m.right);
+        i32(m.bottom);
+        i32(m.left);
+    }
+
+    void align(size_t alignment) {
+        while (data.size() % alignment)
+            data.push_back(0);
+    }
+
+    void patchU32(size_t offset, uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            data[offset + i] = uint8_t(v >> (i * 8));
+    }
+
+    std::vector<uint8_t> data;
+};
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size, size_t offset = 0) :
+        data_(data), size_(size), offset_(offset) {}
+
+    bool u32(uint32_t& v) {
+        if (offset_ > size_ || size_ - offset_ < 4)
+            return false;
+        v = 0;
+        for (int i = 0; i < 4; ++i)
+            v |= uint32_t(data_[offset_ + i]) << (i * 8);
+        offset_ += 4;
+        return true;
+    }
+
+    bool i32(int32_t& v) {
+        uint32_t u;
+        if (!u32(u))
+            return false;
+        v = int32_t(u);
+        return true;
+    }
+
+    bool u64(uint64_t& v) {
+        uint32_t lo, hi;
+        if (!u32(lo) || !u32(hi))
+            return false;
+        v = uint64_t(hi) << 32 | lo;
+        return true;
+    }
+
+    bool margins(Margins& m) {
+        int32_t top, right, bottom, left;
+        if (!i32(top) || !i32(right) || !i32(bottom) || !i32(left))
+            return false;
+        m = { top, right, bottom, left };
+        return true;
+    }
+
+    bool skip(size_t n) {
+        if (size_ - offset_ < n)
+            return false;
+        offset_ += n;
+        return true;
+    }
+
+    void align(size_t alignment) {
+        offset_ = (offset_ + alignment - 1) / alignment * alignment;
+        if (offset_ > size_)
+            offset_ = size_;
+    }
+
+    size_t offset() const {
+        return offset_;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_;
+};
+
+// Font names are stored as UTF-16, whatever the size of wchar_t.
+void appendUtf16(std::vector<uint16_t>& out, const std::wstring& str) {
+    for (wchar_t c : str) {
+        uint32_t cp = uint32_t(c);
+        if (cp >= 0x10000 && cp <= 0x10FFFF) {
+            cp -= 0x10000;
+            out.push_back(uint16_t(0xD800 + (cp >> 10)));
+            out.push_back(uint16_t(0xDC00 + (cp & 0x3FF)));
+        } else
+            out.push_back(uint16_t(cp));
+    }
+}
+
+std::wstring fromUtf16(const std::vector<uint16_t>& units) {
+    std::wstring str;
+    for (size_t i = 0; i < units.size(); ++i) {
+        uint32_t unit = units[i];
+        if (sizeof(wchar_t) == 4 && unit >= 0xD800 && unit < 0xDC00 && i + 1 < units.size() &&
+            units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000) {
+            str.push_back(wchar_t(0x10000 + ((unit - 0xD800) << 10) + (units[i + 1] - 0xDC00)));
+            ++i;
+        } else
+            str.push_back(wchar_t(unit));
+    }
+    return str;
+}
+
+bool fail(std::string* error, const char* message) {
+    if (error)
+        *error = message;
+    return false;
+}
+
+} // namespace
+
+std::vector<uint8_t> writeThemeBinary(const ThemeData& theme) {
+    Writer w;
+    w.data.insert(w.data.end(), magic, magic + 4);
+    w.u32(themeBinaryVersion);
+    w.u32(0);  // file size, patched below
+    w.u32(0);
+    w.u64(0);  // hash, patched below
+
+    w.margins(theme.textMargin);
+    w.margins(theme.contentMargin);
+    w.u32(theme.normalColor);
+    w.u32(theme.highlightCandidateColor);
+    w.i32(theme.fontSize);
+    std::vector<uint16_t> face;
+    appendUtf16(face, theme.fontFace);
+    w.u32(uint32_t(face.size()));
+    for (uint16_t unit : face) {
+        w.data.push_back(uint8_t(unit));
+        w.data.push_back(uint8_t(unit >> 8));
+    }
+    w.align(4);
+
+    const ThemeImageData* images[] = { &theme.background, &theme.highlight };
+    size_t pixelOffsetFields[2];
+    for (int i = 0; i < 2; ++i) {
+        const auto& image = *images[i];
+        bool empty = image.isEmpty() || image.pixels.size() < size_t(image.size.cx) * image.size.cy * 4;
+        w.margins(image.margin);
+        w.i32(empty ? 0 : image.size.cx);
+        w.i32(empty ? 0 : image.size.cy);
+        pixelOffsetFields[i] = w.data.size();
+        w.u32(0);
+    }
+    for (int i = 0; i < 2; ++i) {
+        const auto& image = *images[i];
+        if (image.isEmpty() || image.pixels.size() < size_t(image.size.cx) * image.size.cy * 4)
+            continue;
+        w.align(pixelAlignment);
+        w.patchU32(pixelOffsetFields[i], uint32_t(w.data.size()));
+        w.data.insert(w.data.end(), image.pixels.begin(),
+            image.pixels.begin() + size_t(image.size.cx) * image.size.cy * 4);
+    }
+
+    w.patchU32(8, uint32_t(w.data.size()));
+    uint64_t hash = hashBytes(w.data.data() + headerSize, w.data.size() - headerSize);
+    w.patchU32(16, uint32_t(hash));
+    w.patchU32(20, uint32_t(hash >> 32));
+    return std::move(w.data);
+}
+
+bool readThemeBinary(const uint8_t* data, size_t size, ThemeData& theme, std::string* error) {
+    if (size < headerSize || !std::equal(magic, magic + 4, data))
+        return fail(error, "not a binary theme");
+    Reader header(data, size, 4);
+    uint32_t version, fileSize, reserved;
+    uint64_t hash;
+    header.u32(version);
+    header.u32(fileSize);
+    header.u32(reserved);
+    header.u64(hash);
+    if (version != themeBinaryVersion)
+        return fail(error, "unsupported binary theme version");
+    if (fileSize != size)
+        return fail(error, "truncated binary theme");
+    if (hash != hashBytes(data + headerSize, size - headerSize))
+        return fail(error, "corrupted binary theme");
+
+    Reader r(data, size, headerSize);
+    ThemeData result;
+    uint32_t faceLength;
+    if (!r.margins(result.textMargin) || !r.margins(result.contentMargin) ||
+        !r.u32(result.normalColor) || !r.u32(result.highlightCandidateColor) ||
+        !r.i32(result.fontSize) || !r.u32(faceLength) || (size - r.offset()) / 2 < faceLength)
+        return fail(error, "truncated binary theme");
+    std::vector<uint16_t> face(faceLength);
+    const uint8_t* units = data + r.offset();
+    for (size_t i = 0; i < faceLength; ++i)
+        face[i] = uint16_t(units[i * 2] | units[i * 2 + 1] << 8);
+    r.skip(faceLength * 2);
+    r.align(4);
+    result.fontFace = fromUtf16(face);
+
+    for (auto image : { &result.background, &result.highlight }) {
+        int32_t width, height;
+        uint32_t offset;
+        if (!r.margins(image->margin) || !r.i32(width) || !r.i32(height) || !r.u32(offset))
+            return fail(error, "truncated binary theme");
+        if (width <= 0 || height <= 0)
+            continue;
+        uint64_t bytes = uint64_t(width) * uint64_t(height) * 4;
+        if (offset % pixelAlignment || offset > size || size - offset < bytes)
+            return fail(error, "bad image in binary theme");
+        image->size = { width, height };
+        image->pixels.assign(data + offset, data + offset + bytes);
+    }
+    theme = std::move(result);
+    return true;
+}
+
+} // namespace Ime
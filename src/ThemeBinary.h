@@ -0,0 +1,61 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_THEME_BINARY_H
+#define IME_THEME_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ThemeData.h"
+
+// A compact binary form of ThemeData, compiled from theme.conf and its
+// images so that loading a theme needs neither INI parsing nor image
+// decoding.
+//
+// All integers are little-endian. The file is laid out so it can be used
+// straight from a memory mapping:
+//
+//   header   "IMTH", u32 version, u32 file size, u32 reserved,
+//            u64 FNV-1a hash of everything after the header
+//   body     margins (4 x i32: top, right, bottom, left) for the text and
+//            the content, u32 normal color, u32 highlight color,
+//            i32 font size, u32 face length, UTF-16 face name, padding to 4
+//   images   background then highlight: margins, i32 width, i32 height,
+//            u32 offset of the pixels from the start of the file
+//   pixels   premultiplied BGRA rows, each block aligned to 16 bytes
+
+namespace Ime {
+
+constexpr uint32_t themeBinaryVersion = 1;
+
+// the usual file name, next to theme.conf
+constexpr const char* themeBinaryFileName = "theme.bin";
+
+std::vector<uint8_t> writeThemeBinary(const ThemeData& theme);
+
+// Returns false and describes the problem in error if data is not a valid
+// binary theme of the current version.
+bool readThemeBinary(const uint8_t* data, size_t size, ThemeData& theme,
+    std::string* error = nullptr);
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,67 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#include "ThemeCompiler.h"
+#include "IniFile.h"
+
+namespace Ime {
+
+bool compileTheme(const std::filesystem::path& dir, const ThemeImageDecoder& decoder,
+    ThemeData& theme, std::vector<std::string>* warnings) {
+    IniFile conf;
+    if (!conf.load(dir / "theme.conf"))
+        return false;
+    if (warnings) {
+        for (const auto& error : conf.errors())
+            warnings->push_back("theme.conf:" + std::to_string(error.line) + ": " + error.message);
+    }
+
+    ThemeData result;
+    // only the background has a default image
+    struct { ThemeImageData* image; const wchar_t* section; const wchar_t* defaultFile; } images[] = {
+        { &result.background, L"InputPanel/Background", L"image.png" },
+        { &result.highlight, L"InputPanel/Highlight", L"" },
+    };
+    for (auto& entry : images) {
+        std::wstring section = entry.section;
+        auto name = conf.getString(section, L"Image", entry.defaultFile);
+        if (name.empty())
+            continue;
+        auto file = dir / std::wstring(name);
+        entry.image->margin = conf.getMargins(section + L"/Margin");
+        ThemeImageData decoded;
+        if (decoder && decoder(file, decoded) && !decoded.isEmpty() &&
+            decoded.pixels.size() >= size_t(decoded.size.cx) * decoded.size.cy * 4) {
+            entry.image->size = decoded.size;
+            entry.image->pixels = std::move(decoded.pixels);
+        } else if (warnings)
+            warnings->push_back("cannot decode " + file.u8string());
+    }
+    result.textMargin = conf.getMargins(L"InputPanel/TextMargin");
+    result.contentMargin = conf.getMargins(L"InputPanel/ContentMargin");
+    auto font = conf.getFont(L"InputPanel", L"Font");
+    result.fontFace = font.face;
+    result.fontSize = font.size;
+    result.normalColor = conf.getColor(L"InputPanel", L"NormalColor", 0);
+    result.highlightCandidateColor = conf.getColor(L"InputPanel", L"HighlightCandidateColor", 0);
+    theme = std::move(result);
+    return true;
+}
+
+} // namespace Ime
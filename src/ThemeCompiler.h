@@ -0,0 +1,45 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_THEME_COMPILER_H
+#define IME_THEME_COMPILER_H
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ThemeData.h"
+
+namespace Ime {
+
+// Decodes an image file into premultiplied BGRA pixels; returns false if
+// the file cannot be decoded. Provided by the caller: WIC on Windows,
+// libpng in the command line compiler, a fake in the tests.
+using ThemeImageDecoder = std::function<bool(const std::filesystem::path& file, ThemeImageData& image)>;
+
+// Reads dir/theme.conf and the images it names, with the same defaults as
+// CandidateWindow::Theme. Problems which still leave a usable theme, like
+// an image which cannot be decoded, are appended to warnings. Returns false
+// if theme.conf cannot be read.
+bool compileTheme(const std::filesystem::path& dir, const ThemeImageDecoder& decoder,
+    ThemeData& theme, std::vector<std::string>* warnings = nullptr);
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,85 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_THEME_DATA_H
+#define IME_THEME_DATA_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Geometry.h"
+
+namespace Ime {
+
+// An image of a theme, stretched with fixed borders (see NineSlice).
+struct ThemeImageData {
+    Size size;
+    Margins margin;
+    // premultiplied BGRA, 4 bytes per pixel, rows from top to bottom
+    std::vector<uint8_t> pixels;
+
+    bool isEmpty() const {
+        return size.cx <= 0 || size.cy <= 0;
+    }
+};
+
+// Win32-free description of a candidate window theme, as written in
+// theme.conf. CandidateWindow::Theme is built from it.
+struct ThemeData {
+    ThemeImageData background, highlight;
+    Margins textMargin, contentMargin;
+    // empty means the default GUI font
+    std::wstring fontFace;
+    // in points; 0 keeps the size of the default GUI font
+    int fontSize = 0;
+    // 0x00BBGGRR, like COLORREF
+    uint32_t normalColor = 0;
+    uint32_t highlightCandidateColor = 0;
+};
+
+// A plain theme that needs no files: a white box with a gray border and a
+// light blue highlight. Shown while the real theme is still loading. Its
+// images are opaque: the highlight is painted under the text of the
+// selected candidate, never over it.
+inline ThemeData builtinThemeData() {
+    // 3x3 opaque images (0xAARRGGBB) whose 1 pixel border is kept and whose center is stretched
+    auto box = [](uint32_t border, uint32_t fill) {
+        ThemeImageData image;
+        image.size = { 3, 3 };
+        image.margin = { 1, 1, 1, 1 };
+        for (int i = 0; i < 9; ++i) {
+            uint32_t bgra = i == 4 ? fill : border;
+            for (int shift = 0; shift < 32; shift += 8)
+                image.pixels.push_back(uint8_t(bgra >> shift));
+        }
+        return image;
+    };
+    ThemeData theme;
+    theme.background = box(0xFFA0A0A0, 0xFFFFFFFF);
+    theme.highlight = box(0xFF90C8E8, 0xFFD0E8F8);
+    theme.textMargin = { 2, 4, 2, 4 };
+    theme.contentMargin = { 4, 4, 4, 4 };
+    theme.normalColor = 0x000000;
+    theme.highlightCandidateColor = 0x000000;
+    return theme;
+}
+
+} // namespace Ime
+
+#endif
@@ -0,0 +1,154 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+#ifndef IME_THEME_REGISTRY_H
+#define IME_THEME_REGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Ime {
+
+// The modification time and size of the files directly in a directory, to
+// tell whether anything in it changed.
+class DirectoryStamp {
+public:
+    static DirectoryStamp of(const std::filesystem::path& dir) {
+        DirectoryStamp stamp;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code fileError;
+            if (!it->is_regular_file(fileError))
+                continue;
+            File file{ it->path().filename(), it->last_write_time(fileError), it->file_size(fileError) };
+            if (!fileError)
+                stamp.files_.push_back(std::move(file));
+        }
+        std::sort(stamp.files_.begin(), stamp.files_.end(),
+            [](const File& a, const File& b) { return a.name < b.name; });
+        return stamp;
+    }
+
+    bool operator == (const DirectoryStamp& other) const {
+        return files_ == other.files_;
+    }
+    bool operator != (const DirectoryStamp& other) const {
+        return !(*this == other);
+    }
+
+private:
+    struct File {
+        std::filesystem::path name;
+        std::filesystem::file_time_type time;
+        uintmax_t size;
+
+        bool operator == (const File& other) const {
+            return name == other.name && time == other.time && size == other.size;
+        }
+    };
+
+    std::vector<File> files_;
+};
+
+// Shares immutable themes between all their users in a process, so that
+// every text service (one per thread) activating the same theme uses one
+// decoded copy. Themes are keyed by the canonical path of their directory
+// and built again, lazily, when a file in it changes. Snapshots already
+// handed out stay valid until their last user releases them.
+// Theme is built by the loader from a directory; it is never modified
+// afterwards, so it can be used from several threads at once.
+template <typename Theme>
+class ThemeRegistry {
+public:
+    using Loader = std::function<std::shared_ptr<const Theme>(const std::filesystem::path& dir)>;
+
+    explicit ThemeRegistry(Loader loader) : loader_(std::move(loader)) {}
+
+    std::shared_ptr<const Theme> get(const std::filesystem::path& dir) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& slot = entries_[canonicalPath(dir)];
+            if (!slot)
+                slot = std::make_shared<Entry>();
+            entry = slot;
+        }
+        // Building happens under the lock of the entry only: other threads
+        // asking for the same theme wait and share the result, while other
+        // themes are not blocked.
+        auto stamp = DirectoryStamp::of(dir);
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->theme || entry->stamp != stamp) {
+            entry->theme = loader_(dir);
+            entry->stamp = std::move(stamp);
+            ++loads_;
+        }
+        return entry->theme;
+    }
+
+    // drops the registry's references; snapshots in use stay alive
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    // how many times the loader was called
+    size_t loads() const {
+        return loads_;
+    }
+
+    static std::filesystem::path canonicalPath(const std::filesystem::path& dir) {
+        std::error_code ec;
+        auto path = std::filesystem::weakly_canonical(dir, ec);
+        if (ec)
+            path = std::filesystem::absolute(dir, ec).lexically_normal();
+        // "themes/dark" and "themes/dark/" name the same directory
+        if (!path.has_filename() && path.has_parent_path() && path != path.root_path())
+            path = path.parent_path();
+        return path;
+    }
+
+private:
+    struct Entry {
+        std::mutex mutex;
+        std::shared_ptr<const Theme> theme;
+        DirectoryStamp stamp;
+    };
+
+    Loader loader_;
+    mutable std::mutex mutex_;
+    std::map<std::filesystem::path, std::shared_ptr<Entry>> entries_;
+    std::atomic<size_t> loads_{ 0 };
+};
+
+} // namespace Ime
+
+#endif
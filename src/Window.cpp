@@ -24,8 +24,6 @@ namespace Ime {
 static TCHAR g_imeWindowClassName[] = _T("LibImeWindow");
 static HINSTANCE g_hinstance = NULL;
 
-std::map<HWND, Window*> Window::hwndMap_;
-
 Window::Window():
     hwnd_(NULL) {
 }
@@ -36,14 +34,10 @@ Window::~Window() {
 }
 
 bool Window::create(HWND parent, DWORD style, DWORD exStyle) {
+    // _wndProc() associates this object with the hwnd on WM_NCCREATE
     hwnd_ = CreateWindowEx(exStyle, g_imeWindowClassName, NULL, style,
-                    0, 0, 0, 0, parent, NULL, g_hinstance, NULL);
-    if(hwnd_) {
-        // associate this object with the hwnd
-        hwndMap_[hwnd_] = this;
-        return true;
-    }
-    return false;
+                    0, 0, 0, 0, parent, NULL, g_hinstance, this);
+    return hwnd_ != NULL;
 }
 
 void Window::destroy(void) {
@@ -54,20 +48,34 @@ void Window::destroy(void) {
 
 // static
 LRESULT Window::_wndProc(HWND hwnd , UINT msg, WPARAM wp , LPARAM lp) {
-    // get object pointer from the hwnd
-    Window* window = (Window*)hwndMap_[hwnd];
-    // FIXME: we cannot handle WM_CREATE in Window::wndProc member function
-    // because the message is sent before CreateWindow returns, and
-    // we do SetWindowLongPtr() only after CreateWindow().
+    Window* window;
+    if(msg == WM_NCCREATE) {
+        // the first message, sent before CreateWindowEx() returns, so that
+        // wndProc() also gets WM_NCCREATE and WM_CREATE
+        window = (Window*)((CREATESTRUCT*)lp)->lpCreateParams;
+        window->hwnd_ = hwnd;
+        ::SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)window);
+    }
+    else
+        window = (Window*)::GetWindowLongPtr(hwnd, GWLP_USERDATA);
     if(window) {
         LRESULT result = window->wndProc(msg, wp, lp);
         if(msg == WM_NCDESTROY)
-            hwndMap_.erase(hwnd);
+            ::SetWindowLongPtr(hwnd, GWLP_USERDATA, 0);
         return result;
     }
     return ::DefWindowProc(hwnd, msg, wp, lp);
 }
 
+// static
+Window* Window::fromHwnd(HWND hwnd) {
+    // GWLP_USERDATA is ours only in the windows of our class, which are
+    // the windows of this process using _wndProc()
+    if(::GetWindowLongPtr(hwnd, GWLP_WNDPROC) != (LONG_PTR)Window::_wndProc)
+        return NULL;
+    return (Window*)::GetWindowLongPtr(hwnd, GWLP_USERDATA);
+}
+
 LRESULT Window::wndProc(UINT msg, WPARAM wp , LPARAM lp) {
     return ::DefWindowProc(hwnd_, msg, wp, lp);
 }
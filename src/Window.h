@@ -26,7 +26,6 @@
 
 #include <windows.h>
 #include <tchar.h>
-#include <map>
 
 namespace Ime {
 
@@ -79,10 +78,8 @@ public:
 
     static bool registerClass(HINSTANCE hinstance);
 
-    static Window* fromHwnd(HWND hwnd) {
-        std::map<HWND, Window*>::iterator it = hwndMap_.find(hwnd);
-        return it != hwndMap_.end() ? it->second : NULL;
-    }
+    // safe to call on any thread, with any hwnd
+    static Window* fromHwnd(HWND hwnd);
 
 protected:
     static LRESULT _wndProc(HWND hwnd , UINT msg, WPARAM wp , LPARAM lp);
@@ -90,7 +87,6 @@ protected:
 
 protected:
     HWND hwnd_;
-    static std::map<HWND, Window*> hwndMap_;
 };
 
 }
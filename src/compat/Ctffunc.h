@@ -0,0 +1,37 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+// The function provider interfaces of the Windows SDK used by libIME (see
+// msctf.h).
+
+#ifndef IME_COMPAT_CTFFUNC_H
+#define IME_COMPAT_CTFFUNC_H
+
+#include "msctf.h"
+
+COMPAT_INTERFACE(ITfFunction, IUnknown, 0xdb593490, 0x098f, 0x11d3, 0x8d, 0xf0, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(GetDisplayName)(BSTR* pbstrName) PURE;
+};
+
+COMPAT_INTERFACE(ITfFnConfigure, ITfFunction, 0x88f567c6, 0x1757, 0x49f8, 0xa1, 0xb2, 0x89, 0x23, 0x4c, 0x1e, 0xef, 0xf9) {
+    STDMETHOD(Show)(HWND hwndParent, LANGID langid, REFGUID rguidProfile) PURE;
+};
+
+#endif
@@ -0,0 +1,2 @@
+// Unknwn.h of the Windows SDK is part of windows.h here.
+#include "windows.h"
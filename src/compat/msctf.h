@@ -0,0 +1,483 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+// The Text Services Framework interfaces used by libIME (see windows.h).
+// Interfaces the library implements are declared in full; of those it only
+// calls, such as ITfContext, just the methods it calls are, so that fakes
+// stay small (see FakeTsf.h).
+
+#ifndef IME_COMPAT_MSCTF_H
+#define IME_COMPAT_MSCTF_H
+
+#include "windows.h"
+
+typedef DWORD TfClientId;
+typedef DWORD TfEditCookie;
+typedef DWORD TfGuidAtom;
+
+#define TF_CLIENTID_NULL ((TfClientId)0)
+#define TF_INVALID_COOKIE ((DWORD)0xffffffff)
+#define TF_INVALID_EDIT_COOKIE ((TfEditCookie)0)
+#define TF_INVALID_GUIDATOM ((TfGuidAtom)0)
+
+#define TF_E_NOLOCK ((HRESULT)0x80040201)
+#define TF_E_LOCKED ((HRESULT)0x80040500)
+#define TF_E_SYNCHRONOUS ((HRESULT)0x80040505)
+#define TF_E_ALREADY_EXISTS ((HRESULT)0x80040506)
+#define TF_S_ASYNC ((HRESULT)0x00040300)
+
+// ITfThreadMgrEx::ActivateEx() and GetActiveFlags()
+#define TF_TMAE_NOACTIVATETIP 0x00000001
+#define TF_TMAE_SECUREMODE 0x00000002
+#define TF_TMAE_UIELEMENTENABLEDONLY 0x00000004
+#define TF_TMAE_COMLESS 0x00000008
+#define TF_TMAE_CONSOLE 0x00000040
+#define TF_TMF_NOACTIVATETIP TF_TMAE_NOACTIVATETIP
+#define TF_TMF_SECUREMODE TF_TMAE_SECUREMODE
+#define TF_TMF_UIELEMENTENABLEDONLY TF_TMAE_UIELEMENTENABLEDONLY
+#define TF_TMF_COMLESS TF_TMAE_COMLESS
+#define TF_TMF_CONSOLE TF_TMAE_CONSOLE
+#define TF_TMF_IMMERSIVEMODE 0x40000000
+
+// ITfContext::RequestEditSession()
+#define TF_ES_ASYNCDONTCARE 0x0
+#define TF_ES_SYNC 0x1
+#define TF_ES_READ 0x2
+#define TF_ES_READWRITE 0x6
+#define TF_ES_ASYNC 0x8
+
+#define TF_DEFAULT_SELECTION ((ULONG)-1)
+
+// ITfRange::GetText() and SetText()
+#define TF_TF_MOVESTART 0x1
+#define TF_TF_IGNOREEND 0x2
+#define TF_ST_CORRECTION 0x1
+
+// ITfInsertAtSelection::InsertTextAtSelection()
+#define TF_IAS_NOQUERY 0x1
+#define TF_IAS_QUERYONLY 0x2
+#define TF_IAS_NO_DEFAULT_COMPOSITION 0x80000000
+
+// ITfLangBarMgr::GetShowFloatingStatus()
+#define TF_SFT_SHOWNORMAL 0x00000001
+#define TF_SFT_DOCK 0x00000002
+#define TF_SFT_MINIMIZED 0x00000004
+#define TF_SFT_HIDDEN 0x00000008
+
+// language bar items
+#define TF_LBI_DESC_MAXLEN 32
+
+#define TF_LBI_STYLE_HIDDENSTATUSCONTROL 0x00000001
+#define TF_LBI_STYLE_SHOWNINTRAY 0x00000002
+#define TF_LBI_STYLE_BTN_BUTTON 0x00010000
+#define TF_LBI_STYLE_BTN_MENU 0x00020000
+#define TF_LBI_STYLE_BTN_TOGGLE 0x00040000
+
+#define TF_LBI_STATUS_HIDDEN 0x00000001
+#define TF_LBI_STATUS_DISABLED 0x00000002
+#define TF_LBI_STATUS_BTN_TOGGLED 0x00010000
+
+#define TF_LBI_ICON 0x00000001
+#define TF_LBI_TEXT 0x00000002
+#define TF_LBI_TOOLTIP 0x00000004
+#define TF_LBI_BITMAP 0x00000008
+#define TF_LBI_STATUS 0x00010000
+#define TF_LBI_BTNALL (TF_LBI_ICON | TF_LBI_TEXT | TF_LBI_STATUS)
+
+#define TF_LBMENUF_CHECKED 0x1
+#define TF_LBMENUF_SUBMENU 0x2
+#define TF_LBMENUF_SEPARATOR 0x4
+#define TF_LBMENUF_RADIOCHECKED 0x8
+#define TF_LBMENUF_GRAYED 0x10
+
+enum TfAnchor {
+    TF_ANCHOR_START = 0,
+    TF_ANCHOR_END = 1
+};
+
+enum TfActiveSelEnd {
+    TF_AE_NONE = 0,
+    TF_AE_START = 1,
+    TF_AE_END = 2
+};
+
+enum TfLBIClick {
+    TF_LBI_CLK_RIGHT = 1,
+    TF_LBI_CLK_LEFT = 2
+};
+
+enum TF_DA_LINESTYLE {
+    TF_LS_NONE = 0,
+    TF_LS_SOLID = 1,
+    TF_LS_DOT = 2,
+    TF_LS_DASH = 3,
+    TF_LS_SQUIGGLE = 4
+};
+
+enum TF_DA_COLORTYPE {
+    TF_CT_NONE = 0,
+    TF_CT_SYSCOLOR = 1,
+    TF_CT_COLORREF = 2
+};
+
+enum TF_DA_ATTR_INFO {
+    TF_ATTR_INPUT = 0,
+    TF_ATTR_TARGET_CONVERTED = 1,
+    TF_ATTR_CONVERTED = 2,
+    TF_ATTR_TARGET_NOTCONVERTED = 3,
+    TF_ATTR_INPUT_ERROR = 4,
+    TF_ATTR_FIXEDCONVERTED = 5,
+    TF_ATTR_OTHER = -1
+};
+
+struct ITfRange;
+struct ITfContext;
+struct ITfDocumentMgr;
+struct ITfComposition;
+struct ITfCompositionSink;
+struct ITfCompartmentMgr;
+struct ITfContextView;
+struct ITfProperty;
+struct ITfEditSession;
+struct ITfEditRecord;
+struct ITfKeyEventSink;
+struct ITfLangBarEventSink;
+struct ITfLangBarItem;
+struct ITfMenu;
+struct ITfThreadMgr;
+struct ITfDisplayAttributeInfo;
+
+struct TF_SELECTIONSTYLE {
+    TfActiveSelEnd ase;
+    BOOL fInterimChar;
+};
+
+struct TF_SELECTION {
+    ITfRange* range;
+    TF_SELECTIONSTYLE style;
+};
+
+struct TF_HALTCOND {
+    ITfRange* pHaltRange;
+    TfAnchor aHaltPos;
+    DWORD dwFlags;
+};
+
+struct TF_PRESERVEDKEY {
+    UINT uVKey;
+    UINT uModifiers;
+};
+
+#define TF_MOD_ALT 0x0001
+#define TF_MOD_CONTROL 0x0002
+#define TF_MOD_SHIFT 0x0004
+#define TF_MOD_RALT 0x0008
+#define TF_MOD_RCONTROL 0x0010
+#define TF_MOD_RSHIFT 0x0020
+#define TF_MOD_LALT 0x0040
+#define TF_MOD_LCONTROL 0x0080
+#define TF_MOD_LSHIFT 0x0100
+#define TF_MOD_ON_KEYUP 0x0200
+#define TF_MOD_IGNORE_ALL_MODIFIER 0x0400
+
+struct TF_LANGBARITEMINFO {
+    CLSID clsidService;
+    GUID guidItem;
+    DWORD dwStyle;
+    ULONG ulSort;
+    WCHAR szDescription[TF_LBI_DESC_MAXLEN];
+};
+
+struct TF_DA_COLOR {
+    TF_DA_COLORTYPE type;
+    union {
+        int nIndex;
+        COLORREF cr;
+    };
+};
+
+struct TF_DISPLAYATTRIBUTE {
+    TF_DA_COLOR crText;
+    TF_DA_COLOR crBk;
+    TF_DA_LINESTYLE lsStyle;
+    BOOL fBoldLine;
+    TF_DA_COLOR crLine;
+    TF_DA_ATTR_INFO bAttr;
+};
+
+DEFINE_GUID(CLSID_TF_ThreadMgr, 0x529a9e6b, 0x6587, 0x4f23, 0xab, 0x9e, 0x9c, 0x7d, 0x68, 0x3e, 0x3c, 0x50);
+DEFINE_GUID(CLSID_TF_LangBarMgr, 0xebb08c45, 0x6c4a, 0x4fdc, 0xae, 0x53, 0x4e, 0xb8, 0xc4, 0xc7, 0xdb, 0x8e);
+DEFINE_GUID(CLSID_TF_CategoryMgr, 0xa4b544a1, 0x438d, 0x4b41, 0x93, 0x25, 0x86, 0x95, 0x23, 0xe2, 0xd6, 0xc7);
+DEFINE_GUID(CLSID_TF_InputProcessorProfiles, 0x33c53a50, 0xf456, 0x4884, 0xb0, 0x49, 0x85, 0xfd, 0x64, 0x3e, 0xcf, 0xed);
+
+DEFINE_GUID(GUID_PROP_ATTRIBUTE, 0x34b45670, 0x7526, 0x11d2, 0xa1, 0x47, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5);
+DEFINE_GUID(GUID_COMPARTMENT_KEYBOARD_DISABLED, 0x71a5b253, 0x1951, 0x466b, 0x9f, 0xbc, 0x9c, 0x88, 0x08, 0xfa, 0x84, 0xf2);
+DEFINE_GUID(GUID_COMPARTMENT_KEYBOARD_OPENCLOSE, 0x58273aad, 0x01bb, 0x4164, 0x95, 0xc6, 0x75, 0x5b, 0xa0, 0xb5, 0x16, 0x2d);
+DEFINE_GUID(GUID_COMPARTMENT_EMPTYCONTEXT, 0xd7487dbf, 0x804e, 0x41c5, 0x89, 0x4d, 0xad, 0x96, 0xfd, 0x4e, 0xea, 0x13);
+
+// event sinks and interfaces implemented by text services
+
+COMPAT_INTERFACE(ITfTextInputProcessor, IUnknown, 0xaa80e7f7, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(Activate)(ITfThreadMgr* ptim, TfClientId tid) PURE;
+    STDMETHOD(Deactivate)() PURE;
+};
+
+COMPAT_INTERFACE(ITfTextInputProcessorEx, ITfTextInputProcessor, 0x6e4e2102, 0xf9cd, 0x433d, 0xb4, 0x96, 0x30, 0x3c, 0xe0, 0x3a, 0x65, 0x07) {
+    STDMETHOD(ActivateEx)(ITfThreadMgr* ptim, TfClientId tid, DWORD dwFlags) PURE;
+};
+
+COMPAT_INTERFACE(ITfDisplayAttributeInfo, IUnknown, 0x70528852, 0x2f26, 0x4aea, 0x8c, 0x96, 0x21, 0x51, 0x50, 0x57, 0x89, 0x32) {
+    STDMETHOD(GetGUID)(GUID* pguid) PURE;
+    STDMETHOD(GetDescription)(BSTR* pbstrDesc) PURE;
+    STDMETHOD(GetAttributeInfo)(TF_DISPLAYATTRIBUTE* pda) PURE;
+    STDMETHOD(SetAttributeInfo)(const TF_DISPLAYATTRIBUTE* pda) PURE;
+    STDMETHOD(Reset)() PURE;
+};
+
+COMPAT_INTERFACE(IEnumTfDisplayAttributeInfo, IUnknown, 0x7cef04d7, 0xcb75, 0x4e80, 0xa7, 0xab, 0x5f, 0x5b, 0xc7, 0xd3, 0x32, 0xde) {
+    STDMETHOD(Clone)(IEnumTfDisplayAttributeInfo** ppEnum) PURE;
+    STDMETHOD(Next)(ULONG ulCount, ITfDisplayAttributeInfo** rgInfo, ULONG* pcFetched) PURE;
+    STDMETHOD(Reset)() PURE;
+    STDMETHOD(Skip)(ULONG ulCount) PURE;
+};
+
+COMPAT_INTERFACE(ITfDisplayAttributeProvider, IUnknown, 0xfee47777, 0x163c, 0x4769, 0x99, 0x6a, 0x6e, 0x9c, 0x50, 0xad, 0x8f, 0x54) {
+    STDMETHOD(EnumDisplayAttributeInfo)(IEnumTfDisplayAttributeInfo** ppEnum) PURE;
+    STDMETHOD(GetDisplayAttributeInfo)(REFGUID guid, ITfDisplayAttributeInfo** ppInfo) PURE;
+};
+
+COMPAT_INTERFACE(ITfThreadMgrEventSink, IUnknown, 0xaa80e80e, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(OnInitDocumentMgr)(ITfDocumentMgr* pdim) PURE;
+    STDMETHOD(OnUninitDocumentMgr)(ITfDocumentMgr* pdim) PURE;
+    STDMETHOD(OnSetFocus)(ITfDocumentMgr* pdimFocus, ITfDocumentMgr* pdimPrevFocus) PURE;
+    STDMETHOD(OnPushContext)(ITfContext* pic) PURE;
+    STDMETHOD(OnPopContext)(ITfContext* pic) PURE;
+};
+
+COMPAT_INTERFACE(ITfTextEditSink, IUnknown, 0x8127d409, 0xccd3, 0x4683, 0x96, 0x7a, 0xb4, 0x3d, 0x5b, 0x48, 0x2b, 0xf7) {
+    STDMETHOD(OnEndEdit)(ITfContext* pic, TfEditCookie ecReadOnly, ITfEditRecord* pEditRecord) PURE;
+};
+
+COMPAT_INTERFACE(ITfKeyEventSink, IUnknown, 0xaa80e7f5, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(OnSetFocus)(BOOL fForeground) PURE;
+    STDMETHOD(OnTestKeyDown)(ITfContext* pic, WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(OnTestKeyUp)(ITfContext* pic, WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(OnKeyDown)(ITfContext* pic, WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(OnKeyUp)(ITfContext* pic, WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(OnPreservedKey)(ITfContext* pic, REFGUID rguid, BOOL* pfEaten) PURE;
+};
+
+COMPAT_INTERFACE(ITfCompositionSink, IUnknown, 0xa781718c, 0x579a, 0x4b15, 0xa2, 0x80, 0x32, 0xb8, 0x57, 0x7a, 0xcc, 0x5e) {
+    STDMETHOD(OnCompositionTerminated)(TfEditCookie ecWrite, ITfComposition* pComposition) PURE;
+};
+
+COMPAT_INTERFACE(ITfCompartmentEventSink, IUnknown, 0x743abd5f, 0xf26d, 0x48df, 0x8c, 0xc5, 0x23, 0x84, 0x92, 0x41, 0x9b, 0x64) {
+    STDMETHOD(OnChange)(REFGUID rguid) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarEventSink, IUnknown, 0x18a4e900, 0xe0ae, 0x11d2, 0xaf, 0xdd, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(OnSetFocus)(DWORD dwThreadId) PURE;
+    STDMETHOD(OnThreadTerminate)(DWORD dwThreadId) PURE;
+    STDMETHOD(OnThreadItemChange)(DWORD dwThreadId) PURE;
+    STDMETHOD(OnModalInput)(DWORD dwThreadId, UINT uMsg, WPARAM wParam, LPARAM lParam) PURE;
+    STDMETHOD(ShowFloating)(DWORD dwFlags) PURE;
+    STDMETHOD(GetItemFloatingRect)(DWORD dwThreadId, REFGUID rguid, RECT* prc) PURE;
+};
+
+COMPAT_INTERFACE(ITfActiveLanguageProfileNotifySink, IUnknown, 0xb246cb75, 0xa93e, 0x4652, 0xbf, 0x8c, 0xb3, 0xfe, 0x0c, 0xfd, 0x7e, 0x57) {
+    STDMETHOD(OnActivated)(REFCLSID clsid, REFGUID guidProfile, BOOL fActivated) PURE;
+};
+
+COMPAT_INTERFACE(ITfEditSession, IUnknown, 0xaa80e803, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(DoEditSession)(TfEditCookie ec) PURE;
+};
+
+COMPAT_INTERFACE(ITfSource, IUnknown, 0x4ea48a35, 0x60ae, 0x446f, 0x8f, 0xd6, 0xe6, 0xa8, 0xd8, 0x24, 0x59, 0xf7) {
+    STDMETHOD(AdviseSink)(REFIID riid, IUnknown* punk, DWORD* pdwCookie) PURE;
+    STDMETHOD(UnadviseSink)(DWORD dwCookie) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarItem, IUnknown, 0x73540d69, 0xedeb, 0x4ee9, 0x96, 0xc9, 0x23, 0xaa, 0x30, 0xb2, 0x59, 0x16) {
+    STDMETHOD(GetInfo)(TF_LANGBARITEMINFO* pInfo) PURE;
+    STDMETHOD(GetStatus)(DWORD* pdwStatus) PURE;
+    STDMETHOD(Show)(BOOL fShow) PURE;
+    STDMETHOD(GetTooltipString)(BSTR* pbstrToolTip) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarItemButton, ITfLangBarItem, 0x28c7f1d0, 0xde25, 0x11d2, 0xaf, 0xdd, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(OnClick)(TfLBIClick click, POINT pt, const RECT* prcArea) PURE;
+    STDMETHOD(InitMenu)(ITfMenu* pMenu) PURE;
+    STDMETHOD(OnMenuSelect)(UINT wID) PURE;
+    STDMETHOD(GetIcon)(HICON* phIcon) PURE;
+    STDMETHOD(GetText)(BSTR* pbstrText) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarItemSink, IUnknown, 0x57dbe1a0, 0xde25, 0x11d2, 0xaf, 0xdd, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(OnUpdate)(DWORD dwFlags) PURE;
+};
+
+COMPAT_INTERFACE(ITfMenu, IUnknown, 0x6f8a98e4, 0xaaa0, 0x4f15, 0x8c, 0x5b, 0x07, 0xe0, 0xdf, 0x0a, 0x3d, 0xd8) {
+    STDMETHOD(AddMenuItem)(UINT uId, DWORD dwFlags, HBITMAP hbmp, HBITMAP hbmpMask,
+        const WCHAR* pch, ULONG cch, ITfMenu** ppMenu) PURE;
+};
+
+// interfaces of TSF called by text services
+
+COMPAT_INTERFACE(ITfThreadMgr, IUnknown, 0xaa80e801, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(Activate)(TfClientId* ptid) PURE;
+    STDMETHOD(Deactivate)() PURE;
+    STDMETHOD(CreateDocumentMgr)(ITfDocumentMgr** ppdim) PURE;
+    STDMETHOD(GetFocus)(ITfDocumentMgr** ppdimFocus) PURE;
+    STDMETHOD(SetFocus)(ITfDocumentMgr* pdimFocus) PURE;
+    STDMETHOD(IsThreadFocus)(BOOL* pfThreadFocus) PURE;
+    STDMETHOD(GetGlobalCompartment)(ITfCompartmentMgr** ppCompMgr) PURE;
+};
+
+COMPAT_INTERFACE(ITfThreadMgrEx, ITfThreadMgr, 0x3e90ade3, 0x7594, 0x4cb0, 0xbb, 0x58, 0x69, 0x62, 0x8f, 0x5f, 0x45, 0x8c) {
+    STDMETHOD(ActivateEx)(TfClientId* ptid, DWORD dwFlags) PURE;
+    STDMETHOD(GetActiveFlags)(DWORD* lpdwFlags) PURE;
+};
+
+COMPAT_INTERFACE(ITfDocumentMgr, IUnknown, 0xaa80e7f4, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(CreateContext)(TfClientId tidOwner, DWORD dwFlags, IUnknown* punk,
+        ITfContext** ppic, TfEditCookie* pecTextStore) PURE;
+    STDMETHOD(Push)(ITfContext* pic) PURE;
+    STDMETHOD(Pop)(DWORD dwFlags) PURE;
+    STDMETHOD(GetTop)(ITfContext** ppic) PURE;
+    STDMETHOD(GetBase)(ITfContext** ppic) PURE;
+};
+
+COMPAT_INTERFACE(ITfContext, IUnknown, 0xaa80e7fd, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(RequestEditSession)(TfClientId tid, ITfEditSession* pes, DWORD dwFlags, HRESULT* phrSession) PURE;
+    STDMETHOD(InWriteSession)(TfClientId tid, BOOL* pfWriteSession) PURE;
+    STDMETHOD(GetSelection)(TfEditCookie ec, ULONG ulIndex, ULONG ulCount, TF_SELECTION* pSelection, ULONG* pcFetched) PURE;
+    STDMETHOD(SetSelection)(TfEditCookie ec, ULONG ulCount, const TF_SELECTION* pSelection) PURE;
+    STDMETHOD(GetStart)(TfEditCookie ec, ITfRange** ppStart) PURE;
+    STDMETHOD(GetEnd)(TfEditCookie ec, ITfRange** ppEnd) PURE;
+    STDMETHOD(GetActiveView)(ITfContextView** ppView) PURE;
+    STDMETHOD(GetProperty)(REFGUID guidProp, ITfProperty** ppProp) PURE;
+    STDMETHOD(GetDocumentMgr)(ITfDocumentMgr** ppDm) PURE;
+};
+
+COMPAT_INTERFACE(ITfContextView, IUnknown, 0x2433bf8e, 0x0f9b, 0x435c, 0xba, 0x2c, 0x18, 0x06, 0x11, 0x97, 0x8c, 0x30) {
+    STDMETHOD(GetTextExt)(TfEditCookie ec, ITfRange* pRange, RECT* prc, BOOL* pfClipped) PURE;
+    STDMETHOD(GetScreenExt)(RECT* prc) PURE;
+    STDMETHOD(GetWnd)(HWND* phwnd) PURE;
+};
+
+COMPAT_INTERFACE(ITfRange, IUnknown, 0xaa80e7ff, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(GetText)(TfEditCookie ec, DWORD dwFlags, WCHAR* pchText, ULONG cchMax, ULONG* pcch) PURE;
+    STDMETHOD(SetText)(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch) PURE;
+    STDMETHOD(ShiftStart)(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) PURE;
+    STDMETHOD(ShiftEnd)(TfEditCookie ec, LONG cchReq, LONG* pcch, const TF_HALTCOND* pHalt) PURE;
+    STDMETHOD(ShiftStartToRange)(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) PURE;
+    STDMETHOD(ShiftEndToRange)(TfEditCookie ec, ITfRange* pRange, TfAnchor aPos) PURE;
+    STDMETHOD(IsEmpty)(TfEditCookie ec, BOOL* pfEmpty) PURE;
+    STDMETHOD(Collapse)(TfEditCookie ec, TfAnchor aPos) PURE;
+    STDMETHOD(IsEqualStart)(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) PURE;
+    STDMETHOD(IsEqualEnd)(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, BOOL* pfEqual) PURE;
+    STDMETHOD(CompareStart)(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) PURE;
+    STDMETHOD(CompareEnd)(TfEditCookie ec, ITfRange* pWith, TfAnchor aPos, LONG* plResult) PURE;
+    STDMETHOD(Clone)(ITfRange** ppClone) PURE;
+    STDMETHOD(GetContext)(ITfContext** ppContext) PURE;
+};
+
+COMPAT_INTERFACE(ITfRangeACP, ITfRange, 0x057a6296, 0x029b, 0x4154, 0xb7, 0x9a, 0x0d, 0x46, 0x1d, 0x4e, 0xa9, 0x4c) {
+    STDMETHOD(GetExtent)(LONG* pacpAnchor, LONG* pcch) PURE;
+    STDMETHOD(SetExtent)(LONG acpAnchor, LONG cch) PURE;
+};
+
+COMPAT_INTERFACE(ITfComposition, IUnknown, 0x20168d64, 0x5a8f, 0x4a5a, 0xb7, 0xbd, 0xcf, 0xa2, 0x9f, 0x4d, 0x0f, 0xd9) {
+    STDMETHOD(GetRange)(ITfRange** ppRange) PURE;
+    STDMETHOD(ShiftStart)(TfEditCookie ecWrite, ITfRange* pNewStart) PURE;
+    STDMETHOD(ShiftEnd)(TfEditCookie ecWrite, ITfRange* pNewEnd) PURE;
+    STDMETHOD(EndComposition)(TfEditCookie ecWrite) PURE;
+};
+
+COMPAT_INTERFACE(ITfContextComposition, IUnknown, 0xd40c8aae, 0xac92, 0x4fc7, 0x9a, 0x11, 0x0e, 0xe0, 0xe2, 0x3a, 0xa3, 0x9b) {
+    STDMETHOD(StartComposition)(TfEditCookie ecWrite, ITfRange* pCompositionRange,
+        ITfCompositionSink* pSink, ITfComposition** ppComposition) PURE;
+};
+
+COMPAT_INTERFACE(ITfInsertAtSelection, IUnknown, 0x55ce16ba, 0x3014, 0x41c1, 0x9c, 0xeb, 0xfa, 0xde, 0x14, 0x46, 0xac, 0x6c) {
+    STDMETHOD(InsertTextAtSelection)(TfEditCookie ec, DWORD dwFlags, const WCHAR* pchText, LONG cch, ITfRange** ppRange) PURE;
+};
+
+COMPAT_INTERFACE(ITfReadOnlyProperty, IUnknown, 0x17d49a3d, 0xf8b8, 0x4b2f, 0xb2, 0x54, 0x52, 0x31, 0x9d, 0xd6, 0x4c, 0x53) {
+    STDMETHOD(GetType)(GUID* pguid) PURE;
+    STDMETHOD(GetValue)(TfEditCookie ec, ITfRange* pRange, VARIANT* pvarValue) PURE;
+    STDMETHOD(GetContext)(ITfContext** ppContext) PURE;
+};
+
+COMPAT_INTERFACE(ITfProperty, ITfReadOnlyProperty, 0xe2449660, 0x9542, 0x11d2, 0xbf, 0x46, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(SetValue)(TfEditCookie ec, ITfRange* pRange, const VARIANT* pvarValue) PURE;
+    STDMETHOD(Clear)(TfEditCookie ec, ITfRange* pRange) PURE;
+};
+
+COMPAT_INTERFACE(ITfEditRecord, IUnknown, 0x42d4d099, 0x7c1a, 0x4a89, 0xb8, 0x36, 0x6c, 0x6f, 0x22, 0x16, 0x0d, 0xf0) {
+    STDMETHOD(GetSelectionStatus)(BOOL* pfChanged) PURE;
+};
+
+COMPAT_INTERFACE(ITfCompartment, IUnknown, 0xbb08f7a9, 0x607a, 0x4384, 0x86, 0x23, 0x05, 0x68, 0x92, 0xb6, 0x43, 0x71) {
+    STDMETHOD(SetValue)(TfClientId tid, const VARIANT* pvarValue) PURE;
+    STDMETHOD(GetValue)(VARIANT* pvarValue) PURE;
+};
+
+COMPAT_INTERFACE(ITfCompartmentMgr, IUnknown, 0x7dcf57ac, 0x18ad, 0x438b, 0x82, 0x4d, 0x97, 0x9b, 0xff, 0xb7, 0x4b, 0x7c) {
+    STDMETHOD(GetCompartment)(REFGUID rguid, ITfCompartment** ppcomp) PURE;
+    STDMETHOD(ClearCompartment)(TfClientId tid, REFGUID rguid) PURE;
+};
+
+COMPAT_INTERFACE(ITfKeystrokeMgr, IUnknown, 0xaa80e7f0, 0x2021, 0x11d2, 0x93, 0xe0, 0x00, 0x60, 0xb0, 0x67, 0xb8, 0x6e) {
+    STDMETHOD(AdviseKeyEventSink)(TfClientId tid, ITfKeyEventSink* pSink, BOOL fForeground) PURE;
+    STDMETHOD(UnadviseKeyEventSink)(TfClientId tid) PURE;
+    STDMETHOD(GetForeground)(CLSID* pclsid) PURE;
+    STDMETHOD(TestKeyDown)(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(TestKeyUp)(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(KeyDown)(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(KeyUp)(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) PURE;
+    STDMETHOD(GetPreservedKey)(ITfContext* pic, const TF_PRESERVEDKEY* pprekey, GUID* pguid) PURE;
+    STDMETHOD(IsPreservedKey)(REFGUID rguid, const TF_PRESERVEDKEY* pprekey, BOOL* pfRegistered) PURE;
+    STDMETHOD(PreserveKey)(TfClientId tid, REFGUID rguid, const TF_PRESERVEDKEY* prekey,
+        const WCHAR* pchDesc, ULONG cchDesc) PURE;
+    STDMETHOD(UnpreserveKey)(REFGUID rguid, const TF_PRESERVEDKEY* pprekey) PURE;
+    STDMETHOD(SetPreservedKeyDescription)(REFGUID rguid, const WCHAR* pchDesc, ULONG cchDesc) PURE;
+    STDMETHOD(GetPreservedKeyDescription)(REFGUID rguid, BSTR* pbstrDesc) PURE;
+    STDMETHOD(SimulatePreservedKey)(ITfContext* pic, REFGUID rguid, BOOL* pfEaten) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarItemMgr, IUnknown, 0xba468c55, 0x9956, 0x4fb1, 0xa5, 0x9d, 0x52, 0xa7, 0xdd, 0x7c, 0xc6, 0xaa) {
+    STDMETHOD(AddItem)(ITfLangBarItem* punk) PURE;
+    STDMETHOD(RemoveItem)(ITfLangBarItem* punk) PURE;
+};
+
+COMPAT_INTERFACE(ITfLangBarMgr, IUnknown, 0x87955690, 0xe627, 0x11d2, 0x8d, 0xdb, 0x00, 0x10, 0x5a, 0x27, 0x99, 0xb5) {
+    STDMETHOD(AdviseEventSink)(ITfLangBarEventSink* pSink, HWND hwnd, DWORD dwFlags, DWORD* pdwCookie) PURE;
+    STDMETHOD(UnadviseEventSink)(DWORD dwCookie) PURE;
+    STDMETHOD(GetShowFloatingStatus)(DWORD* pdwFlags) PURE;
+    STDMETHOD(ShowFloating)(DWORD dwFlags) PURE;
+};
+
+COMPAT_INTERFACE(ITfCategoryMgr, IUnknown, 0xc3acefb5, 0xf69d, 0x4905, 0x93, 0x8f, 0xfc, 0xad, 0xcf, 0x4b, 0xe8, 0x30) {
+    STDMETHOD(RegisterGUID)(REFGUID rguid, TfGuidAtom* pguidatom) PURE;
+    STDMETHOD(GetGUID)(TfGuidAtom guidatom, GUID* pguid) PURE;
+};
+
+#endif
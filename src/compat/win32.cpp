@@ -0,0 +1,283 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+#include "windows.h"
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+thread_local DWORD lastError = 0;
+
+struct ClassObject {
+    DWORD cookie;
+    CLSID clsid;
+    IUnknown* object;
+};
+
+std::mutex classObjectsMutex;
+std::vector<ClassObject> classObjects;
+DWORD nextClassCookie = 1;
+
+// the states of GetKeyboardState() for the calling thread
+thread_local BYTE keyboardState[256] = {};
+
+// the characters typed by the keys of the main block without and with Shift
+struct KeyChars {
+    UINT keyCode;
+    WCHAR normal, shifted;
+};
+
+const KeyChars usKeys[] = {
+    { '0', L'0', L')' }, { '1', L'1', L'!' }, { '2', L'2', L'@' }, { '3', L'3', L'#' },
+    { '4', L'4', L'$' }, { '5', L'5', L'%' }, { '6', L'6', L'^' }, { '7', L'7', L'&' },
+    { '8', L'8', L'*' }, { '9', L'9', L'(' },
+    { VK_OEM_1, L';', L':' }, { VK_OEM_PLUS, L'=', L'+' }, { VK_OEM_COMMA, L',', L'<' },
+    { VK_OEM_MINUS, L'-', L'_' }, { VK_OEM_PERIOD, L'.', L'>' }, { VK_OEM_2, L'/', L'?' },
+    { VK_OEM_3, L'`', L'~' }, { VK_OEM_4, L'[', L'{' }, { VK_OEM_5, L'\\', L'|' },
+    { VK_OEM_6, L']', L'}' }, { VK_OEM_7, L'\'', L'"' },
+    { VK_SPACE, L' ', L' ' }, { VK_TAB, L'\t', L'\t' }, { VK_RETURN, L'\r', L'\r' },
+    { VK_BACK, L'\b', L'\b' }, { VK_ESCAPE, 0x1b, 0x1b },
+};
+
+// the character typed by keyCode in the US layout, or 0
+WCHAR usKeyChar(UINT keyCode, const BYTE* states) {
+    bool shift = (states[VK_SHIFT] & 0x80) != 0;
+    bool ctrl = (states[VK_CONTROL] & 0x80) != 0;
+    bool alt = (states[VK_MENU] & 0x80) != 0;
+    if (ctrl && alt) // AltGr
+        return 0;
+    if (keyCode >= 'A' && keyCode <= 'Z') {
+        if (ctrl)
+            return WCHAR(keyCode - 'A' + 1);
+        bool upper = shift != ((states[VK_CAPITAL] & 1) != 0);
+        return WCHAR(upper ? keyCode : keyCode - 'A' + 'a');
+    }
+    if (ctrl)
+        return 0;
+    for (const auto& key : usKeys) {
+        if (key.keyCode == keyCode)
+            return shift ? key.shifted : key.normal;
+    }
+    return 0;
+}
+
+} // namespace
+
+DWORD GetLastError() {
+    return lastError;
+}
+
+void SetLastError(DWORD error) {
+    lastError = error;
+}
+
+// COM
+
+HRESULT CoCreateInstance(REFCLSID rclsid, IUnknown* pUnkOuter, DWORD dwClsContext, REFIID riid, void** ppv) {
+    if (!ppv)
+        return E_POINTER;
+    *ppv = nullptr;
+    IClassFactory* factory = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(classObjectsMutex);
+        for (const auto& classObject : classObjects) {
+            if (classObject.clsid == rclsid) {
+                classObject.object->QueryInterface(IID_IClassFactory, (void**)&factory);
+                break;
+            }
+        }
+    }
+    if (!factory)
+        return REGDB_E_CLASSNOTREG;
+    // the factory may create other objects, so it is called without the lock
+    HRESULT result = factory->CreateInstance(pUnkOuter, riid, ppv);
+    factory->Release();
+    return result;
+}
+
+HRESULT CoRegisterClassObject(REFCLSID rclsid, IUnknown* pUnk, DWORD dwClsContext, DWORD flags, LPDWORD lpdwRegister) {
+    if (!pUnk || !lpdwRegister)
+        return E_INVALIDARG;
+    std::lock_guard<std::mutex> lock(classObjectsMutex);
+    pUnk->AddRef();
+    *lpdwRegister = nextClassCookie++;
+    classObjects.push_back({ *lpdwRegister, rclsid, pUnk });
+    return S_OK;
+}
+
+HRESULT CoRevokeClassObject(DWORD dwRegister) {
+    IUnknown* object = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(classObjectsMutex);
+        for (auto it = classObjects.begin(); it != classObjects.end(); ++it) {
+            if (it->cookie == dwRegister) {
+                object = it->object;
+                classObjects.erase(it);
+                break;
+            }
+        }
+    }
+    if (!object)
+        return E_INVALIDARG;
+    object->Release();
+    return S_OK;
+}
+
+void* CoTaskMemAlloc(SIZE_T cb) {
+    return malloc(cb);
+}
+
+void CoTaskMemFree(void* pv) {
+    free(pv);
+}
+
+// OLE automation
+
+// Like the real ones, strings are prefixed with their size in bytes.
+BSTR SysAllocStringLen(const OLECHAR* strIn, UINT ui) {
+    auto block = (char*)malloc(sizeof(UINT) + (size_t(ui) + 1) * sizeof(OLECHAR));
+    if (!block)
+        return nullptr;
+    UINT bytes = ui * sizeof(OLECHAR);
+    memcpy(block, &bytes, sizeof(UINT));
+    auto str = (BSTR)(block + sizeof(UINT));
+    if (strIn)
+        memcpy(str, strIn, bytes);
+    else
+        memset(str, 0, bytes);
+    str[ui] = 0;
+    return str;
+}
+
+BSTR SysAllocString(const OLECHAR* psz) {
+    return psz ? SysAllocStringLen(psz, (UINT)wcslen(psz)) : nullptr;
+}
+
+void SysFreeString(BSTR bstrString) {
+    if (bstrString)
+        free((char*)bstrString - sizeof(UINT));
+}
+
+UINT SysStringLen(BSTR pbstr) {
+    if (!pbstr)
+        return 0;
+    UINT bytes;
+    memcpy(&bytes, (char*)pbstr - sizeof(UINT), sizeof(UINT));
+    return bytes / sizeof(OLECHAR);
+}
+
+void VariantInit(VARIANT* pvarg) {
+    memset(pvarg, 0, sizeof(VARIANT));
+    pvarg->vt = VT_EMPTY;
+}
+
+HRESULT VariantClear(VARIANT* pvarg) {
+    if (pvarg->vt == VT_BSTR)
+        SysFreeString(pvarg->bstrVal);
+    else if (pvarg->vt == VT_UNKNOWN && pvarg->punkVal)
+        pvarg->punkVal->Release();
+    VariantInit(pvarg);
+    return S_OK;
+}
+
+HRESULT VariantCopy(VARIANT* pvargDest, const VARIANT* pvargSrc) {
+    if (pvargDest == pvargSrc)
+        return S_OK;
+    VariantClear(pvargDest);
+    *pvargDest = *pvargSrc;
+    if (pvargSrc->vt == VT_BSTR && pvargSrc->bstrVal) {
+        pvargDest->bstrVal = SysAllocStringLen(pvargSrc->bstrVal, SysStringLen(pvargSrc->bstrVal));
+        if (!pvargDest->bstrVal) {
+            VariantInit(pvargDest);
+            return E_OUTOFMEMORY;
+        }
+    }
+    else if (pvargSrc->vt == VT_UNKNOWN && pvargSrc->punkVal)
+        pvargSrc->punkVal->AddRef();
+    return S_OK;
+}
+
+// keyboard
+
+BOOL GetKeyboardState(PBYTE lpKeyState) {
+    memcpy(lpKeyState, keyboardState, sizeof(keyboardState));
+    return TRUE;
+}
+
+BOOL SetKeyboardState(LPBYTE lpKeyState) {
+    memcpy(keyboardState, lpKeyState, sizeof(keyboardState));
+    return TRUE;
+}
+
+SHORT GetKeyState(int nVirtKey) {
+    if (nVirtKey < 0 || nVirtKey > 255)
+        return 0;
+    BYTE state = keyboardState[nVirtKey];
+    return SHORT(((state & 0x80) ? 0x8000 : 0) | (state & 1));
+}
+
+HKL GetKeyboardLayout(DWORD idThread) {
+    return (HKL)(ULONG_PTR)0x04090409; // en-US
+}
+
+int ToUnicodeEx(UINT wVirtKey, UINT wScanCode, const BYTE* lpKeyState,
+    LPWSTR pwszBuff, int cchBuff, UINT wFlags, HKL dwhkl) {
+    WCHAR ch = wVirtKey < 256 ? usKeyChar(wVirtKey, lpKeyState) : 0;
+    if (!ch || cchBuff < 1)
+        return 0;
+    pwszBuff[0] = ch;
+    return 1;
+}
+
+// windows, menus and resources
+
+HWND GetFocus() {
+    return nullptr;
+}
+
+int LoadStringW(HINSTANCE hInstance, UINT uID, LPWSTR lpBuffer, int cchBufferMax) {
+    if (cchBufferMax == 0)
+        *(const WCHAR**)lpBuffer = nullptr; // the read-only resource itself
+    else if (cchBufferMax > 0)
+        lpBuffer[0] = 0;
+    return 0;
+}
+
+HICON LoadIconW(HINSTANCE hInstance, LPCWSTR lpIconName) {
+    return nullptr;
+}
+
+HANDLE CopyImage(HANDLE h, UINT type, int cx, int cy, UINT flags) {
+    return nullptr;
+}
+
+BOOL DestroyMenu(HMENU hMenu) {
+    return FALSE;
+}
+
+int GetMenuItemCount(HMENU hMenu) {
+    return -1;
+}
+
+BOOL GetMenuItemInfoW(HMENU hmenu, UINT item, BOOL fByPosition, MENUITEMINFOW* lpmii) {
+    return FALSE;
+}
@@ -0,0 +1,391 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+
+// The part of the Win32 and COM API used by libIME, for building and testing
+// the text service on other platforms, with the in-memory TSF of FakeTsf.h.
+// Only what the library uses is declared. The key state functions work on
+// a keyboard kept per thread; the window manager has no windows, menus or
+// resources here, and its functions fail. Never included on Windows.
+
+#ifndef IME_COMPAT_WINDOWS_H
+#define IME_COMPAT_WINDOWS_H
+
+#ifdef _WIN32
+#error "compat/ must not be on the include path on Windows"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <wchar.h>
+
+// basic types
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef short SHORT;
+typedef unsigned short USHORT;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef float FLOAT;
+typedef double DOUBLE;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef intptr_t INT_PTR, LONG_PTR;
+typedef uintptr_t UINT_PTR, ULONG_PTR;
+typedef size_t SIZE_T;
+typedef ULONG_PTR DWORD_PTR;
+
+typedef BYTE* PBYTE;
+typedef BYTE* LPBYTE;
+typedef DWORD* LPDWORD;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef CHAR* LPSTR;
+typedef const CHAR* LPCSTR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef WCHAR* LPTSTR;
+typedef const WCHAR* LPCTSTR;
+
+typedef UINT_PTR WPARAM;
+typedef LONG_PTR LPARAM;
+typedef LONG_PTR LRESULT;
+typedef LONG HRESULT;
+typedef DWORD COLORREF;
+typedef WORD LANGID;
+typedef DWORD LCID;
+typedef WORD ATOM;
+
+#define TRUE 1
+#define FALSE 0
+
+#define WINAPI
+#define CALLBACK
+#define STDMETHODCALLTYPE
+#define STDMETHODIMP HRESULT STDMETHODCALLTYPE
+#define STDMETHODIMP_(type) type STDMETHODCALLTYPE
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method) virtual type STDMETHODCALLTYPE method
+#define PURE = 0
+
+#define interface struct
+// attributes such as uuid() and dllexport; interfaces get their IID from
+// __CRT_UUID_DECL() instead, as with MinGW
+#define __declspec(x)
+
+#define DECLARE_HANDLE(name) struct name##__ { int unused; }; typedef struct name##__* name
+DECLARE_HANDLE(HWND);
+DECLARE_HANDLE(HINSTANCE);
+DECLARE_HANDLE(HKL);
+DECLARE_HANDLE(HICON);
+DECLARE_HANDLE(HMENU);
+DECLARE_HANDLE(HBITMAP);
+DECLARE_HANDLE(HDC);
+typedef HINSTANCE HMODULE;
+typedef void* HANDLE;
+
+#define MAKEINTRESOURCEW(i) ((LPWSTR)(ULONG_PTR)(WORD)(i))
+#define LOWORD(l) ((WORD)((DWORD_PTR)(l) & 0xffff))
+#define HIWORD(l) ((WORD)(((DWORD_PTR)(l) >> 16) & 0xffff))
+#define LANGIDFROMLCID(lcid) ((WORD)(lcid))
+
+struct RECT {
+    LONG left, top, right, bottom;
+};
+typedef RECT* LPRECT;
+
+struct POINT {
+    LONG x, y;
+};
+
+struct SIZE {
+    LONG cx, cy;
+};
+
+// HRESULT
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define NOERROR S_OK
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_ABORT ((HRESULT)0x80004004)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define E_ACCESSDENIED ((HRESULT)0x80070005)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define CLASS_E_NOAGGREGATION ((HRESULT)0x80040110)
+#define CLASS_E_CLASSNOTAVAILABLE ((HRESULT)0x80040111)
+#define REGDB_E_CLASSNOTREG ((HRESULT)0x80040154)
+#define CONNECT_E_NOCONNECTION ((HRESULT)0x80040200)
+#define CONNECT_E_ADVISELIMIT ((HRESULT)0x80040201)
+#define CONNECT_E_CANNOTCONNECT ((HRESULT)0x80040202)
+
+DWORD GetLastError();
+void SetLastError(DWORD error);
+
+// GUID
+
+struct GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const GUID& REFGUID;
+typedef const IID& REFIID;
+typedef const CLSID& REFCLSID;
+
+inline bool operator == (const GUID& a, const GUID& b) {
+    return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+inline bool operator != (const GUID& a, const GUID& b) {
+    return !(a == b);
+}
+
+inline BOOL IsEqualGUID(REFGUID a, REFGUID b) {
+    return a == b;
+}
+#define IsEqualIID IsEqualGUID
+#define IsEqualCLSID IsEqualGUID
+
+// the IID of an interface, given by __CRT_UUID_DECL()
+template <typename T>
+struct CompatUuidOf;
+
+#define __CRT_UUID_DECL(type, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    template <> \
+    struct CompatUuidOf<type> { \
+        static constexpr GUID value = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }; \
+    };
+
+#define __uuidof(type) (CompatUuidOf<type>::value)
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    inline constexpr GUID name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+
+// Declares an interface with its IID, also as IID_<name>:
+//   COMPAT_INTERFACE(IFoo, IUnknown, 0x..., ...) { STDMETHOD(Foo)() PURE; };
+#define COMPAT_INTERFACE(name, base, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    struct name; \
+    __CRT_UUID_DECL(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    inline constexpr const IID& IID_##name = __uuidof(name); \
+    struct name : public base
+
+DEFINE_GUID(GUID_NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+// COM
+
+struct IUnknown;
+__CRT_UUID_DECL(IUnknown, 0x00000000, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46)
+inline constexpr const IID& IID_IUnknown = __uuidof(IUnknown);
+
+struct IUnknown {
+    STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) PURE;
+    STDMETHOD_(ULONG, AddRef)() PURE;
+    STDMETHOD_(ULONG, Release)() PURE;
+};
+typedef IUnknown* LPUNKNOWN;
+
+COMPAT_INTERFACE(IClassFactory, IUnknown, 0x00000001, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46) {
+    STDMETHOD(CreateInstance)(IUnknown* pUnkOuter, REFIID riid, void** ppvObject) PURE;
+    STDMETHOD(LockServer)(BOOL fLock) PURE;
+};
+
+#define CLSCTX_INPROC_SERVER 0x1
+#define CLSCTX_ALL 0x17
+#define REGCLS_SINGLEUSE 0
+#define REGCLS_MULTIPLEUSE 1
+
+// Creates an object of a class registered with CoRegisterClassObject() in
+// this process; there is no registry. REGDB_E_CLASSNOTREG otherwise.
+HRESULT CoCreateInstance(REFCLSID rclsid, IUnknown* pUnkOuter, DWORD dwClsContext, REFIID riid, void** ppv);
+HRESULT CoRegisterClassObject(REFCLSID rclsid, IUnknown* pUnk, DWORD dwClsContext, DWORD flags, LPDWORD lpdwRegister);
+HRESULT CoRevokeClassObject(DWORD dwRegister);
+
+void* CoTaskMemAlloc(SIZE_T cb);
+void CoTaskMemFree(void* pv);
+
+// OLE automation
+
+typedef WCHAR OLECHAR;
+typedef OLECHAR* BSTR;
+typedef unsigned short VARTYPE;
+typedef short VARIANT_BOOL;
+
+BSTR SysAllocString(const OLECHAR* psz);
+BSTR SysAllocStringLen(const OLECHAR* strIn, UINT ui);
+void SysFreeString(BSTR bstrString);
+UINT SysStringLen(BSTR pbstr);
+
+enum VARENUM {
+    VT_EMPTY = 0,
+    VT_NULL = 1,
+    VT_I2 = 2,
+    VT_I4 = 3,
+    VT_R4 = 4,
+    VT_R8 = 5,
+    VT_BSTR = 8,
+    VT_BOOL = 11,
+    VT_UNKNOWN = 13,
+    VT_UI4 = 19,
+};
+
+struct VARIANT {
+    VARTYPE vt;
+    WORD wReserved1, wReserved2, wReserved3;
+    union {
+        LONG lVal;
+        BYTE bVal;
+        SHORT iVal;
+        FLOAT fltVal;
+        DOUBLE dblVal;
+        VARIANT_BOOL boolVal;
+        ULONG ulVal;
+        BSTR bstrVal;
+        IUnknown* punkVal;
+    };
+};
+
+void VariantInit(VARIANT* pvarg);
+// frees the string of VT_BSTR and releases the object of VT_UNKNOWN
+HRESULT VariantClear(VARIANT* pvarg);
+HRESULT VariantCopy(VARIANT* pvargDest, const VARIANT* pvargSrc);
+
+// messages and keys
+
+#define WM_KEYDOWN 0x0100
+#define WM_KEYUP 0x0101
+#define WM_CHAR 0x0102
+#define WM_SYSKEYDOWN 0x0104
+#define WM_SYSKEYUP 0x0105
+#define WM_USER 0x0400
+
+#define VK_BACK 0x08
+#define VK_TAB 0x09
+#define VK_RETURN 0x0D
+#define VK_SHIFT 0x10
+#define VK_CONTROL 0x11
+#define VK_MENU 0x12
+#define VK_CAPITAL 0x14
+#define VK_ESCAPE 0x1B
+#define VK_SPACE 0x20
+#define VK_PRIOR 0x21
+#define VK_NEXT 0x22
+#define VK_END 0x23
+#define VK_HOME 0x24
+#define VK_LEFT 0x25
+#define VK_UP 0x26
+#define VK_RIGHT 0x27
+#define VK_DOWN 0x28
+#define VK_DELETE 0x2E
+#define VK_LWIN 0x5B
+#define VK_RWIN 0x5C
+#define VK_NUMLOCK 0x90
+#define VK_SCROLL 0x91
+#define VK_LSHIFT 0xA0
+#define VK_RSHIFT 0xA1
+#define VK_LCONTROL 0xA2
+#define VK_RCONTROL 0xA3
+#define VK_LMENU 0xA4
+#define VK_RMENU 0xA5
+#define VK_OEM_1 0xBA
+#define VK_OEM_PLUS 0xBB
+#define VK_OEM_COMMA 0xBC
+#define VK_OEM_MINUS 0xBD
+#define VK_OEM_PERIOD 0xBE
+#define VK_OEM_2 0xBF
+#define VK_OEM_3 0xC0
+#define VK_OEM_4 0xDB
+#define VK_OEM_5 0xDC
+#define VK_OEM_6 0xDD
+#define VK_OEM_7 0xDE
+
+// The keyboard of the calling thread, all keys up until SetKeyboardState().
+BOOL GetKeyboardState(PBYTE lpKeyState);
+BOOL SetKeyboardState(LPBYTE lpKeyState);
+SHORT GetKeyState(int nVirtKey);
+
+// A US English layout: the letters, digits and punctuation of the main
+// block and their shifted symbols, control characters with Ctrl, space,
+// tab, enter, escape and backspace. AltGr types nothing; there are no dead
+// keys.
+HKL GetKeyboardLayout(DWORD idThread);
+int ToUnicodeEx(UINT wVirtKey, UINT wScanCode, const BYTE* lpKeyState,
+    LPWSTR pwszBuff, int cchBuff, UINT wFlags, HKL dwhkl);
+
+// windows, menus and resources
+
+#define COLOR_WINDOW 5
+#define COLOR_WINDOWTEXT 8
+
+#define IMAGE_ICON 1
+
+#define MIIM_STATE 0x0001
+#define MIIM_ID 0x0002
+#define MIIM_SUBMENU 0x0004
+#define MIIM_STRING 0x0040
+#define MIIM_FTYPE 0x0100
+
+#define MFT_STRING 0x0000
+#define MFT_SEPARATOR 0x0800
+
+#define MFS_GRAYED 0x0003
+#define MFS_DISABLED MFS_GRAYED
+#define MFS_CHECKED 0x0008
+
+struct MENUITEMINFOW {
+    UINT cbSize;
+    UINT fMask;
+    UINT fType;
+    UINT fState;
+    UINT wID;
+    HMENU hSubMenu;
+    HBITMAP hbmpChecked;
+    HBITMAP hbmpUnchecked;
+    ULONG_PTR dwItemData;
+    LPWSTR dwTypeData;
+    UINT cch;
+    HBITMAP hbmpItem;
+};
+typedef MENUITEMINFOW MENUITEMINFO;
+
+HWND GetFocus();
+int LoadStringW(HINSTANCE hInstance, UINT uID, LPWSTR lpBuffer, int cchBufferMax);
+HICON LoadIconW(HINSTANCE hInstance, LPCWSTR lpIconName);
+HANDLE CopyImage(HANDLE h, UINT type, int cx, int cy, UINT flags);
+BOOL DestroyMenu(HMENU hMenu);
+int GetMenuItemCount(HMENU hMenu);
+BOOL GetMenuItemInfoW(HMENU hmenu, UINT item, BOOL fByPosition, MENUITEMINFOW* lpmii);
+
+#endif
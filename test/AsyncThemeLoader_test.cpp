@@ -0,0 +1,216 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncThemeLoader.h"
+#include "ThemeCompiler.h"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+using Loader = Ime::AsyncThemeLoader<Ime::ThemeData>;
+using Theme = std::shared_ptr<const Ime::ThemeData>;
+
+class TestAsyncThemeLoader: public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() /
+            ("libIME2_async_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        std::ofstream(dir / "theme.conf", std::ios::binary) <<
+            "[InputPanel]\nNormalColor=#102030\n[InputPanel/Background]\nImage=panel.png\n";
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    // compiles the theme with a fake image decoder, after waiting for
+    // release if it is given; throws if theme.conf is missing
+    Loader::Loader loader(std::shared_future<void> release = {}) {
+        return [this, release](const fs::path& themeDir) {
+            if (release.valid())
+                release.wait();
+            loaderThread = std::this_thread::get_id();
+            auto decoder = [](const fs::path&, Ime::ThemeImageData& image) {
+                image.size = { 2, 2 };
+                image.pixels.assign(16, 0xFF);
+                return true;
+            };
+            auto theme = std::make_shared<Ime::ThemeData>();
+            if (!Ime::compileTheme(themeDir, decoder, *theme))
+                throw std::runtime_error("no theme.conf");
+            return Theme(theme);
+        };
+    }
+
+    fs::path dir;
+    std::thread::id loaderThread;
+};
+
+TEST_F(TestAsyncThemeLoader, LoadsOnWorkerThread)
+{
+    Loader async(loader());
+    std::thread::id callbackThread;
+    auto future = async.load(dir, [&](Theme theme) {
+        EXPECT_TRUE(theme);
+        callbackThread = std::this_thread::get_id();
+    });
+    auto theme = future.get();
+    ASSERT_TRUE(theme);
+    EXPECT_EQ(theme->normalColor, 0x302010u);
+    EXPECT_EQ(theme->background.size.cx, 2);
+    // the callback ran before the future became ready
+    EXPECT_EQ(callbackThread, loaderThread);
+    EXPECT_NE(loaderThread, std::this_thread::get_id());
+}
+
+TEST_F(TestAsyncThemeLoader, PlaceholderUntilReady)
+{
+    std::promise<void> release;
+    Loader async(loader(release.get_future().share()));
+    Ime::ThemeSlot<Ime::ThemeData> current(std::make_shared<Ime::ThemeData>(Ime::builtinThemeData()));
+    auto placeholder = current.get();
+
+    // load() does not wait for the loader
+    auto future = async.load(dir, [&](Theme theme) { current.set(std::move(theme)); });
+    EXPECT_EQ(future.wait_for(50ms), std::future_status::timeout);
+    EXPECT_EQ(current.get(), placeholder);
+
+    release.set_value();
+    auto theme = future.get();
+    EXPECT_EQ(current.get(), theme);
+    EXPECT_NE(theme, placeholder);
+    // the old theme is still usable by whoever holds it
+    EXPECT_FALSE(placeholder->background.isEmpty());
+}
+
+TEST_F(TestAsyncThemeLoader, FailureKeepsCallerInformed)
+{
+    Loader async(loader());
+    bool called = false;
+    Theme result = std::make_shared<Ime::ThemeData>();
+    auto future = async.load(dir / "missing", [&](Theme theme) {
+        called = true;
+        result = theme;
+    });
+    EXPECT_THROW(future.get(), std::runtime_error);
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(result);
+    // the worker goes on with the next request
+    EXPECT_TRUE(async.load(dir).get());
+}
+
+TEST_F(TestAsyncThemeLoader, ServesRequestsInOrder)
+{
+    std::vector<int> order;
+    std::vector<std::shared_future<Theme>> futures;
+    {
+        std::promise<void> release;
+        Loader async(loader(release.get_future().share()));
+        for (int i = 0; i < 5; ++i)
+            futures.push_back(async.load(dir, [&order, i](Theme) { order.push_back(i); }));
+        release.set_value();
+        // the destructor waits for the queued requests
+    }
+    EXPECT_EQ(order, (std::vector<int>{ 0, 1, 2, 3, 4 }));
+    for (auto& future : futures)
+        EXPECT_EQ(future.wait_for(0s), std::future_status::ready);
+}
+
+TEST_F(TestAsyncThemeLoader, RestartsAfterIdle)
+{
+    Loader async(loader());
+    EXPECT_TRUE(async.load(dir).get());
+    async.wait();
+    EXPECT_TRUE(async.load(dir).get());
+    async.wait();
+}
+
+TEST_F(TestAsyncThemeLoader, KeepsOneWorker)
+{
+    std::atomic<int> entered{ 0 }, left{ 0 };
+    Loader async(loader(), [&] { ++entered; }, [&] { ++left; });
+    EXPECT_TRUE(async.load(dir).get());
+    async.wait();
+    auto first = loaderThread;
+    // an idle loader starts no new thread for the next request
+    EXPECT_TRUE(async.load(dir).get());
+    async.wait();
+    EXPECT_EQ(loaderThread, first);
+    EXPECT_EQ(entered, 1);
+    EXPECT_EQ(left, 0);
+}
+
+TEST_F(TestAsyncThemeLoader, StopEndsTheWorker)
+{
+    std::atomic<int> left{ 0 };
+    Loader async(loader(), {}, [&] {
+        // the worker is still busy after the last request is done
+        std::this_thread::sleep_for(20ms);
+        ++left;
+    });
+    EXPECT_TRUE(async.load(dir).get());
+    async.stop();
+    EXPECT_EQ(left, 1);
+    // a later request starts another worker
+    EXPECT_TRUE(async.load(dir).get());
+    async.stop();
+    EXPECT_EQ(left, 2);
+}
+
+TEST_F(TestAsyncThemeLoader, HooksRunOnWorkerAroundLoads)
+{
+    std::vector<std::string> events;
+    std::thread::id enterThread, leaveThread;
+    std::promise<void> release;
+    {
+        Loader async([&, inner = loader(release.get_future().share())](const fs::path& themeDir) {
+            events.push_back("load");
+            return inner(themeDir);
+        }, [&] {
+            events.push_back("enter");
+            enterThread = std::this_thread::get_id();
+        }, [&] {
+            events.push_back("leave");
+            leaveThread = std::this_thread::get_id();
+        });
+        async.load(dir);
+        async.load(dir);
+        release.set_value();
+        async.wait();
+    }
+    // once per worker, not per request
+    EXPECT_EQ(events, (std::vector<std::string>{ "enter", "load", "load", "leave" }));
+    EXPECT_EQ(enterThread, loaderThread);
+    EXPECT_EQ(leaveThread, loaderThread);
+}
+
+TEST(TestThemeSlot, Exchange)
+{
+    auto first = std::make_shared<const Ime::ThemeData>();
+    Ime::ThemeSlot<Ime::ThemeData> slot(first);
+    EXPECT_EQ(slot.exchange(nullptr), first);
+    EXPECT_FALSE(slot.get());
+}
+
+TEST(TestBuiltinTheme, NeedsNoFiles)
+{
+    auto theme = Ime::builtinThemeData();
+    for (const auto* image : { &theme.background, &theme.highlight }) {
+        EXPECT_FALSE(image->isEmpty());
+        EXPECT_EQ(image->pixels.size(), size_t(image->size.cx) * image->size.cy * 4);
+        // opaque, so premultiplied as is
+        for (size_t i = 3; i < image->pixels.size(); i += 4)
+            EXPECT_EQ(image->pixels[i], 0xFF);
+    }
+}
@@ -0,0 +1,171 @@
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CandidateLayout.h"
+#include "CandidateSource.h"
+#include "NineSlice.h"
+#include "TextMeasureCache.h"
+
+// Counts every heap allocation made by this test program.
+static size_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static std::vector<std::wstring> makeItems(size_t count, const wchar_t* prefix) {
+    std::vector<std::wstring> items;
+    for (size_t i = 0; i < count; ++i)
+        items.push_back(prefix + std::to_wstring(i));
+    return items;
+}
+
+TEST(TestCandidateAllocation, AssignTakesConstantAllocations)
+{
+    auto items = makeItems(1000, L"a long enough candidate string ");
+    std::vector<wchar_t> selKeys(1000, L'1');
+    Ime::CandidateList list;
+
+    size_t before = allocationCount;
+    list.assign(items, selKeys);
+    // the text, the offsets and the selection keys
+    EXPECT_LE(allocationCount - before, 3u);
+
+    // refilling with no more text reuses the buffers
+    auto shorter = makeItems(1000, L"short ");
+    before = allocationCount;
+    list.assign(shorter, selKeys);
+    list.assign(items, selKeys);
+    EXPECT_EQ(allocationCount - before, 0u);
+    EXPECT_EQ(list.text(999), L"a long enough candidate string 999");
+}
+
+TEST(TestCandidateAllocation, AssignViews)
+{
+    auto items = makeItems(100, L"candidate ");
+    std::vector<std::wstring_view> views(items.begin(), items.end());
+    Ime::CandidateList list;
+
+    size_t before = allocationCount;
+    list.assign(views, {});
+    EXPECT_LE(allocationCount - before, 3u);
+    EXPECT_EQ(list.text(42), L"candidate 42");
+    EXPECT_EQ(list.selKey(42), L'\0');
+}
+
+TEST(TestCandidateAllocation, PagingReusesTheArena)
+{
+    auto items = makeItems(1000, L"candidate ");
+    Ime::CandidateList list;
+    list.assign(items, {});
+    Ime::CandidatePage page;
+    // the last page has the longest strings
+    page.load(list, 990, 9);
+
+    size_t before = allocationCount;
+    for (size_t first = 9; first < 900; first += 9)
+        page.load(list, first, 9);
+    EXPECT_EQ(allocationCount - before, 0u);
+    EXPECT_EQ(page.text(891), L"candidate 891");
+}
+
+namespace {
+
+class FixedWidthMeasurer: public Ime::TextMeasurer {
+public:
+    Ime::Size measure(std::wstring_view text) override {
+        return { int(text.size()) * 8, 16 };
+    }
+};
+
+// What CandidateWindow does for setItems() and the refresh() which follows,
+// without GDI: fill the list, lay out and measure the visible page with the
+// default settings, then paint it, building the label of each candidate.
+class RefreshCycle {
+public:
+    void run(const std::vector<std::wstring>& items, const std::vector<wchar_t>& selKeys) {
+        // setItems()
+        list_.assign(items, selKeys);
+        page_.invalidate();
+        // updateLayout()
+        Ime::CandidateLayoutParams params;
+        params.itemsPerRow = 1;
+        params.pageSize = Ime::defaultCandidatePageSize;
+        layout_.setParams(params);
+        layout_.resize(list_.count());
+        page_.load(list_, layout_.pageStart(0), layout_.pageSize());
+        for (size_t i = page_.first(); i < page_.first() + page_.size(); ++i)
+            layout_.setItemSize(i, measureCache_.measure({}, candidateString(i), measurer_));
+        // paint()
+        const auto& page = layout_.page(0);
+        slices_.get({ 3, 3 }, { 1, 1, 1, 1 }, page.size);
+        for (size_t i = page.first; i < page.first + page.cells.size(); ++i)
+            painted_ += candidateString(i).size();
+    }
+
+private:
+    std::wstring_view candidateString(size_t i) {
+        label_.clear();
+        if (wchar_t selKey = page_.selKey(i)) {
+            label_ += selKey;
+            label_ += L'.';
+        }
+        label_ += page_.text(i);
+        return label_;
+    }
+
+    Ime::CandidateList list_;
+    Ime::CandidateLayout layout_;
+    Ime::CandidatePage page_;
+    Ime::TextMeasureCache measureCache_;
+    Ime::NineSliceCache slices_;
+    FixedWidthMeasurer measurer_;
+    std::wstring label_;
+    size_t painted_ = 0;
+};
+
+} // namespace
+
+TEST(TestCandidateAllocation, RefreshCycleTakesConstantAllocations)
+{
+    auto many = makeItems(100000, L"a long enough candidate string ");
+    std::vector<wchar_t> selKeys(100000, L'1');
+    RefreshCycle cycle;
+    // the buffers grow to their final size once
+    cycle.run(many, selKeys);
+
+    // the same candidates again, as when the composition changes and the
+    // candidates do not: everything is reused
+    size_t before = allocationCount;
+    cycle.run(many, selKeys);
+    EXPECT_EQ(allocationCount - before, 0u);
+
+    // A new list costs as much whatever its length, as only the visible
+    // page is fetched and measured. What is left are the entries of the
+    // text measure cache, and their rehashing now and then.
+    const size_t bound = size_t(Ime::defaultCandidatePageSize) * 3 + 1;
+    auto fewOther = makeItems(100, L"another long enough candidate ");
+    auto manyOther = makeItems(100000, L"yet another long candidate str ");
+    before = allocationCount;
+    cycle.run(fewOther, selKeys);
+    EXPECT_LE(allocationCount - before, bound);
+    before = allocationCount;
+    cycle.run(manyOther, selKeys);
+    EXPECT_LE(allocationCount - before, bound);
+}
@@ -0,0 +1,194 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "CandidateLayout.h"
+
+using Ime::Rect;
+using Ime::Size;
+
+static const Ime::Margins contentMargin{ 4, 6, 4, 6 };  // top, right, bottom, left
+static const Ime::Margins textMargin{ 1, 2, 1, 2 };
+
+static Ime::CandidateLayoutParams layoutParams(int itemsPerRow = 0, int pageSize = 0) {
+    Ime::CandidateLayoutParams params;
+    params.contentMargin = contentMargin;
+    params.textMargin = textMargin;
+    params.itemsPerRow = itemsPerRow;
+    params.pageSize = pageSize;
+    return params;
+}
+
+TEST(TestCandidateLayout, SingleRow)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams());
+    layout.setItemSizes({ { 30, 16 }, { 50, 18 } });
+    ASSERT_EQ(layout.count(), 2u);
+    EXPECT_EQ(layout.pageCount(), 1u);
+    EXPECT_TRUE(layout.compositionRect().isEmpty());
+
+    // the row is as tall as its tallest cell
+    EXPECT_EQ(layout.cell(0).rect, (Rect{ 6, 4, 40, 24 }));
+    EXPECT_EQ(layout.cell(0).textRect, (Rect{ 8, 5, 38, 21 }));
+    EXPECT_EQ(layout.cell(1).rect, (Rect{ 40, 4, 94, 24 }));
+    EXPECT_EQ(layout.cell(1).textRect, (Rect{ 42, 5, 92, 23 }));
+    EXPECT_EQ(layout.page(0).size, (Size{ 94 + 6, 24 + 4 }));
+}
+
+TEST(TestCandidateLayout, CompositionAboveCandidates)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams());
+    layout.setCompositionSize({ 200, 16 });
+    layout.setItemSizes({ { 30, 16 } });
+    EXPECT_EQ(layout.compositionRect(), (Rect{ 8, 5, 208, 21 }));
+    EXPECT_EQ(layout.cell(0).rect, (Rect{ 6, 22, 40, 40 }));
+    // the composition string is wider than the candidates
+    EXPECT_EQ(layout.page(0).size, (Size{ 6 + 204 + 6, 4 + 18 + 18 + 4 }));
+}
+
+TEST(TestCandidateLayout, Empty)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(3, 9));
+    EXPECT_EQ(layout.count(), 0u);
+    EXPECT_EQ(layout.pageCount(), 1u);
+    EXPECT_TRUE(layout.page(0).cells.empty());
+    EXPECT_EQ(layout.page(0).size, (Size{ 12, 8 }));
+}
+
+TEST(TestCandidateLayout, GridAlignsColumns)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(2));
+    layout.setItemSizes({ { 30, 16 }, { 10, 16 }, { 20, 20 }, { 40, 16 }, { 5, 16 } });
+    ASSERT_EQ(layout.pageCount(), 1u);
+
+    // columns are 34 and 44 pixels wide; rows are 18, 22 and 18 pixels tall
+    EXPECT_EQ(layout.cell(0).rect, (Rect{ 6, 4, 40, 22 }));
+    EXPECT_EQ(layout.cell(1).rect, (Rect{ 40, 4, 84, 22 }));
+    EXPECT_EQ(layout.cell(2).rect, (Rect{ 6, 22, 40, 44 }));
+    EXPECT_EQ(layout.cell(3).rect, (Rect{ 40, 22, 84, 44 }));
+    EXPECT_EQ(layout.cell(4).rect, (Rect{ 6, 44, 40, 62 }));
+    EXPECT_EQ(layout.cell(3).textRect, (Rect{ 42, 23, 82, 39 }));
+    EXPECT_EQ(layout.page(0).size, (Size{ 84 + 6, 62 + 4 }));
+}
+
+TEST(TestCandidateLayout, Pages)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(2, 4));
+    layout.setItemSizes(std::vector<Size>(10, { 20, 16 }));
+    ASSERT_EQ(layout.pageCount(), 3u);
+    EXPECT_EQ(layout.pageOf(3), 0u);
+    EXPECT_EQ(layout.pageOf(4), 1u);
+    EXPECT_EQ(layout.pageStart(2), 8u);
+
+    // every page starts at the top left corner
+    EXPECT_EQ(layout.cell(4).rect, layout.cell(0).rect);
+    EXPECT_EQ(layout.page(1).first, 4u);
+    EXPECT_EQ(layout.page(1).cells.size(), 4u);
+    EXPECT_EQ(layout.page(2).cells.size(), 2u);
+    EXPECT_EQ(layout.page(2).size, (Size{ 6 + 48 + 6, 4 + 18 + 4 }));
+    EXPECT_EQ(layout.page(1).size, (Size{ 6 + 48 + 6, 4 + 36 + 4 }));
+}
+
+TEST(TestCandidateLayout, HitTest)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(0, 2));
+    layout.setItemSizes({ { 30, 16 }, { 50, 18 }, { 30, 16 } });
+    EXPECT_EQ(layout.hitTest(0, { 6, 4 }), 0);
+    EXPECT_EQ(layout.hitTest(0, { 39, 10 }), 0);
+    EXPECT_EQ(layout.hitTest(0, { 40, 10 }), 1);
+    EXPECT_EQ(layout.hitTest(0, { 0, 0 }), -1);
+    EXPECT_EQ(layout.hitTest(0, { 94, 10 }), -1);
+    EXPECT_EQ(layout.hitTest(1, { 6, 4 }), 2);
+}
+
+TEST(TestCandidateLayout, SelectionDamageCoversOnlyTwoCells)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams());
+    layout.setItemSizes({ { 30, 16 }, { 50, 18 }, { 20, 16 } });
+    auto damage = layout.selectionDamage(0, 2);
+    ASSERT_EQ(damage.size(), 2u);
+    EXPECT_EQ(damage[0], layout.cell(0).rect);
+    EXPECT_EQ(damage[1], layout.cell(2).rect);
+    EXPECT_FALSE(damage[0].intersects(layout.cell(1).rect));
+    EXPECT_FALSE(damage[1].intersects(layout.cell(1).rect));
+
+    EXPECT_EQ(layout.selectionDamage(1, 1).size(), 1u);
+    EXPECT_EQ(layout.selectionDamage(-1, 1).size(), 1u);
+    EXPECT_TRUE(layout.selectionDamage(5, 7).empty());
+}
+
+TEST(TestCandidateLayout, NoSelectionDamageAcrossPages)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(0, 2));
+    layout.setItemSizes(std::vector<Size>(4, { 20, 16 }));
+    EXPECT_EQ(layout.selectionDamage(0, 1).size(), 2u);
+    EXPECT_TRUE(layout.selectionDamage(1, 2).empty());
+}
+
+TEST(TestCandidateLayout, LaysOutPagesLazily)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(3, 9));
+    layout.setItemSizes(std::vector<Size>(10000, { 20, 16 }));
+    EXPECT_EQ(layout.pageCount(), 1112u);
+    EXPECT_EQ(layout.layoutPasses(), 0u);
+    layout.page(500);
+    layout.page(500);
+    EXPECT_EQ(layout.layoutPasses(), 1u);
+}
+
+TEST(TestCandidateLayout, UpdatesOnlyChangedPages)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(3, 9));
+    std::vector<Size> sizes(10000, { 20, 16 });
+    layout.setItemSizes(sizes);
+    for (size_t page = 0; page < layout.pageCount(); ++page)
+        layout.page(page);
+    size_t passes = layout.layoutPasses();
+
+    // unchanged sizes keep every page
+    layout.setItemSizes(sizes);
+    for (size_t page = 0; page < layout.pageCount(); ++page)
+        layout.page(page);
+    EXPECT_EQ(layout.layoutPasses(), passes);
+
+    sizes[4000] = { 60, 16 };
+    sizes[4001] = { 60, 16 };
+    sizes[9999] = { 60, 16 };
+    layout.setItemSizes(sizes);
+    for (size_t page = 0; page < layout.pageCount(); ++page)
+        layout.page(page);
+    EXPECT_EQ(layout.layoutPasses(), passes + 2);
+    EXPECT_EQ(layout.cell(4001).textRect.width(), 60);
+
+    // appending items only lays out the last page and the new ones
+    passes = layout.layoutPasses();
+    sizes.resize(10020, { 20, 16 });
+    layout.setItemSizes(sizes);
+    for (size_t page = 0; page < layout.pageCount(); ++page)
+        layout.page(page);
+    EXPECT_EQ(layout.layoutPasses(), passes + 3);
+}
+
+TEST(TestCandidateLayout, ParamsInvalidateEverything)
+{
+    Ime::CandidateLayout layout;
+    layout.setParams(layoutParams(3, 9));
+    layout.setItemSizes(std::vector<Size>(20, { 20, 16 }));
+    layout.page(0);
+    layout.setParams(layoutParams(3, 9));
+    layout.page(0);
+    EXPECT_EQ(layout.layoutPasses(), 1u);
+    layout.setParams(layoutParams(1, 9));
+    EXPECT_EQ(layout.cell(1).rect.left, layout.cell(0).rect.left);
+    EXPECT_EQ(layout.layoutPasses(), 2u);
+}
@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "CandidateSource.h"
+#include "CandidateLayout.h"
+
+// Generates "candidate N" on demand and counts the candidates it produced.
+class GeneratedSource: public Ime::CandidateSource {
+public:
+    explicit GeneratedSource(size_t count): count_(count) {}
+
+    size_t count() const override {
+        return count_;
+    }
+
+    Ime::Candidate at(size_t index) const override {
+        ++fetched;
+        return { L"candidate " + std::to_wstring(index), wchar_t(L'1' + index % 9) };
+    }
+
+    mutable size_t fetched = 0;
+
+private:
+    size_t count_;
+};
+
+TEST(TestCandidateSource, GetRangeClipsToCount)
+{
+    GeneratedSource source(10);
+    Ime::CandidateArena out;
+    out.push_back(L"stale", 0);
+    source.getRange(8, 5, out);
+    ASSERT_EQ(out.size(), 2u);
+    EXPECT_EQ(out.text(0), L"candidate 8");
+    EXPECT_EQ(out.selKey(1), L'1');
+    source.getRange(12, 5, out);
+    EXPECT_TRUE(out.empty());
+}
+
+TEST(TestCandidateSource, List)
+{
+    Ime::CandidateList list;
+    std::vector<std::wstring> items{ L"a", L"bb", L"c" };
+    std::vector<wchar_t> selKeys{ L'1', L'2' };
+    list.assign(items, selKeys);
+    ASSERT_EQ(list.count(), 3u);
+    EXPECT_EQ(list.at(1).text, L"bb");
+    EXPECT_EQ(list.text(1), L"bb");
+    EXPECT_EQ(list.at(1).selKey, L'2');
+    // missing selection keys read as 0
+    EXPECT_EQ(list.at(2).selKey, L'\0');
+
+    list.add(L"d", L'4');
+    EXPECT_EQ(list.at(3).text, L"d");
+    EXPECT_EQ(list.at(3).selKey, L'4');
+    // out of range, as for the selection of an empty list
+    EXPECT_TRUE(list.at(4).text.empty());
+    EXPECT_EQ(list.at(4).selKey, L'\0');
+    EXPECT_EQ(Ime::CandidateList().at(0).selKey, L'\0');
+
+    Ime::CandidateArena range;
+    list.getRange(1, 2, range);
+    ASSERT_EQ(range.size(), 2u);
+    EXPECT_EQ(range.text(0), L"bb");
+    EXPECT_EQ(range.text(1), L"c");
+    EXPECT_EQ(range.textLength(), 3u);
+
+    list.clear();
+    EXPECT_EQ(list.count(), 0u);
+}
+
+TEST(TestCandidateSource, ListFromBracedLists)
+{
+    Ime::CandidateList list;
+    std::vector<wchar_t> selKeys{ L'1', L'2' };
+    list.assign({ L"a", L"bb" }, selKeys);
+    ASSERT_EQ(list.count(), 2u);
+    EXPECT_EQ(list.text(1), L"bb");
+    EXPECT_EQ(list.selKey(1), L'2');
+    // a temporary vector still picks the std::wstring overload
+    list.assign(std::vector<std::wstring>{ L"c" }, {});
+    EXPECT_EQ(list.text(0), L"c");
+}
+
+TEST(TestCandidateSource, PageFetchesOnlyOnce)
+{
+    GeneratedSource source(100);
+    Ime::CandidatePage page;
+    EXPECT_TRUE(page.load(source, 9, 9));
+    EXPECT_FALSE(page.load(source, 9, 9));
+    EXPECT_EQ(source.fetched, 9u);
+    EXPECT_TRUE(page.contains(17));
+    EXPECT_FALSE(page.contains(18));
+    EXPECT_EQ(page.text(17), L"candidate 17");
+
+    page.invalidate();
+    EXPECT_FALSE(page.contains(17));
+    EXPECT_TRUE(page.load(source, 9, 9));
+    EXPECT_EQ(source.fetched, 18u);
+}
+
+TEST(TestCandidateSource, HugeSourceMaterializesVisiblePageOnly)
+{
+    const size_t pageSize = 9;
+    GeneratedSource source(100000);
+    Ime::CandidateLayoutParams params;
+    params.itemsPerRow = 3;
+    params.pageSize = int(pageSize);
+    Ime::CandidateLayout layout;
+    layout.setParams(params);
+    layout.resize(source.count());
+    EXPECT_EQ(layout.pageCount(), 11112u);
+
+    // what CandidateWindow does to show the page of candidate 50000
+    Ime::CandidatePage page;
+    size_t visible = layout.pageOf(50000);
+    page.load(source, layout.pageStart(visible), pageSize);
+    for (size_t i = page.first(); i < page.first() + page.size(); ++i)
+        layout.setItemSize(i, { int(page.text(i).size()) * 8, 16 });
+
+    EXPECT_EQ(source.fetched, pageSize);
+    EXPECT_EQ(page.size(), pageSize);
+    EXPECT_EQ(layout.cell(50000).textRect.width(), 15 * 8);
+    EXPECT_EQ(layout.layoutPasses(), 1u);
+
+    // the last page is short
+    page.load(source, layout.pageStart(layout.pageCount() - 1), pageSize);
+    EXPECT_EQ(page.size(), 1u);
+    EXPECT_EQ(page.text(99999), L"candidate 99999");
+}
+
+TEST(TestCandidateSource, WindowDefaultsFetchOnePage)
+{
+    // what CandidateWindow::updateLayout() does with its default settings,
+    // one candidate per row and defaultCandidatePageSize per page, after
+    // setSource() with a huge source
+    GeneratedSource source(100000);
+    Ime::CandidateLayoutParams params;
+    params.itemsPerRow = 1;
+    params.pageSize = Ime::defaultCandidatePageSize;
+    Ime::CandidateLayout layout;
+    layout.setParams(params);
+    layout.resize(source.count());
+
+    Ime::CandidatePage page;
+    page.load(source, layout.pageStart(layout.pageOf(0)), layout.pageSize());
+    for (size_t i = page.first(); i < page.first() + page.size(); ++i)
+        layout.setItemSize(i, { int(page.text(i).size()) * 8, 16 });
+
+    EXPECT_EQ(source.fetched, size_t(Ime::defaultCandidatePageSize));
+    EXPECT_EQ(layout.pageCount(), 100000u / Ime::defaultCandidatePageSize);
+}
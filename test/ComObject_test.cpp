@@ -3,6 +3,9 @@
 
 #include <unknwn.h>
 #include <msctf.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "ComObject.h"
 
@@ -12,6 +15,20 @@ interface __declspec(uuid("5F840B91-F834-498D-9EAA-C3F65D87A7B2")) Interface1: p
 interface __declspec(uuid("31C548DD-7FD8-4380-BBD4-2F4F47F0BC0D")) Interface2 : public IUnknown {
 };
 
+interface __declspec(uuid("9A3E6C02-5B17-4E8D-A0F4-61C2D7B38E95")) Interface3 : public Interface1 {
+};
+
+// the first word of Interface2
+interface __declspec(uuid("31C548DD-0001-4000-8000-000000000001")) Interface4 : public IUnknown {
+};
+
+#ifdef __CRT_UUID_DECL // __declspec(uuid) is only known to MSVC
+__CRT_UUID_DECL(Interface1, 0x5F840B91, 0xF834, 0x498D, 0x9E, 0xAA, 0xC3, 0xF6, 0x5D, 0x87, 0xA7, 0xB2)
+__CRT_UUID_DECL(Interface2, 0x31C548DD, 0x7FD8, 0x4380, 0xBB, 0xD4, 0x2F, 0x4F, 0x47, 0xF0, 0xBC, 0x0D)
+__CRT_UUID_DECL(Interface3, 0x9A3E6C02, 0x5B17, 0x4E8D, 0xA0, 0xF4, 0x61, 0xC2, 0xD7, 0xB3, 0x8E, 0x95)
+__CRT_UUID_DECL(Interface4, 0x31C548DD, 0x0001, 0x4000, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01)
+#endif
+
 
 TEST(TestIUnknownImpl, RefCounts)
 {
@@ -64,13 +81,110 @@ TEST(TestIUnknownImpl, QueryInterface)
     EXPECT_EQ(obj->Release(), 0);
 }
 
+TEST(TestIUnknownImpl, QueryInterfaceSharedData1)
+{
+    auto obj = new Ime::ComObject<
+        Ime::ComInterface<Interface1>,
+        Ime::ComInterface<Interface4>,
+        Ime::ComInterface<Interface2>
+    >();
+    Interface2* ptr2 = nullptr;
+    EXPECT_EQ(obj->QueryInterface(__uuidof(Interface2), reinterpret_cast<void**>(&ptr2)), S_OK);
+    EXPECT_EQ(ptr2, (Interface2*)obj);
+    ptr2->Release();
+    Interface4* ptr4 = nullptr;
+    EXPECT_EQ(obj->QueryInterface(__uuidof(Interface4), reinterpret_cast<void**>(&ptr4)), S_OK);
+    EXPECT_EQ(ptr4, (Interface4*)obj);
+    ptr4->Release();
+    // the same first word, but another IID
+    IID other = __uuidof(Interface4);
+    other.Data4[7] = 2;
+    void* none = obj;
+    EXPECT_EQ(obj->QueryInterface(other, &none), E_NOINTERFACE);
+    EXPECT_EQ(none, nullptr);
+    EXPECT_EQ(obj->Release(), 0);
+}
+
+// A class of an IME built against libIME, calling its base by the name of
+// the template, as they could always do.
+class DerivedObject : public Ime::ComObject<Ime::ComInterface<Interface1>> {
+public:
+    STDMETHODIMP_(ULONG) AddRef() {
+        ++addRefs;
+        return ComObject::AddRef();
+    }
+
+    STDMETHODIMP_(ULONG) Release() {
+        return ComObject::Release();
+    }
+
+    int addRefs = 0;
+};
+
+TEST(TestIUnknownImpl, DerivedClassesNameTheirBase)
+{
+    auto obj = new DerivedObject();
+    EXPECT_EQ(obj->AddRef(), 2);
+    EXPECT_EQ(obj->addRefs, 1);
+    EXPECT_EQ(obj->Release(), 1);
+    EXPECT_EQ(obj->Release(), 0);
+}
+
+TEST(TestIUnknownImpl, QueryInterfaceOfBaseInterfaces)
+{
+    auto obj = new Ime::ComObject<
+        Ime::ComInterface<Interface2>,
+        Ime::ComInterface<Interface3, Interface1>,
+        Ime::ComInterface<IUnknown>
+    >();
+
+    // IUnknown is always the first interface, even if another one lists it
+    IUnknown* unknown = nullptr;
+    EXPECT_EQ(obj->QueryInterface(IID_IUnknown, reinterpret_cast<void**>(&unknown)), S_OK);
+    EXPECT_EQ(unknown, static_cast<Interface2*>(obj));
+    unknown->Release();
+
+    Interface3* ptr3 = nullptr;
+    EXPECT_EQ(obj->QueryInterface(__uuidof(Interface3), reinterpret_cast<void**>(&ptr3)), S_OK);
+    EXPECT_EQ(ptr3, static_cast<Interface3*>(obj));
+    ptr3->Release();
+
+    Interface1* ptr1 = nullptr;
+    EXPECT_EQ(obj->QueryInterface(__uuidof(Interface1), reinterpret_cast<void**>(&ptr1)), S_OK);
+    EXPECT_EQ(ptr1, static_cast<Interface1*>(static_cast<Interface3*>(obj)));
+    ptr1->Release();
+
+    Interface2* ptr2 = nullptr;
+    EXPECT_EQ(obj->QueryInterface(__uuidof(Interface2), reinterpret_cast<void**>(&ptr2)), S_OK);
+    EXPECT_EQ(ptr2, static_cast<Interface2*>(obj));
+    ptr2->Release();
+
+    // another object of the class shares the table, with its own addresses
+    auto other = new Ime::ComObject<
+        Ime::ComInterface<Interface2>,
+        Ime::ComInterface<Interface3, Interface1>,
+        Ime::ComInterface<IUnknown>
+    >();
+    EXPECT_EQ(other->QueryInterface(__uuidof(Interface1), reinterpret_cast<void**>(&ptr1)), S_OK);
+    EXPECT_EQ(ptr1, static_cast<Interface1*>(static_cast<Interface3*>(other)));
+    ptr1->Release();
+
+    EXPECT_EQ(obj->refCount(), 1);
+    EXPECT_EQ(obj->Release(), 0);
+    EXPECT_EQ(other->Release(), 0);
+}
+
 TEST(TestIUnknownImpl, QueryInterfaceTSF)
 {
     class TestImpl : public Ime::ComObject<
         Ime::ComInterface<ITfCompartmentEventSink>
     > {
     public:
+#ifdef _WIN32
         MOCK_METHOD(HRESULT, OnChange, (REFGUID rguid), (Calltype(STDMETHODCALLTYPE), override));
+#else // Calltype() of gmock 1.10 only builds with MSVC; there are no calling conventions elsewhere
+        MOCK_METHOD(HRESULT, OnChange, (REFGUID rguid), (override));
+#endif
 
         MOCK_METHOD(void, destroy, (), ());
 
@@ -104,3 +218,82 @@ TEST(TestIUnknownImpl, QueryInterfaceTSF)
     EXPECT_CALL((*obj), destroy()).Times(1);
     EXPECT_EQ(obj->Release(), 0);
 }
+
+TEST(TestIUnknownImpl, MultiThreadedRefCounts)
+{
+    static std::atomic<int> deletions{ 0 };
+    class TestImpl : public Ime::MultiThreadedComObject<
+        Ime::ComInterface<Interface1>
+    > {
+    public:
+        virtual ~TestImpl() {
+            ++deletions;
+        }
+    };
+
+    auto obj = new TestImpl();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([obj] {
+            for (int n = 0; n < 10000; ++n) {
+                obj->AddRef();
+                Interface1* ptr = nullptr;
+                obj->QueryInterface(__uuidof(Interface1), reinterpret_cast<void**>(&ptr));
+                ptr->Release();
+                obj->Release();
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(obj->refCount(), 1);
+    EXPECT_EQ(deletions, 0);
+
+    // the last reference released on another thread deletes the object once
+    obj->AddRef();
+    std::thread([obj] { obj->Release(); }).join();
+    EXPECT_EQ(obj->Release(), 0);
+    EXPECT_EQ(deletions, 1);
+}
+
+TEST(TestIUnknownImpl, WeakReferences)
+{
+    static int deletions = 0;
+    static bool lockedWhileDeleted = true;
+    class TestImpl : public Ime::ComObject<Ime::ComInterface<Interface1>> {
+    public:
+        Ime::ComWeakPtr<TestImpl> self;
+        virtual ~TestImpl() {
+            // the weak references are expired before the destructors run
+            lockedWhileDeleted = self.lock() != nullptr;
+            ++deletions;
+        }
+    };
+
+    Ime::ComWeakPtr<TestImpl> weak;
+    EXPECT_TRUE(weak.expired());
+    EXPECT_EQ(weak.lock(), nullptr);
+
+    auto obj = Ime::ComPtr<TestImpl>::make();
+    obj->self = obj.get();
+    weak = obj.get();
+    EXPECT_EQ(obj->refCount(), 1);  // weak references do not count
+    {
+        auto copy = weak;
+        auto locked = copy.lock();
+        EXPECT_EQ(locked, obj.get());
+        EXPECT_EQ(obj->refCount(), 2);
+    }
+    EXPECT_EQ(obj->refCount(), 1);
+
+    auto moved = std::move(weak);
+    EXPECT_TRUE(weak.expired());
+    EXPECT_FALSE(moved.expired());
+
+    obj = nullptr;
+    EXPECT_EQ(deletions, 1);
+    EXPECT_FALSE(lockedWhileDeleted);
+    // the weak reference outlives the object
+    EXPECT_TRUE(moved.expired());
+    EXPECT_EQ(moved.lock(), nullptr);
+}
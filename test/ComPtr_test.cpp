@@ -9,7 +9,11 @@ using ::testing::Return;
 
 class IUnknownMock : public Ime::ComObject<Ime::ComInterface<IUnknown>> {
 public:
+#ifdef _WIN32
     MOCK_METHOD(HRESULT, QueryInterface, (REFIID riid, void** ppvObject), (Calltype(STDMETHODCALLTYPE), override));
+#else // Calltype() of gmock 1.10 only builds with MSVC; there are no calling conventions elsewhere
+    MOCK_METHOD(HRESULT, QueryInterface, (REFIID riid, void** ppvObject), (override));
+#endif
 };
 
 TEST(TestComPtr, DefaultsToNull)
@@ -109,4 +113,92 @@ TEST(TestComPtr, Assignment)
     EXPECT_EQ(ptr3, &obj2);
     EXPECT_EQ(obj2.refCount(), 2);  // ref count does not change.
     EXPECT_EQ(ptr, nullptr);  // moved ptr is cleared.
+
+    Ime::ComPtr<IUnknownMock> ptr4{ &obj };
+    EXPECT_EQ(obj.refCount(), 2);
+    // Move assignment to a non-null ComPtr
+    ptr3 = std::move(ptr4);
+    EXPECT_EQ(ptr3, &obj);
+    EXPECT_EQ(obj.refCount(), 2);
+    EXPECT_EQ(obj2.refCount(), 1);  // old ref is released.
+    EXPECT_EQ(ptr4, nullptr);
+}
+
+TEST(TestComPtr, MoveAssignmentFreesTheOldObject)
+{
+    // a text service advising sinks was kept alive this way: the member
+    // pointer replaced by a moved one was never released
+    struct Counted : IUnknownMock {
+        explicit Counted(int& alive) : alive(alive) { ++alive; }
+        ~Counted() override { --alive; }
+        int& alive;
+    };
+    int alive = 0;
+    auto ptr = Ime::ComPtr<Counted>::takeover(new Counted(alive));
+    ptr = Ime::ComPtr<Counted>::takeover(new Counted(alive));
+    EXPECT_EQ(alive, 1);
+    EXPECT_EQ(ptr->refCount(), 1);
+
+    // moving into itself keeps the object
+    auto& self = ptr;
+    ptr = std::move(self);
+    EXPECT_EQ(alive, 1);
+    EXPECT_EQ(ptr->refCount(), 1);
+
+    ptr = Ime::ComPtr<Counted>();
+    EXPECT_EQ(alive, 0);
+}
+
+TEST(TestComPtr, PutReleasesTheOldPointer)
+{
+    IUnknownMock obj, obj2;
+    Ime::ComPtr<IUnknownMock> ptr{ &obj };
+    EXPECT_EQ(obj.refCount(), 2);
+    // as an out parameter would
+    IUnknownMock** out = ptr.put();
+    EXPECT_EQ(obj.refCount(), 1);
+    EXPECT_EQ(*out, nullptr);
+    obj2.AddRef();
+    *out = &obj2;
+    EXPECT_EQ(ptr, &obj2);
+    EXPECT_EQ(obj2.refCount(), 2);
+}
+
+TEST(TestComPtr, AttachAndDetach)
+{
+    IUnknownMock obj;
+    obj.AddRef();
+    Ime::ComPtr<IUnknownMock> ptr;
+    ptr.attach(&obj);
+    EXPECT_EQ(ptr, &obj);
+    EXPECT_EQ(obj.refCount(), 2);  // no AddRef()
+
+    IUnknownMock* raw = ptr.detach();
+    EXPECT_EQ(raw, &obj);
+    EXPECT_EQ(ptr, nullptr);
+    EXPECT_EQ(obj.refCount(), 2);  // no Release()
+    raw->Release();
+}
+
+TEST(TestComRef, BorrowsWithoutAddRef)
+{
+    IUnknownMock obj;
+    Ime::ComPtr<IUnknownMock> ptr{ &obj };
+    EXPECT_EQ(obj.refCount(), 2);
+    {
+        Ime::ComRef<IUnknownMock> ref{ ptr };
+        Ime::ComRef<IUnknown> base{ ptr };
+        Ime::ComRef<IUnknownMock> copy = ref;
+        EXPECT_EQ(ref, &obj);
+        EXPECT_EQ(base, static_cast<IUnknown*>(&obj));
+        EXPECT_EQ(copy.get(), &obj);
+        EXPECT_EQ(obj.refCount(), 2);
+    }
+    EXPECT_EQ(obj.refCount(), 2);
+
+    Ime::ComRef<IUnknownMock> null = nullptr;
+    EXPECT_TRUE(!null);
+    // an owning pointer can be made from it
+    Ime::ComPtr<IUnknownMock> owner{ Ime::ComRef<IUnknownMock>{ &obj } };
+    EXPECT_EQ(obj.refCount(), 3);
 }
@@ -0,0 +1,76 @@
+#include "gtest/gtest.h"
+
+#include "DirtyRegion.h"
+
+using Ime::Rect;
+
+TEST(TestDirtyRegion, StartsEmpty)
+{
+    Ime::DirtyRegion region{ { 0, 0, 100, 50 } };
+    EXPECT_TRUE(region.isEmpty());
+    EXPECT_TRUE(region.boundingRect().isEmpty());
+}
+
+TEST(TestDirtyRegion, ClipsToBounds)
+{
+    Ime::DirtyRegion region{ { 0, 0, 100, 50 } };
+    EXPECT_EQ(region.add({ 90, 40, 120, 60 }), (Rect{ 90, 40, 100, 50 }));
+    EXPECT_TRUE(region.add({ 200, 0, 210, 10 }).isEmpty());
+    EXPECT_EQ(region.boxes().size(), 1u);
+}
+
+TEST(TestDirtyRegion, KeepsDisjointBoxes)
+{
+    Ime::DirtyRegion region{ { 0, 0, 100, 50 } };
+    region.add({ 0, 0, 10, 10 });
+    region.add({ 20, 0, 30, 10 });
+    region.add({ 40, 0, 50, 10 });
+    ASSERT_EQ(region.boxes().size(), 3u);
+    EXPECT_EQ(region.boundingRect(), (Rect{ 0, 0, 50, 10 }));
+}
+
+TEST(TestDirtyRegion, MergesOverlappingBoxes)
+{
+    Ime::DirtyRegion region{ { 0, 0, 100, 50 } };
+    region.add({ 0, 0, 10, 10 });
+    region.add({ 20, 0, 30, 10 });
+    // overlaps both boxes
+    EXPECT_EQ(region.add({ 5, 5, 25, 15 }), (Rect{ 0, 0, 30, 15 }));
+    ASSERT_EQ(region.boxes().size(), 1u);
+    EXPECT_EQ(region.boxes()[0], (Rect{ 0, 0, 30, 15 }));
+}
+
+TEST(TestDirtyRegion, MergesTransitively)
+{
+    Ime::DirtyRegion region{ { 0, 0, 100, 50 } };
+    region.add({ 0, 0, 10, 10 });
+    region.add({ 12, 20, 20, 30 });
+    // overlaps the first box only, but the union then covers the second one
+    EXPECT_EQ(region.add({ 5, 0, 15, 25 }), (Rect{ 0, 0, 20, 30 }));
+    EXPECT_EQ(region.boxes().size(), 1u);
+}
+
+TEST(TestDirtyRegion, MergesWithNearestWhenFull)
+{
+    Ime::DirtyRegion region{ { 0, 0, 1000, 50 }, 2 };
+    region.add({ 0, 0, 10, 10 });
+    region.add({ 500, 0, 510, 10 });
+    EXPECT_EQ(region.add({ 20, 0, 30, 10 }), (Rect{ 0, 0, 30, 10 }));
+    ASSERT_EQ(region.boxes().size(), 2u);
+    EXPECT_EQ(region.boxes()[0], (Rect{ 500, 0, 510, 10 }));
+    EXPECT_EQ(region.boxes()[1], (Rect{ 0, 0, 30, 10 }));
+}
+
+TEST(TestDirtyRegion, BoxesNeverOverlap)
+{
+    Ime::DirtyRegion region{ { 0, 0, 200, 200 }, 3 };
+    for (int i = 0; i < 50; ++i) {
+        int x = (i * 37) % 180, y = (i * 53) % 180;
+        region.add({ x, y, x + 15, y + 12 });
+        const auto& boxes = region.boxes();
+        EXPECT_LE(boxes.size(), 3u);
+        for (size_t a = 0; a < boxes.size(); ++a)
+            for (size_t b = a + 1; b < boxes.size(); ++b)
+                EXPECT_FALSE(boxes[a].intersects(boxes[b]));
+    }
+}
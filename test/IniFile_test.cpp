@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "IniFile.h"
+
+using namespace std::literals;
+
+static Ime::IniFile parse(std::wstring text) {
+    Ime::IniFile ini;
+    ini.parse(std::move(text));
+    return ini;
+}
+
+TEST(TestIniFile, SectionsAndKeys)
+{
+    auto ini = parse(
+        L"; comment\n"
+        L"# another comment\n"
+        L"top = level\n"
+        L"[InputPanel]\n"
+        L"  Font =  Sans 12  \r\n"
+        L"Empty=\n"
+        L"[InputPanel/Background]\n"
+        L"Image=a=b.png\n");
+    EXPECT_TRUE(ini.errors().empty());
+    EXPECT_EQ(ini.size(), 4u);
+    EXPECT_EQ(ini.getString(L"", L"top"), L"level");
+    EXPECT_EQ(ini.getString(L"InputPanel", L"Font"), L"Sans 12");
+    EXPECT_EQ(ini.get(L"InputPanel", L"Empty"), std::optional<std::wstring_view>(L""));
+    EXPECT_EQ(ini.getString(L"InputPanel/Background", L"Image"), L"a=b.png");
+    EXPECT_FALSE(ini.get(L"InputPanel", L"Image"));
+    EXPECT_EQ(ini.getString(L"Missing", L"Font", L"fallback"), L"fallback");
+}
+
+TEST(TestIniFile, CaseInsensitiveFirstWins)
+{
+    auto ini = parse(L"[Section]\nKey=1\nkey=2\n[SECTION]\nKEY=3\nOther=4\n");
+    EXPECT_EQ(ini.getString(L"section", L"kEy"), L"1");
+    EXPECT_EQ(ini.getString(L"SeCtIoN", L"other"), L"4");
+}
+
+TEST(TestIniFile, LongValuesAreNotTruncated)
+{
+    std::wstring value(1000, L'x');
+    auto ini = parse(L"[S]\nK=" + value + L"\n");
+    EXPECT_EQ(ini.getString(L"S", L"K"), value);
+}
+
+TEST(TestIniFile, CopiesStayValid)
+{
+    Ime::IniFile copy;
+    {
+        auto ini = parse(L"[S]\nK=short\n");
+        copy = ini;
+    }
+    EXPECT_EQ(copy.getString(L"S", L"K"), L"short");
+}
+
+TEST(TestIniFile, ReportsMalformedLines)
+{
+    auto ini = parse(L"[Good]\nno equal sign\n = no key\n[Unterminated\nKey=1\n");
+    ASSERT_EQ(ini.errors().size(), 3u);
+    EXPECT_EQ(ini.errors()[0].line, 2u);
+    EXPECT_EQ(ini.errors()[1].line, 3u);
+    EXPECT_EQ(ini.errors()[2].line, 4u);
+    // the rest of the file is still read
+    EXPECT_EQ(ini.getString(L"Unterminated", L"Key"), L"1");
+}
+
+TEST(TestIniFile, Int)
+{
+    auto ini = parse(L"[S]\na=12\nb=-7\nc=15px\nd=px\ne=\nf=99999999999\n");
+    EXPECT_EQ(ini.getInt(L"S", L"a", 0), 12);
+    EXPECT_EQ(ini.getInt(L"S", L"b", 0), -7);
+    EXPECT_EQ(ini.getInt(L"S", L"c", 0), 15);
+    EXPECT_EQ(ini.getInt(L"S", L"d", 3), 3);
+    EXPECT_EQ(ini.getInt(L"S", L"e", 4), 4);
+    EXPECT_EQ(ini.getInt(L"S", L"f", 0), 0x7FFFFFFF);
+    EXPECT_EQ(ini.getInt(L"S", L"missing", 5), 5);
+}
+
+TEST(TestIniFile, Color)
+{
+    auto ini = parse(L"[S]\na=#102030\nb=A0b0C0\nc=#12345\nd=#12345g\n");
+    EXPECT_EQ(ini.getColor(L"S", L"a", 1), 0x302010u);
+    EXPECT_EQ(ini.getColor(L"S", L"b", 1), 0xC0B0A0u);
+    EXPECT_EQ(ini.getColor(L"S", L"c", 1), 1u);
+    EXPECT_EQ(ini.getColor(L"S", L"d", 1), 1u);
+}
+
+TEST(TestIniFile, Font)
+{
+    auto ini = parse(L"[S]\na=Noto Sans CJK 14\nb=Sans\nc=Font 0\nd=Font -3\n");
+    auto a = ini.getFont(L"S", L"a");
+    EXPECT_EQ(a.face, L"Noto Sans CJK");
+    EXPECT_EQ(a.size, 14);
+    EXPECT_EQ(ini.getFont(L"S", L"b").face, L"Sans");
+    EXPECT_EQ(ini.getFont(L"S", L"b").size, 0);
+    EXPECT_EQ(ini.getFont(L"S", L"c").face, L"Font 0");
+    EXPECT_EQ(ini.getFont(L"S", L"d").face, L"Font -3");
+    EXPECT_TRUE(ini.getFont(L"S", L"missing").face.empty());
+}
+
+TEST(TestIniFile, Margins)
+{
+    auto ini = parse(L"[M]\nTop=1\nright=2\nLEFT=4\n");
+    EXPECT_EQ(ini.getMargins(L"M"), (Ime::Margins{ 1, 2, 0, 4 }));
+    EXPECT_EQ(ini.getMargins(L"None"), Ime::Margins{});
+}
+
+TEST(TestIniFile, Decode)
+{
+    EXPECT_EQ(Ime::IniFile::decode("\xEF\xBB\xBF" "a\xC3\xA9"), L"a\u00E9");
+    EXPECT_EQ(Ime::IniFile::decode("\xFF\xFE" "a\0\xE9\0"sv), L"a\u00E9");
+    EXPECT_EQ(Ime::IniFile::decode("\xE5\xBE\xAE"), L"\u5FAE");
+    // invalid and truncated sequences become U+FFFD
+    EXPECT_EQ(Ime::IniFile::decode("a\x80" "b"), L"a\uFFFD" L"b");
+    EXPECT_EQ(Ime::IniFile::decode("a\xE5\xBE"), L"a\uFFFD\uFFFD");
+}
+
+TEST(TestIniFile, Fuzz)
+{
+    const std::string alphabet = "[]=;#\n\r \tabcAB01-\xC3\xA9\xE5\xBE\xFF\xFE";
+    std::mt19937 rng(42);
+    for (int round = 0; round < 2000; ++round) {
+        std::string bytes(rng() % 200, '\0');
+        for (auto& c : bytes)
+            c = rng() % 4 ? alphabet[rng() % alphabet.size()] : char(rng());
+        Ime::IniFile ini;
+        ini.parseBytes(bytes);
+        // arbitrary input never breaks the parser or the typed lookups
+        for (auto section : { L""sv, L"a"sv, L"AB"sv })
+            for (auto key : { L"a"sv, L"b0"sv, L"Top"sv }) {
+                ini.getInt(section, key, 0);
+                ini.getColor(section, key, 0);
+                ini.getFont(section, key);
+            }
+        for (const auto& error : ini.errors())
+            EXPECT_GE(error.line, 1u);
+    }
+}
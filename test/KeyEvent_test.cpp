@@ -0,0 +1,261 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+#include "KeyEvent.h"
+
+namespace {
+
+const unsigned WM_KEYDOWN = 0x0100;
+const unsigned WM_KEYUP = 0x0101;
+const unsigned VK_SHIFT = 0x10;
+const unsigned VK_CONTROL = 0x11;
+const unsigned VK_MENU = 0x12;
+const unsigned VK_CAPITAL = 0x14;
+
+// a US layout for letters only, counting the calls
+class FakeKeyStateProvider: public Ime::KeyStateProvider {
+public:
+    bool keyboardState(uint8_t* states) override {
+        ++stateCalls;
+        std::memcpy(states, keys, sizeof(keys));
+        return available;
+    }
+
+    Ime::KeyText translateKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        ++translateCalls;
+        lastScanCode = scanCode;
+        Ime::KeyText text;
+        if (keyCode < 'A' || keyCode > 'Z' || (modifiers & Ime::KeyModifierAltGr))
+            return text;
+        bool upper = !!(modifiers & Ime::KeyModifierShift) != !!(modifiers & Ime::KeyModifierCapsLock);
+        text.units[0] = wchar_t(upper ? keyCode : keyCode - 'A' + 'a');
+        text.length = 1;
+        return text;
+    }
+
+    uint8_t keys[256] = {};
+    bool available = true;
+    int stateCalls = 0;
+    int translateCalls = 0;
+    unsigned lastScanCode = 0;
+};
+
+// lParam of a key press: repeat count 1 and the scan code
+intptr_t keyParam(unsigned scanCode, bool extended = false) {
+    return 1 | (intptr_t(scanCode) << 16) | (extended ? (1 << 24) : 0);
+}
+
+} // namespace
+
+TEST(TestKeyEvent, TranslatesOnlyWhenAsked)
+{
+    FakeKeyStateProvider provider;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), provider);
+    EXPECT_EQ(event.keyCode(), unsigned('A'));
+    EXPECT_EQ(event.type(), WM_KEYDOWN);
+    EXPECT_EQ(event.repeatCount(), 1);
+    EXPECT_EQ(provider.stateCalls, 1);
+    EXPECT_EQ(provider.translateCalls, 0);
+
+    EXPECT_EQ(event.charCode(), unsigned('a'));
+    EXPECT_EQ(event.charCode(), unsigned('a'));
+    EXPECT_TRUE(event.isChar());
+    EXPECT_EQ(provider.stateCalls, 1);
+    EXPECT_EQ(provider.translateCalls, 1);
+}
+
+TEST(TestKeyEvent, ScanCodeAndFlags)
+{
+    FakeKeyStateProvider provider;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E, true), provider);
+    EXPECT_EQ(event.scanCode(), 0x1E);
+    EXPECT_TRUE(event.isExtended());
+    event.charCode();
+    EXPECT_EQ(provider.lastScanCode, 0x1Eu);
+}
+
+TEST(TestKeyEvent, KeyStates)
+{
+    FakeKeyStateProvider provider;
+    provider.keys[VK_SHIFT] = 0x80;
+    provider.keys[VK_CAPITAL] = 0x01;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), provider);
+    EXPECT_TRUE(event.isKeyDown(VK_SHIFT));
+    EXPECT_TRUE(event.isKeyToggled(VK_CAPITAL));
+    EXPECT_FALSE(event.isKeyDown(VK_CONTROL));
+    EXPECT_EQ(provider.stateCalls, 1);
+    // the modifiers already fetched are used for the character
+    EXPECT_EQ(event.charCode(), unsigned('a'));
+    EXPECT_EQ(provider.stateCalls, 1);
+
+    // other keys are asked again
+    provider.keys['Q'] = 0x80;
+    EXPECT_TRUE(event.isKeyDown('Q'));
+    EXPECT_FALSE(event.isKeyDown(VK_CAPITAL));
+    EXPECT_EQ(provider.stateCalls, 3);
+}
+
+TEST(TestKeyEvent, Modifiers)
+{
+    FakeKeyStateProvider provider;
+    provider.keys[VK_SHIFT] = provider.keys[0xA1] = 0x80; // right shift
+    provider.keys[VK_MENU] = provider.keys[0xA4] = 0x80; // left alt
+    provider.keys[0x5C] = 0x80; // right win
+    provider.keys[0x90] = 0x01; // num lock
+    provider.keys[0x91] = 0x80; // scroll lock, pressed but off
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), provider);
+    EXPECT_EQ(event.modifiers(), Ime::ModifierShift | Ime::ModifierRightShift |
+        Ime::ModifierAlt | Ime::ModifierLeftAlt | Ime::ModifierRightWin | Ime::ModifierNumLock);
+    EXPECT_TRUE(event.hasModifiers(Ime::ModifierShift | Ime::ModifierAlt));
+    EXPECT_FALSE(event.hasModifiers(Ime::ModifierShift | Ime::ModifierCtrl));
+    EXPECT_TRUE(event.isKeyDown(0xA1));
+    EXPECT_FALSE(event.isKeyDown(0xA0));
+    EXPECT_TRUE(event.isKeyToggled(0x90));
+    EXPECT_FALSE(event.isKeyToggled(0x91));
+    EXPECT_EQ(provider.stateCalls, 1);
+}
+
+TEST(TestKeyEvent, ModifiersOfTheKeystroke)
+{
+    FakeKeyStateProvider provider;
+    provider.keys[VK_SHIFT] = 0x80;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), provider);
+    // Shift released before the event is looked at
+    provider.keys[VK_SHIFT] = 0;
+    EXPECT_TRUE(event.hasModifiers(Ime::ModifierShift));
+    EXPECT_EQ(event.charCode(), unsigned('A'));
+}
+
+TEST(TestKeyEvent, AltGrIsTheRightAlt)
+{
+    FakeKeyStateProvider provider;
+    // a shortcut: Ctrl + left Alt
+    provider.keys[VK_CONTROL] = provider.keys[0xA2] = 0x80;
+    provider.keys[VK_MENU] = provider.keys[0xA4] = 0x80;
+    EXPECT_EQ(Ime::KeyEvent(WM_KEYDOWN, 'A', keyParam(0x1E), provider).charCode(), unsigned('a'));
+    // AltGr, which Windows reports with the left Ctrl
+    provider.keys[0xA4] = 0;
+    provider.keys[0xA5] = 0x80;
+    EXPECT_EQ(Ime::KeyEvent(WM_KEYDOWN, 'A', keyParam(0x1E), provider).charCode(), 0u);
+}
+
+TEST(TestKeyEvent, FromFullState)
+{
+    FakeKeyStateProvider provider;
+    uint8_t states[256] = {};
+    states[VK_SHIFT] = 0x80;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), states, provider);
+    EXPECT_EQ(event.modifiers(), Ime::ModifierShift);
+    EXPECT_EQ(event.charCode(), unsigned('A'));
+    EXPECT_EQ(provider.stateCalls, 0);
+
+    // the escape hatch asks the provider for the current states
+    provider.keys['Q'] = 0x80;
+    uint8_t full[256];
+    EXPECT_TRUE(event.fullKeyStates(full));
+    EXPECT_EQ(full['Q'], 0x80);
+    EXPECT_EQ(provider.stateCalls, 1);
+}
+
+TEST(TestKeyEvent, Resolved)
+{
+    Ime::KeyEvent copy = [] {
+        FakeKeyStateProvider provider;
+        provider.keys[VK_SHIFT] = 0x80;
+        Ime::KeyEvent event(WM_KEYDOWN, 'B', keyParam(0x30), provider);
+        auto resolved = event.resolved();
+        EXPECT_EQ(provider.stateCalls, 1);
+        EXPECT_EQ(provider.translateCalls, 1);
+        return resolved;
+    }();
+    // the provider is gone
+    EXPECT_EQ(copy.type(), WM_KEYDOWN);
+    EXPECT_EQ(copy.keyCode(), unsigned('B'));
+    EXPECT_EQ(copy.scanCode(), 0x30);
+    EXPECT_EQ(copy.charCode(), unsigned('B'));
+    EXPECT_EQ(copy.text(), L"B");
+    EXPECT_TRUE(copy.isKeyDown(VK_SHIFT));
+    EXPECT_FALSE(copy.isKeyDown('Q'));
+    uint8_t full[256];
+    EXPECT_FALSE(copy.fullKeyStates(full));
+    EXPECT_EQ(full[VK_SHIFT], 0);
+    EXPECT_TRUE(copy.isSameMessage(WM_KEYDOWN, 'B', keyParam(0x30)));
+}
+
+TEST(TestKeyEvent, Compact)
+{
+    if (sizeof(wchar_t) == 2)
+        EXPECT_LE(sizeof(Ime::KeyEvent), 32u);
+    else
+        EXPECT_LE(sizeof(Ime::KeyEvent), 40u);
+    // the key up flags in the high bits of lParam survive
+    FakeKeyStateProvider provider;
+    intptr_t up = intptr_t(0xC0000001u) | (intptr_t(0x1E) << 16);
+    Ime::KeyEvent event(WM_KEYUP, 'A', up, provider);
+    EXPECT_EQ(uint32_t(event.lParam()), uint32_t(up));
+    EXPECT_EQ(event.scanCode(), 0x1E);
+}
+
+TEST(TestKeyEvent, IgnoresCtrlForCharCode)
+{
+    FakeKeyStateProvider provider;
+    provider.keys[VK_CONTROL] = 0x80;
+    Ime::KeyEvent event(WM_KEYDOWN, 'C', keyParam(0x2E), provider);
+    EXPECT_EQ(event.charCode(), unsigned('c'));
+    EXPECT_EQ(event.text(), L"c");
+    EXPECT_TRUE(event.isKeyDown(VK_CONTROL));
+}
+
+TEST(TestKeyEvent, UnavailableStates)
+{
+    FakeKeyStateProvider provider;
+    provider.keys[VK_SHIFT] = 0x80;
+    provider.available = false;
+    Ime::KeyEvent event(WM_KEYDOWN, 'A', keyParam(0x1E), provider);
+    EXPECT_FALSE(event.isKeyDown(VK_SHIFT));
+    EXPECT_EQ(event.charCode(), unsigned('a'));
+}
+
+TEST(TestKeyEventCache, SharesStatesWithinTestAndHandle)
+{
+    FakeKeyStateProvider provider;
+    Ime::KeyEventCache cache(provider);
+
+    auto& tested = cache.test(WM_KEYDOWN, 'A', keyParam(0x1E));
+    EXPECT_EQ(tested.charCode(), unsigned('a'));
+    auto& handled = cache.handle(WM_KEYDOWN, 'A', keyParam(0x1E));
+    EXPECT_EQ(handled.charCode(), unsigned('a'));
+    EXPECT_EQ(provider.stateCalls, 1);
+    EXPECT_EQ(provider.translateCalls, 1);
+
+    // another keystroke, with its own modifiers
+    auto& up = cache.test(WM_KEYUP, 'A', keyParam(0x1E));
+    cache.handle(WM_KEYUP, 'A', keyParam(0x1E));
+    EXPECT_EQ(up.type(), WM_KEYUP);
+    EXPECT_EQ(provider.stateCalls, 2);
+}
+
+TEST(TestKeyEventCache, NewKeystrokeFetchesAgain)
+{
+    FakeKeyStateProvider provider;
+    Ime::KeyEventCache cache(provider);
+    cache.test(WM_KEYDOWN, 'A', keyParam(0x1E)).charCode();
+    cache.handle(WM_KEYDOWN, 'A', keyParam(0x1E)).charCode();
+
+    // the same key pressed again with shift, without a test in between
+    provider.keys[VK_SHIFT] = 0x80;
+    EXPECT_EQ(cache.handle(WM_KEYDOWN, 'A', keyParam(0x1E)).charCode(), unsigned('A'));
+    EXPECT_EQ(provider.stateCalls, 2);
+
+    // a test of another key is not reused
+    cache.test(WM_KEYDOWN, 'B', keyParam(0x30)).charCode();
+    EXPECT_EQ(cache.handle(WM_KEYDOWN, 'C', keyParam(0x2E)).charCode(), unsigned('C'));
+    EXPECT_EQ(provider.stateCalls, 4);
+
+    // nor one which was already handled
+    cache.test(WM_KEYDOWN, 'D', keyParam(0x20)).charCode();
+    cache.handle(WM_KEYDOWN, 'D', keyParam(0x20));
+    cache.handle(WM_KEYDOWN, 'D', keyParam(0x20)).charCode();
+    EXPECT_EQ(provider.stateCalls, 6);
+}
@@ -0,0 +1,211 @@
+#include "gtest/gtest.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "KeyTranslation.h"
+
+namespace {
+
+const unsigned VK_SHIFT = 0x10;
+const unsigned VK_CONTROL = 0x11;
+const unsigned VK_MENU = 0x12;
+const unsigned VK_CAPITAL = 0x14;
+const unsigned VK_LMENU = 0xA4;
+const unsigned VK_RMENU = 0xA5;
+const unsigned VK_OEM_1 = 0xBA;
+
+// a made up layout: letters, a dead key, an AltGr character outside the
+// BMP and a ligature; counts the translations asked for
+class FakeLayout: public Ime::KeyboardLayout {
+public:
+    uintptr_t id() override {
+        return layoutId;
+    }
+
+    Ime::KeyText translate(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        ++calls;
+        Ime::KeyText result;
+        std::wstring text;
+        if (keyCode == VK_OEM_1 && !modifiers) {
+            result.deadKey = true; // an accent
+            return result;
+        }
+        if (keyCode == 'E' && modifiers == Ime::KeyModifierAltGr)
+            text = L"\U0001F600";
+        else if (keyCode == 'L' && modifiers == Ime::KeyModifierAltGr)
+            text = L"\u0644\u0627";
+        else if (keyCode >= 'A' && keyCode <= 'Z' && !(modifiers & Ime::KeyModifierAltGr)) {
+            bool upper = !!(modifiers & Ime::KeyModifierShift) != !!(modifiers & Ime::KeyModifierCapsLock);
+            text = std::wstring(1, wchar_t(upper ? keyCode : keyCode - 'A' + 'a'));
+        }
+        if (layoutId == 2 && keyCode == 'Y')
+            text = L"z"; // a German layout
+        // UTF-16, also where wchar_t is 32 bits
+        for (wchar_t c : text) {
+            if (c > 0xFFFF) {
+                result.units[result.length++] = wchar_t(0xD800 + ((c - 0x10000) >> 10));
+                result.units[result.length++] = wchar_t(0xDC00 + ((c - 0x10000) & 0x3FF));
+            }
+            else
+                result.units[result.length++] = c;
+        }
+        return result;
+    }
+
+    // the accent makes E an é, types nothing with Shift and itself otherwise
+    Ime::KeyText translateAfterDeadKey(unsigned keyCode, unsigned scanCode, unsigned modifiers) override {
+        ++afterDeadKeyCalls;
+        Ime::KeyText result;
+        if (keyCode == 'E' && !modifiers)
+            result.units[result.length++] = L'\u00E9';
+        else if (keyCode != VK_SHIFT)
+            result.units[result.length++] = L'\u00B4';
+        return result;
+    }
+
+    uintptr_t layoutId = 1;
+    int calls = 0;
+    int afterDeadKeyCalls = 0;
+};
+
+} // namespace
+
+TEST(TestKeyTranslation, Modifiers)
+{
+    uint8_t states[256] = {};
+    EXPECT_EQ(Ime::keyModifiers(states), 0u);
+    states[VK_SHIFT] = 0x80;
+    states[VK_CAPITAL] = 0x01;
+    EXPECT_EQ(Ime::keyModifiers(states), unsigned(Ime::KeyModifierShift | Ime::KeyModifierCapsLock));
+    // Ctrl alone does not change the character
+    states[VK_CONTROL] = 0x80;
+    EXPECT_EQ(Ime::keyModifiers(states), unsigned(Ime::KeyModifierShift | Ime::KeyModifierCapsLock));
+    // nor Ctrl + left Alt, a shortcut
+    states[VK_MENU] = states[VK_LMENU] = 0x80;
+    EXPECT_EQ(Ime::keyModifiers(states), unsigned(Ime::KeyModifierShift | Ime::KeyModifierCapsLock));
+    states[VK_LMENU] = 0;
+    states[VK_RMENU] = 0x80;
+    EXPECT_EQ(Ime::keyModifiers(states),
+        unsigned(Ime::KeyModifierShift | Ime::KeyModifierCapsLock | Ime::KeyModifierAltGr));
+    // caps lock pressed but not toggled
+    uint8_t caps[256] = {};
+    caps[VK_CAPITAL] = 0x80;
+    EXPECT_EQ(Ime::keyModifiers(caps), 0u);
+}
+
+TEST(TestKeyTranslation, CodePoint)
+{
+    Ime::KeyText text;
+    EXPECT_EQ(text.codePoint(), 0u);
+    text.units[0] = L'a';
+    text.length = 1;
+    EXPECT_EQ(text.codePoint(), unsigned('a'));
+    text.units[0] = wchar_t(0xD83D);
+    text.units[1] = wchar_t(0xDE00);
+    text.length = 2;
+    EXPECT_EQ(text.codePoint(), 0x1F600u);
+    // a lone surrogate, and two characters
+    text.length = 1;
+    EXPECT_EQ(text.codePoint(), 0u);
+    text.units[0] = L'a';
+    text.units[1] = L'b';
+    text.length = 2;
+    EXPECT_EQ(text.codePoint(), 0u);
+}
+
+TEST(TestKeyTranslation, CachesPerKeyAndModifiers)
+{
+    FakeLayout layout;
+    Ime::KeyTranslationCache cache;
+    EXPECT_EQ(cache.translate(layout, 'A', 0x1E, 0).text(), L"a");
+    EXPECT_EQ(cache.translate(layout, 'A', 0x1E, Ime::KeyModifierShift).text(), L"A");
+    EXPECT_EQ(cache.translate(layout, 'A', 0x1E,
+        Ime::KeyModifierShift | Ime::KeyModifierCapsLock).text(), L"a");
+    EXPECT_EQ(layout.calls, 3);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(cache.translate(layout, 'A', 0x1E, 0).text(), L"a");
+        EXPECT_EQ(cache.translate(layout, 'A', 0x1E, Ime::KeyModifierShift).text(), L"A");
+    }
+    EXPECT_EQ(layout.calls, 3);
+    EXPECT_EQ(cache.misses(), 3u);
+}
+
+TEST(TestKeyTranslation, FullUtf16)
+{
+    FakeLayout layout;
+    Ime::KeyTranslationCache cache;
+    auto emoji = cache.translate(layout, 'E', 0x12, Ime::KeyModifierAltGr);
+    EXPECT_EQ(emoji.length, 2);
+    EXPECT_EQ(emoji.codePoint(), 0x1F600u);
+    auto ligature = cache.translate(layout, 'L', 0x26, Ime::KeyModifierAltGr);
+    EXPECT_EQ(ligature.text(), L"\u0644\u0627");
+    EXPECT_EQ(ligature.codePoint(), 0u);
+    // from the cache this time
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, Ime::KeyModifierAltGr).codePoint(), 0x1F600u);
+    EXPECT_EQ(layout.calls, 2);
+    auto dead = cache.translate(layout, VK_OEM_1, 0x27, 0);
+    EXPECT_TRUE(dead.deadKey);
+    EXPECT_TRUE(dead.text().empty());
+    EXPECT_EQ(layout.calls, 3);
+}
+
+TEST(TestKeyTranslation, DeadKeyAndLetter)
+{
+    FakeLayout layout;
+    Ime::KeyTranslationCache cache;
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, 0).text(), L"e");
+    EXPECT_TRUE(cache.translate(layout, VK_OEM_1, 0x27, 0).deadKey);
+    // Shift types nothing, so the accent still waits for a letter
+    EXPECT_TRUE(cache.translate(layout, VK_SHIFT, 0x2A, Ime::KeyModifierShift).text().empty());
+    // not the cached e
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, 0).text(), L"\u00E9");
+    EXPECT_EQ(layout.afterDeadKeyCalls, 2);
+    // the accent was used up
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, 0).text(), L"e");
+    // the dead key is cached like other keys, the keys after it are not
+    EXPECT_TRUE(cache.translate(layout, VK_OEM_1, 0x27, 0).deadKey);
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, 0).text(), L"\u00E9");
+    EXPECT_EQ(layout.calls, 2);
+    EXPECT_EQ(layout.afterDeadKeyCalls, 3);
+    // a new layout forgets the accent of the old one
+    EXPECT_TRUE(cache.translate(layout, VK_OEM_1, 0x27, 0).deadKey);
+    layout.layoutId = 2;
+    EXPECT_EQ(cache.translate(layout, 'E', 0x12, 0).text(), L"e");
+    EXPECT_EQ(layout.afterDeadKeyCalls, 3);
+}
+
+TEST(TestKeyTranslation, LayoutChange)
+{
+    FakeLayout layout;
+    Ime::KeyTranslationCache cache;
+    EXPECT_EQ(cache.translate(layout, 'Y', 0x15, 0).text(), L"y");
+    EXPECT_EQ(cache.translate(layout, 'A', 0x1E, 0).text(), L"a");
+    layout.layoutId = 2;
+    EXPECT_EQ(cache.translate(layout, 'Y', 0x15, 0).text(), L"z");
+    EXPECT_EQ(cache.translate(layout, 'A', 0x1E, 0).text(), L"a");
+    EXPECT_EQ(layout.calls, 4);
+    layout.layoutId = 1;
+    EXPECT_EQ(cache.translate(layout, 'Y', 0x15, 0).text(), L"y");
+    EXPECT_EQ(layout.calls, 5);
+
+    cache.invalidate();
+    EXPECT_EQ(cache.translate(layout, 'Y', 0x15, 0).text(), L"y");
+    EXPECT_EQ(layout.calls, 6);
+}
+
+TEST(TestKeyTranslation, OtherScanCodeOrKeyCode)
+{
+    FakeLayout layout;
+    Ime::KeyTranslationCache cache;
+    cache.translate(layout, 'A', 0x1E, 0);
+    // the same key code from another scan code is translated again
+    cache.translate(layout, 'A', 0x1F, 0);
+    cache.translate(layout, 'A', 0x1F, 0);
+    EXPECT_EQ(layout.calls, 2);
+    // key codes out of range are never cached
+    cache.translate(layout, 0x1234, 0, 0);
+    cache.translate(layout, 0x1234, 0, 0);
+    EXPECT_EQ(layout.calls, 4);
+}
@@ -0,0 +1,218 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "KeystrokeLog.h"
+#include "KeystrokeReplay.h"
+
+namespace {
+
+const unsigned WM_KEYDOWN = 0x0100;
+const unsigned WM_KEYUP = 0x0101;
+
+class FakeKeyStateProvider: public Ime::KeyStateProvider {
+public:
+    bool keyboardState(uint8_t* states) override {
+        std::fill(states, states + 256, 0);
+        states[0x10] = shift ? 0x80 : 0;
+        return true;
+    }
+
+    Ime::KeyText translateKey(unsigned keyCode, unsigned, unsigned modifiers) override {
+        Ime::KeyText text;
+        if (keyCode >= 'A' && keyCode <= 'Z') {
+            text.units[0] = wchar_t((modifiers & Ime::KeyModifierShift) ? keyCode : keyCode - 'A' + 'a');
+            text.length = 1;
+        }
+        return text;
+    }
+
+    bool shift = false;
+};
+
+// A tiny engine: letters start a composition, which space or enter end.
+class FakeEngine: public Ime::KeystrokeTarget {
+public:
+    bool testKey(Ime::KeyEvent& event, uint32_t) override {
+        return wants(event);
+    }
+
+    bool handleKey(Ime::KeyEvent& event, uint32_t) override {
+        if (!wants(event))
+            return false;
+        if (event.type() == WM_KEYDOWN) {
+            if (event.isChar())
+                composition += event.text();
+            else {
+                committed += composition;
+                composition.clear();
+            }
+        }
+        return true;
+    }
+
+    bool wants(const Ime::KeyEvent& event) const {
+        if (event.keyCode() >= 'A' && event.keyCode() <= 'Z')
+            return !eatNothing;
+        return !composition.empty() && (event.keyCode() == ' ' || event.keyCode() == '\r');
+    }
+
+    std::wstring composition, committed;
+    bool eatNothing = false;
+};
+
+// types keys into the engine the way TSF does, recording each call
+void type(Ime::KeystrokeRecorder& recorder, FakeEngine& engine, Ime::KeyStateProvider& provider,
+    const void* context, const std::vector<unsigned>& keys) {
+    for (unsigned key : keys) {
+        for (unsigned message : { WM_KEYDOWN, WM_KEYUP }) {
+            Ime::KeyEvent event(message, key, 1, provider);
+            bool wanted = engine.testKey(event, 0);
+            recorder.record(event, context, true, wanted);
+            if (wanted)
+                recorder.record(event, context, false, engine.handleKey(event, 0));
+        }
+    }
+}
+
+std::vector<Ime::KeystrokeRecord> read(const std::string& log) {
+    std::vector<Ime::KeystrokeRecord> records;
+    std::string error;
+    EXPECT_TRUE(Ime::readKeystrokeLog((const uint8_t*) log.data(), log.size(), records, &error)) << error;
+    return records;
+}
+
+} // namespace
+
+TEST(TestKeystrokeLog, RoundTrip)
+{
+    std::ostringstream out;
+    Ime::KeystrokeRecorder recorder(out);
+    Ime::KeystrokeRecord a;
+    a.time = 0x123456789ull;
+    a.contextId = 7;
+    a.type = WM_KEYUP;
+    a.keyCode = 'A';
+    a.lParam = 0xC01E0001u;
+    a.modifiers = Ime::ModifierShift | Ime::ModifierLeftShift | Ime::ModifierCapsLock;
+    a.eaten = true;
+    a.text.units[0] = wchar_t(0xD83D);
+    a.text.units[1] = wchar_t(0xDE00);
+    a.text.length = 2;
+    Ime::KeystrokeRecord b;
+    b.test = true;
+    b.text.deadKey = true;
+    recorder.record(a);
+    recorder.record(b);
+    EXPECT_EQ(recorder.count(), 2u);
+    // a fixed size per key
+    EXPECT_EQ(out.str().size(), 16u + 2 * 32u);
+
+    auto records = read(out.str());
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0], a);
+    EXPECT_EQ(records[1], b);
+
+    auto event = records[0].event();
+    EXPECT_EQ(event.type(), WM_KEYUP);
+    EXPECT_EQ(event.scanCode(), 0x1E);
+    EXPECT_EQ(event.charCode(), 0x1F600u);
+    EXPECT_TRUE(event.hasModifiers(Ime::ModifierShift | Ime::ModifierCapsLock));
+}
+
+TEST(TestKeystrokeLog, RecordsEvents)
+{
+    FakeKeyStateProvider provider;
+    provider.shift = true;
+    std::ostringstream out;
+    Ime::KeystrokeRecorder recorder(out);
+    int context1, context2;
+    recorder.record(Ime::KeyEvent(WM_KEYDOWN, 'Q', 1, provider), &context1, true, true);
+    recorder.record(Ime::KeyEvent(WM_KEYDOWN, 'Q', 1, provider), &context2, false, false);
+    recorder.record(Ime::KeyEvent(WM_KEYUP, 'Q', 1, provider), &context1, false, true);
+
+    auto records = read(out.str());
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].contextId, 1u);
+    EXPECT_EQ(records[1].contextId, 2u);
+    EXPECT_EQ(records[2].contextId, 1u);
+    EXPECT_TRUE(records[0].test);
+    EXPECT_TRUE(records[0].eaten);
+    EXPECT_FALSE(records[1].eaten);
+    EXPECT_EQ(records[0].text.text(), L"Q");
+    EXPECT_EQ(records[0].modifiers, Ime::ModifierShift);
+    EXPECT_LE(records[0].time, records[2].time);
+}
+
+TEST(TestKeystrokeLog, BadLogs)
+{
+    std::ostringstream out;
+    Ime::KeystrokeRecorder recorder(out);
+    recorder.record(Ime::KeystrokeRecord{});
+    recorder.record(Ime::KeystrokeRecord{});
+    auto log = out.str();
+
+    std::vector<Ime::KeystrokeRecord> records;
+    std::string error;
+    EXPECT_FALSE(Ime::readKeystrokeLog((const uint8_t*) "IMTH", 4, records, &error));
+    EXPECT_EQ(error, "not a keystroke log");
+
+    auto truncated = log.substr(0, log.size() - 1);
+    EXPECT_FALSE(Ime::readKeystrokeLog((const uint8_t*) truncated.data(), truncated.size(), records, &error));
+    EXPECT_EQ(error, "truncated keystroke log");
+    // what came before is kept
+    EXPECT_EQ(records.size(), 1u);
+
+    auto newer = log;
+    newer[4] = 2;
+    records.clear();
+    EXPECT_FALSE(Ime::readKeystrokeLog((const uint8_t*) newer.data(), newer.size(), records, &error));
+    EXPECT_EQ(error, "unsupported keystroke log version");
+
+    auto corrupted = log;
+    corrupted[16 + 23] = 9; // text length
+    EXPECT_FALSE(Ime::readKeystrokeLog((const uint8_t*) corrupted.data(), corrupted.size(), records, &error));
+    EXPECT_EQ(error, "corrupted keystroke log");
+}
+
+TEST(TestKeystrokeReplay, Percentile)
+{
+    EXPECT_EQ(Ime::percentile({}, 50), 0);
+    std::vector<double> values{ 1, 2, 3, 4, 5 };
+    EXPECT_DOUBLE_EQ(Ime::percentile(values, 0), 1);
+    EXPECT_DOUBLE_EQ(Ime::percentile(values, 50), 3);
+    EXPECT_DOUBLE_EQ(Ime::percentile(values, 100), 5);
+    EXPECT_DOUBLE_EQ(Ime::percentile(values, 90), 4.6);
+    EXPECT_DOUBLE_EQ(Ime::percentile({ 8 }, 99), 8);
+}
+
+TEST(TestKeystrokeReplay, ReplaysAgainstEngine)
+{
+    FakeKeyStateProvider provider;
+    std::ostringstream out;
+    Ime::KeystrokeRecorder recorder(out);
+    FakeEngine recorded;
+    int context;
+    type(recorder, recorded, provider, &context, { 'N', 'I', ' ', 'H', 'A', 'O', '\r', '1' });
+    EXPECT_EQ(recorded.committed, L"nihao");
+    auto records = read(out.str());
+
+    // the same engine gives the same results, and types the same text
+    FakeEngine engine;
+    auto report = Ime::replayKeystrokes(records, engine, 3);
+    EXPECT_EQ(report.keys, records.size() * 3);
+    EXPECT_EQ(report.mismatches, 0u);
+    EXPECT_EQ(engine.committed, L"nihaonihaonihao");
+    EXPECT_LE(report.p50, report.p90);
+    EXPECT_LE(report.p90, report.p99);
+    EXPECT_LE(report.p99, report.max);
+    EXPECT_GE(report.seconds, 0);
+    EXPECT_NE(report.summary().find("0 mismatches"), std::string::npos);
+
+    // a regression shows up as mismatches
+    FakeEngine broken;
+    broken.eatNothing = true;
+    EXPECT_GT(Ime::replayKeystrokes(records, broken).mismatches, 0u);
+}
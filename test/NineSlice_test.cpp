@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+
+#include "NineSlice.h"
+
+using Ime::Rect;
+
+static const Ime::Size imageSize{ 30, 20 };
+static const Ime::Margins imageMargins{ 4, 5, 6, 7 };  // top, right, bottom, left
+
+TEST(TestNineSlice, ScaleForDpi)
+{
+    EXPECT_EQ(Ime::scaleForDpi(10, 96), 10);
+    EXPECT_EQ(Ime::scaleForDpi(10, 144), 15);
+    EXPECT_EQ(Ime::scaleForDpi(5, 120), 6);    // 6.25
+    EXPECT_EQ(Ime::scaleForDpi(3, 144), 5);    // 4.5 rounds up
+    EXPECT_EQ(Ime::scaleForDpi(-3, 144), -5);  // and away from zero
+    EXPECT_EQ(Ime::scaleForDpi(0, 192), 0);
+}
+
+TEST(TestNineSlice, NinePatchesAt96Dpi)
+{
+    Ime::NineSlice slice(imageSize, imageMargins, { 100, 50, 200, 90 });
+    ASSERT_EQ(slice.size(), 9u);
+    // left column: top, middle, bottom
+    EXPECT_EQ(slice[0].src, (Rect{ 0, 0, 7, 4 }));
+    EXPECT_EQ(slice[0].dest, (Rect{ 100, 50, 107, 54 }));
+    EXPECT_EQ(slice[1].src, (Rect{ 0, 4, 7, 14 }));
+    EXPECT_EQ(slice[1].dest, (Rect{ 100, 54, 107, 84 }));
+    EXPECT_EQ(slice[2].src, (Rect{ 0, 14, 7, 20 }));
+    EXPECT_EQ(slice[2].dest, (Rect{ 100, 84, 107, 90 }));
+    // the center is stretched both ways
+    EXPECT_EQ(slice[4].src, (Rect{ 7, 4, 25, 14 }));
+    EXPECT_EQ(slice[4].dest, (Rect{ 107, 54, 195, 84 }));
+    // right bottom corner
+    EXPECT_EQ(slice[8].src, (Rect{ 25, 14, 30, 20 }));
+    EXPECT_EQ(slice[8].dest, (Rect{ 195, 84, 200, 90 }));
+}
+
+TEST(TestNineSlice, PatchesTileTheTarget)
+{
+    const Rect dest{ 3, 7, 181, 64 };
+    for (int dpi : { 96, 120, 144, 168, 192 }) {
+        Ime::NineSlice slice(imageSize, imageMargins, dest, dpi, dpi);
+        ASSERT_EQ(slice.size(), 9u);
+        long long area = 0;
+        for (const auto& patch : slice) {
+            EXPECT_TRUE(dest.contains(patch.dest)) << "dpi " << dpi;
+            area += patch.dest.area();
+            for (const auto& other : slice) {
+                if (&other != &patch)
+                    EXPECT_FALSE(patch.dest.intersects(other.dest)) << "dpi " << dpi;
+            }
+        }
+        EXPECT_EQ(area, dest.area()) << "dpi " << dpi;
+    }
+}
+
+TEST(TestNineSlice, CornersScaleWithDpi)
+{
+    Ime::NineSlice slice(imageSize, imageMargins, { 0, 0, 100, 100 }, 192, 144);
+    EXPECT_EQ(slice[0].src, (Rect{ 0, 0, 7, 4 }));
+    EXPECT_EQ(slice[0].dest, (Rect{ 0, 0, 14, 6 }));
+    EXPECT_EQ(slice[8].dest, (Rect{ 90, 91, 100, 100 }));
+}
+
+TEST(TestNineSlice, SkipsEmptyPatches)
+{
+    // no margins: only the center is left
+    Ime::NineSlice plain(imageSize, {}, { 0, 0, 50, 50 });
+    ASSERT_EQ(plain.size(), 1u);
+    EXPECT_EQ(plain[0].src, (Rect{ 0, 0, 30, 20 }));
+    EXPECT_EQ(plain[0].dest, (Rect{ 0, 0, 50, 50 }));
+
+    // a target smaller than the borders has no center
+    Ime::NineSlice tiny(imageSize, imageMargins, { 0, 0, 10, 8 });
+    for (const auto& patch : tiny) {
+        EXPECT_FALSE(patch.src.isEmpty());
+        EXPECT_FALSE(patch.dest.isEmpty());
+    }
+    EXPECT_LT(tiny.size(), 9u);
+}
+
+TEST(TestNineSlice, CacheReusesSlices)
+{
+    Ime::NineSliceCache cache(2);
+    const Ime::Size a{ 100, 40 }, b{ 120, 40 }, c{ 140, 40 };
+    const auto* first = &cache.get(imageSize, imageMargins, a, 96, 96);
+    EXPECT_EQ(&cache.get(imageSize, imageMargins, a, 96, 96), first);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+
+    cache.get(imageSize, imageMargins, a, 144, 144);  // another DPI
+    cache.get(imageSize, imageMargins, b, 96, 96);    // evicts a at 96 DPI
+    cache.get(imageSize, imageMargins, a, 96, 96);
+    EXPECT_EQ(cache.misses(), 4u);
+    EXPECT_EQ(cache.get(imageSize, imageMargins, c, 96, 96)[4].dest.right, 140 - 5);
+}
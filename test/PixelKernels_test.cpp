@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+#include <cstdint>
+
+#include "PixelKernels.h"
+
+using Ime::PixelKernelIsa;
+
+static std::vector<uint8_t> coveragePixels(size_t count) {
+    std::vector<uint8_t> pixels(count * 4);
+    uint32_t seed = 12345;
+    for (auto& byte : pixels) {
+        seed = seed * 1103515245 + 12345;
+        byte = uint8_t(seed >> 16);
+    }
+    return pixels;
+}
+
+TEST(TestPixelKernels, ScalarMatchesReference)
+{
+    // every possible coverage value in the blue channel
+    std::vector<uint8_t> pixels(256 * 4, 0x55);
+    for (int i = 0; i < 256; ++i) {
+        pixels[i * 4] = uint8_t(i);
+    }
+    const uint8_t r = 0x12, g = 0x80, b = 0xFF;
+    Ime::premultiplyCoverageScalar(pixels.data(), 256, r, g, b);
+    for (int i = 0; i < 256; ++i) {
+        int alpha = 255 - i;
+        EXPECT_EQ(pixels[i * 4 + 0], b * alpha / 255);
+        EXPECT_EQ(pixels[i * 4 + 1], g * alpha / 255);
+        EXPECT_EQ(pixels[i * 4 + 2], r * alpha / 255);
+        EXPECT_EQ(pixels[i * 4 + 3], alpha);
+    }
+}
+
+TEST(TestPixelKernels, WhiteIsTransparent)
+{
+    std::vector<uint8_t> pixels(16 * 4, 0xFF);
+    Ime::premultiplyCoverage(pixels.data(), 16, 0x40, 0x50, 0x60);
+    for (auto byte : pixels) {
+        EXPECT_EQ(byte, 0);
+    }
+}
+
+TEST(TestPixelKernels, SimdMatchesScalar)
+{
+    const PixelKernelIsa isas[] = { PixelKernelIsa::Sse2, PixelKernelIsa::Avx2 };
+    const uint8_t colors[][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 0x12, 0x80, 0xFE } };
+    // odd sizes exercise the scalar tails of the SIMD loops
+    const size_t counts[] = { 0, 1, 3, 4, 7, 8, 9, 31, 1000 };
+    for (auto isa : isas) {
+        if (!Ime::isPixelKernelIsaSupported(isa))
+            continue;
+        auto kernel = Ime::premultiplyCoverageKernel(isa);
+        for (auto& color : colors) for (auto count : counts) {
+            auto expected = coveragePixels(count);
+            auto actual = expected;
+            Ime::premultiplyCoverageScalar(expected.data(), count, color[0], color[1], color[2]);
+            kernel(actual.data(), count, color[0], color[1], color[2]);
+            EXPECT_EQ(actual, expected) << "isa " << int(isa) << ", count " << count;
+        }
+    }
+}
+
+TEST(TestPixelKernels, UnalignedBuffer)
+{
+    auto buffer = coveragePixels(65);
+    auto expected = buffer;
+    Ime::premultiplyCoverageScalar(expected.data() + 4, 64, 1, 2, 3);
+    Ime::premultiplyCoverage(buffer.data() + 4, 64, 1, 2, 3);
+    EXPECT_EQ(buffer, expected);
+}
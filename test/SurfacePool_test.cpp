@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+
+#include "SurfacePool.h"
+
+// Fake allocator which counts live surfaces.
+struct FakeSurface {
+    FakeSurface(Ime::Size size, int* live) : size{ size }, live{ live } {
+        ++*live;
+    }
+    ~FakeSurface() {
+        --*live;
+    }
+    Ime::Size size;
+    int* live;
+};
+
+class TestSurfacePool : public ::testing::Test {
+protected:
+    Ime::SurfacePool<FakeSurface>::Allocator allocator() {
+        return [this](Ime::Size size) {
+            ++allocations;
+            return std::make_unique<FakeSurface>(size, &live);
+        };
+    }
+
+    int allocations = 0;
+    int live = 0;
+};
+
+TEST_F(TestSurfacePool, RoundsUpToBuckets)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator(), 64 };
+    auto lease = pool.acquire({ 100, 20 });
+    EXPECT_EQ(lease.size(), (Ime::Size{ 128, 64 }));
+    EXPECT_EQ(lease->size, (Ime::Size{ 128, 64 }));
+    EXPECT_EQ(pool.misses(), 1u);
+    EXPECT_EQ(pool.outstandingCount(), 1u);
+}
+
+TEST_F(TestSurfacePool, ReusesAcrossFrames)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator() };
+    for (int frame = 0; frame < 10; ++frame) {
+        auto backBuffer = pool.acquire({ 300, 40 });
+        auto normal = pool.acquire({ 300, 40 });
+        auto highlight = pool.acquire({ 300, 40 });
+    }
+    EXPECT_EQ(allocations, 3);
+    EXPECT_EQ(pool.misses(), 3u);
+    EXPECT_EQ(pool.hits(), 27u);
+    EXPECT_EQ(pool.idleCount(), 3u);
+    EXPECT_EQ(pool.outstandingCount(), 0u);
+}
+
+TEST_F(TestSurfacePool, SmallerRequestsHitWithinBucket)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator() };
+    { auto lease = pool.acquire({ 300, 40 }); }
+    { auto lease = pool.acquire({ 260, 10 }); }
+    EXPECT_EQ(allocations, 1);
+    // growing past the bucket needs a new surface
+    { auto lease = pool.acquire({ 330, 40 }); }
+    EXPECT_EQ(allocations, 2);
+    EXPECT_EQ(pool.hits(), 1u);
+    EXPECT_EQ(pool.misses(), 2u);
+}
+
+TEST_F(TestSurfacePool, PicksSmallestFit)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator() };
+    {
+        auto big = pool.acquire({ 500, 500 });
+        auto small = pool.acquire({ 50, 50 });
+    }
+    auto lease = pool.acquire({ 10, 10 });
+    EXPECT_EQ(lease.size(), (Ime::Size{ 64, 64 }));
+}
+
+TEST_F(TestSurfacePool, TrimFreesOutgrownSurfaces)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator() };
+    {
+        auto a = pool.acquire({ 100, 30 });
+        auto b = pool.acquire({ 400, 30 });
+    }
+    EXPECT_EQ(live, 2);
+    pool.trim({ 200, 30 });
+    EXPECT_EQ(live, 1);
+    EXPECT_EQ(pool.idleCount(), 1u);
+    pool.clear();
+    EXPECT_EQ(live, 0);
+}
+
+TEST_F(TestSurfacePool, LimitsIdleSurfaces)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator(), 64, 2 };
+    {
+        auto a = pool.acquire({ 10, 10 });
+        auto b = pool.acquire({ 100, 10 });
+        auto c = pool.acquire({ 200, 10 });
+    }
+    EXPECT_EQ(pool.idleCount(), 2u);
+    EXPECT_EQ(live, 2);
+    // the smallest one was dropped
+    auto lease = pool.acquire({ 10, 10 });
+    EXPECT_EQ(lease.size(), (Ime::Size{ 128, 64 }));
+}
+
+TEST_F(TestSurfacePool, LeaseMoves)
+{
+    Ime::SurfacePool<FakeSurface> pool{ allocator() };
+    auto a = pool.acquire({ 10, 10 });
+    Ime::SurfacePool<FakeSurface>::Lease b;
+    EXPECT_FALSE(b);
+    b = std::move(a);
+    EXPECT_FALSE(a);
+    EXPECT_TRUE(b);
+    EXPECT_EQ(pool.outstandingCount(), 1u);
+    b.reset();
+    EXPECT_EQ(pool.outstandingCount(), 0u);
+    EXPECT_EQ(pool.idleCount(), 1u);
+}
@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "TextMeasureCache.h"
+
+using Ime::FontKey;
+using Ime::Size;
+
+// Every character is 10 units wide and the font size gives the height.
+class FakeMeasurer : public Ime::TextMeasurer {
+public:
+    explicit FakeMeasurer(int height = 16) : height{ height } {}
+
+    Size measure(std::wstring_view text) override {
+        ++calls;
+        return { int(text.size()) * 10, height };
+    }
+
+    int height;
+    int calls = 0;
+};
+
+TEST(TestTextMeasureCache, MeasuresOnMissOnly)
+{
+    Ime::TextMeasureCache cache;
+    FakeMeasurer measurer;
+    FontKey font{ 1, 96 };
+    EXPECT_EQ(cache.measure(font, L"abc", measurer), (Size{ 30, 16 }));
+    EXPECT_EQ(cache.measure(font, L"abc", measurer), (Size{ 30, 16 }));
+    EXPECT_EQ(measurer.calls, 1);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+    EXPECT_DOUBLE_EQ(cache.hitRate(), 0.5);
+}
+
+TEST(TestTextMeasureCache, KeyIncludesFontAndDpi)
+{
+    Ime::TextMeasureCache cache;
+    FakeMeasurer small{ 16 }, large{ 32 };
+    EXPECT_EQ(cache.measure({ 1, 96 }, L"x", small).cy, 16);
+    EXPECT_EQ(cache.measure({ 2, 96 }, L"x", large).cy, 32);
+    EXPECT_EQ(cache.measure({ 1, 192 }, L"x", large).cy, 32);
+    EXPECT_EQ(cache.measure({ 1, 96 }, L"x", large).cy, 16);
+    EXPECT_EQ(cache.size(), 3u);
+    EXPECT_EQ(cache.hits(), 1u);
+}
+
+TEST(TestTextMeasureCache, EvictsLeastRecentlyUsed)
+{
+    Ime::TextMeasureCache cache{ 2 };
+    FakeMeasurer measurer;
+    FontKey font;
+    cache.measure(font, L"a", measurer);
+    cache.measure(font, L"b", measurer);
+    cache.measure(font, L"a", measurer); // "b" is now the oldest
+    cache.measure(font, L"c", measurer);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_NE(cache.peek(font, L"a"), nullptr);
+    EXPECT_EQ(cache.peek(font, L"b"), nullptr);
+    EXPECT_NE(cache.peek(font, L"c"), nullptr);
+}
+
+TEST(TestTextMeasureCache, PeekDoesNotCount)
+{
+    Ime::TextMeasureCache cache;
+    FakeMeasurer measurer;
+    EXPECT_EQ(cache.peek({}, L"abc"), nullptr);
+    cache.measure({}, L"abc", measurer);
+    ASSERT_NE(cache.peek({}, L"abc"), nullptr);
+    EXPECT_EQ(*cache.peek({}, L"abc"), (Size{ 30, 16 }));
+    EXPECT_EQ(cache.hits() + cache.misses(), 1u);
+}
+
+TEST(TestTextMeasureCache, CandidateRefreshHitRate)
+{
+    // The same page of candidates is laid out and painted on every keystroke.
+    Ime::TextMeasureCache cache{ 256 };
+    FakeMeasurer measurer;
+    FontKey font{ Ime::hashBytes("SimSun 12", 9), 96 };
+    std::vector<std::wstring> page{ L"1.\u7684", L"2.\u5730", L"3.\u5f97", L"4.\u5fb7", L"5.\u4f4e" };
+    for (int keystroke = 0; keystroke < 100; ++keystroke) {
+        for (const auto& str : page) // recalculateSize()
+            cache.measure(font, str, measurer);
+        for (const auto& str : page) // paint()
+            cache.measure(font, str, measurer);
+    }
+    EXPECT_EQ(measurer.calls, 5);
+    EXPECT_GT(cache.hitRate(), 0.99);
+}
+
+TEST(TestTextMeasureCache, Clear)
+{
+    Ime::TextMeasureCache cache;
+    FakeMeasurer measurer;
+    cache.measure({}, L"abc", measurer);
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    cache.measure({}, L"abc", measurer);
+    EXPECT_EQ(measurer.calls, 2);
+}
+
+TEST(TestTextMeasureCache, HashBytes)
+{
+    EXPECT_EQ(Ime::hashBytes("", 0), 14695981039346656037ull);
+    EXPECT_NE(Ime::hashBytes("a", 1), Ime::hashBytes("b", 1));
+    EXPECT_EQ(Ime::hashBytes("ab", 2), Ime::hashBytes("b", 1, Ime::hashBytes("a", 1)));
+}
@@ -0,0 +1,542 @@
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FakeTsf.h"
+#include "ImeModule.h"
+#include "TextService.h"
+#include "EditSession.h"
+#include "LangBarButton.h"
+#include "KeystrokeLog.h"
+#include "KeystrokeReplay.h"
+
+using namespace Ime;
+
+namespace {
+
+// {7E4B2F1A-3C55-4D0B-9A61-2B8E5C0F4D17}
+const GUID testClsid = { 0x7e4b2f1a, 0x3c55, 0x4d0b, { 0x9a, 0x61, 0x2b, 0x8e, 0x5c, 0x0f, 0x4d, 0x17 } };
+// {0B7F3D6E-91A2-4C48-8E3F-5D2A6B1C9E04}
+const GUID toggleKeyGuid = { 0x0b7f3d6e, 0x91a2, 0x4c48, { 0x8e, 0x3f, 0x5d, 0x2a, 0x6b, 0x1c, 0x9e, 0x04 } };
+// {C2D81F47-6A3E-4B95-B07C-1E9F4A2D8C63}
+const GUID buttonGuid = { 0xc2d81f47, 0x6a3e, 0x4b95, { 0xb0, 0x7c, 0x1e, 0x9f, 0x4a, 0x2d, 0x8c, 0x63 } };
+
+// Composes the letters typed and commits them with Enter.
+class TestTextService : public TextService {
+public:
+    explicit TestTextService(ImeModule* module) : TextService(module) {
+        ++instances;
+    }
+
+    ~TestTextService() override {
+        --instances;
+    }
+
+    bool filterKeyDown(KeyEvent& keyEvent) override {
+        if (keyEvent.keyCode() >= 'A' && keyEvent.keyCode() <= 'Z')
+            return !keyEvent.hasModifiers(ModifierCtrl);
+        return isComposing() && keyEvent.keyCode() == VK_RETURN;
+    }
+
+    bool onKeyDown(KeyEvent& keyEvent, EditSession* session) override {
+        if (keyEvent.keyCode() == VK_RETURN) {
+            endComposition(session->context());
+            buffer.clear();
+            return true;
+        }
+        if (!isComposing())
+            startComposition(session->context());
+        buffer += keyEvent.charCode();
+        setCompositionString(session, buffer.c_str(), (int)buffer.size());
+        return true;
+    }
+
+    // eats the release of Escape, to see both calls
+    bool filterKeyUp(KeyEvent& keyEvent) override {
+        keyUps.push_back({ keyEvent.type(), &keyEvent });
+        return keyEvent.keyCode() == VK_ESCAPE;
+    }
+
+    bool onKeyUp(KeyEvent& keyEvent, EditSession* session) override {
+        keyUps.push_back({ keyEvent.type(), &keyEvent });
+        return true;
+    }
+
+    bool onPreservedKey(const GUID& guid) override {
+        preservedKeys.push_back(guid);
+        return true;
+    }
+
+    bool onCommand(UINT id, CommandType type) override {
+        commands.push_back(id);
+        return true;
+    }
+
+    void onKeyboardStatusChanged(bool opened) override {
+        keyboardChanges.push_back(opened);
+    }
+
+    void onCompositionTerminated(bool forced) override {
+        terminations.push_back(forced);
+        buffer.clear();
+    }
+
+    std::wstring buffer;
+    // the type and the address of the events of filterKeyUp() and onKeyUp()
+    std::vector<std::pair<unsigned, const KeyEvent*>> keyUps;
+    std::vector<GUID> preservedKeys;
+    std::vector<UINT> commands;
+    std::vector<bool> keyboardChanges;
+    std::vector<bool> terminations;
+
+    // the ones alive
+    static inline int instances = 0;
+};
+
+class TestImeModule : public ImeModule {
+public:
+    TestImeModule() : ImeModule(NULL, testClsid) {}
+
+    TextService* createTextService() override {
+        return new TestTextService(this);
+    }
+};
+
+class TextServiceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        BYTE states[256] = {};
+        ::SetKeyboardState(states);
+        module = ComPtr<TestImeModule>::make();
+        service = ComPtr<TestTextService>::make(module);
+        threadMgr = ComPtr<FakeThreadMgr>::make();
+    }
+
+    void TearDown() override {
+        threadMgr->deactivate();
+    }
+
+    void activate() {
+        ASSERT_EQ(threadMgr->activate(service), S_OK);
+    }
+
+    ComPtr<TestImeModule> module;
+    ComPtr<TestTextService> service;
+    ComPtr<FakeThreadMgr> threadMgr;
+};
+
+// Lets CoCreateInstance() create thread managers, as TSF does.
+class FakeThreadMgrFactory : public ComObject<ComInterface<IClassFactory>> {
+public:
+    STDMETHODIMP CreateInstance(IUnknown* outer, REFIID riid, void** ppv) override {
+        if (outer)
+            return CLASS_E_NOAGGREGATION;
+        return ComPtr<FakeThreadMgr>::make()->QueryInterface(riid, ppv);
+    }
+
+    STDMETHODIMP LockServer(BOOL lock) override {
+        return S_OK;
+    }
+};
+
+ComPtr<EditSession> editSession(FakeContext* context, std::function<void(EditSession*, TfEditCookie)> callback) {
+    return ComPtr<EditSession>::make(context, std::move(callback));
+}
+
+} // namespace
+
+TEST_F(TextServiceTest, ActivationInstallsSinksAndOpensKeyboard) {
+    activate();
+    EXPECT_TRUE(service->isActivated());
+    EXPECT_EQ(service->clientId(), threadMgr->clientId());
+    EXPECT_EQ(threadMgr->keyEventSink(), static_cast<ITfKeyEventSink*>(service));
+    EXPECT_EQ(threadMgr->sinkCount(IID_ITfThreadMgrEventSink), 1u);
+    EXPECT_EQ(threadMgr->sinkCount(IID_ITfActiveLanguageProfileNotifySink), 1u);
+
+    auto openClose = threadMgr->compartments()->compartment(GUID_COMPARTMENT_KEYBOARD_OPENCLOSE);
+    EXPECT_EQ(openClose->intValue(), 1u);
+    EXPECT_EQ(openClose->sinkCount(), 1u);
+    EXPECT_TRUE(service->isKeyboardOpened());
+    EXPECT_EQ(service->keyboardChanges, std::vector<bool>{ true });
+
+    threadMgr->deactivate();
+    EXPECT_FALSE(service->isActivated());
+    EXPECT_EQ(threadMgr->keyEventSink(), nullptr);
+    EXPECT_EQ(threadMgr->sinkCount(IID_ITfThreadMgrEventSink), 0u);
+    EXPECT_EQ(openClose->sinkCount(), 0u);
+}
+
+TEST_F(TextServiceTest, KeyboardFollowsThreadCompartment) {
+    activate();
+    service->setKeyboardOpen(false);
+    EXPECT_FALSE(service->isKeyboardOpened());
+    EXPECT_EQ(threadMgr->compartments()->compartment(GUID_COMPARTMENT_KEYBOARD_OPENCLOSE)->intValue(), 0u);
+
+    auto context = threadMgr->focusNewContext();
+    EXPECT_FALSE(threadMgr->typeKey('A'));
+    EXPECT_EQ(context->text(), L"");
+
+    service->setKeyboardOpen(true);
+    EXPECT_TRUE(threadMgr->typeKey('A'));
+    EXPECT_EQ(service->keyboardChanges, (std::vector<bool>{ true, false, true }));
+}
+
+TEST_F(TextServiceTest, GlobalCompartmentsAreShared) {
+    activate();
+    // {4F1C8E2B-7D3A-4A96-B5E0-8C2F6D1A3B79}
+    const GUID key = { 0x4f1c8e2b, 0x7d3a, 0x4a96, { 0xb5, 0xe0, 0x8c, 0x2f, 0x6d, 0x1a, 0x3b, 0x79 } };
+    service->setGlobalCompartmentValue(key, 42);
+    EXPECT_EQ(FakeThreadMgr::globalCompartments()->compartment(key)->intValue(), 42u);
+    EXPECT_EQ(service->globalCompartmentValue(key), 42u);
+    EXPECT_EQ(service->threadCompartmentValue(key), 0u);
+}
+
+TEST_F(TextServiceTest, GlobalCompartmentsBeforeActivation) {
+    auto factory = ComPtr<FakeThreadMgrFactory>::make();
+    DWORD cookie = 0;
+    ASSERT_EQ(::CoRegisterClassObject(CLSID_TF_ThreadMgr, factory, CLSCTX_INPROC_SERVER,
+        REGCLS_MULTIPLEUSE, &cookie), S_OK);
+    // {D4E2A9B7-5C13-4E8F-9A26-7B0C3D1F6E58}
+    const GUID key = { 0xd4e2a9b7, 0x5c13, 0x4e8f, { 0x9a, 0x26, 0x7b, 0x0c, 0x3d, 0x1f, 0x6e, 0x58 } };
+    // not activated: the service creates a thread manager of its own
+    service->setGlobalCompartmentValue(key, 5);
+    EXPECT_EQ(FakeThreadMgr::globalCompartments()->compartment(key)->intValue(), 5u);
+    EXPECT_EQ(service->globalCompartmentValue(key), 5u);
+    ::CoRevokeClassObject(cookie);
+}
+
+TEST_F(TextServiceTest, ContextCompartmentsOfAnotherContext) {
+    activate();
+    // {93A5E7C1-2B4D-4F68-8D0A-6C1E3F5B7D92}
+    const GUID key = { 0x93a5e7c1, 0x2b4d, 0x4f68, { 0x8d, 0x0a, 0x6c, 0x1e, 0x3f, 0x5b, 0x7d, 0x92 } };
+    auto first = threadMgr->focusNewContext();
+    service->setContextCompartmentValue(key, 7, first);
+    // the value of the context asked for, not of the focused one
+    auto second = threadMgr->focusNewContext();
+    EXPECT_EQ(service->contextCompartmentValue(key, first), 7u);
+    EXPECT_EQ(service->contextCompartmentValue(key, second), 0u);
+    EXPECT_EQ(service->contextCompartmentValue(key), 0u);
+}
+
+TEST_F(TextServiceTest, ComposesAndCommits) {
+    activate();
+    auto context = threadMgr->focusNewContext(L"x");
+    EXPECT_TRUE(threadMgr->typeKey('H'));
+    threadMgr->keyDown(VK_SHIFT);
+    EXPECT_TRUE(threadMgr->typeKey('I'));
+    threadMgr->keyUp(VK_SHIFT);
+
+    EXPECT_TRUE(service->isComposing());
+    ASSERT_NE(context->composition(), nullptr);
+    EXPECT_EQ(context->composition()->text(), L"hI");
+    EXPECT_EQ(context->text(), L"xhI");
+    EXPECT_EQ(context->selectionStart(), 3);
+    EXPECT_EQ(context->selectionEnd(), 3);
+    // the composition is shown with the input display attribute
+    auto attributes = context->property(GUID_PROP_ATTRIBUTE);
+    ASSERT_NE(attributes, nullptr);
+    ASSERT_NE(attributes->valueAt(1), nullptr);
+    EXPECT_EQ(attributes->valueAt(1)->vt, VT_I4);
+    EXPECT_EQ(attributes->valueAt(0), nullptr);
+
+    EXPECT_TRUE(threadMgr->typeKey(VK_RETURN));
+    EXPECT_FALSE(service->isComposing());
+    EXPECT_EQ(context->composition(), nullptr);
+    EXPECT_EQ(context->text(), L"xhI");
+    EXPECT_EQ(context->selectionStart(), 3);
+    EXPECT_EQ(attributes->spanCount(), 0u);
+    EXPECT_EQ(service->terminations, std::vector<bool>{ false });
+
+    // keys the service does not want go to the application
+    EXPECT_FALSE(threadMgr->typeKey(VK_RETURN));
+    EXPECT_FALSE(threadMgr->typeKey('1'));
+}
+
+TEST_F(TextServiceTest, ComposesAtTheSelection) {
+    activate();
+    auto context = threadMgr->focusNewContext(L"ab");
+    threadMgr->typeKey('X');
+    threadMgr->typeKey(VK_RETURN);
+    threadMgr->typeKey('Y');
+    EXPECT_EQ(context->text(), L"abxy");
+    EXPECT_EQ(context->composition()->start(), 3);
+    EXPECT_EQ(context->composition()->end(), 4);
+}
+
+TEST_F(TextServiceTest, ForcedTerminationIsReported) {
+    activate();
+    auto context = threadMgr->focusNewContext();
+    threadMgr->typeKey('A');
+    ASSERT_TRUE(service->isComposing());
+    context->terminateComposition();
+    EXPECT_FALSE(service->isComposing());
+    EXPECT_EQ(service->terminations, std::vector<bool>{ true });
+    EXPECT_EQ(context->text(), L"a");
+    // a new composition can start afterwards
+    threadMgr->typeKey('B');
+    EXPECT_TRUE(service->isComposing());
+    EXPECT_EQ(context->composition()->text(), L"b");
+}
+
+TEST_F(TextServiceTest, DisabledContextGetsNoKeys) {
+    activate();
+    auto context = threadMgr->focusNewContext();
+    VARIANT value;
+    ::VariantInit(&value);
+    value.vt = VT_I4;
+    value.lVal = 1;
+    context->compartments()->compartment(GUID_COMPARTMENT_KEYBOARD_DISABLED)->SetValue(0, &value);
+    EXPECT_TRUE(service->isKeyboardDisabled(context));
+    EXPECT_FALSE(threadMgr->typeKey('A'));
+    EXPECT_EQ(context->sessionCount(), 0u);
+
+    // only that context
+    auto other = threadMgr->focusNewContext();
+    EXPECT_FALSE(service->isKeyboardDisabled(other));
+    EXPECT_TRUE(threadMgr->typeKey('A'));
+    EXPECT_EQ(other->text(), L"a");
+}
+
+TEST_F(TextServiceTest, PreservedKeys) {
+    service->addPreservedKey(VK_SPACE, TF_MOD_SHIFT, toggleKeyGuid);
+    activate();
+    EXPECT_EQ(threadMgr->preservedKeyCount(), 1u);
+    auto context = threadMgr->focusNewContext();
+
+    EXPECT_FALSE(threadMgr->typeKey(VK_SPACE));
+    EXPECT_TRUE(service->preservedKeys.empty());
+
+    threadMgr->keyDown(VK_SHIFT);
+    EXPECT_TRUE(threadMgr->typeKey(VK_SPACE));
+    threadMgr->keyUp(VK_SHIFT);
+    EXPECT_EQ(service->preservedKeys, std::vector<GUID>{ toggleKeyGuid });
+
+    service->removePreservedKey(toggleKeyGuid);
+    EXPECT_EQ(threadMgr->preservedKeyCount(), 0u);
+    threadMgr->deactivate();
+    EXPECT_EQ(threadMgr->preservedKeyCount(), 0u);
+}
+
+TEST_F(TextServiceTest, LangBarButtonSendsCommands) {
+    auto button = ComPtr<LangBarButton>::make(static_cast<TextService*>(service), buttonGuid, 7, L"Mode");
+    service->addButton(button);
+    activate();
+    ASSERT_EQ(threadMgr->langBarItems().size(), 1u);
+    auto item = threadMgr->langBarItems()[0].query<ITfLangBarItemButton>();
+    ASSERT_NE(item, nullptr);
+    TF_LANGBARITEMINFO info;
+    item->GetInfo(&info);
+    EXPECT_EQ(info.guidItem, buttonGuid);
+    EXPECT_EQ(info.clsidService, testClsid);
+    item->OnClick(TF_LBI_CLK_LEFT, POINT{}, nullptr);
+    EXPECT_EQ(service->commands, std::vector<UINT>{ 7 });
+
+    service->removeButton(button);
+    EXPECT_TRUE(threadMgr->langBarItems().empty());
+    EXPECT_EQ(button->textService(), static_cast<TextService*>(service));
+}
+
+TEST_F(TextServiceTest, ActivationCyclesFreeTheServices) {
+    const int instances = TestTextService::instances;
+    const int moduleRefs = module->refCount();
+    for (int i = 0; i < 3; ++i) {
+        auto other = ComPtr<TestTextService>::make(module);
+        auto button = ComPtr<LangBarButton>::make(other, buttonGuid, 7, L"Mode");
+        other->addButton(button);
+        ComWeakPtr<TextService> weakService = other.get();
+        ComWeakPtr<LangBarButton> weakButton = button.get();
+        button = nullptr;
+        auto otherThreadMgr = ComPtr<FakeThreadMgr>::make();
+        ASSERT_EQ(otherThreadMgr->activate(other), S_OK);
+        auto context = otherThreadMgr->focusNewContext();
+        otherThreadMgr->typeKey('A');
+        EXPECT_TRUE(other->isComposing());
+        otherThreadMgr->deactivate();
+        EXPECT_EQ(context->text(), L"a");
+        EXPECT_TRUE(otherThreadMgr->langBarItems().empty());
+
+        // the service keeps its button, which only has a weak reference back
+        other = nullptr;
+        EXPECT_TRUE(weakService.expired());
+        EXPECT_TRUE(weakButton.expired());
+        EXPECT_EQ(TestTextService::instances, instances);
+    }
+    EXPECT_EQ(module->refCount(), moduleRefs);
+}
+
+TEST_F(TextServiceTest, RecordedKeysReplayThroughTsf) {
+    activate();
+    std::ostringstream log;
+    KeystrokeRecorder recorder(log);
+    service->setKeystrokeRecorder(&recorder);
+    auto context = threadMgr->focusNewContext();
+    for (UINT key : std::vector<UINT>{ 'L', 'I', 'B', VK_RETURN, '2', 'I', 'M', 'E' })
+        threadMgr->typeKey(key);
+    service->setKeystrokeRecorder(nullptr);
+    EXPECT_EQ(context->text(), L"libime");
+
+    auto data = log.str();
+    std::vector<KeystrokeRecord> records;
+    ASSERT_TRUE(readKeystrokeLog((const uint8_t*)data.data(), data.size(), records));
+    EXPECT_EQ(records.size(), recorder.count());
+
+    auto otherService = ComPtr<TestTextService>::make(module);
+    auto otherThreadMgr = ComPtr<FakeThreadMgr>::make();
+    ASSERT_EQ(otherThreadMgr->activate(otherService), S_OK);
+    FakeKeystrokeTarget target(otherThreadMgr);
+    auto report = replayKeystrokes(records, target);
+    EXPECT_EQ(report.keys, records.size());
+    EXPECT_EQ(report.mismatches, 0u);
+    // contexts are numbered from 1
+    EXPECT_EQ(target.context(1)->text(), L"libime");
+    otherThreadMgr->deactivate();
+}
+
+TEST_F(TextServiceTest, KeyUpsAreKeyUpEvents) {
+    activate();
+    threadMgr->focusNewContext();
+    threadMgr->typeKey(VK_ESCAPE);
+    // filtered by OnTestKeyUp(), then by OnKeyUp() which handles it
+    ASSERT_EQ(service->keyUps.size(), 3u);
+    EXPECT_EQ(service->keyUps[0].first, unsigned(WM_KEYUP));
+    // the tested event is the one handled
+    EXPECT_EQ(service->keyUps[1], service->keyUps[0]);
+    EXPECT_EQ(service->keyUps[2], service->keyUps[0]);
+}
+
+TEST_F(TextServiceTest, KeysTakeFewReferencesOfTsfObjects) {
+    activate();
+    auto context = threadMgr->focusNewContext();
+    threadMgr->typeKey('A');
+    ASSERT_TRUE(service->isComposing());
+    // a key extending the composition, and one the service does not want
+    size_t before = fakeRefCountCalls;
+    threadMgr->typeKey('B');
+    size_t composing = fakeRefCountCalls - before;
+    before = fakeRefCountCalls;
+    threadMgr->typeKey('1');
+    size_t ignored = fakeRefCountCalls - before;
+    EXPECT_EQ(context->composition()->text(), L"ab");
+    // The counts include the calls of the fakes themselves. Passing the
+    // contexts and the compartments around as ComPtr, and querying the
+    // compartments of the context at each key, made them 60 and 32. The
+    // edit session owns its context, as it may run asynchronously.
+    EXPECT_LE(composing, 48u);
+    EXPECT_LE(ignored, 24u);
+}
+
+TEST_F(TextServiceTest, ActivationQueriesTheThreadMgrOnce) {
+    activate();
+    auto context = threadMgr->focusNewContext();
+    threadMgr->typeKey('A');
+    // keys only read the compartments of the context, queried for the first one
+    size_t before = fakeQueryInterfaceCalls;
+    threadMgr->typeKey('B');
+    threadMgr->typeKey(VK_RETURN);
+    threadMgr->typeKey('1');
+    EXPECT_EQ(fakeQueryInterfaceCalls - before, 0u);
+
+    // nor do the helpers query the thread manager
+    auto button = ComPtr<LangBarButton>::make(static_cast<TextService*>(service), buttonGuid, 7, L"Mode");
+    before = fakeQueryInterfaceCalls;
+    service->addButton(button);
+    service->addPreservedKey(VK_SPACE, TF_MOD_SHIFT, toggleKeyGuid);
+    service->setKeyboardOpen(false);
+    service->setKeyboardOpen(true);
+    service->removePreservedKey(toggleKeyGuid);
+    service->removeButton(button);
+    EXPECT_EQ(fakeQueryInterfaceCalls - before, 0u);
+    EXPECT_EQ(service->keyboardChanges, (std::vector<bool>{ true, false, true }));
+
+    // another context is queried once
+    auto other = threadMgr->focusNewContext();
+    before = fakeQueryInterfaceCalls;
+    threadMgr->typeKey('1');
+    threadMgr->typeKey('2');
+    EXPECT_EQ(fakeQueryInterfaceCalls - before, 1u);
+
+    // the interfaces still work after activating again
+    threadMgr->deactivate();
+    activate();
+    EXPECT_EQ(threadMgr->preservedKeyCount(), 0u);
+    EXPECT_TRUE(threadMgr->typeKey('C'));
+    EXPECT_EQ(other->text(), L"c");
+}
+
+TEST(FakeTsfTest, TextNeedsALock) {
+    auto context = ComPtr<FakeContext>::make();
+    context->setText(L"abc");
+    ComPtr<ITfRange> range;
+    EXPECT_EQ(context->GetStart(0, &range), TF_E_NOLOCK);
+
+    HRESULT sessionResult = E_FAIL;
+    auto read = editSession(context, [&](EditSession* session, TfEditCookie cookie) {
+        EXPECT_EQ(context->GetStart(cookie, &range), S_OK);
+        WCHAR text[4];
+        ULONG length = 0;
+        EXPECT_EQ(range->ShiftEnd(cookie, 10, (LONG*)&length, nullptr), S_OK);
+        EXPECT_EQ(length, 3u);
+        EXPECT_EQ(range->GetText(cookie, 0, text, 4, &length), S_OK);
+        EXPECT_EQ(std::wstring(text, length), L"abc");
+        // no writing with a read lock, even synchronously
+        EXPECT_EQ(range->SetText(cookie, 0, L"x", 1), TF_E_NOLOCK);
+        HRESULT nestedResult = S_OK;
+        auto write = editSession(context, [](EditSession*, TfEditCookie) {});
+        context->RequestEditSession(1, write, TF_ES_SYNC | TF_ES_READWRITE, &nestedResult);
+        EXPECT_EQ(nestedResult, TF_E_SYNCHRONOUS);
+    });
+    EXPECT_EQ(context->RequestEditSession(1, read, TF_ES_SYNC | TF_ES_READ, &sessionResult), S_OK);
+    EXPECT_EQ(sessionResult, S_OK);
+    // the cookie is dead once the session ended
+    WCHAR text[4];
+    ULONG length = 0;
+    EXPECT_EQ(range->GetText(read->editCookie(), 0, text, 4, &length), TF_E_NOLOCK);
+}
+
+TEST(FakeTsfTest, AsyncSessionsRunAfterTheCurrentOne) {
+    auto context = ComPtr<FakeContext>::make();
+    std::vector<int> order;
+    HRESULT sessionResult;
+    auto inner = editSession(context, [&](EditSession*, TfEditCookie) { order.push_back(2); });
+    auto outer = editSession(context, [&](EditSession*, TfEditCookie) {
+        HRESULT innerResult;
+        context->RequestEditSession(2, inner, TF_ES_ASYNC | TF_ES_READWRITE, &innerResult);
+        EXPECT_EQ(innerResult, TF_S_ASYNC);
+        order.push_back(1);
+    });
+    context->RequestEditSession(1, outer, TF_ES_SYNC | TF_ES_READWRITE, &sessionResult);
+    EXPECT_EQ(order, (std::vector<int>{ 1, 2 }));
+    EXPECT_EQ(context->sessionCount(), 2u);
+}
+
+TEST(FakeTsfTest, SessionsKeepTheirContext) {
+    auto context = ComPtr<FakeContext>::make();
+    auto session = editSession(context, [](EditSession*, TfEditCookie) {});
+    // queued with TF_ES_ASYNC, it may run after the requester let go
+    EXPECT_EQ(context->refCount(), 2);
+    session = nullptr;
+    EXPECT_EQ(context->refCount(), 1);
+}
+
+TEST(FakeTsfTest, RangesFollowEdits) {
+    auto context = ComPtr<FakeContext>::make();
+    context->setText(L"hello world");
+    HRESULT sessionResult;
+    auto session = editSession(context, [&](EditSession*, TfEditCookie cookie) {
+        ComPtr<ITfRange> world, start;
+        context->GetEnd(cookie, &world);
+        LONG moved;
+        world->ShiftStart(cookie, -5, &moved, nullptr);
+        context->GetStart(cookie, &start);
+        start->SetText(cookie, 0, L">> ", -1);
+        auto acp = world.query<ITfRangeACP>();
+        LONG anchor, length;
+        acp->GetExtent(&anchor, &length);
+        EXPECT_EQ(anchor, 9);
+        EXPECT_EQ(length, 5);
+    });
+    context->RequestEditSession(1, session, TF_ES_SYNC | TF_ES_READWRITE, &sessionResult);
+    EXPECT_EQ(context->text(), L">> hello world");
+}
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ThemeBinary.h"
+
+static Ime::ThemeImageData makeImage(int width, int height, uint8_t seed) {
+    Ime::ThemeImageData image;
+    image.size = { width, height };
+    image.margin = { 1, 2, 3, 4 };
+    image.pixels.resize(size_t(width) * height * 4);
+    for (size_t i = 0; i < image.pixels.size(); ++i)
+        image.pixels[i] = uint8_t(i * 7 + seed);
+    return image;
+}
+
+static Ime::ThemeData makeTheme() {
+    Ime::ThemeData theme;
+    theme.background = makeImage(5, 3, 1);
+    theme.highlight = makeImage(2, 2, 9);
+    theme.textMargin = { 1, 2, 1, 2 };
+    theme.contentMargin = { 4, 6, 4, 6 };
+    theme.fontFace = L"Microsoft JhengHei \u5FAE\u8EDF";
+    theme.fontSize = 12;
+    theme.normalColor = 0x123456;
+    theme.highlightCandidateColor = 0xFEDCBA;
+    return theme;
+}
+
+static void expectSameImage(const Ime::ThemeImageData& a, const Ime::ThemeImageData& b) {
+    EXPECT_EQ(a.size, b.size);
+    EXPECT_EQ(a.margin, b.margin);
+    EXPECT_EQ(a.pixels, b.pixels);
+}
+
+TEST(TestThemeBinary, RoundTrip)
+{
+    auto theme = makeTheme();
+    auto data = Ime::writeThemeBinary(theme);
+    Ime::ThemeData read;
+    std::string error;
+    ASSERT_TRUE(Ime::readThemeBinary(data.data(), data.size(), read, &error)) << error;
+    expectSameImage(read.background, theme.background);
+    expectSameImage(read.highlight, theme.highlight);
+    EXPECT_EQ(read.textMargin, theme.textMargin);
+    EXPECT_EQ(read.contentMargin, theme.contentMargin);
+    EXPECT_EQ(read.fontFace, theme.fontFace);
+    EXPECT_EQ(read.fontSize, 12);
+    EXPECT_EQ(read.normalColor, 0x123456u);
+    EXPECT_EQ(read.highlightCandidateColor, 0xFEDCBAu);
+}
+
+TEST(TestThemeBinary, WithoutImages)
+{
+    Ime::ThemeData theme;
+    theme.highlight.margin = { 5, 5, 5, 5 };
+    auto data = Ime::writeThemeBinary(theme);
+    Ime::ThemeData read;
+    ASSERT_TRUE(Ime::readThemeBinary(data.data(), data.size(), read));
+    EXPECT_TRUE(read.background.isEmpty());
+    EXPECT_TRUE(read.highlight.isEmpty());
+    EXPECT_TRUE(read.highlight.pixels.empty());
+    EXPECT_EQ(read.highlight.margin, theme.highlight.margin);
+}
+
+TEST(TestThemeBinary, PixelsAreAligned)
+{
+    auto data = Ime::writeThemeBinary(makeTheme());
+    auto pixels = makeTheme().background.pixels;
+    auto it = std::search(data.begin(), data.end(), pixels.begin(), pixels.end());
+    ASSERT_NE(it, data.end());
+    EXPECT_EQ((it - data.begin()) % 16, 0);
+}
+
+TEST(TestThemeBinary, RejectsBadData)
+{
+    auto data = Ime::writeThemeBinary(makeTheme());
+    Ime::ThemeData read;
+    read.fontSize = 42;
+    std::string error;
+
+    EXPECT_FALSE(Ime::readThemeBinary(data.data(), 10, read, &error));
+    EXPECT_EQ(error, "not a binary theme");
+
+    EXPECT_FALSE(Ime::readThemeBinary(data.data(), data.size() - 1, read, &error));
+    EXPECT_EQ(error, "truncated binary theme");
+
+    auto wrongVersion = data;
+    wrongVersion[4] = 99;
+    EXPECT_FALSE(Ime::readThemeBinary(wrongVersion.data(), wrongVersion.size(), read, &error));
+    EXPECT_EQ(error, "unsupported binary theme version");
+
+    auto corrupted = data;
+    corrupted[corrupted.size() - 1] ^= 1;
+    EXPECT_FALSE(Ime::readThemeBinary(corrupted.data(), corrupted.size(), read, &error));
+    EXPECT_EQ(error, "corrupted binary theme");
+
+    // the output is left alone on failure
+    EXPECT_EQ(read.fontSize, 42);
+}
+
+TEST(TestThemeBinary, NeverReadsOutOfBounds)
+{
+    auto data = Ime::writeThemeBinary(makeTheme());
+    Ime::ThemeData read;
+    for (size_t size = 0; size < data.size(); ++size) {
+        std::vector<uint8_t> prefix(data.begin(), data.begin() + size);
+        EXPECT_FALSE(Ime::readThemeBinary(prefix.data(), prefix.size(), read)) << size;
+    }
+}
@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ThemeCompiler.h"
+
+namespace fs = std::filesystem;
+
+class TestThemeCompiler: public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() /
+            ("libIME2_theme_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    void writeConf(const std::string& text) {
+        std::ofstream(dir / "theme.conf", std::ios::binary) << text;
+    }
+
+    // "decodes" any file into a 2x1 image and records its name
+    Ime::ThemeImageDecoder fakeDecoder() {
+        return [this](const fs::path& file, Ime::ThemeImageData& image) {
+            decoded.push_back(file.filename().string());
+            if (file.filename() == "broken.png")
+                return false;
+            image.size = { 2, 1 };
+            image.pixels.assign(8, 0x80);
+            return true;
+        };
+    }
+
+    fs::path dir;
+    std::vector<std::string> decoded;
+};
+
+TEST_F(TestThemeCompiler, ReadsEverything)
+{
+    writeConf(
+        "\xEF\xBB\xBF"
+        "; comment\n"
+        "[InputPanel]\n"
+        "Font = Noto Sans CJK 14\n"
+        "NormalColor=#102030\n"
+        "HighlightCandidateColor=a0B0c0\n"
+        "\n"
+        "[InputPanel/Background]\n"
+        "Image=panel.png\n"
+        "[InputPanel/Background/Margin]\n"
+        "Top=1\r\nRight=2\r\nBottom=3\r\nLeft=4\r\n"
+        "[InputPanel/Highlight]\n"
+        "Image=highlight.png\n"
+        "[inputpanel/textmargin]\n"
+        "top=5\n"
+        "Left=-6\n"
+        "[InputPanel/ContentMargin]\n"
+        "Right=7px\n");
+    Ime::ThemeData theme;
+    std::vector<std::string> warnings;
+    ASSERT_TRUE(Ime::compileTheme(dir, fakeDecoder(), theme, &warnings));
+    EXPECT_TRUE(warnings.empty());
+    EXPECT_EQ(decoded, (std::vector<std::string>{ "panel.png", "highlight.png" }));
+
+    EXPECT_EQ(theme.fontFace, L"Noto Sans CJK");
+    EXPECT_EQ(theme.fontSize, 14);
+    EXPECT_EQ(theme.normalColor, 0x302010u);
+    EXPECT_EQ(theme.highlightCandidateColor, 0xC0B0A0u);
+    EXPECT_EQ(theme.background.margin, (Ime::Margins{ 1, 2, 3, 4 }));
+    EXPECT_EQ(theme.background.size, (Ime::Size{ 2, 1 }));
+    EXPECT_EQ(theme.highlight.size, (Ime::Size{ 2, 1 }));
+    EXPECT_EQ(theme.textMargin, (Ime::Margins{ 5, 0, 0, -6 }));
+    EXPECT_EQ(theme.contentMargin, (Ime::Margins{ 0, 7, 0, 0 }));
+}
+
+TEST_F(TestThemeCompiler, Defaults)
+{
+    writeConf("[InputPanel]\nFont=Sans\nNormalColor=#12345\n");
+    Ime::ThemeData theme;
+    ASSERT_TRUE(Ime::compileTheme(dir, fakeDecoder(), theme));
+    // only the background has a default image
+    EXPECT_EQ(decoded, (std::vector<std::string>{ "image.png" }));
+    EXPECT_TRUE(theme.highlight.isEmpty());
+    EXPECT_EQ(theme.fontFace, L"Sans");
+    EXPECT_EQ(theme.fontSize, 0);
+    EXPECT_EQ(theme.normalColor, 0u);
+    EXPECT_EQ(theme.textMargin, Ime::Margins{});
+}
+
+TEST_F(TestThemeCompiler, Utf16Conf)
+{
+    std::u16string text = u"\uFEFF[InputPanel]\nFont=\u5FAE\u8EDF\u6B63\u9ED1\u9AD4 11\n";
+    std::string bytes;
+    for (auto c : text) {
+        bytes.push_back(char(c & 0xFF));
+        bytes.push_back(char(c >> 8));
+    }
+    writeConf(bytes);
+    Ime::ThemeData theme;
+    ASSERT_TRUE(Ime::compileTheme(dir, fakeDecoder(), theme));
+    EXPECT_EQ(theme.fontFace, L"\u5FAE\u8EDF\u6B63\u9ED1\u9AD4");
+    EXPECT_EQ(theme.fontSize, 11);
+}
+
+TEST_F(TestThemeCompiler, WarnsAboutBrokenImages)
+{
+    writeConf("[InputPanel/Background]\nImage=broken.png\n");
+    Ime::ThemeData theme;
+    std::vector<std::string> warnings;
+    ASSERT_TRUE(Ime::compileTheme(dir, fakeDecoder(), theme, &warnings));
+    ASSERT_EQ(warnings.size(), 1u);
+    EXPECT_NE(warnings[0].find("broken.png"), std::string::npos);
+    EXPECT_TRUE(theme.background.isEmpty());
+}
+
+TEST_F(TestThemeCompiler, MissingConf)
+{
+    Ime::ThemeData theme;
+    EXPECT_FALSE(Ime::compileTheme(dir, fakeDecoder(), theme));
+}
@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThemeRegistry.h"
+
+namespace fs = std::filesystem;
+
+struct FakeTheme {
+    std::string conf;
+};
+
+class TestThemeRegistry: public ::testing::Test {
+protected:
+    void SetUp() override {
+        root = fs::temp_directory_path() /
+            ("libIME2_registry_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+        fs::remove_all(root);
+        fs::create_directories(root / "dark");
+        fs::create_directories(root / "light");
+        write(root / "dark" / "theme.conf", "dark");
+        write(root / "light" / "theme.conf", "light");
+    }
+
+    void TearDown() override {
+        fs::remove_all(root);
+    }
+
+    static void write(const fs::path& file, const std::string& text) {
+        std::ofstream(file, std::ios::binary) << text;
+    }
+
+    // reads theme.conf, slowly enough for other threads to pile up
+    Ime::ThemeRegistry<FakeTheme>::Loader loader(std::chrono::milliseconds delay = {}) {
+        return [delay](const fs::path& dir) {
+            std::this_thread::sleep_for(delay);
+            std::ifstream stream(dir / "theme.conf");
+            auto theme = std::make_shared<FakeTheme>();
+            std::getline(stream, theme->conf);
+            return std::shared_ptr<const FakeTheme>(theme);
+        };
+    }
+
+    fs::path root;
+};
+
+TEST_F(TestThemeRegistry, SharesOneCopyPerDirectory)
+{
+    Ime::ThemeRegistry<FakeTheme> registry(loader());
+    auto dark = registry.get(root / "dark");
+    EXPECT_EQ(dark->conf, "dark");
+    // other spellings of the same directory
+    EXPECT_EQ(registry.get(root / "dark" / ""), dark);
+    EXPECT_EQ(registry.get(root / "light" / ".." / "dark"), dark);
+    EXPECT_EQ(registry.get(root / "light")->conf, "light");
+    EXPECT_EQ(registry.loads(), 2u);
+    EXPECT_EQ(registry.size(), 2u);
+}
+
+TEST_F(TestThemeRegistry, RebuildsWhenFilesChange)
+{
+    Ime::ThemeRegistry<FakeTheme> registry(loader());
+    auto before = registry.get(root / "dark");
+
+    write(root / "dark" / "theme.conf", "darker");
+    fs::last_write_time(root / "dark" / "theme.conf",
+        fs::last_write_time(root / "dark" / "theme.conf") + std::chrono::seconds(5));
+    auto after = registry.get(root / "dark");
+    EXPECT_NE(after, before);
+    EXPECT_EQ(after->conf, "darker");
+    // the old snapshot is still usable by whoever holds it
+    EXPECT_EQ(before->conf, "dark");
+
+    // adding an image counts as a change too
+    write(root / "dark" / "image.png", "png");
+    EXPECT_NE(registry.get(root / "dark"), after);
+    EXPECT_EQ(registry.get(root / "dark"), registry.get(root / "dark"));
+    EXPECT_EQ(registry.loads(), 3u);
+}
+
+TEST_F(TestThemeRegistry, ClearKeepsSnapshotsAlive)
+{
+    Ime::ThemeRegistry<FakeTheme> registry(loader());
+    auto dark = registry.get(root / "dark");
+    registry.clear();
+    EXPECT_EQ(registry.size(), 0u);
+    EXPECT_EQ(dark->conf, "dark");
+    EXPECT_NE(registry.get(root / "dark"), dark);
+}
+
+TEST_F(TestThemeRegistry, ConcurrentUsersShareOneLoad)
+{
+    Ime::ThemeRegistry<FakeTheme> registry(loader(std::chrono::milliseconds(50)));
+    std::vector<std::shared_ptr<const FakeTheme>> themes(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < themes.size(); ++i)
+        threads.emplace_back([&, i] { themes[i] = registry.get(root / "dark"); });
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ(registry.loads(), 1u);
+    for (const auto& theme : themes)
+        EXPECT_EQ(theme, themes[0]);
+}
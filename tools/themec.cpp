@@ -0,0 +1,129 @@
+//
+//    Copyright (C) 2020 Hong Jen Yee (PCMan) <pcman.tw@gmail.com>
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Library General Public
+//    License as published by the Free Software Foundation; either
+//    version 2 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Library General Public License for more details.
+//
+//    You should have received a copy of the GNU Library General Public
+//    License along with this library; if not, write to the
+//    Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+//    Boston, MA  02110-1301, USA.
+//
+
+// Compiles a theme directory into the binary theme format:
+//
+//     libIME2_themec <theme dir> [output file]
+//
+// The output defaults to theme.bin in the theme directory, where
+// CandidateWindow::Theme looks for it.
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ThemeBinary.h"
+#include "ThemeCompiler.h"
+
+#if defined(IME_HAVE_PNG)
+#include <png.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <wincodec.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#if defined(IME_HAVE_PNG)
+
+static bool decodeImage(const fs::path& file, Ime::ThemeImageData& image) {
+    png_image png = {};
+    png.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&png, file.string().c_str()))
+        return false;
+    png.format = PNG_FORMAT_BGRA;
+    std::vector<uint8_t> pixels(PNG_IMAGE_SIZE(png));
+    if (!png_image_finish_read(&png, nullptr, pixels.data(), 0, nullptr)) {
+        png_image_free(&png);
+        return false;
+    }
+    // libpng gives straight alpha; GDI wants it premultiplied
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        unsigned alpha = pixels[i + 3];
+        for (int c = 0; c < 3; ++c)
+            pixels[i + c] = uint8_t((pixels[i + c] * alpha + 127) / 255);
+    }
+    image.size = { (int) png.width, (int) png.height };
+    image.pixels = std::move(pixels);
+    return true;
+}
+
+#elif defined(_WIN32)
+
+static bool decodeImage(const fs::path& file, Ime::ThemeImageData& image) {
+    IWICImagingFactory* factory = nullptr;
+    IWICBitmapDecoder* decoder = nullptr;
+    IWICBitmapFrameDecode* frame = nullptr;
+    IWICFormatConverter* converter = nullptr;
+    UINT width = 0, height = 0;
+    bool ok = SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER,
+            IID_IWICImagingFactory, (LPVOID*) &factory)) &&
+        SUCCEEDED(factory->CreateDecoderFromFilename(file.c_str(), NULL, GENERIC_READ,
+            WICDecodeMetadataCacheOnDemand, &decoder)) &&
+        SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+        SUCCEEDED(frame->GetSize(&width, &height)) &&
+        SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+        SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppPBGRA,
+            WICBitmapDitherTypeNone, NULL, 0, WICBitmapPaletteTypeCustom));
+    if (ok) {
+        image.pixels.resize(size_t(width) * height * 4);
+        ok = SUCCEEDED(converter->CopyPixels(nullptr, width * 4, (UINT) image.pixels.size(),
+            image.pixels.data()));
+        image.size = { (int) width, (int) height };
+    }
+    for (IUnknown* p : { (IUnknown*) converter, (IUnknown*) frame, (IUnknown*) decoder, (IUnknown*) factory })
+        if (p) p->Release();
+    return ok;
+}
+
+#endif
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::fprintf(stderr, "usage: %s <theme dir> [output file]\n", argv[0]);
+        return 2;
+    }
+    fs::path dir = fs::u8path(argv[1]);
+    fs::path output = argc > 2 ? fs::u8path(argv[2]) : dir / Ime::themeBinaryFileName;
+
+    Ime::ThemeImageDecoder decoder;
+#if defined(IME_HAVE_PNG)
+    decoder = decodeImage;
+#elif defined(_WIN32)
+    CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+    decoder = decodeImage;
+#endif
+
+    Ime::ThemeData theme;
+    std::vector<std::string> warnings;
+    if (!Ime::compileTheme(dir, decoder, theme, &warnings)) {
+        std::fprintf(stderr, "cannot read %s\n", (dir / "theme.conf").u8string().c_str());
+        return 1;
+    }
+    for (const auto& warning : warnings)
+        std::fprintf(stderr, "warning: %s\n", warning.c_str());
+
+    auto data = Ime::writeThemeBinary(theme);
+    std::ofstream stream(output, std::ios::binary);
+    if (!stream.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+        std::fprintf(stderr, "cannot write %s\n", output.u8string().c_str());
+        return 1;
+    }
+    return 0;
+}